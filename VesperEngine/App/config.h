@@ -22,6 +22,62 @@ struct Config
 	uint16 MaxEntities = 128;
 	uint16 MaxComponentsPerEntity = 32;
 
+	// Rendering
+	// large transparent objects are ordered by their farthest bounds corner instead of their center
+	bool SortTransparentByFarthestBound = false;
+	// transparent objects are resolved with weighted blended OIT instead of being sorted back to front
+	bool UseWeightedBlendedOIT = false;
+	// opaque entities sharing geometry and material are drawn with a single instanced draw
+	bool EnableInstancing = true;
+	// opaque PBR entities are frustum culled by a compute pass and drawn with indirect count draws, when the device supports it
+	bool EnableGPUDrivenRendering = false;
+	// opaque PBR entities lay down their depth first, then are shaded with an EQUAL depth test: one fragment shaded per pixel.
+	// The alpha tested ones skip the prepass, their depth is known only after the discard
+	bool EnableDepthPrepass = true;
+	// opaque PBR materials are drawn with pipelines specialized on the textures they set and on their alpha test,
+	// created at load time for the materials in the scene: the fetches and the math of the missing features are compiled out
+	bool EnableMaterialPermutations = true;
+	// threads recording the render systems in secondary command buffers, 0 records everything inline on the main thread
+	uint32 RecordingThreadCount = 0;
+	// threads compiling the pipelines of the render systems at startup, while the assets are loaded. 0 compiles them one after another on the main thread
+	uint32 PipelineCompileThreadCount = 4;
+	// slots of the bindless arrays of textures and materials, when the device supports bindless. Clamped to the update after bind limits
+	// of the device; the slots are recycled, so they bound the resources alive at the same time, not the ones ever loaded
+	uint32 BindlessTextureCapacity = 4096;
+	uint32 BindlessBufferCapacity = 1024;
+	// per entity data in one storage buffer indexed by the draw firstInstance, bound once per frame instead of once per draw with a dynamic offset.
+	// The transforms stay resident on the GPU, only the changed ones are uploaded and composed by a compute pass
+	bool UseEntityStorageBuffer = false;
+	// static meshes are sub-allocated in few large vertex and index buffers shared by all of them, instead of owning their buffers
+	bool UseGeometryArena = true;
+	// size in elements of every page of the geometry arena, bigger meshes get a page of their size
+	uint32 GeometryArenaPageVertexCount = 131072;
+	uint32 GeometryArenaPageIndexCount = 524288;
+	// opaque entities with StaticComponent sharing a material are merged, vertices pre-transformed in world space, in few spatially clustered batches,
+	// one draw each. Off by default: a merged entity cannot move anymore, and loaded geometry is static unless told otherwise
+	bool EnableStaticBatching = false;
+	// world size of the side of a batch cluster: smaller clusters are culled more precisely, bigger ones are fewer draws
+	float StaticBatchClusterSize = 32.0f;
+	// vertices a batch cluster can hold at most
+	uint32 StaticBatchMaxClusterVertexCount = 65536;
+	// PBR lights cast shadows from a shared atlas: cascades for the directional lights, a face per axis for the point lights.
+	// The static casters are cached and redrawn only when they or the light change, the dynamic ones are drawn over them
+	bool EnableShadows = true;
+	// side in texels of the shadow atlas, power of two
+	uint32 ShadowAtlasSize = 4096;
+	// shadow views redrawn per frame at most, the ones waiting longer first. 0 redraws every view needing it
+	uint32 ShadowUpdateBudget = 8;
+	// distance from the camera covered by the cascades, also the range of the never attenuated lights
+	float ShadowDistance = 50.0f;
+	// the swap chain render pass draws at a scale of the swap chain extent driven by the measured GPU frame time, then it is upscaled to the swap chain image
+	bool EnableDynamicResolution = false;
+	// lowest scale of the sides of the scene, the highest is 1
+	float DynamicResolutionMinScale = 0.5f;
+	// GPU frame time in milliseconds the scale is adjusted to
+	float DynamicResolutionTargetFrameTime = 16.6f;
+	// strength of the sharpening of the upscale, 0 is a plain bilinear upscale
+	float DynamicResolutionSharpness = 0.25f;
+
 	// Asset
 	std::string ShadersFolderName = "Shaders/";
 	std::string ModelsFolderName = "Models/";
@@ -30,6 +86,9 @@ struct Config
 	std::string ShadersPath = "Assets/" + ShadersFolderName;
 	std::string ModelsPath = "Assets/" + ModelsFolderName;
 	std::string TexturesPath = "Assets/" + TexturesFolderName;
+
+	// driver compiled pipelines, loaded at startup and saved back at shutdown: later runs skip the pipeline compilation. Empty disables it
+	std::string PipelineCacheFilePath = "pipeline_cache.bin";
 };
 
 VESPERENGINE_NAMESPACE_END
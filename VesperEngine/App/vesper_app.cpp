@@ -73,11 +73,13 @@ void VesperApp::RegisterDefaultComponents()
 	m_componentManager.RegisterComponent<IndexBufferComponent>();
 	m_componentManager.RegisterComponent<NotVertexBufferComponent>();
 	m_componentManager.RegisterComponent<NotIndexBufferComponent>();
+	m_componentManager.RegisterComponent<GeometryComponent>();
 
 	// RENDER/UPDATE
 	m_componentManager.RegisterComponent<UpdateComponent>();
 	m_componentManager.RegisterComponent<DynamicOffsetComponent>();
 	m_componentManager.RegisterComponent<VisibilityComponent>();
+	m_componentManager.RegisterComponent<BoundsComponent>();
 	m_componentManager.RegisterComponent<MorphWeightsComponent>();
 	m_componentManager.RegisterComponent<MorphAnimationComponent>();
 
@@ -122,11 +124,13 @@ void VesperApp::UnregisterDefaultComponent()
 	m_componentManager.UnregisterComponent<IndexBufferComponent>();
 	m_componentManager.UnregisterComponent<NotVertexBufferComponent>();
 	m_componentManager.UnregisterComponent<NotIndexBufferComponent>();
+	m_componentManager.UnregisterComponent<GeometryComponent>();
 
 	// RENDER/UPDATE
 	m_componentManager.UnregisterComponent<UpdateComponent>();
 	m_componentManager.UnregisterComponent<DynamicOffsetComponent>();
 	m_componentManager.UnregisterComponent<VisibilityComponent>();
+	m_componentManager.UnregisterComponent<BoundsComponent>();
 	m_componentManager.UnregisterComponent<MorphWeightsComponent>();
 	m_componentManager.UnregisterComponent<MorphAnimationComponent>();
 
@@ -0,0 +1,28 @@
+#version 450
+
+// Weighted blended OIT composite (McGuire and Bavoil 2013)
+// accumulation and revealage are read at the current pixel, written by the transparent subpass
+layout(input_attachment_index = 0, set = 0, binding = 0) uniform subpassInput accumulationInput;
+layout(input_attachment_index = 1, set = 0, binding = 1) uniform subpassInput revealageInput;
+
+layout(location = 0) in vec2 inUV;
+
+layout(location = 0) out vec4 outColor;
+
+void main()
+{
+    const float revealage = subpassLoad(revealageInput).r;
+
+    // fully revealed, no transparent surface here
+    if (revealage >= 1.0)
+    {
+        discard;
+    }
+
+    const vec4 accumulation = subpassLoad(accumulationInput);
+
+    // weighted average of the premultiplied colors, the alpha is the total coverage used to blend over the opaque color
+    const vec3 averageColor = accumulation.rgb / max(accumulation.a, 1e-5);
+
+    outColor = vec4(averageColor, 1.0 - revealage);
+}
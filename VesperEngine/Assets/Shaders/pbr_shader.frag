@@ -12,6 +12,7 @@ layout(location = 4) in vec2 fragUV2;
 layout(location = 5) in vec4 fragTangentWorld;
 
 layout(location = 0) out vec4 outColor;
+layout(location = 1) out float outRevealage;	// written only in the weighted blended OIT path
 
 layout(std140, set = 0, binding = 0) uniform SceneUBO
 {
@@ -22,11 +23,8 @@ layout(std140, set = 0, binding = 0) uniform SceneUBO
 } sceneUBO;
 
 
-const int c_MaxDirectionalLights = 16;
-const int c_MaxPointLights = 256;
-const int c_MaxSpotLights = 256;
-
 const float c_LightBoost = 1.0;
+const int c_ShadowCascadeCount = 4;   // kShadowCascadeCount
 
 const float c_AmbientDiffuseIntensity = 1.0;
 const float c_AmbientSpecularIntensity = 0.5;
@@ -41,11 +39,49 @@ layout(std140, set = 0, binding = 1) uniform LightsUBO
     int PointCount;
     int SpotCount;
     int _padding;
-    DirectionalLightData DirectionalLights[c_MaxDirectionalLights];
-    PointLightData PointLights[c_MaxPointLights];
-    SpotLightData SpotLights[c_MaxSpotLights];
+    uvec4 ClusterCount;
+    vec4 ClusterParams;     // xy cluster size in pixels, zw scale and bias of the depth slice from log(view depth)
 } lightsUBO;
 
+// sized on the actual count of lights, the counts above tell how many are valid
+layout(std430, set = 0, binding = 5) readonly buffer DirectionalLightsSSBO
+{
+    DirectionalLightData DirectionalLights[];
+} directionalLightsSSBO;
+
+layout(std430, set = 0, binding = 6) readonly buffer PointLightsSSBO
+{
+    PointLightData PointLights[];
+} pointLightsSSBO;
+
+layout(std430, set = 0, binding = 7) readonly buffer SpotLightsSSBO
+{
+    SpotLightData SpotLights[];
+} spotLightsSSBO;
+
+// clustered forward: every cluster has its range in the light indices, its point lights followed by its spot lights
+struct LightClusterData { uint PointOffset; uint PointCount; uint SpotOffset; uint SpotCount; };
+
+layout(std430, set = 0, binding = 8) readonly buffer LightClustersSSBO
+{
+    LightClusterData Clusters[];
+} lightClustersSSBO;
+
+layout(std430, set = 0, binding = 9) readonly buffer LightIndicesSSBO
+{
+    uint LightIndices[];
+} lightIndicesSSBO;
+
+// shadow maps, every view a tile of the atlas: the lights hold the index of their first ShadowData in the w they do not use (see ShadowSystem)
+struct ShadowData { mat4 ViewProjection; vec4 AtlasRect; vec4 Params; };   // AtlasRect uv offset and size, Params x valid, y texel world size, z cascade far, w perspective
+
+layout(set = 0, binding = 10) uniform sampler2DShadow shadowAtlas;
+
+layout(std430, set = 0, binding = 11) readonly buffer ShadowsSSBO
+{
+    ShadowData Shadows[];
+} shadowsSSBO;
+
 layout(set = 0, binding = 2) uniform samplerCube irradianceMap;
 layout(set = 0, binding = 3) uniform samplerCube prefilteredEnvMap;
 layout(set = 0, binding = 4) uniform sampler2D brdfLUT;
@@ -66,10 +102,11 @@ layout(std140, set = 1, binding = 1) uniform MaterialData
     int TextureIndices[7];
     int UVIndices[7];
 } materials[];
-layout(std140, set = 3, binding = 0) uniform MaterialIndexUBO
+// pushed with the draws, the last int of the default push constant range (VESPERENGINE_PUSHCONSTANT_MATERIALINDEX_OFFSET)
+layout(push_constant) uniform PushConstants
 {
-    int materialIndex;
-} materialIndexUBO;
+    layout(offset = 124) int materialIndex;
+} pushConstants;
 #else
 layout(set = 2, binding = 0) uniform sampler2D roughnessTexture;
 layout(set = 2, binding = 1) uniform sampler2D metallicTexture;
@@ -172,7 +209,7 @@ vec3 getNormal(bool hasNormal, vec2 uv)
 #if BINDLESS == 1
     if (hasNormal) 
     {
-        vec3 tangentNormal = texture(textures[nonuniformEXT(materials[materialIndexUBO.materialIndex].TextureIndices[4])], uv).xyz * 2.0 - 1.0;
+        vec3 tangentNormal = texture(textures[nonuniformEXT(materials[pushConstants.materialIndex].TextureIndices[4])], uv).xyz * 2.0 - 1.0;
         tangentNormal.y = -tangentNormal.y; //FLIP GREEN CHANNEL
         N = normalize(mat3(T, B, N) * tangentNormal);
     }
@@ -210,20 +247,128 @@ vec3 getIBLContribution(PBRInfo pbrInputs, vec3 n, vec3 reflection)
     return diffuse + specular;
 }
 
+// Weighted blended OIT (McGuire and Bavoil 2013), set by the transparent render system when the OIT path is enabled
+layout(constant_id = 0) const bool kWeightedBlendedOIT = false;
+
+// Material features the pipeline is specialized for, kPBRFeature bits (see graphics_components.h), set by the opaque render system.
+// A feature out of the mask is folded away with its texture fetch and math, the default keeps all of them checked at run time
+layout(constant_id = 1) const uint kMaterialFeatures = 0xFFu;
+
+const uint c_FeatureRoughnessTexture = 1u << 0;
+const uint c_FeatureMetallicTexture = 1u << 1;
+const uint c_FeatureSheenTexture = 1u << 2;
+const uint c_FeatureEmissiveTexture = 1u << 3;
+const uint c_FeatureNormalTexture = 1u << 4;
+const uint c_FeatureBaseColorTexture = 1u << 5;
+const uint c_FeatureAOTexture = 1u << 6;
+const uint c_FeatureAlphaTest = 1u << 7;
+
+bool hasFeature(uint feature)
+{
+    return (kMaterialFeatures & feature) != 0u;
+}
+
+float computeOITWeight(float alpha)
+{
+    // depth weight of the paper (eq. 10) on the [0, 1] window depth, nearer surfaces weight more
+    const float depth = 1.0 - gl_FragCoord.z * 0.9;
+    return clamp(pow(min(1.0, alpha * 10.0) + 0.01, 3.0) * 1e8 * pow(depth, 3.0), 1e-2, 3e3);
+}
+
+// cluster of the fragment: screen tile from the pixel, depth slice logarithmic on the view depth (see LightClusterSystem)
+uint getClusterIndex()
+{
+    uvec2 tile = min(uvec2(gl_FragCoord.xy / lightsUBO.ClusterParams.xy), lightsUBO.ClusterCount.xy - 1u);
+    float viewDepth = max((sceneUBO.ViewMatrix * vec4(fragPositionWorld, 1.0)).z, 1e-4);
+    uint slice = uint(clamp(log(viewDepth) * lightsUBO.ClusterParams.z + lightsUBO.ClusterParams.w, 0.0, float(lightsUBO.ClusterCount.z - 1u)));
+    return tile.x + lightsUBO.ClusterCount.x * (tile.y + lightsUBO.ClusterCount.y * slice);
+}
+
+// 1 lit, 0 shadowed. The position is pushed along the geometric normal by about a texel of the view, against the acne the depth bias misses,
+// then 3x3 PCF kept inside the tile so the neighbour views in the atlas never bleed in
+float sampleShadow(int index, vec3 geometricNormal, float lightDistance)
+{
+    ShadowData shadow = shadowsSSBO.Shadows[index];
+    if (shadow.Params.x == 0.0)
+    {
+        return 1.0;
+    }
+
+    float texelWorldSize = shadow.Params.y * (shadow.Params.w == 1.0 ? lightDistance : 1.0);
+    vec4 clip = shadow.ViewProjection * vec4(fragPositionWorld + geometricNormal * texelWorldSize * 1.5, 1.0);
+    vec3 ndc = clip.xyz / clip.w;
+    if (any(greaterThan(abs(ndc.xy), vec2(1.0))) || ndc.z <= 0.0 || ndc.z >= 1.0)
+    {
+        return 1.0;
+    }
+
+    vec2 texelSize = 1.0 / vec2(textureSize(shadowAtlas, 0));
+    vec2 minUV = shadow.AtlasRect.xy + texelSize * 0.5;
+    vec2 maxUV = shadow.AtlasRect.xy + shadow.AtlasRect.zw - texelSize * 0.5;
+    vec2 uv = shadow.AtlasRect.xy + (ndc.xy * 0.5 + 0.5) * shadow.AtlasRect.zw;
+
+    float lit = 0.0;
+    for (int y = -1; y <= 1; ++y)
+    {
+        for (int x = -1; x <= 1; ++x)
+        {
+            lit += texture(shadowAtlas, vec3(clamp(uv + vec2(x, y) * texelSize, minUV, maxUV), ndc.z));
+        }
+    }
+    return lit / 9.0;
+}
+
+// the first cascade reaching the fragment, lit past the last one
+float getDirectionalShadow(int firstShadow, vec3 geometricNormal)
+{
+    if (firstShadow < 0)
+    {
+        return 1.0;
+    }
+
+    float viewDepth = (sceneUBO.ViewMatrix * vec4(fragPositionWorld, 1.0)).z;
+    for (int c = 0; c < c_ShadowCascadeCount; ++c)
+    {
+        if (viewDepth <= shadowsSSBO.Shadows[firstShadow + c].Params.z)
+        {
+            return sampleShadow(firstShadow + c, geometricNormal, 1.0);
+        }
+    }
+    return 1.0;
+}
+
+// the cube face on the major axis from the light to the fragment, in the order +X, -X, +Y, -Y, +Z, -Z
+float getPointShadow(int firstShadow, vec3 lightToFragment, vec3 geometricNormal)
+{
+    if (firstShadow < 0)
+    {
+        return 1.0;
+    }
+
+    vec3 a = abs(lightToFragment);
+    int face = (a.x >= a.y && a.x >= a.z) ? (lightToFragment.x > 0.0 ? 0 : 1) : (a.y >= a.z) ? (lightToFragment.y > 0.0 ? 2 : 3) : (lightToFragment.z > 0.0 ? 4 : 5);
+    return sampleShadow(firstShadow + face, geometricNormal, length(lightToFragment));
+}
+
+float getSpotShadow(int firstShadow, vec3 geometricNormal, float lightDistance)
+{
+    return firstShadow < 0 ? 1.0 : sampleShadow(firstShadow, geometricNormal, lightDistance);
+}
+
 void main()
 {
 #if BINDLESS == 1
-    int matIdx = materialIndexUBO.materialIndex;
+    int matIdx = pushConstants.materialIndex;
     float roughness = materials[matIdx].Roughness;
     float metallic = materials[matIdx].Metallic;
     float sheen = materials[matIdx].Sheen;
-    bool hasNormal = materials[matIdx].TextureIndices[4] != -1;
-    bool hasRoughness = materials[matIdx].TextureIndices[0] != -1;
-    bool hasMetallic = materials[matIdx].TextureIndices[1] != -1;
-    bool hasSheen = materials[matIdx].TextureIndices[2] != -1;
-    bool hasEmissive = materials[matIdx].TextureIndices[3] != -1;
-    bool hasBaseColor = materials[matIdx].TextureIndices[5] != -1;
-    bool hasAO = materials[matIdx].TextureIndices[6] != -1;
+    bool hasNormal = hasFeature(c_FeatureNormalTexture) && materials[matIdx].TextureIndices[4] != -1;
+    bool hasRoughness = hasFeature(c_FeatureRoughnessTexture) && materials[matIdx].TextureIndices[0] != -1;
+    bool hasMetallic = hasFeature(c_FeatureMetallicTexture) && materials[matIdx].TextureIndices[1] != -1;
+    bool hasSheen = hasFeature(c_FeatureSheenTexture) && materials[matIdx].TextureIndices[2] != -1;
+    bool hasEmissive = hasFeature(c_FeatureEmissiveTexture) && materials[matIdx].TextureIndices[3] != -1;
+    bool hasBaseColor = hasFeature(c_FeatureBaseColorTexture) && materials[matIdx].TextureIndices[5] != -1;
+    bool hasAO = hasFeature(c_FeatureAOTexture) && materials[matIdx].TextureIndices[6] != -1;
     vec2 uvNormal = (materials[matIdx].UVIndices[4] == 0) ? fragUV1 : fragUV2;
     vec2 uvRough = (materials[matIdx].UVIndices[0] == 0) ? fragUV1 : fragUV2;
     vec2 uvMetallic = (materials[matIdx].UVIndices[1] == 0) ? fragUV1 : fragUV2;
@@ -235,13 +380,13 @@ void main()
     float roughness = material.Roughness;
     float metallic = material.Metallic;
     float sheen = material.Sheen;
-    bool hasNormal = material.TextureIndices[4] != -1;
-    bool hasRoughness = material.TextureIndices[0] != -1;
-    bool hasMetallic = material.TextureIndices[1] != -1;
-    bool hasSheen = material.TextureIndices[2] != -1;
-    bool hasEmissive = material.TextureIndices[3] != -1;
-    bool hasBaseColor = material.TextureIndices[5] != -1;
-    bool hasAO = material.TextureIndices[6] != -1;
+    bool hasNormal = hasFeature(c_FeatureNormalTexture) && material.TextureIndices[4] != -1;
+    bool hasRoughness = hasFeature(c_FeatureRoughnessTexture) && material.TextureIndices[0] != -1;
+    bool hasMetallic = hasFeature(c_FeatureMetallicTexture) && material.TextureIndices[1] != -1;
+    bool hasSheen = hasFeature(c_FeatureSheenTexture) && material.TextureIndices[2] != -1;
+    bool hasEmissive = hasFeature(c_FeatureEmissiveTexture) && material.TextureIndices[3] != -1;
+    bool hasBaseColor = hasFeature(c_FeatureBaseColorTexture) && material.TextureIndices[5] != -1;
+    bool hasAO = hasFeature(c_FeatureAOTexture) && material.TextureIndices[6] != -1;
     vec2 uvNormal = (material.UVIndices[4] == 0) ? fragUV1 : fragUV2;
     vec2 uvRough = (material.UVIndices[0] == 0) ? fragUV1 : fragUV2;
     vec2 uvMetallic = (material.UVIndices[1] == 0) ? fragUV1 : fragUV2;
@@ -269,7 +414,8 @@ vec4 baseColor;
         ? texture(textures[nonuniformEXT(materials[matIdx].TextureIndices[6])], uvAO).r
         : 1.0;
 
-    if (baseColor.a < materials[matIdx].AlphaCutoff)
+    // without the alpha test feature there is no discard, the early depth test stays on
+    if (hasFeature(c_FeatureAlphaTest) && baseColor.a < materials[matIdx].AlphaCutoff)
         discard;
 
 #else
@@ -284,7 +430,7 @@ vec4 baseColor;
         ? texture(aoTexture, uvAO).r 
         : 1.0;
 
-    if (baseColor.a < material.AlphaCutoff)
+    if (hasFeature(c_FeatureAlphaTest) && baseColor.a < material.AlphaCutoff)
         discard;
 #endif
 
@@ -313,13 +459,14 @@ vec4 baseColor;
     vec3 specularEnvironmentR90 = vec3(1.0) * reflectance90;
 
     vec3 v = normalize(sceneUBO.CameraPosition.xyz - fragPositionWorld);
+    vec3 geometricNormal = normalize(fragNormalWorld);
     vec3 reflection = normalize(reflect(-v, n));
 
      vec3 color = vec3(0.0);
 
     for (int i = 0; i < lightsUBO.DirectionalCount; ++i)
     {
-        vec3 l = normalize(-lightsUBO.DirectionalLights[i].Direction.xyz);
+        vec3 l = normalize(-directionalLightsSSBO.DirectionalLights[i].Direction.xyz);
         vec3 h = normalize(l + v);
 
         float NdotL = clamp(dot(n, l), 0.001, 1.0);
@@ -347,19 +494,23 @@ vec4 baseColor;
         float G = geometricOcclusion(pbrInputs);
         float D = microfacetDistribution(pbrInputs);
 
-        vec3 lightColor = lightsUBO.DirectionalLights[i].Color.rgb * lightsUBO.DirectionalLights[i].Color.a * c_LightBoost;
+        vec3 lightColor = directionalLightsSSBO.DirectionalLights[i].Color.rgb * directionalLightsSSBO.DirectionalLights[i].Color.a * c_LightBoost;
+        lightColor *= getDirectionalShadow(int(directionalLightsSSBO.DirectionalLights[i].Direction.w), geometricNormal);
         vec3 diffuseContrib = (1.0 - F) * diffuse(pbrInputs);
         vec3 specContrib = F * G * D / (4.0 * NdotL * NdotV);
         color += NdotL * lightColor * (diffuseContrib + specContrib);
     }
 
-    for (int i = 0; i < lightsUBO.PointCount; ++i)
+    LightClusterData cluster = lightClustersSSBO.Clusters[getClusterIndex()];
+
+    for (uint c = 0; c < cluster.PointCount; ++c)
     {
-        vec3 L = lightsUBO.PointLights[i].Position.xyz - fragPositionWorld;
+        uint i = lightIndicesSSBO.LightIndices[cluster.PointOffset + c];
+        vec3 L = pointLightsSSBO.PointLights[i].Position.xyz - fragPositionWorld;
         float dist = length(L);
         vec3 l = normalize(L);
         vec3 h = normalize(l + v);
-        float att = 1.0 / (lightsUBO.PointLights[i].Attenuation.x + lightsUBO.PointLights[i].Attenuation.y * dist + lightsUBO.PointLights[i].Attenuation.z * dist * dist);
+        float att = 1.0 / (pointLightsSSBO.PointLights[i].Attenuation.x + pointLightsSSBO.PointLights[i].Attenuation.y * dist + pointLightsSSBO.PointLights[i].Attenuation.z * dist * dist);
 
         float NdotL = clamp(dot(n, l), 0.001, 1.0);
         float NdotV = clamp(abs(dot(n, v)), 0.001, 1.0);
@@ -386,21 +537,23 @@ vec4 baseColor;
         float G = geometricOcclusion(pbrInputs);
         float D = microfacetDistribution(pbrInputs);
 
-        vec3 lightColor = lightsUBO.PointLights[i].Color.rgb * lightsUBO.PointLights[i].Color.a * att * c_LightBoost;
+        vec3 lightColor = pointLightsSSBO.PointLights[i].Color.rgb * pointLightsSSBO.PointLights[i].Color.a * att * c_LightBoost;
+        lightColor *= getPointShadow(int(pointLightsSSBO.PointLights[i].Position.w), -L, geometricNormal);
         vec3 diffuseContrib = (1.0 - F) * diffuse(pbrInputs);
         vec3 specContrib = F * G * D / (4.0 * NdotL * NdotV);
         color += NdotL * lightColor * (diffuseContrib + specContrib);
     }
 
-    for (int i = 0; i < lightsUBO.SpotCount; ++i)
+    for (uint c = 0; c < cluster.SpotCount; ++c)
     {
-        vec3 L = lightsUBO.SpotLights[i].Position.xyz - fragPositionWorld;
+        uint i = lightIndicesSSBO.LightIndices[cluster.SpotOffset + c];
+        vec3 L = spotLightsSSBO.SpotLights[i].Position.xyz - fragPositionWorld;
         float dist = length(L);
         vec3 l = normalize(L);
         vec3 h = normalize(l + v);
-        float theta = dot(l, normalize(-lightsUBO.SpotLights[i].Direction.xyz));
-        float epsilon = lightsUBO.SpotLights[i].Params.x - lightsUBO.SpotLights[i].Params.y;
-        float intensity = clamp((theta - lightsUBO.SpotLights[i].Params.y) / epsilon, 0.0, 1.0);
+        float theta = dot(l, normalize(-spotLightsSSBO.SpotLights[i].Direction.xyz));
+        float epsilon = spotLightsSSBO.SpotLights[i].Params.x - spotLightsSSBO.SpotLights[i].Params.y;
+        float intensity = clamp((theta - spotLightsSSBO.SpotLights[i].Params.y) / epsilon, 0.0, 1.0);
         float att = intensity / (dist * dist);
 
         float NdotL = clamp(dot(n, l), 0.001, 1.0);
@@ -428,7 +581,8 @@ vec4 baseColor;
         float G = geometricOcclusion(pbrInputs);
         float D = microfacetDistribution(pbrInputs);
 
-        vec3 lightColor = lightsUBO.SpotLights[i].Color.rgb * lightsUBO.SpotLights[i].Color.a * att * c_LightBoost;
+        vec3 lightColor = spotLightsSSBO.SpotLights[i].Color.rgb * spotLightsSSBO.SpotLights[i].Color.a * att * c_LightBoost;
+        lightColor *= getSpotShadow(int(spotLightsSSBO.SpotLights[i].Position.w), geometricNormal, dist);
         vec3 diffuseContrib = (1.0 - F) * diffuse(pbrInputs);
         vec3 specContrib = F * G * D / (4.0 * NdotL * NdotV);
         color += NdotL * lightColor * (diffuseContrib + specContrib);
@@ -478,10 +632,19 @@ vec4 baseColor;
 #endif
 
     //outColor = vec4(vec3(pbrInputs.NdotL), 1.0);
-    //outColor = vec4(normalize(lightsUBO.DirectionalLights[0].Direction.xyz) * 0.5 + 0.5, 1.0);
+    //outColor = vec4(normalize(directionalLightsSSBO.DirectionalLights[0].Direction.xyz) * 0.5 + 0.5, 1.0);
     //outColor = vec4(reflection * 0.5 + 0.5, 1.0); // see how it changes as camera moves
     //outColor = vec4(vec3(metallic), 1.0); // roughness or metallic
     //outColor = vec4(vec3(baseColor.a), 1.0);
 
-    outColor = vec4(color, baseColor.a);
+    if (kWeightedBlendedOIT)
+    {
+        const float weight = computeOITWeight(baseColor.a);
+        outColor = vec4(color * baseColor.a, baseColor.a) * weight;
+        outRevealage = baseColor.a;
+    }
+    else
+    {
+        outColor = vec4(color, baseColor.a);
+    }
 }
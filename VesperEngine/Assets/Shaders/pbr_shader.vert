@@ -34,6 +34,9 @@ layout(location = 3) out vec2 fragUV1;
 layout(location = 4) out vec2 fragUV2;
 layout(location = 5) out vec4 fragTangentWorld;
 
+// the depth prepass runs this same stage without the fragment one: the depth has to match bit for bit the EQUAL test of the shading pass
+invariant gl_Position;
+
 layout(std140, set = 0, binding = 0) uniform SceneUBO
 {
     mat4 ProjectionMatrix;
@@ -13,6 +13,7 @@ layout(location = 4) in vec2 fragUV2;
 layout(location = 5) in vec4 fragTangentWorld;
 
 layout(location = 0) out vec4 outColor;
+layout(location = 1) out float outRevealage;	// written only in the weighted blended OIT path
 
 layout(std140, set = 0, binding = 0) uniform SceneUBO 
 {
@@ -22,10 +23,6 @@ layout(std140, set = 0, binding = 0) uniform SceneUBO
     vec4 AmbientColor; // w is intensity
 } sceneUBO;
 
-const int c_MaxDirectionalLights = 16;
-const int c_MaxPointLights = 256;
-const int c_MaxSpotLights = 256;
-
 
 struct DirectionalLightData { vec4 Direction; vec4 Color; };
 struct PointLightData { vec4 Position; vec4 Color; vec4 Attenuation; };
@@ -37,11 +34,24 @@ layout(std140, set = 0, binding = 1) uniform LightsUBO
     int PointCount;
     int SpotCount;
     int _padding;
-    DirectionalLightData DirectionalLights[c_MaxDirectionalLights];
-    PointLightData PointLights[c_MaxPointLights];
-    SpotLightData SpotLights[c_MaxSpotLights];
 } lightsUBO;
 
+// sized on the actual count of lights, the counts above tell how many are valid
+layout(std430, set = 0, binding = 5) readonly buffer DirectionalLightsSSBO
+{
+    DirectionalLightData DirectionalLights[];
+} directionalLightsSSBO;
+
+layout(std430, set = 0, binding = 6) readonly buffer PointLightsSSBO
+{
+    PointLightData PointLights[];
+} pointLightsSSBO;
+
+layout(std430, set = 0, binding = 7) readonly buffer SpotLightsSSBO
+{
+    SpotLightData SpotLights[];
+} spotLightsSSBO;
+
 
 #if BINDLESS == 1
 
@@ -58,10 +68,11 @@ layout(std140, set = 1, binding = 1) uniform MaterialData
     int UVIndices[5];
 } materials[];
 
-layout(std140, set = 3, binding = 0) uniform MaterialIndexUBO
+// pushed with the draws, the last int of the default push constant range (VESPERENGINE_PUSHCONSTANT_MATERIALINDEX_OFFSET)
+layout(push_constant) uniform PushConstants
 {
-    int materialIndex;
-} materialIndexUBO;
+    layout(offset = 124) int materialIndex;
+} pushConstants;
 
 #else
 
@@ -88,6 +99,16 @@ layout(std140, set = 2, binding = 5) uniform MaterialData
 // Specialization constant for brightness adjustment
 layout(constant_id = 0) const float kBrightnessFactor = 1.0;
 
+// Weighted blended OIT (McGuire and Bavoil 2013), set by the transparent render system when the OIT path is enabled
+layout(constant_id = 1) const bool kWeightedBlendedOIT = false;
+
+float computeOITWeight(float alpha)
+{
+    // depth weight of the paper (eq. 10) on the [0, 1] window depth, nearer surfaces weight more
+    const float depth = 1.0 - gl_FragCoord.z * 0.9;
+    return clamp(pow(min(1.0, alpha * 10.0) + 0.01, 3.0) * 1e8 * pow(depth, 3.0), 1e-2, 3e3);
+}
+
 void main() 
 {
     // DEBUG UV COLOR
@@ -95,7 +116,7 @@ void main()
     
 #if BINDLESS == 1
     // Access material data using the index
-    int matIdx = materialIndexUBO.materialIndex;
+    int matIdx = pushConstants.materialIndex;
     vec4 ambientColor = materials[matIdx].AmbientColor;
     vec4 diffuseColor = materials[matIdx].DiffuseColor;
     vec4 specularColor = materials[matIdx].SpecularColor;
@@ -189,34 +210,34 @@ void main()
 
         for (int i = 0; i < lightsUBO.DirectionalCount; ++i)
         {
-            vec3 lDir = normalize(lightsUBO.DirectionalLights[i].Direction.xyz);
+            vec3 lDir = normalize(directionalLightsSSBO.DirectionalLights[i].Direction.xyz);
             float diffIntensity = max(dot(normal, lDir), 0.0);
-            vec3 lightCol = lightsUBO.DirectionalLights[i].Color.rgb * lightsUBO.DirectionalLights[i].Color.a;
+            vec3 lightCol = directionalLightsSSBO.DirectionalLights[i].Color.rgb * directionalLightsSSBO.DirectionalLights[i].Color.a;
             combinedLighting += finalDiffuseColor * vec4(lightCol * diffIntensity, 1.0);
         }
 
         for (int i = 0; i < lightsUBO.PointCount; ++i)
         {
-            vec3 L = lightsUBO.PointLights[i].Position.xyz - fragPositionWorld;
+            vec3 L = pointLightsSSBO.PointLights[i].Position.xyz - fragPositionWorld;
             float dist = length(L);
             vec3 lDir = normalize(L);
-            float att = 1.0 / (lightsUBO.PointLights[i].Attenuation.x + lightsUBO.PointLights[i].Attenuation.y * dist + lightsUBO.PointLights[i].Attenuation.z * dist * dist);
+            float att = 1.0 / (pointLightsSSBO.PointLights[i].Attenuation.x + pointLightsSSBO.PointLights[i].Attenuation.y * dist + pointLightsSSBO.PointLights[i].Attenuation.z * dist * dist);
             float diffIntensity = max(dot(normal, lDir), 0.0);
-            vec3 lightCol = lightsUBO.PointLights[i].Color.rgb * lightsUBO.PointLights[i].Color.a * att;
+            vec3 lightCol = pointLightsSSBO.PointLights[i].Color.rgb * pointLightsSSBO.PointLights[i].Color.a * att;
             combinedLighting += finalDiffuseColor * vec4(lightCol * diffIntensity, 1.0);
         }
 
         for (int i = 0; i < lightsUBO.SpotCount; ++i)
         {
-            vec3 L = lightsUBO.SpotLights[i].Position.xyz - fragPositionWorld;
+            vec3 L = spotLightsSSBO.SpotLights[i].Position.xyz - fragPositionWorld;
             float dist = length(L);
             vec3 lDir = normalize(L);
-            float theta = dot(lDir, normalize(-lightsUBO.SpotLights[i].Direction.xyz));
-            float epsilon = lightsUBO.SpotLights[i].Params.x - lightsUBO.SpotLights[i].Params.y;
-            float intensity = clamp((theta - lightsUBO.SpotLights[i].Params.y) / epsilon, 0.0, 1.0);
+            float theta = dot(lDir, normalize(-spotLightsSSBO.SpotLights[i].Direction.xyz));
+            float epsilon = spotLightsSSBO.SpotLights[i].Params.x - spotLightsSSBO.SpotLights[i].Params.y;
+            float intensity = clamp((theta - spotLightsSSBO.SpotLights[i].Params.y) / epsilon, 0.0, 1.0);
             float att = intensity / (dist * dist);
             float diffIntensity = max(dot(normal, lDir), 0.0);
-            vec3 lightCol = lightsUBO.SpotLights[i].Color.rgb * lightsUBO.SpotLights[i].Color.a * att;
+            vec3 lightCol = spotLightsSSBO.SpotLights[i].Color.rgb * spotLightsSSBO.SpotLights[i].Color.a * att;
             combinedLighting += finalDiffuseColor * vec4(lightCol * diffIntensity, 1.0);
         }
     }
@@ -234,37 +255,37 @@ void main()
 
         for (int i = 0; i < lightsUBO.DirectionalCount; ++i)
         {
-            vec3 lDir = normalize(lightsUBO.DirectionalLights[i].Direction.xyz);
+            vec3 lDir = normalize(directionalLightsSSBO.DirectionalLights[i].Direction.xyz);
             vec3 reflectDir = reflect(-lDir, normal);
             float specIntensity = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
-            vec3 lightCol = lightsUBO.DirectionalLights[i].Color.rgb * lightsUBO.DirectionalLights[i].Color.a;
+            vec3 lightCol = directionalLightsSSBO.DirectionalLights[i].Color.rgb * directionalLightsSSBO.DirectionalLights[i].Color.a;
             combinedLighting += finalSpecularColor * vec4(lightCol * clamp(specIntensity, 0.0, 1.0), 1.0);
         }
 
         for (int i = 0; i < lightsUBO.PointCount; ++i)
         {
-            vec3 L = lightsUBO.PointLights[i].Position.xyz - fragPositionWorld;
+            vec3 L = pointLightsSSBO.PointLights[i].Position.xyz - fragPositionWorld;
             float dist = length(L);
             vec3 lDir = normalize(L);
-            float att = 1.0 / (lightsUBO.PointLights[i].Attenuation.x + lightsUBO.PointLights[i].Attenuation.y * dist + lightsUBO.PointLights[i].Attenuation.z * dist * dist);
+            float att = 1.0 / (pointLightsSSBO.PointLights[i].Attenuation.x + pointLightsSSBO.PointLights[i].Attenuation.y * dist + pointLightsSSBO.PointLights[i].Attenuation.z * dist * dist);
             vec3 reflectDir = reflect(-lDir, normal);
             float specIntensity = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
-            vec3 lightCol = lightsUBO.PointLights[i].Color.rgb * lightsUBO.PointLights[i].Color.a * att;
+            vec3 lightCol = pointLightsSSBO.PointLights[i].Color.rgb * pointLightsSSBO.PointLights[i].Color.a * att;
             combinedLighting += finalSpecularColor * vec4(lightCol * clamp(specIntensity, 0.0, 1.0), 1.0);
         }
 
         for (int i = 0; i < lightsUBO.SpotCount; ++i)
         {
-            vec3 L = lightsUBO.SpotLights[i].Position.xyz - fragPositionWorld;
+            vec3 L = spotLightsSSBO.SpotLights[i].Position.xyz - fragPositionWorld;
             float dist = length(L);
             vec3 lDir = normalize(L);
-            float theta = dot(lDir, normalize(-lightsUBO.SpotLights[i].Direction.xyz));
-            float epsilon = lightsUBO.SpotLights[i].Params.x - lightsUBO.SpotLights[i].Params.y;
-            float intensity = clamp((theta - lightsUBO.SpotLights[i].Params.y) / epsilon, 0.0, 1.0);
+            float theta = dot(lDir, normalize(-spotLightsSSBO.SpotLights[i].Direction.xyz));
+            float epsilon = spotLightsSSBO.SpotLights[i].Params.x - spotLightsSSBO.SpotLights[i].Params.y;
+            float intensity = clamp((theta - spotLightsSSBO.SpotLights[i].Params.y) / epsilon, 0.0, 1.0);
             float att = intensity / (dist * dist);
             vec3 reflectDir = reflect(-lDir, normal);
             float specIntensity = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
-            vec3 lightCol = lightsUBO.SpotLights[i].Color.rgb * lightsUBO.SpotLights[i].Color.a * att;
+            vec3 lightCol = spotLightsSSBO.SpotLights[i].Color.rgb * spotLightsSSBO.SpotLights[i].Color.a * att;
             combinedLighting += finalSpecularColor * vec4(lightCol * clamp(specIntensity, 0.0, 1.0), 1.0);
         }
     }
@@ -277,31 +298,31 @@ void main()
                 
         for (int i = 0; i < lightsUBO.DirectionalCount; ++i)
         {
-            vec3 lDir = normalize(lightsUBO.DirectionalLights[i].Direction.xyz);
-            vec3 lightColor = lightsUBO.DirectionalLights[i].Color.rgb * lightsUBO.DirectionalLights[i].Color.a;
+            vec3 lDir = normalize(directionalLightsSSBO.DirectionalLights[i].Direction.xyz);
+            vec3 lightColor = directionalLightsSSBO.DirectionalLights[i].Color.rgb * directionalLightsSSBO.DirectionalLights[i].Color.a;
             diffuseAccum += lightColor * max(dot(fragNormalWorld, lDir), 0.0);
         }
 
         for (int i = 0; i < lightsUBO.PointCount; ++i)
         {
-            vec3 L = lightsUBO.PointLights[i].Position.xyz - fragPositionWorld;
+            vec3 L = pointLightsSSBO.PointLights[i].Position.xyz - fragPositionWorld;
             float dist = length(L);
             vec3 lDir = normalize(L);
-            float att = 1.0 / (lightsUBO.PointLights[i].Attenuation.x + lightsUBO.PointLights[i].Attenuation.y * dist + lightsUBO.PointLights[i].Attenuation.z * dist * dist);
-            vec3 lightColor = lightsUBO.PointLights[i].Color.rgb * lightsUBO.PointLights[i].Color.a * att;
+            float att = 1.0 / (pointLightsSSBO.PointLights[i].Attenuation.x + pointLightsSSBO.PointLights[i].Attenuation.y * dist + pointLightsSSBO.PointLights[i].Attenuation.z * dist * dist);
+            vec3 lightColor = pointLightsSSBO.PointLights[i].Color.rgb * pointLightsSSBO.PointLights[i].Color.a * att;
             diffuseAccum += lightColor * max(dot(fragNormalWorld, lDir), 0.0);
         }
 
         for (int i = 0; i < lightsUBO.SpotCount; ++i)
         {
-            vec3 L = lightsUBO.SpotLights[i].Position.xyz - fragPositionWorld;
+            vec3 L = spotLightsSSBO.SpotLights[i].Position.xyz - fragPositionWorld;
             float dist = length(L);
             vec3 lDir = normalize(L);
-            float theta = dot(lDir, normalize(-lightsUBO.SpotLights[i].Direction.xyz));
-            float epsilon = lightsUBO.SpotLights[i].Params.x - lightsUBO.SpotLights[i].Params.y;
-            float intensity = clamp((theta - lightsUBO.SpotLights[i].Params.y) / epsilon, 0.0, 1.0);
+            float theta = dot(lDir, normalize(-spotLightsSSBO.SpotLights[i].Direction.xyz));
+            float epsilon = spotLightsSSBO.SpotLights[i].Params.x - spotLightsSSBO.SpotLights[i].Params.y;
+            float intensity = clamp((theta - spotLightsSSBO.SpotLights[i].Params.y) / epsilon, 0.0, 1.0);
             float att = intensity / (dist * dist);
-            vec3 lightColor = lightsUBO.SpotLights[i].Color.rgb * lightsUBO.SpotLights[i].Color.a * att;
+            vec3 lightColor = spotLightsSSBO.SpotLights[i].Color.rgb * spotLightsSSBO.SpotLights[i].Color.a * att;
             diffuseAccum += lightColor * max(dot(fragNormalWorld, lDir), 0.0);
         }
 
@@ -312,5 +333,15 @@ void main()
     combinedLighting += emissionColor;
 
     // Clamp Final Result
-    outColor = clamp(vec4(combinedLighting.rgb, alpha) * kBrightnessFactor, 0.0, 1.0);
+    const vec4 finalColor = clamp(vec4(combinedLighting.rgb, alpha) * kBrightnessFactor, 0.0, 1.0);
+    if (kWeightedBlendedOIT)
+    {
+        const float weight = computeOITWeight(finalColor.a);
+        outColor = vec4(finalColor.rgb * finalColor.a, finalColor.a) * weight;
+        outRevealage = finalColor.a;
+    }
+    else
+    {
+        outColor = finalColor;
+    }
 }
@@ -0,0 +1,15 @@
+#version 450
+
+// the rest of the vertex is not bound, see Pipeline::ShadowPipelineConfig
+layout(location = 0) in vec3 inPosition;
+
+layout(push_constant) uniform PushConstants
+{
+    mat4 viewProjection;    // of the shadow view
+    mat4 modelMatrix;
+} pushConstants;
+
+void main()
+{
+    gl_Position = pushConstants.viewProjection * pushConstants.modelMatrix * vec4(inPosition, 1.0);
+}
@@ -0,0 +1,49 @@
+#version 450
+
+// Dynamic resolution upscale: the scene has been rendered in the top left corner of its target, uvScale wide,
+// filtered bilinearly to the whole swap chain image and optionally sharpened to recover some of the lost detail
+layout(set = 0, binding = 0) uniform sampler2D sceneColor;
+
+layout(push_constant) uniform PushConstants
+{
+    vec2 uvScale;       // render extent / target extent
+    vec2 texelSize;     // of the target
+    float sharpness;    // 0 plain bilinear
+} pushConstants;
+
+layout(location = 0) in vec2 inUV;
+
+layout(location = 0) out vec4 outColor;
+
+// clamped half a texel inside the rendered area, the bilinear filter must not pick the stale texels around it
+vec3 sampleScene(vec2 _uv)
+{
+    const vec2 uv = clamp(_uv, pushConstants.texelSize * 0.5, pushConstants.uvScale - pushConstants.texelSize * 0.5);
+    return texture(sceneColor, uv).rgb;
+}
+
+void main()
+{
+    const vec2 uv = inUV * pushConstants.uvScale;
+    const vec3 center = sampleScene(uv);
+
+    if (pushConstants.sharpness <= 0.0)
+    {
+        outColor = vec4(center, 1.0);
+        return;
+    }
+
+    const vec3 left = sampleScene(uv - vec2(pushConstants.texelSize.x, 0.0));
+    const vec3 right = sampleScene(uv + vec2(pushConstants.texelSize.x, 0.0));
+    const vec3 top = sampleScene(uv - vec2(0.0, pushConstants.texelSize.y));
+    const vec3 bottom = sampleScene(uv + vec2(0.0, pushConstants.texelSize.y));
+
+    // unsharp mask on the cross, limited to the local range so the edges do not ring
+    const vec3 blurred = (left + right + top + bottom) * 0.25;
+    const vec3 sharpened = center + (center - blurred) * pushConstants.sharpness;
+
+    const vec3 minColor = min(center, min(min(left, right), min(top, bottom)));
+    const vec3 maxColor = max(center, max(max(left, right), max(top, bottom)));
+
+    outColor = vec4(clamp(sharpened, minColor, maxColor), 1.0);
+}
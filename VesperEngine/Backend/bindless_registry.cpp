@@ -0,0 +1,255 @@
+// Copyright (c) 2025-2025 Michele Condo'
+// File: C:\Projects\Vesper\VesperEngine\Backend\bindless_registry.cpp
+// Licensed under the MIT License. See LICENSE file in the project root for full license information.
+
+#include "Backend/bindless_registry.h"
+#include "Backend/device.h"
+#include "Backend/descriptors.h"
+#include "Backend/swap_chain.h"
+
+#include "Utility/logger.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+
+VESPERENGINE_NAMESPACE_BEGIN
+
+BindlessRegistry::BindlessRegistry(Device& _device, uint32 _textureCapacity, uint32 _bufferCapacity)
+	: m_device{ _device }
+{
+	assertMsg(m_device.IsBindlessResourcesSupported(), "The bindless registry needs the device to support bindless resources");
+
+	// only the fragment stage reads the arrays, so the per stage limits apply as well as the per set ones
+	const VkPhysicalDeviceDescriptorIndexingProperties& limits = m_device.GetDescriptorIndexingProperties();
+	const uint32 maxTextureCount = std::min({
+		limits.maxDescriptorSetUpdateAfterBindSampledImages,
+		limits.maxDescriptorSetUpdateAfterBindSamplers,
+		limits.maxPerStageDescriptorUpdateAfterBindSampledImages,
+		limits.maxPerStageDescriptorUpdateAfterBindSamplers });
+	const uint32 maxBufferCount = std::min(
+		limits.maxDescriptorSetUpdateAfterBindUniformBuffers,
+		limits.maxPerStageDescriptorUpdateAfterBindUniformBuffers);
+
+	if (_textureCapacity > maxTextureCount)
+	{
+		LOG(Logger::WARNING, "Bindless texture capacity ", _textureCapacity, " over the device limit, clamped to ", maxTextureCount);
+	}
+	if (_bufferCapacity > maxBufferCount)
+	{
+		LOG(Logger::WARNING, "Bindless buffer capacity ", _bufferCapacity, " over the device limit, clamped to ", maxBufferCount);
+	}
+
+	InitializeSlots(m_textures, std::min(_textureCapacity, maxTextureCount));
+	InitializeSlots(m_buffers, std::min(_bufferCapacity, maxBufferCount));
+
+	// the buffers are the last binding, its count is the variable one the sets are allocated with
+	m_setLayout = DescriptorSetLayout::Builder(m_device)
+		.SetFlags(VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT)
+		.AddBinding(kTexturesBindingIndex, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, m_textures.Capacity, m_textures.Capacity)
+		.AddBinding(kBuffersBindingIndex, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, m_buffers.Capacity, m_buffers.Capacity)
+		.Build();
+
+	// own pool, sized on the capacity: the global pool is not update after bind and far too small for it
+	m_pool = DescriptorPool::Builder(m_device)
+		.SetPoolFlags(VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT)
+		.SetMaxSets(SwapChain::kMaxFramesInFlight)
+		.AddPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, SwapChain::kMaxFramesInFlight * m_textures.Capacity)
+		.AddPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, SwapChain::kMaxFramesInFlight * m_buffers.Capacity)
+		.Build();
+
+	m_descriptorSets.resize(SwapChain::kMaxFramesInFlight, VK_NULL_HANDLE);
+	for (VkDescriptorSet& set : m_descriptorSets)
+	{
+		if (!m_pool->AllocateDescriptorSet(*m_setLayout, set))
+		{
+			throw std::runtime_error("failed to allocate the bindless descriptor sets!");
+		}
+	}
+
+	LOG(Logger::INFO, "Bindless registry: ", m_textures.Capacity, " textures, ", m_buffers.Capacity, " buffers");
+}
+
+BindlessRegistry::~BindlessRegistry() = default;
+
+VkDescriptorSetLayout BindlessRegistry::GetDescriptorSetLayout() const
+{
+	return m_setLayout->GetDescriptorSetLayout();
+}
+
+uint32 BindlessRegistry::RegisterTexture(const VkDescriptorImageInfo& _imageInfo)
+{
+	return Register(m_textures, _imageInfo);
+}
+
+uint32 BindlessRegistry::RegisterBuffer(const VkDescriptorBufferInfo& _bufferInfo)
+{
+	return Register(m_buffers, _bufferInfo);
+}
+
+void BindlessRegistry::UpdateTexture(uint32 _slot, const VkDescriptorImageInfo& _imageInfo)
+{
+	Update(m_textures, _slot, _imageInfo);
+}
+
+void BindlessRegistry::UpdateBuffer(uint32 _slot, const VkDescriptorBufferInfo& _bufferInfo)
+{
+	Update(m_buffers, _slot, _bufferInfo);
+}
+
+void BindlessRegistry::ReleaseTexture(uint32 _slot)
+{
+	Release(m_textures, _slot);
+}
+
+void BindlessRegistry::ReleaseBuffer(uint32 _slot)
+{
+	Release(m_buffers, _slot);
+}
+
+void BindlessRegistry::BeginFrame(const int32 _frameIndex)
+{
+	m_frameIndex = _frameIndex;
+	m_isFrameActive = true;
+
+	// released while this frame was recorded the last time: its fence is signaled, and so are the ones of the frames before it
+	Recycle(m_textures, _frameIndex);
+	Recycle(m_buffers, _frameIndex);
+
+	WritePendingSlots(_frameIndex);
+}
+
+void BindlessRegistry::EndFrame()
+{
+	m_isFrameActive = false;
+}
+
+template<typename DescriptorInfo>
+void BindlessRegistry::InitializeSlots(SlotArray<DescriptorInfo>& _slots, uint32 _capacity)
+{
+	_slots.Capacity = _capacity;
+	_slots.IsUsed.resize(_capacity, 0);
+	_slots.ReleasedSlots.resize(SwapChain::kMaxFramesInFlight);
+	_slots.PendingWrites.resize(SwapChain::kMaxFramesInFlight);
+}
+
+template<typename DescriptorInfo>
+uint32 BindlessRegistry::Register(SlotArray<DescriptorInfo>& _slots, const DescriptorInfo& _info)
+{
+	uint32 slot = kInvalidSlot;
+	if (!_slots.FreeSlots.empty())
+	{
+		slot = _slots.FreeSlots.back();
+		_slots.FreeSlots.pop_back();
+	}
+	else if (_slots.NextSlot < _slots.Capacity)
+	{
+		slot = _slots.NextSlot++;
+	}
+	else
+	{
+		LOG(Logger::ERROR, "Bindless array full, capacity ", _slots.Capacity);
+		return kInvalidSlot;
+	}
+
+	_slots.IsUsed[slot] = 1;
+	++_slots.UsedCount;
+
+	Update(_slots, slot, _info);
+
+	return slot;
+}
+
+template<typename DescriptorInfo>
+void BindlessRegistry::Update(SlotArray<DescriptorInfo>& _slots, uint32 _slot, const DescriptorInfo& _info)
+{
+	assertMsgReturnVoid(_slot < _slots.Capacity && _slots.IsUsed[_slot], "Cannot update the bindless slot: not registered");
+
+	// the set of the frame being recorded is written now: its fence has been waited and its bindings are update after bind.
+	// Outside of a frame no set can be written, the one of the last frame may be in flight as the others
+	if (m_isFrameActive)
+	{
+		WriteSlot(_slot, _info);
+	}
+
+	// the other sets may still be read by their frames, they get it when their frame begins, the latest write of the slot wins
+	for (int32 i = 0; i < static_cast<int32>(_slots.PendingWrites.size()); ++i)
+	{
+		if (m_isFrameActive && i == m_frameIndex)
+		{
+			_slots.PendingWrites[i].erase(_slot);
+		}
+		else
+		{
+			_slots.PendingWrites[i][_slot] = _info;
+		}
+	}
+}
+
+template<typename DescriptorInfo>
+void BindlessRegistry::Release(SlotArray<DescriptorInfo>& _slots, uint32 _slot)
+{
+	assertMsgReturnVoid(_slot < _slots.Capacity && _slots.IsUsed[_slot], "Cannot release the bindless slot: not registered");
+
+	_slots.IsUsed[_slot] = 0;
+	--_slots.UsedCount;
+
+	// the resource may be destroyed right after, the sets which did not get it yet must not be written with it
+	for (auto& pendingWrites : _slots.PendingWrites)
+	{
+		pendingWrites.erase(_slot);
+	}
+
+	_slots.ReleasedSlots[m_frameIndex].push_back(_slot);
+}
+
+template<typename DescriptorInfo>
+void BindlessRegistry::Recycle(SlotArray<DescriptorInfo>& _slots, const int32 _frameIndex)
+{
+	std::vector<uint32>& releasedSlots = _slots.ReleasedSlots[_frameIndex];
+	_slots.FreeSlots.insert(_slots.FreeSlots.end(), releasedSlots.begin(), releasedSlots.end());
+	releasedSlots.clear();
+}
+
+void BindlessRegistry::WriteSlot(uint32 _slot, const VkDescriptorImageInfo& _imageInfo)
+{
+	VkDescriptorImageInfo imageInfo = _imageInfo;
+	DescriptorWriter(*m_setLayout, *m_pool)
+		.WriteImage(kTexturesBindingIndex, &imageInfo, 1, _slot)
+		.Overwrite(m_descriptorSets[m_frameIndex]);
+}
+
+void BindlessRegistry::WriteSlot(uint32 _slot, const VkDescriptorBufferInfo& _bufferInfo)
+{
+	VkDescriptorBufferInfo bufferInfo = _bufferInfo;
+	DescriptorWriter(*m_setLayout, *m_pool)
+		.WriteBuffer(kBuffersBindingIndex, &bufferInfo, 1, _slot)
+		.Overwrite(m_descriptorSets[m_frameIndex]);
+}
+
+void BindlessRegistry::WritePendingSlots(const int32 _frameIndex)
+{
+	auto& pendingTextures = m_textures.PendingWrites[_frameIndex];
+	auto& pendingBuffers = m_buffers.PendingWrites[_frameIndex];
+	if (pendingTextures.empty() && pendingBuffers.empty())
+	{
+		return;
+	}
+
+	// one write per changed slot, all in a single update
+	DescriptorWriter writer(*m_setLayout, *m_pool);
+	for (auto& [slot, imageInfo] : pendingTextures)
+	{
+		writer.WriteImage(kTexturesBindingIndex, &imageInfo, 1, slot);
+	}
+	for (auto& [slot, bufferInfo] : pendingBuffers)
+	{
+		writer.WriteBuffer(kBuffersBindingIndex, &bufferInfo, 1, slot);
+	}
+	writer.Overwrite(m_descriptorSets[_frameIndex]);
+
+	pendingTextures.clear();
+	pendingBuffers.clear();
+}
+
+VESPERENGINE_NAMESPACE_END
@@ -0,0 +1,117 @@
+// Copyright (c) 2025-2025 Michele Condo'
+// File: C:\Projects\Vesper\VesperEngine\Backend\bindless_registry.h
+// Licensed under the MIT License. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include "Core/core_defines.h"
+
+#include "vulkan/vulkan.h"
+
+#include <memory>
+#include <vector>
+#include <unordered_map>
+
+
+VESPERENGINE_NAMESPACE_BEGIN
+
+class Device;
+class DescriptorSetLayout;
+class DescriptorPool;
+
+/**
+ * The bindless arrays of textures and material buffers, the shaders index them by slot.
+ * The slots come from a free list, they can be registered and released at any time, i.e. while textures are streamed in and out.
+ * Every frame in flight has its own set. A registered or updated slot is written at once to the set of the frame being recorded,
+ * so it can be used by the draws recorded after the call; the other sets get it in their BeginFrame, once their fence has been waited.
+ * Outside of a frame, before the first one or after the submission of the last one, every set gets it in its BeginFrame.
+ * A released slot goes back to the free list only when all the frames which could still read it are done.
+ * The bindings are update after bind and partially bound: the slots never written or released are simply not read, and the capacity
+ * is bound by the update after bind limits of the device instead of the far smaller limits of the regular descriptors.
+ */
+class VESPERENGINE_API BindlessRegistry final
+{
+public:
+	static constexpr uint32 kTexturesBindingIndex = 0u;
+	static constexpr uint32 kBuffersBindingIndex = 1u;
+
+	static constexpr uint32 kInvalidSlot = ~0u;
+
+public:
+	// The capacities are clamped to the update after bind limits of the device
+	BindlessRegistry(Device& _device, uint32 _textureCapacity, uint32 _bufferCapacity);
+	~BindlessRegistry();
+
+	BindlessRegistry(const BindlessRegistry&) = delete;
+	BindlessRegistry& operator=(const BindlessRegistry&) = delete;
+
+public:
+	VkDescriptorSetLayout GetDescriptorSetLayout() const;
+	VESPERENGINE_INLINE VkDescriptorSet GetDescriptorSet(const int32 _frameIndex) const { return m_descriptorSets[_frameIndex]; }
+
+	VESPERENGINE_INLINE uint32 GetTextureCapacity() const { return m_textures.Capacity; }
+	VESPERENGINE_INLINE uint32 GetBufferCapacity() const { return m_buffers.Capacity; }
+	VESPERENGINE_INLINE uint32 GetTextureCount() const { return m_textures.UsedCount; }
+	VESPERENGINE_INLINE uint32 GetBufferCount() const { return m_buffers.UsedCount; }
+
+public:
+	// Slot of the descriptor, kInvalidSlot when the array is full. Never used slots are given in order, the first time from 0
+	uint32 RegisterTexture(const VkDescriptorImageInfo& _imageInfo);
+	uint32 RegisterBuffer(const VkDescriptorBufferInfo& _bufferInfo);
+
+	// Point a registered slot to another resource, i.e. a higher mip level streamed in. The frames still in flight keep reading the old one
+	void UpdateTexture(uint32 _slot, const VkDescriptorImageInfo& _imageInfo);
+	void UpdateBuffer(uint32 _slot, const VkDescriptorBufferInfo& _bufferInfo);
+
+	// The resource of the slot can be destroyed only when the frames in flight are done with it, as for any other resource
+	void ReleaseTexture(uint32 _slot);
+	void ReleaseBuffer(uint32 _slot);
+
+	// Call once the fence of the frame has been waited and before its recording, before the set of the frame is bound
+	void BeginFrame(const int32 _frameIndex);
+	// Call once the frame has been submitted, its set must not be written anymore
+	void EndFrame();
+
+private:
+	template<typename DescriptorInfo>
+	struct SlotArray
+	{
+		uint32 Capacity{ 0 };
+		uint32 NextSlot{ 0 };		// the slots from here on were never used
+		uint32 UsedCount{ 0 };
+		std::vector<uint32> FreeSlots;
+		std::vector<uint8> IsUsed;													// per slot
+		std::vector<std::vector<uint32>> ReleasedSlots;								// per frame, the slots released while it was recorded
+		std::vector<std::unordered_map<uint32, DescriptorInfo>> PendingWrites;		// per frame, the slots its set does not have yet
+	};
+
+	template<typename DescriptorInfo>
+	void InitializeSlots(SlotArray<DescriptorInfo>& _slots, uint32 _capacity);
+	template<typename DescriptorInfo>
+	uint32 Register(SlotArray<DescriptorInfo>& _slots, const DescriptorInfo& _info);
+	template<typename DescriptorInfo>
+	void Update(SlotArray<DescriptorInfo>& _slots, uint32 _slot, const DescriptorInfo& _info);
+	template<typename DescriptorInfo>
+	void Release(SlotArray<DescriptorInfo>& _slots, uint32 _slot);
+	template<typename DescriptorInfo>
+	void Recycle(SlotArray<DescriptorInfo>& _slots, const int32 _frameIndex);
+
+	void WriteSlot(uint32 _slot, const VkDescriptorImageInfo& _imageInfo);
+	void WriteSlot(uint32 _slot, const VkDescriptorBufferInfo& _bufferInfo);
+	void WritePendingSlots(const int32 _frameIndex);
+
+private:
+	Device& m_device;
+
+	std::unique_ptr<DescriptorSetLayout> m_setLayout;
+	std::unique_ptr<DescriptorPool> m_pool;
+	std::vector<VkDescriptorSet> m_descriptorSets;	// per frame
+
+	SlotArray<VkDescriptorImageInfo> m_textures;
+	SlotArray<VkDescriptorBufferInfo> m_buffers;
+
+	int32 m_frameIndex{ 0 };		// the frame being recorded, or the last one, the releases are deferred until it is done
+	bool m_isFrameActive{ false };	// between BeginFrame and EndFrame, the set of m_frameIndex can be written at once
+};
+
+VESPERENGINE_NAMESPACE_END
@@ -110,6 +110,17 @@ public:
 		vmaUnmapMemory(m_device.GetAllocator(), _buffer.AllocationMemory);
 	}
 	
+	// PERSISTEN BUFFER VERSION
+	// The mapping of a persistent buffer does not change for its whole life, so the pointer can be cached once after Create
+	template<typename BufferType>
+	void* GetMappedMemory(const BufferType& _buffer) const
+	{
+		VmaAllocationInfo allocationInfo;
+		vmaGetAllocationInfo(m_device.GetAllocator(), _buffer.AllocationMemory, &allocationInfo);
+
+		return allocationInfo.pMappedData;
+	}
+
 	// PERSISTEN BUFFER VERSION
 	template<typename BufferType>
 	void WriteToBuffer(BufferType& _buffer)
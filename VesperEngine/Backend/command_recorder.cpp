@@ -0,0 +1,222 @@
+// Copyright (c) 2025-2025 Michele Condo'
+// File: C:\Projects\Vesper\VesperEngine\Backend\command_recorder.cpp
+// Licensed under the MIT License. See LICENSE file in the project root for full license information.
+
+#include "Backend/command_recorder.h"
+#include "Backend/pipeline.h"
+#include "Backend/device.h"
+
+#include <cstring>
+
+
+VESPERENGINE_NAMESPACE_BEGIN
+
+void CommandRecorder::Reset(VkCommandBuffer _commandBuffer)
+{
+	m_commandBuffer = _commandBuffer;
+	m_pipelineLayout = VK_NULL_HANDLE;
+
+	m_pipeline = VK_NULL_HANDLE;
+	m_descriptorSets.fill(BoundDescriptorSet{});
+
+	m_vertexBuffer = VK_NULL_HANDLE;
+	m_vertexBufferOffset = 0;
+	m_indexBuffer = VK_NULL_HANDLE;
+	m_indexBufferOffset = 0;
+	m_indexType = VK_INDEX_TYPE_MAX_ENUM;
+
+	m_pushConstantsValid.fill(false);
+	m_pushConstantsStages = 0;
+
+	m_isCullModeValid = false;
+	m_isFrontFaceValid = false;
+
+	m_statistics = CommandRecorderStatistics{};
+}
+
+void CommandRecorder::BindPipeline(VkCommandBuffer _commandBuffer, const Pipeline& _pipeline)
+{
+	Track(_commandBuffer);
+
+	if (m_pipeline == _pipeline.GetPipeline())
+	{
+		++m_statistics.ElidedCount;
+		return;
+	}
+
+	vkCmdBindPipeline(_commandBuffer, _pipeline.GetBindPoint(), _pipeline.GetPipeline());
+	m_pipeline = _pipeline.GetPipeline();
+
+	m_isCullModeValid = false;
+	m_isFrontFaceValid = false;
+
+	++m_statistics.IssuedCount;
+}
+
+void CommandRecorder::BindDescriptorSet(VkCommandBuffer _commandBuffer, VkPipelineBindPoint _bindPoint, VkPipelineLayout _pipelineLayout, uint32 _setIndex, VkDescriptorSet _descriptorSet,
+	uint32 _dynamicOffsetCount, const uint32* _dynamicOffsets)
+{
+	Track(_commandBuffer);
+	TrackPipelineLayout(_pipelineLayout);
+
+	const bool isTracked = _setIndex < kMaxDescriptorSets && _dynamicOffsetCount <= kMaxDynamicOffsets;
+	if (isTracked)
+	{
+		const BoundDescriptorSet& bound = m_descriptorSets[_setIndex];
+		if (bound.IsValid
+			&& bound.BindPoint == _bindPoint
+			&& bound.DescriptorSet == _descriptorSet
+			&& bound.DynamicOffsetCount == _dynamicOffsetCount
+			&& (_dynamicOffsetCount == 0 || std::memcmp(bound.DynamicOffsets.data(), _dynamicOffsets, sizeof(uint32) * _dynamicOffsetCount) == 0))
+		{
+			++m_statistics.ElidedCount;
+			return;
+		}
+	}
+
+	vkCmdBindDescriptorSets(_commandBuffer, _bindPoint, _pipelineLayout, _setIndex, 1, &_descriptorSet, _dynamicOffsetCount, _dynamicOffsets);
+
+	if (isTracked)
+	{
+		BoundDescriptorSet& bound = m_descriptorSets[_setIndex];
+		bound.BindPoint = _bindPoint;
+		bound.DescriptorSet = _descriptorSet;
+		bound.DynamicOffsetCount = _dynamicOffsetCount;
+		if (_dynamicOffsetCount > 0)
+		{
+			std::memcpy(bound.DynamicOffsets.data(), _dynamicOffsets, sizeof(uint32) * _dynamicOffsetCount);
+		}
+		bound.IsValid = true;
+	}
+
+	++m_statistics.IssuedCount;
+}
+
+void CommandRecorder::BindVertexBuffer(VkCommandBuffer _commandBuffer, VkBuffer _buffer, VkDeviceSize _offset)
+{
+	Track(_commandBuffer);
+
+	if (m_vertexBuffer == _buffer && m_vertexBufferOffset == _offset)
+	{
+		++m_statistics.ElidedCount;
+		return;
+	}
+
+	vkCmdBindVertexBuffers(_commandBuffer, 0, 1, &_buffer, &_offset);
+	m_vertexBuffer = _buffer;
+	m_vertexBufferOffset = _offset;
+
+	++m_statistics.IssuedCount;
+}
+
+void CommandRecorder::BindIndexBuffer(VkCommandBuffer _commandBuffer, VkBuffer _buffer, VkDeviceSize _offset, VkIndexType _indexType)
+{
+	Track(_commandBuffer);
+
+	if (m_indexBuffer == _buffer && m_indexBufferOffset == _offset && m_indexType == _indexType)
+	{
+		++m_statistics.ElidedCount;
+		return;
+	}
+
+	vkCmdBindIndexBuffer(_commandBuffer, _buffer, _offset, _indexType);
+	m_indexBuffer = _buffer;
+	m_indexBufferOffset = _offset;
+	m_indexType = _indexType;
+
+	++m_statistics.IssuedCount;
+}
+
+void CommandRecorder::PushConstants(VkCommandBuffer _commandBuffer, VkPipelineLayout _pipelineLayout, VkShaderStageFlags _stageFlags, uint32 _offset, uint32 _size, const void* _values)
+{
+	Track(_commandBuffer);
+	TrackPipelineLayout(_pipelineLayout);
+
+	const bool isTracked = _offset + _size <= kMaxPushConstantsSize;
+	if (isTracked && m_pushConstantsStages == _stageFlags)
+	{
+		bool isSame = std::memcmp(m_pushConstantsValues.data() + _offset, _values, _size) == 0;
+		for (uint32 i = _offset; isSame && i < _offset + _size; ++i)
+		{
+			isSame = m_pushConstantsValid[i];
+		}
+
+		if (isSame)
+		{
+			++m_statistics.ElidedCount;
+			return;
+		}
+	}
+
+	vkCmdPushConstants(_commandBuffer, _pipelineLayout, _stageFlags, _offset, _size, _values);
+
+	// the values of other stages are unknown from here
+	if (m_pushConstantsStages != _stageFlags)
+	{
+		m_pushConstantsValid.fill(false);
+		m_pushConstantsStages = _stageFlags;
+	}
+
+	if (isTracked)
+	{
+		std::memcpy(m_pushConstantsValues.data() + _offset, _values, _size);
+		std::fill(m_pushConstantsValid.begin() + _offset, m_pushConstantsValid.begin() + _offset + _size, true);
+	}
+
+	++m_statistics.IssuedCount;
+}
+
+void CommandRecorder::SetCullMode(VkCommandBuffer _commandBuffer, VkCullModeFlags _cullMode)
+{
+	Track(_commandBuffer);
+
+	if (m_isCullModeValid && m_cullMode == _cullMode)
+	{
+		++m_statistics.ElidedCount;
+		return;
+	}
+
+	vkCmdSetCullModeEXT(_commandBuffer, _cullMode);
+	m_cullMode = _cullMode;
+	m_isCullModeValid = true;
+
+	++m_statistics.IssuedCount;
+}
+
+void CommandRecorder::SetFrontFace(VkCommandBuffer _commandBuffer, VkFrontFace _frontFace)
+{
+	Track(_commandBuffer);
+
+	if (m_isFrontFaceValid && m_frontFace == _frontFace)
+	{
+		++m_statistics.ElidedCount;
+		return;
+	}
+
+	vkCmdSetFrontFaceEXT(_commandBuffer, _frontFace);
+	m_frontFace = _frontFace;
+	m_isFrontFaceValid = true;
+
+	++m_statistics.IssuedCount;
+}
+
+void CommandRecorder::Track(VkCommandBuffer _commandBuffer)
+{
+	if (m_commandBuffer != _commandBuffer)
+	{
+		Reset(_commandBuffer);
+	}
+}
+
+void CommandRecorder::TrackPipelineLayout(VkPipelineLayout _pipelineLayout)
+{
+	if (m_pipelineLayout != _pipelineLayout)
+	{
+		m_descriptorSets.fill(BoundDescriptorSet{});
+		m_pushConstantsValid.fill(false);
+		m_pushConstantsStages = 0;
+		m_pipelineLayout = _pipelineLayout;
+	}
+}
+
+VESPERENGINE_NAMESPACE_END
@@ -0,0 +1,101 @@
+// Copyright (c) 2025-2025 Michele Condo'
+// File: C:\Projects\Vesper\VesperEngine\Backend\command_recorder.h
+// Licensed under the MIT License. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include "Core/core_defines.h"
+
+#include "vulkan/vulkan.h"
+
+#include <array>
+
+
+VESPERENGINE_NAMESPACE_BEGIN
+
+class Pipeline;
+
+struct CommandRecorderStatistics
+{
+	uint32 IssuedCount{ 0 };	// commands recorded in the command buffer
+	uint32 ElidedCount{ 0 };	// commands skipped because they would set the state already set
+};
+
+/**
+ * Thin wrapper of the state commands, it remembers what has been set in the command buffer and skips the commands that would not change it.
+ * The state known is the one set through the recorder since the last Reset: any command recorded directly in the same command buffer
+ * in the meanwhile makes it stale, so Reset is called at the beginning of every Render and after any foreign recording.
+ * Recording in another command buffer resets it as well.
+ * To stay on the safe side:
+ * - binding another pipeline forgets the dynamic states, the new pipeline could have them static
+ * - using another pipeline layout forgets descriptor sets and push constants, the new layout could be not compatible
+ */
+class VESPERENGINE_API CommandRecorder final
+{
+public:
+	static constexpr uint32 kMaxDescriptorSets = 8u;
+	static constexpr uint32 kMaxDynamicOffsets = 4u;
+	static constexpr uint32 kMaxPushConstantsSize = 128u;	// the minimum guaranteed by Vulkan, the one used by the engine
+
+public:
+	CommandRecorder() = default;
+	~CommandRecorder() = default;
+
+	CommandRecorder(const CommandRecorder&) = delete;
+	CommandRecorder& operator=(const CommandRecorder&) = delete;
+
+public:
+	VESPERENGINE_INLINE const CommandRecorderStatistics& GetStatistics() const { return m_statistics; }
+
+public:
+	// Forget all the state and the statistics
+	void Reset(VkCommandBuffer _commandBuffer = VK_NULL_HANDLE);
+
+	void BindPipeline(VkCommandBuffer _commandBuffer, const Pipeline& _pipeline);
+	void BindDescriptorSet(VkCommandBuffer _commandBuffer, VkPipelineBindPoint _bindPoint, VkPipelineLayout _pipelineLayout, uint32 _setIndex, VkDescriptorSet _descriptorSet,
+		uint32 _dynamicOffsetCount = 0, const uint32* _dynamicOffsets = nullptr);
+	void BindVertexBuffer(VkCommandBuffer _commandBuffer, VkBuffer _buffer, VkDeviceSize _offset = 0);
+	void BindIndexBuffer(VkCommandBuffer _commandBuffer, VkBuffer _buffer, VkDeviceSize _offset, VkIndexType _indexType);
+	void PushConstants(VkCommandBuffer _commandBuffer, VkPipelineLayout _pipelineLayout, VkShaderStageFlags _stageFlags, uint32 _offset, uint32 _size, const void* _values);
+	void SetCullMode(VkCommandBuffer _commandBuffer, VkCullModeFlags _cullMode);
+	void SetFrontFace(VkCommandBuffer _commandBuffer, VkFrontFace _frontFace);
+
+private:
+	struct BoundDescriptorSet
+	{
+		VkPipelineBindPoint BindPoint{ VK_PIPELINE_BIND_POINT_MAX_ENUM };
+		VkDescriptorSet DescriptorSet{ VK_NULL_HANDLE };
+		std::array<uint32, kMaxDynamicOffsets> DynamicOffsets{};
+		uint32 DynamicOffsetCount{ 0 };
+		bool IsValid{ false };
+	};
+
+	void Track(VkCommandBuffer _commandBuffer);
+	void TrackPipelineLayout(VkPipelineLayout _pipelineLayout);
+
+private:
+	VkCommandBuffer m_commandBuffer{ VK_NULL_HANDLE };
+	VkPipelineLayout m_pipelineLayout{ VK_NULL_HANDLE };
+
+	VkPipeline m_pipeline{ VK_NULL_HANDLE };
+	std::array<BoundDescriptorSet, kMaxDescriptorSets> m_descriptorSets{};
+
+	VkBuffer m_vertexBuffer{ VK_NULL_HANDLE };
+	VkDeviceSize m_vertexBufferOffset{ 0 };
+	VkBuffer m_indexBuffer{ VK_NULL_HANDLE };
+	VkDeviceSize m_indexBufferOffset{ 0 };
+	VkIndexType m_indexType{ VK_INDEX_TYPE_MAX_ENUM };
+
+	std::array<uint8, kMaxPushConstantsSize> m_pushConstantsValues{};
+	std::array<bool, kMaxPushConstantsSize> m_pushConstantsValid{};
+	VkShaderStageFlags m_pushConstantsStages{ 0 };
+
+	VkCullModeFlags m_cullMode{ VK_CULL_MODE_FLAG_BITS_MAX_ENUM };
+	VkFrontFace m_frontFace{ VK_FRONT_FACE_MAX_ENUM };
+	bool m_isCullModeValid{ false };
+	bool m_isFrontFaceValid{ false };
+
+	CommandRecorderStatistics m_statistics;
+};
+
+VESPERENGINE_NAMESPACE_END
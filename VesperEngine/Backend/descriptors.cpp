@@ -8,6 +8,7 @@
 #include "Utility/logger.h"
 
 #include <cassert>
+#include <algorithm>
 
 
 VESPERENGINE_NAMESPACE_BEGIN
@@ -39,26 +40,37 @@ DescriptorSetLayout::Builder& DescriptorSetLayout::Builder::SetFlags(VkDescripto
 	return *this;
 }
 
+DescriptorSetLayout::Builder& DescriptorSetLayout::Builder::SetUpdateTemplate(const std::vector<DescriptorTemplateEntry>& _entries)
+{
+	m_templateEntries = _entries;
+	return *this;
+}
+
 std::unique_ptr<DescriptorSetLayout> DescriptorSetLayout::Builder::Build() const 
 {
-	return std::make_unique<DescriptorSetLayout>(m_device, m_flags, m_bindings, m_sizePerBinding);
+	return std::make_unique<DescriptorSetLayout>(m_device, m_flags, m_bindings, m_sizePerBinding, m_templateEntries);
 }
 
 DescriptorSetLayout::DescriptorSetLayout(
 	Device& _device, 
 	VkDescriptorSetLayoutCreateFlags _flags,
 	std::unordered_map<uint32, VkDescriptorSetLayoutBinding> _bindings,
-	std::unordered_map<uint32, uint32> _sizePerBinding)
+	std::unordered_map<uint32, uint32> _sizePerBinding,
+	const std::vector<DescriptorTemplateEntry>& _templateEntries)
 	: m_device{ _device }
 	, m_bindings{ _bindings }
 	, m_layoutFlags{ _flags }
 	, m_sizePerBinding{ _sizePerBinding }
+	, m_templateEntries{ _templateEntries }
 {
 	std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings{};
 	for (auto kv : m_bindings) 
 	{
 		setLayoutBindings.push_back(kv.second);
 	}
+	// the variable descriptor count is allowed only on the last binding, by number
+	std::sort(setLayoutBindings.begin(), setLayoutBindings.end(),
+		[](const VkDescriptorSetLayoutBinding& _a, const VkDescriptorSetLayoutBinding& _b) { return _a.binding < _b.binding; });
 
 	VkDescriptorSetLayoutCreateInfo descriptorSetLayoutInfo{};
 	descriptorSetLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
@@ -97,13 +109,107 @@ DescriptorSetLayout::DescriptorSetLayout(
 	{
 		throw std::runtime_error("failed to create descriptor set layout!");
 	}
+
+	if (!m_templateEntries.empty())
+	{
+		CreateUpdateTemplate();
+	}
 }
 
 DescriptorSetLayout::~DescriptorSetLayout()
 {
+#if VMA_VULKAN_VERSION >= 1001000
+	if (m_updateTemplate != VK_NULL_HANDLE)
+	{
+		vkDestroyDescriptorUpdateTemplate(m_device.GetDevice(), m_updateTemplate, nullptr);
+	}
+#endif
 	vkDestroyDescriptorSetLayout(m_device.GetDevice(), m_descriptorSetLayout, nullptr);
 }
 
+void DescriptorSetLayout::CreateUpdateTemplate()
+{
+	for (const DescriptorTemplateEntry& entry : m_templateEntries)
+	{
+		assert(m_bindings.count(entry.Binding) == 1 && "Layout does not contain the template binding");
+	}
+
+	// templates are core from Vulkan 1.1, with 1.0 UpdateDescriptorSet writes the entries as a DescriptorWriter would
+#if VMA_VULKAN_VERSION >= 1001000
+	std::vector<VkDescriptorUpdateTemplateEntry> templateEntries;
+	templateEntries.reserve(m_templateEntries.size());
+	for (const DescriptorTemplateEntry& entry : m_templateEntries)
+	{
+		VkDescriptorUpdateTemplateEntry templateEntry{};
+		templateEntry.dstBinding = entry.Binding;
+		templateEntry.dstArrayElement = entry.ArrayElement;
+		templateEntry.descriptorCount = entry.Count;
+		templateEntry.descriptorType = m_bindings.at(entry.Binding).descriptorType;
+		templateEntry.offset = entry.Offset;
+		templateEntry.stride = entry.Stride;
+		templateEntries.push_back(templateEntry);
+	}
+
+	VkDescriptorUpdateTemplateCreateInfo templateInfo{};
+	templateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+	templateInfo.descriptorUpdateEntryCount = static_cast<uint32>(templateEntries.size());
+	templateInfo.pDescriptorUpdateEntries = templateEntries.data();
+	templateInfo.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+	templateInfo.descriptorSetLayout = m_descriptorSetLayout;
+
+	if (vkCreateDescriptorUpdateTemplate(m_device.GetDevice(), &templateInfo, nullptr, &m_updateTemplate) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create descriptor update template!");
+	}
+#endif
+}
+
+void DescriptorSetLayout::UpdateDescriptorSet(VkDescriptorSet _set, const void* _data) const
+{
+	assertMsgReturnVoid(HasUpdateTemplate(), "Cannot update the descriptor set: the layout has no update template");
+
+#if VMA_VULKAN_VERSION >= 1001000
+	vkUpdateDescriptorSetWithTemplate(m_device.GetDevice(), _set, m_updateTemplate, _data);
+#else
+	const uint8* data = static_cast<const uint8*>(_data);
+
+	std::vector<VkWriteDescriptorSet> writes;
+	for (const DescriptorTemplateEntry& entry : m_templateEntries)
+	{
+		const VkDescriptorType descriptorType = m_bindings.at(entry.Binding).descriptorType;
+		const bool isImage = descriptorType == VK_DESCRIPTOR_TYPE_SAMPLER ||
+			descriptorType == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER ||
+			descriptorType == VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE ||
+			descriptorType == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE ||
+			descriptorType == VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+
+		// one write per element, the stride of the data does not have to match the size of the infos
+		for (uint32 element = 0; element < entry.Count; ++element)
+		{
+			const uint8* info = data + entry.Offset + element * entry.Stride;
+
+			VkWriteDescriptorSet write{};
+			write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			write.dstSet = _set;
+			write.dstBinding = entry.Binding;
+			write.dstArrayElement = entry.ArrayElement + element;
+			write.descriptorType = descriptorType;
+			write.descriptorCount = 1;
+			if (isImage)
+			{
+				write.pImageInfo = reinterpret_cast<const VkDescriptorImageInfo*>(info);
+			}
+			else
+			{
+				write.pBufferInfo = reinterpret_cast<const VkDescriptorBufferInfo*>(info);
+			}
+			writes.push_back(write);
+		}
+	}
+	vkUpdateDescriptorSets(m_device.GetDevice(), static_cast<uint32>(writes.size()), writes.data(), 0, nullptr);
+#endif
+}
+
 //////////////////////////////////////////////////////////////////////////
 
 DescriptorPool::Builder& DescriptorPool::Builder::AddPoolSize(VkDescriptorType _descriptorType, uint32 _count)
@@ -174,10 +280,18 @@ bool DescriptorPool::AllocateDescriptorSet(const DescriptorSetLayout& _descripto
 		variableDescCount.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO;
 		variableDescCount.descriptorSetCount = 1;
 
+		// one count per set allocated, the size of the last binding, the variable one
+		uint32 lastBinding = 0;
+		uint32 lastBindingSize = 0;
 		for (const auto& [key, value] : _descriptorSetLayout.GetSizePerBinding())
 		{
-			variableDescCounts.push_back(value);
+			if (key >= lastBinding)
+			{
+				lastBinding = key;
+				lastBindingSize = value;
+			}
 		}
+		variableDescCounts.push_back(lastBindingSize);
 		variableDescCount.pDescriptorCounts = variableDescCounts.data();
 
 		allocInfo.pNext = &variableDescCount;
@@ -231,7 +345,7 @@ DescriptorWriter::DescriptorWriter(DescriptorSetLayout& _setLayout, DescriptorPo
 	: m_setLayout{ _setLayout }
 	, m_pool{ _pool } {}
 
-DescriptorWriter& DescriptorWriter::WriteBuffer(uint32 _binding, VkDescriptorBufferInfo* _bufferInfo, uint32 _count) 
+DescriptorWriter& DescriptorWriter::WriteBuffer(uint32 _binding, VkDescriptorBufferInfo* _bufferInfo, uint32 _count, uint32 _arrayElement) 
 {
 	assert(m_setLayout.m_bindings.count(_binding) == 1 && "Layout does not contain specified _binding");
 
@@ -243,12 +357,13 @@ DescriptorWriter& DescriptorWriter::WriteBuffer(uint32 _binding, VkDescriptorBuf
 	write.dstBinding = _binding;
 	write.pBufferInfo = _bufferInfo;
 	write.descriptorCount = _count;
+	write.dstArrayElement = _arrayElement;
 
 	m_writes.push_back(write);
 	return *this;
 }
 
-DescriptorWriter& DescriptorWriter::WriteImage(uint32 _binding, VkDescriptorImageInfo* _imageInfo, uint32 _count)
+DescriptorWriter& DescriptorWriter::WriteImage(uint32 _binding, VkDescriptorImageInfo* _imageInfo, uint32 _count, uint32 _arrayElement)
 {
 	assert(m_setLayout.m_bindings.count(_binding) == 1 && "Layout does not contain specified _binding");
 
@@ -260,6 +375,7 @@ DescriptorWriter& DescriptorWriter::WriteImage(uint32 _binding, VkDescriptorImag
 	write.dstBinding = _binding;
 	write.pImageInfo = _imageInfo;
 	write.descriptorCount = _count;
+	write.dstArrayElement = _arrayElement;
 
 	m_writes.push_back(write);
 	return *this;
@@ -287,4 +403,40 @@ void DescriptorWriter::Overwrite(VkDescriptorSet& _set)
 	vkUpdateDescriptorSets(m_pool.m_device.GetDevice(), static_cast<uint32>(m_writes.size()), m_writes.data(), 0, nullptr);
 }
 
+bool DescriptorWriter::BuildFromTemplate(VkDescriptorSet& _set, const void* _data)
+{
+	bool success = m_pool.AllocateDescriptorSet(m_setLayout, _set);
+	if (!success)
+	{
+		LOG(Logger::ERROR, "Cannot build the descriptor set!");
+
+		return false;
+	}
+	m_setLayout.UpdateDescriptorSet(_set, _data);
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+DescriptorUpdateBatch& DescriptorUpdateBatch::Add(const DescriptorWriter& _writer, VkDescriptorSet _set)
+{
+	for (VkWriteDescriptorSet write : _writer.m_writes)
+	{
+		write.dstSet = _set;
+		m_writes.push_back(write);
+	}
+	return *this;
+}
+
+void DescriptorUpdateBatch::Flush()
+{
+	if (m_writes.empty())
+	{
+		return;
+	}
+
+	vkUpdateDescriptorSets(m_device.GetDevice(), static_cast<uint32>(m_writes.size()), m_writes.data(), 0, nullptr);
+	m_writes.clear();
+}
+
 VESPERENGINE_NAMESPACE_END
@@ -17,6 +17,17 @@ VESPERENGINE_NAMESPACE_BEGIN
 
 class Device;
 
+// Where the descriptors of a binding are in the packed data given to the update template of a DescriptorSetLayout:
+// the data is a POD struct of VkDescriptorImageInfo/VkDescriptorBufferInfo, one entry per binding it writes
+struct DescriptorTemplateEntry
+{
+	uint32 Binding{ 0 };
+	std::size_t Offset{ 0 };	// of the first descriptor info of the binding, i.e. offsetof
+	std::size_t Stride{ 0 };	// between the descriptor infos of an array binding
+	uint32 Count{ 1 };
+	uint32 ArrayElement{ 0 };
+};
+
 //////////////////////////////////////////////////////////////////////////
 class VESPERENGINE_API DescriptorSetLayout
 {
@@ -33,6 +44,8 @@ public:
 			uint32 _maxCount = 1,
 			uint32 _count = 1);
 		Builder& SetFlags(VkDescriptorSetLayoutCreateFlags _flags);
+		// Create the update template of the layout, to write a whole set from packed data with one call
+		Builder& SetUpdateTemplate(const std::vector<DescriptorTemplateEntry>& _entries);
 		std::unique_ptr<DescriptorSetLayout> Build() const;
 
 	private:
@@ -40,12 +53,14 @@ public:
 		VkDescriptorSetLayoutCreateFlags m_flags = 0;
 		std::unordered_map<uint32, VkDescriptorSetLayoutBinding> m_bindings{};
 		std::unordered_map<uint32, uint32> m_sizePerBinding{};	// used for bindless binding
+		std::vector<DescriptorTemplateEntry> m_templateEntries{};
 	};
 
 	DescriptorSetLayout(Device& _device,
 		VkDescriptorSetLayoutCreateFlags _flags,
 		std::unordered_map<uint32, VkDescriptorSetLayoutBinding> _bindings,
-		std::unordered_map<uint32, uint32> _sizePerBinding);
+		std::unordered_map<uint32, uint32> _sizePerBinding,
+		const std::vector<DescriptorTemplateEntry>& _templateEntries = {});
 	~DescriptorSetLayout();
 	DescriptorSetLayout(const DescriptorSetLayout&) = delete;
 	DescriptorSetLayout& operator=(const DescriptorSetLayout&) = delete;
@@ -54,6 +69,13 @@ public:
 	//const std::unordered_map<uint32, VkDescriptorSetLayoutBinding>& GetBindings() const { return m_bindings; }
 	const std::unordered_map<uint32, uint32>& GetSizePerBinding() const { return m_sizePerBinding; }
 	VkDescriptorSetLayoutCreateFlags GetLayoutFlags() const { return m_layoutFlags; }
+	bool HasUpdateTemplate() const { return !m_templateEntries.empty(); }
+
+	// Write all the template bindings of _set from _data, laid out as described by the template entries
+	void UpdateDescriptorSet(VkDescriptorSet _set, const void* _data) const;
+
+private:
+	void CreateUpdateTemplate();
 
 private:
 	Device& m_device;
@@ -61,6 +83,8 @@ private:
 	std::unordered_map<uint32, VkDescriptorSetLayoutBinding> m_bindings{};
 	std::unordered_map<uint32, uint32> m_sizePerBinding{};	// used for bindless binding
 	VkDescriptorSetLayoutCreateFlags m_layoutFlags{0};		// used for bindless binding
+	std::vector<DescriptorTemplateEntry> m_templateEntries{};
+	VkDescriptorUpdateTemplate m_updateTemplate{ VK_NULL_HANDLE };	// null with Vulkan 1.0, the entries are written one by one
 
 	friend class DescriptorWriter;
 };
@@ -112,16 +136,43 @@ class VESPERENGINE_API DescriptorWriter
 public:
 	DescriptorWriter(DescriptorSetLayout& _setLayout, DescriptorPool& _pool);
 
-	DescriptorWriter& WriteBuffer(uint32 _binding, VkDescriptorBufferInfo* _bufferInfo, uint32 _count = 1);
-	DescriptorWriter& WriteImage(uint32 _binding, VkDescriptorImageInfo* _imageInfo, uint32 _count = 1);
+	// _arrayElement is the first element written of an array binding, i.e. a slot of a bindless array
+	DescriptorWriter& WriteBuffer(uint32 _binding, VkDescriptorBufferInfo* _bufferInfo, uint32 _count = 1, uint32 _arrayElement = 0);
+	DescriptorWriter& WriteImage(uint32 _binding, VkDescriptorImageInfo* _imageInfo, uint32 _count = 1, uint32 _arrayElement = 0);
 
 	bool Build(VkDescriptorSet& _set);
 	void Overwrite(VkDescriptorSet& _set);
 
+	// Allocate _set and write it through the update template of the layout, the writes added are not used
+	bool BuildFromTemplate(VkDescriptorSet& _set, const void* _data);
+
 private:
 	DescriptorSetLayout& m_setLayout;
 	DescriptorPool& m_pool;
 	std::vector<VkWriteDescriptorSet> m_writes;
+
+	friend class DescriptorUpdateBatch;
+};
+
+//////////////////////////////////////////////////////////////////////////
+/**
+ * Collects the writes of several DescriptorWriter, each for its own set, and updates all of them with one call.
+ * The descriptor infos pointed by the writers must stay alive until Flush.
+ */
+class VESPERENGINE_API DescriptorUpdateBatch
+{
+public:
+	DescriptorUpdateBatch(Device& _device) : m_device{ _device } {}
+	DescriptorUpdateBatch(const DescriptorUpdateBatch&) = delete;
+	DescriptorUpdateBatch& operator=(const DescriptorUpdateBatch&) = delete;
+
+	DescriptorUpdateBatch& Add(const DescriptorWriter& _writer, VkDescriptorSet _set);
+	bool IsEmpty() const { return m_writes.empty(); }
+	void Flush();
+
+private:
+	Device& m_device;
+	std::vector<VkWriteDescriptorSet> m_writes;
 };
 
 VESPERENGINE_NAMESPACE_END
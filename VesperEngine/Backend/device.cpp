@@ -3,21 +3,42 @@
 // Licensed under the MIT License. See LICENSE file in the project root for full license information.
 
 #include "Backend/device.h"
+#include "Backend/shader_module_cache.h"
 
 #include "App/window_handle.h"
 
 #include "Utility/logger.h"
+#include "Utility/hash.h"
 
 #include <string>
 #include <set>
 #include <unordered_set>
 #include <string_view>
+#include <fstream>
+#include <filesystem>
+#include <cstring>
 
 
 VESPERENGINE_NAMESPACE_BEGIN
 
 PFN_vkCmdSetCullModeEXT  vkCmdSetCullModeEXT = nullptr;
 PFN_vkCmdSetFrontFaceEXT vkCmdSetFrontFaceEXT = nullptr;
+PFN_vkCmdDrawIndexedIndirectCountKHR vkCmdDrawIndexedIndirectCountKHR = nullptr;
+
+// prefix of the pipeline cache file: the Vulkan header of the cache data has no driver version, and the data is checked for truncation
+struct PipelineCacheFileHeader
+{
+	uint64 DataSize;
+	uint32 Magic;
+	uint32 VendorID;
+	uint32 DeviceID;
+	uint32 DriverVersion;
+	uint32 DataHash;
+	uint8 PipelineCacheUUID[VK_UUID_SIZE];
+	uint32 Padding;
+};
+
+static constexpr uint32 kPipelineCacheMagic = 0x43505356;	// "VSPC"
 
 // local callback functions
 static VKAPI_ATTR VkBool32 VKAPI_CALL DebugCallback(
@@ -77,10 +98,20 @@ Device::Device(WindowHandle& _window)
 	CreateLogicalDevice();
 	CreateCommandPool();
 	CreateVma();
+	CreatePipelineCache({});
+
+	m_shaderModuleCache = std::make_unique<ShaderModuleCache>(*this);
 }
 
 Device::~Device() 
 {
+	if (!m_pipelineCacheFilePath.empty())
+	{
+		SavePipelineCache();
+	}
+	vkDestroyPipelineCache(m_device, m_pipelineCache, nullptr);
+	m_shaderModuleCache.reset();
+
 	vmaDestroyAllocator(m_allocator);
 
 	vkDestroyCommandPool(m_device, m_commandPool, nullptr);
@@ -170,6 +201,16 @@ void Device::PickPhysicalDevice()
 
 	vkGetPhysicalDeviceProperties(m_physicalDevice, &m_properties);
 
+	if (m_bIsBindlessResourcesSupported)
+	{
+		m_descriptorIndexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES;
+
+		VkPhysicalDeviceProperties2 properties2{};
+		properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		properties2.pNext = &m_descriptorIndexingProperties;
+		vkGetPhysicalDeviceProperties2(m_physicalDevice, &properties2);
+	}
+
 	LOG(Logger::INFO, "Physical device: ", m_properties.deviceName);
 	LOG_NL();
 
@@ -200,6 +241,9 @@ void Device::CreateLogicalDevice()
 
 	VkPhysicalDeviceFeatures deviceFeatures = {};
 	deviceFeatures.samplerAnisotropy = VK_TRUE;
+	// GPU driven rendering: several indirect draws per call, each one with its own first instance
+	deviceFeatures.multiDrawIndirect = m_bIsGPUDrivenRenderingSupported ? VK_TRUE : VK_FALSE;
+	deviceFeatures.drawIndirectFirstInstance = m_bIsGPUDrivenRenderingSupported ? VK_TRUE : VK_FALSE;
 
 	// EXT features -> Dynamic state
 	VkPhysicalDeviceExtendedDynamicStateFeaturesEXT dynamicStateFeatures = {};
@@ -235,14 +279,21 @@ void Device::CreateLogicalDevice()
 		dynamicStateFeatures.pNext = &indexingFeatures;
 	}
 
+	// optional extensions are appended to the required ones only when the device supports them
+	std::vector<const char*> enabledExtensions = m_deviceExtensions;
+	if (m_bIsGPUDrivenRenderingSupported)
+	{
+		enabledExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+	}
+
 	VkDeviceCreateInfo createInfo = {};
 	createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 
 	createInfo.queueCreateInfoCount = static_cast<uint32>(queueCreateInfos.size());
 	createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
-	createInfo.enabledExtensionCount = static_cast<uint32>(m_deviceExtensions.size());
-	createInfo.ppEnabledExtensionNames = m_deviceExtensions.data();
+	createInfo.enabledExtensionCount = static_cast<uint32>(enabledExtensions.size());
+	createInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
 	// validation layers
 	if (m_window.IsValidationLayersEnabled())
@@ -264,7 +315,16 @@ void Device::CreateLogicalDevice()
 	}
 	else
 	{
-		createInfo.pNext = &dynamicStateFeatures;;
+		// the base features are only passed through features2, so it is needed as well when the indirect draw features are enabled
+		if (m_bIsGPUDrivenRenderingSupported)
+		{
+			deviceFeatures2.pNext = &dynamicStateFeatures;
+			createInfo.pNext = &deviceFeatures2;
+		}
+		else
+		{
+			createInfo.pNext = &dynamicStateFeatures;;
+		}
 	}
 	//
 
@@ -291,6 +351,14 @@ void Device::CreateLogicalDevice()
 	{
 		throw std::runtime_error("failed to create logical device! Device does not support VK_EXT_extended_dynamic_state2, which is required!");
 	}
+
+	if (m_bIsGPUDrivenRenderingSupported)
+	{
+		vkCmdDrawIndexedIndirectCountKHR = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(vkGetDeviceProcAddr(m_device, "vkCmdDrawIndexedIndirectCountKHR"));
+
+		// not mandatory, the render systems fall back to the CPU path
+		m_bIsGPUDrivenRenderingSupported = vkCmdDrawIndexedIndirectCountKHR != nullptr;
+	}
 }
 
 void Device::CreateCommandPool()
@@ -375,6 +443,134 @@ void Device::CreateVma()
 	}
 }
 
+void Device::CreatePipelineCache(const std::vector<int8>& _initialData)
+{
+	VkPipelineCacheCreateInfo cacheInfo{};
+	cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	cacheInfo.initialDataSize = _initialData.size();
+	cacheInfo.pInitialData = _initialData.empty() ? nullptr : _initialData.data();
+
+	if (vkCreatePipelineCache(m_device, &cacheInfo, nullptr, &m_pipelineCache) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create pipeline cache!");
+	}
+}
+
+void Device::LoadPipelineCache(const std::string& _filePath)
+{
+	m_pipelineCacheFilePath = _filePath;
+
+	if (_filePath.empty())
+	{
+		return;
+	}
+
+	std::ifstream file{ _filePath, std::ios::ate | std::ios::binary };
+	if (!file.is_open())
+	{
+		LOG(Logger::INFO, "No pipeline cache at ", _filePath, ", the pipelines are compiled from scratch");
+		return;
+	}
+
+	const std::size_t fileSize = static_cast<std::size_t>(file.tellg());
+	file.seekg(0);
+
+	PipelineCacheFileHeader header{};
+	if (fileSize < sizeof(header) || !file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+	{
+		LOG(Logger::WARNING, "Pipeline cache ", _filePath, " is truncated, ignored");
+		return;
+	}
+
+	// another GPU or another driver would reject the data anyway, some drivers crash on it instead
+	if (header.Magic != kPipelineCacheMagic ||
+		header.VendorID != m_properties.vendorID ||
+		header.DeviceID != m_properties.deviceID ||
+		header.DriverVersion != m_properties.driverVersion ||
+		std::memcmp(header.PipelineCacheUUID, m_properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+	{
+		LOG(Logger::INFO, "Pipeline cache ", _filePath, " was written by another device or driver, ignored");
+		return;
+	}
+
+	if (header.DataSize != fileSize - sizeof(header) || header.DataSize < sizeof(VkPipelineCacheHeaderVersionOne))
+	{
+		LOG(Logger::WARNING, "Pipeline cache ", _filePath, " is truncated, ignored");
+		return;
+	}
+
+	std::vector<int8> data(static_cast<std::size_t>(header.DataSize));
+	if (!file.read(data.data(), data.size()) || HashBytes(data.data(), data.size()) != header.DataHash)
+	{
+		LOG(Logger::WARNING, "Pipeline cache ", _filePath, " is corrupted, ignored");
+		return;
+	}
+
+	// the data starts with the Vulkan header, checked as well in case the file was written by another application
+	VkPipelineCacheHeaderVersionOne cacheHeader{};
+	std::memcpy(&cacheHeader, data.data(), sizeof(cacheHeader));
+	if (cacheHeader.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+		cacheHeader.vendorID != m_properties.vendorID ||
+		cacheHeader.deviceID != m_properties.deviceID ||
+		std::memcmp(cacheHeader.pipelineCacheUUID, m_properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+	{
+		LOG(Logger::WARNING, "Pipeline cache ", _filePath, " does not match its header, ignored");
+		return;
+	}
+
+	vkDestroyPipelineCache(m_device, m_pipelineCache, nullptr);
+	CreatePipelineCache(data);
+}
+
+void Device::SavePipelineCache() const
+{
+	assertMsgReturnVoid(!m_pipelineCacheFilePath.empty(), "Cannot save the pipeline cache: no file, call LoadPipelineCache first");
+
+	std::size_t dataSize = 0;
+	if (vkGetPipelineCacheData(m_device, m_pipelineCache, &dataSize, nullptr) != VK_SUCCESS || dataSize == 0)
+	{
+		return;
+	}
+
+	std::vector<int8> data(dataSize);
+	if (vkGetPipelineCacheData(m_device, m_pipelineCache, &dataSize, data.data()) != VK_SUCCESS)
+	{
+		LOG(Logger::WARNING, "Failed to get the pipeline cache data, not saved");
+		return;
+	}
+	data.resize(dataSize);
+
+	PipelineCacheFileHeader header{};
+	header.DataSize = dataSize;
+	header.Magic = kPipelineCacheMagic;
+	header.VendorID = m_properties.vendorID;
+	header.DeviceID = m_properties.deviceID;
+	header.DriverVersion = m_properties.driverVersion;
+	header.DataHash = HashBytes(data.data(), data.size());
+	std::memcpy(header.PipelineCacheUUID, m_properties.pipelineCacheUUID, VK_UUID_SIZE);
+
+	const std::string tempFilePath = m_pipelineCacheFilePath + ".tmp";
+	{
+		std::ofstream file{ tempFilePath, std::ios::binary | std::ios::trunc };
+		if (!file.is_open() ||
+			!file.write(reinterpret_cast<const char*>(&header), sizeof(header)) ||
+			!file.write(data.data(), data.size()))
+		{
+			LOG(Logger::WARNING, "Failed to write the pipeline cache to ", tempFilePath);
+			return;
+		}
+	}
+
+	// the rename replaces the previous file in one step
+	std::error_code error;
+	std::filesystem::rename(tempFilePath, m_pipelineCacheFilePath, error);
+	if (error)
+	{
+		LOG(Logger::WARNING, "Failed to replace the pipeline cache ", m_pipelineCacheFilePath, ": ", error.message());
+		std::filesystem::remove(tempFilePath, error);
+	}
+}
+
 void Device::CreateSurface() 
 { 
 	m_window.CreateWindowSurface(m_instance, &m_surface); 
@@ -419,6 +615,10 @@ bool Device::IsDeviceSuitable(VkPhysicalDevice device)
 		descriptorIndexingFeatures.descriptorBindingUniformTexelBufferUpdateAfterBind &&
 		descriptorIndexingFeatures.descriptorBindingStorageTexelBufferUpdateAfterBind;
 
+	m_bIsGPUDrivenRenderingSupported = VK_KHR_draw_indirect_count_enabled &&
+		supportedFeatures.multiDrawIndirect &&
+		supportedFeatures.drawIndirectFirstInstance;
+
 	return indices.IsComplete() 
 		&& extensionsSupported 
 		&& swapChainAdequate
@@ -579,6 +779,10 @@ bool Device::CheckDeviceExtensionSupport(VkPhysicalDevice _device)
 		{
 			VK_EXT_extended_dynamic_state2_enabled = true;
 		}
+		else if (strcmp(extension.extensionName, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME) == 0)
+		{
+			VK_KHR_draw_indirect_count_enabled = true;
+		}
 
 		requiredExtensions.erase(extension.extensionName);
 	}
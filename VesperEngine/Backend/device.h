@@ -8,12 +8,15 @@
 
 #include "vma/vk_mem_alloc.h"
 
+#include <string>
 #include <vector>
+#include <memory>
 
 
 VESPERENGINE_NAMESPACE_BEGIN
 
 class WindowHandle;
+class ShaderModuleCache;
 
 struct SwapChainSupportDetails
 {
@@ -33,6 +36,7 @@ struct QueueFamilyIndices
 
 extern PFN_vkCmdSetCullModeEXT vkCmdSetCullModeEXT;
 extern PFN_vkCmdSetFrontFaceEXT vkCmdSetFrontFaceEXT;
+extern PFN_vkCmdDrawIndexedIndirectCountKHR vkCmdDrawIndexedIndirectCountKHR;
 
 class VESPERENGINE_API Device final
 {
@@ -55,14 +59,28 @@ public:
 	VESPERENGINE_INLINE const VmaAllocator GetAllocator() const { return m_allocator; }
 	VESPERENGINE_INLINE const VkPhysicalDeviceProperties& GetProperties() const { return m_properties; }
 	VESPERENGINE_INLINE const VkPhysicalDeviceLimits& GetLimits() const { return m_properties.limits; }
+	// limits of the update after bind descriptors, the bindless arrays. Only filled when bindless is supported
+	VESPERENGINE_INLINE const VkPhysicalDeviceDescriptorIndexingProperties& GetDescriptorIndexingProperties() const { return m_descriptorIndexingProperties; }
+	// passed to every pipeline creation, the driver skips the compilation of the pipelines it already has
+	VESPERENGINE_INLINE const VkPipelineCache GetPipelineCache() const { return m_pipelineCache; }
+	// the shader modules of all the pipelines, created once per SPIR-V file
+	VESPERENGINE_INLINE ShaderModuleCache& GetShaderModuleCache() const { return *m_shaderModuleCache; }
 
 	VESPERENGINE_INLINE const bool IsBindlessResourcesSupported() const { return m_bIsBindlessResourcesSupported; }
+	// multi draw indirect with count and first instance, used by the compute culling
+	VESPERENGINE_INLINE const bool IsGPUDrivenRenderingSupported() const { return m_bIsGPUDrivenRenderingSupported; }
 
 	SwapChainSupportDetails GetSwapChainSupport() { return QuerySwapChainSupport(m_physicalDevice); }
 	uint32 FindMemoryType(uint32 _typeFilter, VkMemoryPropertyFlags _properties);
 	QueueFamilyIndices FindPhysicalQueueFamilies() { return FindQueueFamilies(m_physicalDevice); }
 	VkFormat FindSupportedFormat(const std::vector<VkFormat>& _candidates, VkImageTiling _tiling, VkFormatFeatureFlags _features);
 
+	// Call before any pipeline is created: fill the pipeline cache with the file written by a previous run,
+	// ignored if written by another device or driver. The cache is saved back to the same file when the device is destroyed
+	void LoadPipelineCache(const std::string& _filePath);
+	// write the pipeline cache to a temporary file, then replace the previous one: a crash never leaves a truncated cache
+	void SavePipelineCache() const;
+
 	// Buffer Helper Functions
 	void CreateBuffer(
 		VkDeviceSize _size,
@@ -118,8 +136,10 @@ private:
 	bool VK_EXT_debug_utils_enabled = false;
 	bool VK_EXT_descriptor_indexing_extension_enabled = false;
 	bool VK_EXT_extended_dynamic_state2_enabled = false;
+	bool VK_KHR_draw_indirect_count_enabled = false;
 
 	bool m_bIsBindlessResourcesSupported = false;
+	bool m_bIsGPUDrivenRenderingSupported = false;
 
 private:
 	void CreateInstance();
@@ -129,6 +149,7 @@ private:
 	void CreateLogicalDevice();
 	void CreateCommandPool();
 	void CreateVma();
+	void CreatePipelineCache(const std::vector<int8>& _initialData);
 
 	void RecordCopyBuffer(VkCommandBuffer _commandBuffer, VkBuffer _srcBuffer, VkBuffer _dstBuffer, VkDeviceSize _size);
 	void RecordCopyBufferToImage(VkCommandBuffer _commandBuffer, VkBuffer _buffer, VkImage _image, uint32 _width, uint32 _height, uint32 _layerCount, uint32 _mipLevel);
@@ -159,9 +180,14 @@ private:
 	VkQueue m_presentQueue;
 
 	VkPhysicalDeviceProperties m_properties;
+	VkPhysicalDeviceDescriptorIndexingProperties m_descriptorIndexingProperties{};
 
 	VmaAllocator m_allocator;
 
+	VkPipelineCache m_pipelineCache = VK_NULL_HANDLE;
+	std::string m_pipelineCacheFilePath;
+	std::unique_ptr<ShaderModuleCache> m_shaderModuleCache;
+
 	const std::vector<const char*> m_validationLayers = { "VK_LAYER_KHRONOS_validation" };
 	const std::vector<const char*> m_deviceExtensions = { 
 		VK_KHR_SWAPCHAIN_EXTENSION_NAME,			// Swapchain support
@@ -0,0 +1,137 @@
+// Copyright (c) 2025-2025 Michele Condo'
+// File: C:\Projects\Vesper\VesperEngine\Backend\dynamic_resolution.cpp
+// Licensed under the MIT License. See LICENSE file in the project root for full license information.
+
+#include "Backend/dynamic_resolution.h"
+#include "Backend/device.h"
+#include "Backend/swap_chain.h"
+
+#include "Utility/logger.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+
+VESPERENGINE_NAMESPACE_BEGIN
+
+DynamicResolution::DynamicResolution(Device& _device, float _minScale, float _targetFrameTime)
+	: m_device{ _device }
+	, m_minScale{ std::clamp(_minScale, kScaleStep, 1.0f) }
+	, m_targetFrameTime{ _targetFrameTime }
+{
+	const VkPhysicalDeviceLimits& limits = m_device.GetProperties().limits;
+	if (!limits.timestampComputeAndGraphics)
+	{
+		LOG(Logger::WARNING, "Timestamps are not supported by the graphics queue, dynamic resolution stays at full scale");
+		return;
+	}
+
+	m_timestampPeriod = limits.timestampPeriod;
+
+	// two per frame in flight: top of the pipe at the beginning, bottom of the pipe at the end
+	VkQueryPoolCreateInfo queryPoolInfo{};
+	queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	queryPoolInfo.queryCount = SwapChain::kMaxFramesInFlight * 2;
+
+	if (vkCreateQueryPool(m_device.GetDevice(), &queryPoolInfo, nullptr, &m_queryPool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create timestamp query pool!");
+	}
+
+	m_isQueryWritten.resize(SwapChain::kMaxFramesInFlight, false);
+}
+
+DynamicResolution::~DynamicResolution()
+{
+	if (m_queryPool != VK_NULL_HANDLE)
+	{
+		vkDestroyQueryPool(m_device.GetDevice(), m_queryPool, nullptr);
+	}
+}
+
+VkExtent2D DynamicResolution::GetScaledExtent(VkExtent2D _extent) const
+{
+	VkExtent2D scaledExtent;
+	scaledExtent.width = (std::max)(1u, static_cast<uint32>(std::lround(static_cast<float>(_extent.width) * m_scale)));
+	scaledExtent.height = (std::max)(1u, static_cast<uint32>(std::lround(static_cast<float>(_extent.height) * m_scale)));
+	return scaledExtent;
+}
+
+void DynamicResolution::BeginFrame(VkCommandBuffer _commandBuffer, int32 _frameIndex)
+{
+	if (!IsTimingSupported())
+	{
+		return;
+	}
+
+	ReadFrameTime(_frameIndex);
+
+	const uint32 firstQuery = static_cast<uint32>(_frameIndex) * 2;
+	vkCmdResetQueryPool(_commandBuffer, m_queryPool, firstQuery, 2);
+	vkCmdWriteTimestamp(_commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_queryPool, firstQuery);
+}
+
+void DynamicResolution::EndFrame(VkCommandBuffer _commandBuffer, int32 _frameIndex)
+{
+	if (!IsTimingSupported())
+	{
+		return;
+	}
+
+	vkCmdWriteTimestamp(_commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_queryPool, static_cast<uint32>(_frameIndex) * 2 + 1);
+	m_isQueryWritten[_frameIndex] = true;
+}
+
+void DynamicResolution::ReadFrameTime(int32 _frameIndex)
+{
+	if (!m_isQueryWritten[_frameIndex])
+	{
+		return;
+	}
+
+	// the fence of the frame has been waited, so the results are available: no wait flag, a not ready result is just skipped
+	uint64 timestamps[2]{};
+	const VkResult result = vkGetQueryPoolResults(m_device.GetDevice(), m_queryPool, static_cast<uint32>(_frameIndex) * 2, 2,
+		sizeof(timestamps), timestamps, sizeof(uint64), VK_QUERY_RESULT_64_BIT);
+
+	if (result != VK_SUCCESS || timestamps[1] < timestamps[0])
+	{
+		return;
+	}
+
+	const float frameTime = static_cast<float>(timestamps[1] - timestamps[0]) * m_timestampPeriod * 1e-6f;
+	UpdateScale(frameTime);
+}
+
+void DynamicResolution::UpdateScale(float _frameTime)
+{
+	m_gpuFrameTime = m_gpuFrameTime > 0.0f ? m_gpuFrameTime + (_frameTime - m_gpuFrameTime) * kSmoothingFactor : _frameTime;
+
+	if (m_gpuFrameTime > m_targetFrameTime * kDecreaseThreshold)
+	{
+		m_framesBelowTarget = 0;
+		if (++m_framesAboveTarget >= kDecreaseFrameCount)
+		{
+			m_scale = (std::max)(m_minScale, m_scale - kScaleStep);
+			m_framesAboveTarget = 0;
+		}
+	}
+	else if (m_gpuFrameTime < m_targetFrameTime * kIncreaseThreshold)
+	{
+		m_framesAboveTarget = 0;
+		if (++m_framesBelowTarget >= kIncreaseFrameCount)
+		{
+			m_scale = (std::min)(1.0f, m_scale + kScaleStep);
+			m_framesBelowTarget = 0;
+		}
+	}
+	else
+	{
+		m_framesAboveTarget = 0;
+		m_framesBelowTarget = 0;
+	}
+}
+
+VESPERENGINE_NAMESPACE_END
@@ -0,0 +1,76 @@
+// Copyright (c) 2025-2025 Michele Condo'
+// File: C:\Projects\Vesper\VesperEngine\Backend\dynamic_resolution.h
+// Licensed under the MIT License. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include "Core/core_defines.h"
+
+#include "vulkan/vulkan.h"
+
+#include <vector>
+
+
+VESPERENGINE_NAMESPACE_BEGIN
+
+class Device;
+
+/**
+ * Scale of the scene target driven by the GPU frame time, measured with two timestamps around the command buffer of every frame in flight.
+ * The time is smoothed, then the scale moves of a fixed step only after it stayed out of the band around the target for some frames:
+ * quantized steps with hysteresis, so it does not oscillate every frame and the render area changes rarely.
+ */
+class VESPERENGINE_API DynamicResolution final
+{
+public:
+	static constexpr float kScaleStep = 0.05f;
+	static constexpr float kSmoothingFactor = 0.1f;				// weight of the newest frame time in the moving average
+	static constexpr float kDecreaseThreshold = 1.05f;			// of the target frame time, above it the scale goes down
+	static constexpr float kIncreaseThreshold = 0.85f;			// of the target frame time, below it the scale goes up
+	static constexpr uint32 kDecreaseFrameCount = 4u;			// consecutive frames above the band before a step down
+	static constexpr uint32 kIncreaseFrameCount = 30u;			// consecutive frames below the band before a step up, slower to avoid ping pong
+
+public:
+	DynamicResolution(Device& _device, float _minScale, float _targetFrameTime);
+	~DynamicResolution();
+
+	DynamicResolution(const DynamicResolution&) = delete;
+	DynamicResolution& operator=(const DynamicResolution&) = delete;
+
+public:
+	VESPERENGINE_INLINE float GetScale() const { return m_scale; }
+	// milliseconds, smoothed
+	VESPERENGINE_INLINE float GetGPUFrameTime() const { return m_gpuFrameTime; }
+	// false if the graphics queue cannot write timestamps, the scale then stays at 1
+	VESPERENGINE_INLINE bool IsTimingSupported() const { return m_queryPool != VK_NULL_HANDLE; }
+
+	// _extent scaled and rounded, never 0
+	VkExtent2D GetScaledExtent(VkExtent2D _extent) const;
+
+public:
+	// Call right after the command buffer of the frame begins, after the fence of the frame has been waited:
+	// the timestamps of the last use of this frame are read and the scale updated for the frame being recorded
+	void BeginFrame(VkCommandBuffer _commandBuffer, int32 _frameIndex);
+	// Call right before the command buffer of the frame ends
+	void EndFrame(VkCommandBuffer _commandBuffer, int32 _frameIndex);
+
+private:
+	void ReadFrameTime(int32 _frameIndex);
+	void UpdateScale(float _frameTime);
+
+private:
+	Device& m_device;
+	VkQueryPool m_queryPool{ VK_NULL_HANDLE };
+	std::vector<bool> m_isQueryWritten;		// per frame in flight, the queries of a frame are read only after being written once
+
+	float m_minScale{ 1.0f };
+	float m_targetFrameTime{ 0.0f };
+	float m_timestampPeriod{ 0.0f };		// nanoseconds per tick
+
+	float m_scale{ 1.0f };
+	float m_gpuFrameTime{ 0.0f };
+	uint32 m_framesAboveTarget{ 0 };
+	uint32 m_framesBelowTarget{ 0 };
+};
+
+VESPERENGINE_NAMESPACE_END
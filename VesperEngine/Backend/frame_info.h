@@ -10,6 +10,8 @@
 
 VESPERENGINE_NAMESPACE_BEGIN
 
+class RenderPacketList;
+
 struct FrameInfo
 {
     int32 FrameIndex{ 0 };
@@ -18,6 +20,8 @@ struct FrameInfo
     VkDescriptorSet GlobalDescriptorSet{ VK_NULL_HANDLE };
     VkDescriptorSet EntityDescriptorSet{ VK_NULL_HANDLE };
     VkDescriptorSet BindlessDescriptorSet{ VK_NULL_HANDLE };
+    bool IsEntityStorageBuffer{ false };    // EntityDescriptorSet holds a storage buffer indexed by firstInstance, instead of a dynamic uniform buffer
+    const RenderPacketList* RenderPackets{ nullptr };   // extracted for this frame, the render systems record their draws from it
 };
 
 VESPERENGINE_NAMESPACE_END
@@ -0,0 +1,453 @@
+// Copyright (c) 2025-2025 Michele Condo'
+// File: C:\Projects\Vesper\VesperEngine\Backend\geometry_arena.cpp
+// Licensed under the MIT License. See LICENSE file in the project root for full license information.
+
+#include "Backend/geometry_arena.h"
+#include "Backend/device.h"
+#include "Backend/buffer.h"
+#include "Backend/model_data.h"
+
+#include <algorithm>
+#include <iterator>
+
+
+VESPERENGINE_NAMESPACE_BEGIN
+
+//////////////////////////////////////////////////////////////////////////
+// RANGE ALLOCATOR
+
+void GeometryArena::RangeAllocator::Reset(uint32 _capacity, uint32 _usedCount)
+{
+	m_freeRanges.clear();
+	m_capacity = _capacity;
+	m_usedCount = _usedCount;
+
+	if (_usedCount < _capacity)
+	{
+		m_freeRanges[_usedCount] = _capacity - _usedCount;
+	}
+}
+
+uint32 GeometryArena::RangeAllocator::Allocate(uint32 _count)
+{
+	for (auto iterator = m_freeRanges.begin(); iterator != m_freeRanges.end(); ++iterator)
+	{
+		if (iterator->second < _count)
+		{
+			continue;
+		}
+
+		const uint32 offset = iterator->first;
+		const uint32 remainingCount = iterator->second - _count;
+
+		m_freeRanges.erase(iterator);
+		if (remainingCount > 0)
+		{
+			m_freeRanges[offset + _count] = remainingCount;
+		}
+
+		m_usedCount += _count;
+		return offset;
+	}
+
+	return kInvalidOffset;
+}
+
+void GeometryArena::RangeAllocator::Free(uint32 _offset, uint32 _count)
+{
+	assertMsgReturnVoid(_offset + _count <= m_capacity && _count <= m_usedCount, "Freeing a range outside of the allocator");
+
+	uint32 offset = _offset;
+	uint32 count = _count;
+
+	// merge with the free range ending where this one begins
+	auto next = m_freeRanges.lower_bound(offset);
+	if (next != m_freeRanges.begin())
+	{
+		auto previous = std::prev(next);
+		if (previous->first + previous->second == offset)
+		{
+			offset = previous->first;
+			count += previous->second;
+			m_freeRanges.erase(previous);
+		}
+	}
+
+	// merge with the free range beginning where this one ends
+	if (next != m_freeRanges.end() && next->first == _offset + _count)
+	{
+		count += next->second;
+		m_freeRanges.erase(next);
+	}
+
+	m_freeRanges[offset] = count;
+	m_usedCount -= _count;
+}
+
+float GeometryArena::RangeAllocator::GetFragmentation() const
+{
+	const uint32 freeCount = m_capacity - m_usedCount;
+	if (freeCount == 0)
+	{
+		return 0.0f;
+	}
+
+	uint32 largestFreeCount = 0;
+	for (const auto& freeRange : m_freeRanges)
+	{
+		largestFreeCount = std::max(largestFreeCount, freeRange.second);
+	}
+
+	return 1.0f - static_cast<float>(largestFreeCount) / static_cast<float>(freeCount);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// GEOMETRY ARENA
+
+GeometryArena::GeometryArena(Device& _device, uint32 _pageVertexCount, uint32 _pageIndexCount)
+	: m_device{ _device }
+	, m_pageVertexCount{ _pageVertexCount }
+	, m_pageIndexCount{ _pageIndexCount }
+{
+	m_buffer = std::make_unique<Buffer>(m_device);
+}
+
+uint32 GeometryArena::Allocate(const std::vector<Vertex>& _vertices, const std::vector<uint32>& _indices)
+{
+	const uint32 vertexCount = static_cast<uint32>(_vertices.size());
+	const uint32 indexCount = static_cast<uint32>(_indices.size());
+
+	assertMsgReturnValue(vertexCount >= 3, "Vertex count must be at least 3", kInvalidHandle);
+
+	GeometryAllocation allocation;
+
+	// first fit, in the pages first and then in the ranges of the page
+	uint32 pageIndex = 0;
+	for (; pageIndex < m_pages.size(); ++pageIndex)
+	{
+		if (!m_pages[pageIndex])
+		{
+			continue;
+		}
+
+		Page& page = *m_pages[pageIndex];
+
+		const uint32 firstVertex = page.Vertices.Allocate(vertexCount);
+		if (firstVertex == RangeAllocator::kInvalidOffset)
+		{
+			continue;
+		}
+
+		const uint32 firstIndex = indexCount > 0 ? page.Indices.Allocate(indexCount) : 0;
+		if (firstIndex == RangeAllocator::kInvalidOffset)
+		{
+			page.Vertices.Free(firstVertex, vertexCount);
+			continue;
+		}
+
+		allocation.FirstVertex = firstVertex;
+		allocation.FirstIndex = firstIndex;
+		break;
+	}
+
+	if (pageIndex == m_pages.size() || !m_pages[pageIndex])
+	{
+		// reuse the slot of a destroyed page if any, the indices of the pages in use must not change
+		auto freeSlot = std::find(m_pages.begin(), m_pages.end(), nullptr);
+		pageIndex = static_cast<uint32>(std::distance(m_pages.begin(), freeSlot));
+		if (freeSlot == m_pages.end())
+		{
+			m_pages.emplace_back();
+		}
+
+		// meshes bigger than a page get a page on their own
+		m_pages[pageIndex] = std::make_unique<Page>();
+		CreatePage(*m_pages[pageIndex], std::max(m_pageVertexCount, vertexCount), std::max(m_pageIndexCount, indexCount));
+
+		allocation.FirstVertex = m_pages[pageIndex]->Vertices.Allocate(vertexCount);
+		allocation.FirstIndex = indexCount > 0 ? m_pages[pageIndex]->Indices.Allocate(indexCount) : 0;
+	}
+
+	allocation.PageIndex = pageIndex;
+	allocation.VertexCount = vertexCount;
+	allocation.IndexCount = indexCount;
+	allocation.IsValid = true;
+
+	Page& page = *m_pages[pageIndex];
+	++page.AllocationCount;
+
+	// vertices and indices share the same staging buffer and the same command
+	const VkDeviceSize verticesSize = sizeof(Vertex) * vertexCount;
+	const VkDeviceSize indicesSize = sizeof(uint32) * indexCount;
+
+	BufferComponent stagingBuffer = m_buffer->Create<BufferComponent>(
+		verticesSize + indicesSize,
+		1,
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
+		VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT
+	);
+
+	m_buffer->Map(stagingBuffer);
+	m_buffer->WriteToBuffer(stagingBuffer.MappedMemory, (void*)_vertices.data(), static_cast<std::size_t>(verticesSize));
+	if (indexCount > 0)
+	{
+		m_buffer->WriteToBufferWithOffset(stagingBuffer.MappedMemory, (void*)_indices.data(), static_cast<std::size_t>(indicesSize), verticesSize);
+	}
+	m_buffer->Unmap(stagingBuffer);
+
+	VkCommandBuffer commandBuffer = m_device.BeginSingleTimeCommands();
+
+	VkBufferCopy vertexRegion{};
+	vertexRegion.srcOffset = 0;
+	vertexRegion.dstOffset = sizeof(Vertex) * allocation.FirstVertex;
+	vertexRegion.size = verticesSize;
+	vkCmdCopyBuffer(commandBuffer, stagingBuffer.Buffer, page.VertexBuffer.Buffer, 1, &vertexRegion);
+
+	if (indexCount > 0)
+	{
+		VkBufferCopy indexRegion{};
+		indexRegion.srcOffset = verticesSize;
+		indexRegion.dstOffset = sizeof(uint32) * allocation.FirstIndex;
+		indexRegion.size = indicesSize;
+		vkCmdCopyBuffer(commandBuffer, stagingBuffer.Buffer, page.IndexBuffer.Buffer, 1, &indexRegion);
+	}
+
+	m_device.EndSingleTimeCommands(commandBuffer);
+
+	m_buffer->Destroy(stagingBuffer);
+
+	uint32 handle;
+	if (!m_freeHandles.empty())
+	{
+		handle = m_freeHandles.back();
+		m_freeHandles.pop_back();
+		m_allocations[handle] = allocation;
+	}
+	else
+	{
+		handle = static_cast<uint32>(m_allocations.size());
+		m_allocations.push_back(allocation);
+	}
+
+	return handle;
+}
+
+void GeometryArena::Free(uint32 _handle)
+{
+	assertMsgReturnVoid(_handle < m_allocations.size() && m_allocations[_handle].IsValid, "Freeing a geometry allocation not in use");
+
+	GeometryAllocation& allocation = m_allocations[_handle];
+	Page& page = *m_pages[allocation.PageIndex];
+
+	// the page content is left as it is: draws recorded in the frames in flight can still read it
+	page.Vertices.Free(allocation.FirstVertex, allocation.VertexCount);
+	if (allocation.IndexCount > 0)
+	{
+		page.Indices.Free(allocation.FirstIndex, allocation.IndexCount);
+	}
+	--page.AllocationCount;
+
+	allocation = GeometryAllocation{};
+	m_freeHandles.push_back(_handle);
+}
+
+VertexBufferComponent GeometryArena::GetVertexBufferComponent(uint32 _handle) const
+{
+	const GeometryAllocation& allocation = m_allocations[_handle];
+	assertMsgReturnValue(allocation.IsValid, "Geometry allocation not in use", VertexBufferComponent());
+
+	VertexBufferComponent vertexBufferComponent = m_pages[allocation.PageIndex]->VertexBuffer;
+	vertexBufferComponent.AllocationMemory = VK_NULL_HANDLE;	// owned by the page
+	vertexBufferComponent.Count = allocation.VertexCount;
+	vertexBufferComponent.FirstVertex = allocation.FirstVertex;
+
+	return vertexBufferComponent;
+}
+
+IndexBufferComponent GeometryArena::GetIndexBufferComponent(uint32 _handle) const
+{
+	const GeometryAllocation& allocation = m_allocations[_handle];
+	assertMsgReturnValue(allocation.IsValid && allocation.IndexCount > 0, "Geometry allocation not in use or without indices", IndexBufferComponent());
+
+	IndexBufferComponent indexBufferComponent = m_pages[allocation.PageIndex]->IndexBuffer;
+	indexBufferComponent.AllocationMemory = VK_NULL_HANDLE;	// owned by the page
+	indexBufferComponent.Count = allocation.IndexCount;
+	indexBufferComponent.FirstIndex = allocation.FirstIndex;
+	indexBufferComponent.VertexOffset = static_cast<int32>(allocation.FirstVertex);
+
+	return indexBufferComponent;
+}
+
+bool GeometryArena::IsDefragmentationNeeded() const
+{
+	for (const std::unique_ptr<Page>& page : m_pages)
+	{
+		if (page && (page->AllocationCount == 0 || IsPageFragmented(*page)))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool GeometryArena::Defragment()
+{
+	bool hasMoved = false;
+
+	// the frames in flight may still read the pages destroyed or compacted below, wait them once before touching any
+	vkQueueWaitIdle(m_device.GetGraphicsQueue());
+
+	for (uint32 pageIndex = 0; pageIndex < m_pages.size(); ++pageIndex)
+	{
+		if (!m_pages[pageIndex])
+		{
+			continue;
+		}
+
+		if (m_pages[pageIndex]->AllocationCount == 0)
+		{
+			DestroyPage(*m_pages[pageIndex]);
+			m_pages[pageIndex].reset();
+		}
+		else if (IsPageFragmented(*m_pages[pageIndex]))
+		{
+			CompactPage(pageIndex);
+			hasMoved = true;
+		}
+	}
+
+	// trailing empty slots are not needed to keep the indices of the pages in use
+	while (!m_pages.empty() && !m_pages.back())
+	{
+		m_pages.pop_back();
+	}
+
+	return hasMoved;
+}
+
+void GeometryArena::Cleanup()
+{
+	for (std::unique_ptr<Page>& page : m_pages)
+	{
+		if (page)
+		{
+			DestroyPage(*page);
+		}
+	}
+
+	m_pages.clear();
+	m_allocations.clear();
+	m_freeHandles.clear();
+}
+
+void GeometryArena::CreatePage(Page& _page, uint32 _vertexCount, uint32 _indexCount) const
+{
+	// transfer source as well, to be copied in a new page when compacted
+	_page.VertexBuffer = m_buffer->Create<VertexBufferComponent>(
+		sizeof(Vertex),
+		_vertexCount,
+		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+		0
+	);
+
+	_page.IndexBuffer = m_buffer->Create<IndexBufferComponent>(
+		sizeof(uint32),
+		_indexCount,
+		VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+		0
+	);
+
+	_page.Vertices.Reset(_vertexCount);
+	_page.Indices.Reset(_indexCount);
+	_page.AllocationCount = 0;
+}
+
+void GeometryArena::DestroyPage(Page& _page) const
+{
+	m_buffer->Destroy(_page.VertexBuffer);
+	m_buffer->Destroy(_page.IndexBuffer);
+
+	_page = Page{};
+}
+
+bool GeometryArena::IsPageFragmented(const Page& _page) const
+{
+	return _page.Vertices.GetFragmentation() > kDefragmentationThreshold || _page.Indices.GetFragmentation() > kDefragmentationThreshold;
+}
+
+void GeometryArena::CompactPage(uint32 _pageIndex)
+{
+	Page& oldPage = *m_pages[_pageIndex];
+
+	// vkCmdCopyBuffer does not allow overlapping regions, so the allocations are packed in a new page instead of in place
+	std::unique_ptr<Page> newPage = std::make_unique<Page>();
+	CreatePage(*newPage, oldPage.Vertices.GetCapacity(), oldPage.Indices.GetCapacity());
+
+	// keep the allocations in their current order, so the ones already packed at the beginning are copied to the same place
+	std::vector<uint32> handles;
+	handles.reserve(oldPage.AllocationCount);
+	for (uint32 handle = 0; handle < m_allocations.size(); ++handle)
+	{
+		if (m_allocations[handle].IsValid && m_allocations[handle].PageIndex == _pageIndex)
+		{
+			handles.push_back(handle);
+		}
+	}
+
+	std::sort(handles.begin(), handles.end(), [this](uint32 _a, uint32 _b) { return m_allocations[_a].FirstVertex < m_allocations[_b].FirstVertex; });
+
+	std::vector<VkBufferCopy> vertexRegions;
+	std::vector<VkBufferCopy> indexRegions;
+	vertexRegions.reserve(handles.size());
+	indexRegions.reserve(handles.size());
+
+	uint32 vertexCount = 0;
+	uint32 indexCount = 0;
+	for (uint32 handle : handles)
+	{
+		GeometryAllocation& allocation = m_allocations[handle];
+
+		VkBufferCopy& vertexRegion = vertexRegions.emplace_back();
+		vertexRegion.srcOffset = sizeof(Vertex) * allocation.FirstVertex;
+		vertexRegion.dstOffset = sizeof(Vertex) * vertexCount;
+		vertexRegion.size = sizeof(Vertex) * allocation.VertexCount;
+
+		allocation.FirstVertex = vertexCount;
+		vertexCount += allocation.VertexCount;
+
+		if (allocation.IndexCount > 0)
+		{
+			VkBufferCopy& indexRegion = indexRegions.emplace_back();
+			indexRegion.srcOffset = sizeof(uint32) * allocation.FirstIndex;
+			indexRegion.dstOffset = sizeof(uint32) * indexCount;
+			indexRegion.size = sizeof(uint32) * allocation.IndexCount;
+
+			allocation.FirstIndex = indexCount;
+			indexCount += allocation.IndexCount;
+		}
+	}
+
+	VkCommandBuffer commandBuffer = m_device.BeginSingleTimeCommands();
+
+	vkCmdCopyBuffer(commandBuffer, oldPage.VertexBuffer.Buffer, newPage->VertexBuffer.Buffer, static_cast<uint32>(vertexRegions.size()), vertexRegions.data());
+	if (!indexRegions.empty())
+	{
+		vkCmdCopyBuffer(commandBuffer, oldPage.IndexBuffer.Buffer, newPage->IndexBuffer.Buffer, static_cast<uint32>(indexRegions.size()), indexRegions.data());
+	}
+
+	// the single time command waits the graphics queue to be idle, so no frame is reading the old page anymore
+	m_device.EndSingleTimeCommands(commandBuffer);
+
+	newPage->Vertices.Reset(newPage->Vertices.GetCapacity(), vertexCount);
+	newPage->Indices.Reset(newPage->Indices.GetCapacity(), indexCount);
+	newPage->AllocationCount = oldPage.AllocationCount;
+
+	DestroyPage(oldPage);
+	m_pages[_pageIndex] = std::move(newPage);
+}
+
+VESPERENGINE_NAMESPACE_END
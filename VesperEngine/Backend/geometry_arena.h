@@ -0,0 +1,132 @@
+// Copyright (c) 2025-2025 Michele Condo'
+// File: C:\Projects\Vesper\VesperEngine\Backend\geometry_arena.h
+// Licensed under the MIT License. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include "Core/core_defines.h"
+
+#include "Components/graphics_components.h"
+
+#include "vulkan/vulkan.h"
+
+#include <vector>
+#include <map>
+#include <memory>
+
+
+VESPERENGINE_NAMESPACE_BEGIN
+
+class Device;
+class Buffer;
+
+struct Vertex;
+
+// Where a mesh lives inside the arena: draws use the ranges as firstVertex/vertexOffset and firstIndex
+struct GeometryAllocation
+{
+	uint32 PageIndex{ 0 };
+	uint32 FirstVertex{ 0 };
+	uint32 VertexCount{ 0 };
+	uint32 FirstIndex{ 0 };
+	uint32 IndexCount{ 0 };
+	bool IsValid{ false };
+};
+
+/**
+ * Few large device local vertex and index buffers (pages) shared by all the static meshes, sub-allocated with a first fit free list.
+ * Meshes in the same page share the same buffers, so consecutive draws bind them once and they can be merged in indirect and multi draws.
+ * Offsets and sizes are in elements (vertices and indices), not in bytes.
+ * Allocations are referenced by handle, because Defragment moves them: after it, the allocations must be read again.
+ * Uploads and defragmentation are executed within single time commands, so they wait the graphics queue to be idle and
+ * must not be called while a frame is being recorded.
+ */
+class VESPERENGINE_API GeometryArena final
+{
+public:
+	static constexpr uint32 kInvalidHandle = ~0u;
+	// a page is compacted when its fragmentation (1 - biggest free block / free space) is over it, for vertices or indices
+	static constexpr float kDefragmentationThreshold = 0.75f;
+
+public:
+	GeometryArena(Device& _device, uint32 _pageVertexCount, uint32 _pageIndexCount);
+	~GeometryArena() = default;
+
+	GeometryArena(const GeometryArena&) = delete;
+	GeometryArena& operator=(const GeometryArena&) = delete;
+
+public:
+	VESPERENGINE_INLINE uint32 GetPageCount() const { return static_cast<uint32>(m_pages.size()); }
+	VESPERENGINE_INLINE const GeometryAllocation& GetAllocation(uint32 _handle) const { return m_allocations[_handle]; }
+
+public:
+	// Upload the mesh in the first page having room for it, creating a new page if none has, and return its handle
+	uint32 Allocate(const std::vector<Vertex>& _vertices, const std::vector<uint32>& _indices);
+	void Free(uint32 _handle);
+
+	// Components referencing the allocation, Buffer is the page buffer so they must never be destroyed by the owner
+	VertexBufferComponent GetVertexBufferComponent(uint32 _handle) const;
+	IndexBufferComponent GetIndexBufferComponent(uint32 _handle) const;
+
+	// true if at least one page is fragmented over the threshold or is empty
+	bool IsDefragmentationNeeded() const;
+	// Compact the fragmented pages and destroy the empty ones, return true if any allocation moved.
+	// Waits the graphics queue to be idle first, so no frame in flight reads a page destroyed
+	bool Defragment();
+
+	// Call at the end or at destruction time, anyway after the game loop is done.
+	void Cleanup();
+
+private:
+	// First fit free list of element ranges, adjacent free ranges are merged when released
+	class RangeAllocator
+	{
+	public:
+		static constexpr uint32 kInvalidOffset = ~0u;
+
+	public:
+		void Reset(uint32 _capacity, uint32 _usedCount = 0);
+
+		uint32 Allocate(uint32 _count);
+		void Free(uint32 _offset, uint32 _count);
+
+		VESPERENGINE_INLINE uint32 GetCapacity() const { return m_capacity; }
+		VESPERENGINE_INLINE uint32 GetUsedCount() const { return m_usedCount; }
+
+		// 0 when the free space is all in one block, towards 1 the more it is split
+		float GetFragmentation() const;
+
+	private:
+		std::map<uint32, uint32> m_freeRanges;	// offset, count
+		uint32 m_capacity{ 0 };
+		uint32 m_usedCount{ 0 };
+	};
+
+	struct Page
+	{
+		VertexBufferComponent VertexBuffer{};
+		IndexBufferComponent IndexBuffer{};
+		RangeAllocator Vertices;
+		RangeAllocator Indices;
+		uint32 AllocationCount{ 0 };
+	};
+
+	void CreatePage(Page& _page, uint32 _vertexCount, uint32 _indexCount) const;
+	void DestroyPage(Page& _page) const;
+	bool IsPageFragmented(const Page& _page) const;
+	void CompactPage(uint32 _pageIndex);
+
+private:
+	Device& m_device;
+	std::unique_ptr<Buffer> m_buffer;
+
+	std::vector<std::unique_ptr<Page>> m_pages;		// pointers, so a page can be destroyed without moving the other ones
+
+	std::vector<GeometryAllocation> m_allocations;
+	std::vector<uint32> m_freeHandles;
+
+	uint32 m_pageVertexCount{ 0 };
+	uint32 m_pageIndexCount{ 0 };
+};
+
+VESPERENGINE_NAMESPACE_END
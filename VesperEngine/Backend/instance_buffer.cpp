@@ -0,0 +1,93 @@
+// Copyright (c) 2025-2025 Michele Condo'
+// File: C:\Projects\Vesper\VesperEngine\Backend\instance_buffer.cpp
+// Licensed under the MIT License. See LICENSE file in the project root for full license information.
+
+#include "Systems/uniform_buffer.h"			// NOTE: dependency forced, compiler need to know the size of the InstanceData used here first
+#include "Backend/instance_buffer.h"
+
+#include "Backend/buffer.h"
+#include "Backend/swap_chain.h"
+#include "Backend/device.h"
+#include "Backend/renderer.h"
+
+#include "Components/graphics_components.h"
+
+#include "Core/memory_copy.h"
+
+
+VESPERENGINE_NAMESPACE_BEGIN
+
+InstanceBuffer::InstanceBuffer(Device& _device, Renderer& _renderer, uint32 _maxInstanceCount)
+	: m_device(_device)
+	, m_renderer(_renderer)
+	, m_maxInstanceCount(_maxInstanceCount)
+{
+	m_buffer = std::make_unique<Buffer>(m_device);
+
+	m_instanceSetLayout = DescriptorSetLayout::Builder(m_device)
+		.AddBinding(kInstanceBindingIndex, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT)
+		.Build();
+
+	m_instanceBuffers.resize(SwapChain::kMaxFramesInFlight);
+	m_instanceDescriptorSets.resize(SwapChain::kMaxFramesInFlight);
+	m_mappedMemory.resize(SwapChain::kMaxFramesInFlight, nullptr);
+
+	for (int32 i = 0; i < SwapChain::kMaxFramesInFlight; ++i)
+	{
+		m_instanceBuffers[i] = m_buffer->Create<BufferComponent>(
+			sizeof(InstanceData),
+			m_maxInstanceCount,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
+			VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
+			/*minUboAlignment*/1,
+			true
+		);
+
+		m_mappedMemory[i] = static_cast<uint8*>(m_buffer->GetMappedMemory(m_instanceBuffers[i]));
+
+		// the whole buffer is visible to the shader, not only the first element
+		VkDescriptorBufferInfo bufferInfo;
+		bufferInfo.buffer = m_instanceBuffers[i].Buffer;
+		bufferInfo.offset = 0;
+		bufferInfo.range = VK_WHOLE_SIZE;
+
+		DescriptorWriter(*m_instanceSetLayout, *m_renderer.GetDescriptorPool())
+			.WriteBuffer(kInstanceBindingIndex, &bufferInfo)
+			.Build(m_instanceDescriptorSets[i]);
+	}
+}
+
+uint32 InstanceBuffer::Push(const int32 _frameIndex, const InstanceData& _instanceData)
+{
+	assertMsgReturnValue(m_instanceCount < m_maxInstanceCount, "Instance buffer is full", m_instanceCount);
+
+	MemCpy(m_mappedMemory[_frameIndex] + static_cast<std::size_t>(m_instanceCount) * sizeof(InstanceData), &_instanceData, sizeof(InstanceData));
+
+	return m_instanceCount++;
+}
+
+void InstanceBuffer::Write(const int32 _frameIndex, uint32 _firstIndex, const InstanceData* _instanceData, uint32 _count)
+{
+	assertMsgReturnVoid(_firstIndex + _count <= m_maxInstanceCount, "Instance buffer is full");
+
+	MemCpy(m_mappedMemory[_frameIndex] + static_cast<std::size_t>(_firstIndex) * sizeof(InstanceData), _instanceData, static_cast<std::size_t>(_count) * sizeof(InstanceData));
+}
+
+VkBuffer InstanceBuffer::GetBuffer(const int32 _frameIndex) const
+{
+	return m_instanceBuffers[_frameIndex].Buffer;
+}
+
+void InstanceBuffer::Cleanup()
+{
+	for (int32 i = 0; i < SwapChain::kMaxFramesInFlight; ++i)
+	{
+		m_buffer->Destroy(m_instanceBuffers[i]);
+	}
+
+	m_mappedMemory.clear();
+	m_instanceCount = 0;
+}
+
+VESPERENGINE_NAMESPACE_END
@@ -0,0 +1,80 @@
+// Copyright (c) 2025-2025 Michele Condo'
+// File: C:\Projects\Vesper\VesperEngine\Backend\instance_buffer.h
+// Licensed under the MIT License. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include "Core/core_defines.h"
+
+#include "Backend/descriptors.h"
+
+#include "vulkan/vulkan.h"
+
+#include <vector>
+#include <memory>
+
+
+VESPERENGINE_NAMESPACE_BEGIN
+
+class Device;
+class Renderer;
+class Buffer;
+
+struct BufferComponent;
+struct InstanceData;
+
+/**
+ * Per frame storage buffer holding the InstanceData of the instanced draws.
+ * Instances are appended one after the other during the frame: the index returned by Push of the first instance
+ * of a batch is the firstInstance of its draw, so the vertex shader can read its entry through gl_InstanceIndex.
+ * The resident instances of the GPU culling are written instead at their own index, only when they change.
+ * The buffers are persistently mapped and sized once for the worst case (every entity drawn instanced).
+ */
+class VESPERENGINE_API InstanceBuffer final
+{
+public:
+	static constexpr uint32 kInstanceBindingIndex = 0u;
+
+public:
+	InstanceBuffer(Device& _device, Renderer& _renderer, uint32 _maxInstanceCount);
+	~InstanceBuffer() = default;
+
+	InstanceBuffer(const InstanceBuffer&) = delete;
+	InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+
+public:
+	VESPERENGINE_INLINE VkDescriptorSetLayout GetDescriptorSetLayout() const { return m_instanceSetLayout->GetDescriptorSetLayout(); }
+	VESPERENGINE_INLINE VkDescriptorSet GetDescriptorSet(const int32 _frameIndex) const { return m_instanceDescriptorSets[_frameIndex]; }
+
+	VESPERENGINE_INLINE uint32 GetInstanceCount() const { return m_instanceCount; }
+	VESPERENGINE_INLINE uint32 GetMaxInstanceCount() const { return m_maxInstanceCount; }
+
+	// Call once per frame, before pushing the first instance
+	VESPERENGINE_INLINE void Reset() { m_instanceCount = 0; }
+
+public:
+	// Copy the instance at the end of the frame buffer and return its index
+	uint32 Push(const int32 _frameIndex, const InstanceData& _instanceData);
+	// Copy _count instances from _firstIndex on, the pushed ones are not counted
+	void Write(const int32 _frameIndex, uint32 _firstIndex, const InstanceData* _instanceData, uint32 _count);
+	// The buffer of the frame, to bind it in other descriptor sets (i.e. compute culling)
+	VkBuffer GetBuffer(const int32 _frameIndex) const;
+	// Call at the end or at destruction time, anyway after the game loop is done.
+	void Cleanup();
+
+private:
+	Device& m_device;
+	Renderer& m_renderer;
+
+	std::unique_ptr<DescriptorSetLayout> m_instanceSetLayout;
+	std::unique_ptr<Buffer> m_buffer;
+
+	std::vector<BufferComponent> m_instanceBuffers;
+	std::vector<VkDescriptorSet> m_instanceDescriptorSets;
+	std::vector<uint8*> m_mappedMemory;		// per frame, persistent mapping cached at creation
+
+	uint32 m_maxInstanceCount{ 0 };
+	uint32 m_instanceCount{ 0 };
+};
+
+VESPERENGINE_NAMESPACE_END
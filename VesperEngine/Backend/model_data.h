@@ -72,6 +72,8 @@ struct MaterialData
 	int32 Index{ -1 };
 	bool IsTransparent{ false };
 	bool IsDoubleSided{ false };
+	bool IsAlphaTested{ false };	// PBR with an AlphaCutoff, the fragment stage discards
+	uint32 FeatureMask{ kPBRFeatureAll };	// PBR, the kPBRFeature bits of the textures set and of the alpha test
 	MaterialType Type;
 };
 
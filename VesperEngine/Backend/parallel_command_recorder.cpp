@@ -0,0 +1,210 @@
+// Copyright (c) 2025-2025 Michele Condo'
+// File: C:\Projects\Vesper\VesperEngine\Backend\parallel_command_recorder.cpp
+// Licensed under the MIT License. See LICENSE file in the project root for full license information.
+
+#include "Backend/parallel_command_recorder.h"
+#include "Backend/device.h"
+#include "Backend/swap_chain.h"
+
+#include <stdexcept>
+
+
+VESPERENGINE_NAMESPACE_BEGIN
+
+ParallelCommandRecorder::ParallelCommandRecorder(Device& _device, uint32 _workerCount)
+	: m_device{ _device }
+{
+	assertMsgReturnVoid(_workerCount > 0, "ParallelCommandRecorder needs at least one worker");
+
+	QueueFamilyIndices queueFamilyIndices = m_device.FindPhysicalQueueFamilies();
+
+	VkCommandPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.queueFamilyIndex = queueFamilyIndices.GraphicsFamily;
+	// the whole pool is reset every frame, so no VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+	m_frameData.resize(_workerCount);
+	for (uint32 worker = 0; worker < _workerCount; ++worker)
+	{
+		m_frameData[worker].resize(SwapChain::kMaxFramesInFlight);
+		for (int32 frame = 0; frame < SwapChain::kMaxFramesInFlight; ++frame)
+		{
+			if (vkCreateCommandPool(m_device.GetDevice(), &poolInfo, nullptr, &m_frameData[worker][frame].CommandPool) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to create worker command pool!");
+			}
+		}
+	}
+
+	m_workers.reserve(_workerCount);
+	for (uint32 worker = 0; worker < _workerCount; ++worker)
+	{
+		m_workers.emplace_back(&ParallelCommandRecorder::WorkerLoop, this, worker);
+	}
+}
+
+ParallelCommandRecorder::~ParallelCommandRecorder()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_isStopping = true;
+	}
+	m_workAvailable.notify_all();
+
+	for (std::thread& worker : m_workers)
+	{
+		worker.join();
+	}
+
+	// destroying the pool frees its command buffers as well
+	for (std::vector<WorkerFrameData>& workerFrames : m_frameData)
+	{
+		for (WorkerFrameData& frameData : workerFrames)
+		{
+			vkDestroyCommandPool(m_device.GetDevice(), frameData.CommandPool, nullptr);
+		}
+	}
+}
+
+void ParallelCommandRecorder::BeginFrame(const int32 _frameIndex)
+{
+	for (std::vector<WorkerFrameData>& workerFrames : m_frameData)
+	{
+		WorkerFrameData& frameData = workerFrames[_frameIndex];
+		vkResetCommandPool(m_device.GetDevice(), frameData.CommandPool, 0);
+		frameData.UsedCount = 0;
+	}
+}
+
+void ParallelCommandRecorder::Record(const int32 _frameIndex, const VkCommandBufferInheritanceInfo& _inheritanceInfo, const VkViewport& _viewport, const VkRect2D& _scissor,
+	const std::vector<RecordTask>& _tasks, std::vector<VkCommandBuffer>& _outCommandBuffers)
+{
+	_outCommandBuffers.assign(_tasks.size(), VK_NULL_HANDLE);
+	if (_tasks.empty())
+	{
+		return;
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+
+		m_tasks = &_tasks;
+		m_commandBuffers = &_outCommandBuffers;
+		m_inheritanceInfo = &_inheritanceInfo;
+		m_viewport = _viewport;
+		m_scissor = _scissor;
+		m_frameIndex = _frameIndex;
+		m_exception = nullptr;
+		m_pendingWorkers = static_cast<uint32>(m_workers.size());
+		++m_jobGeneration;
+
+		m_workAvailable.notify_all();
+		m_workDone.wait(lock, [this]() { return m_pendingWorkers == 0; });
+
+		m_tasks = nullptr;
+		m_commandBuffers = nullptr;
+		m_inheritanceInfo = nullptr;
+	}
+
+	if (m_exception)
+	{
+		std::rethrow_exception(m_exception);
+	}
+}
+
+void ParallelCommandRecorder::WorkerLoop(uint32 _workerIndex)
+{
+	uint64 lastGeneration = 0;
+
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_workAvailable.wait(lock, [this, lastGeneration]() { return m_isStopping || m_jobGeneration != lastGeneration; });
+
+			if (m_isStopping)
+			{
+				return;
+			}
+
+			lastGeneration = m_jobGeneration;
+		}
+
+		try
+		{
+			RecordTasks(_workerIndex);
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_exception = std::current_exception();
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			--m_pendingWorkers;
+		}
+		m_workDone.notify_one();
+	}
+}
+
+void ParallelCommandRecorder::RecordTasks(uint32 _workerIndex)
+{
+	const uint32 workerCount = static_cast<uint32>(m_workers.size());
+	const uint32 taskCount = static_cast<uint32>(m_tasks->size());
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	beginInfo.pInheritanceInfo = m_inheritanceInfo;
+
+	// every worker writes only its own slots of the output, no need to lock
+	for (uint32 taskIndex = _workerIndex; taskIndex < taskCount; taskIndex += workerCount)
+	{
+		VkCommandBuffer commandBuffer = AcquireCommandBuffer(_workerIndex);
+
+		if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to begin recording secondary command buffer!");
+		}
+
+		vkCmdSetViewport(commandBuffer, 0, 1, &m_viewport);
+		vkCmdSetScissor(commandBuffer, 0, 1, &m_scissor);
+
+		(*m_tasks)[taskIndex](commandBuffer);
+
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to record secondary command buffer!");
+		}
+
+		(*m_commandBuffers)[taskIndex] = commandBuffer;
+	}
+}
+
+VkCommandBuffer ParallelCommandRecorder::AcquireCommandBuffer(uint32 _workerIndex)
+{
+	WorkerFrameData& frameData = m_frameData[_workerIndex][m_frameIndex];
+
+	if (frameData.UsedCount == frameData.CommandBuffers.size())
+	{
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		allocInfo.commandPool = frameData.CommandPool;
+		allocInfo.commandBufferCount = 1;
+
+		VkCommandBuffer commandBuffer;
+		if (vkAllocateCommandBuffers(m_device.GetDevice(), &allocInfo, &commandBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate secondary command buffer!");
+		}
+
+		frameData.CommandBuffers.push_back(commandBuffer);
+	}
+
+	return frameData.CommandBuffers[frameData.UsedCount++];
+}
+
+VESPERENGINE_NAMESPACE_END
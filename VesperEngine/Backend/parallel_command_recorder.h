@@ -0,0 +1,89 @@
+// Copyright (c) 2025-2025 Michele Condo'
+// File: C:\Projects\Vesper\VesperEngine\Backend\parallel_command_recorder.h
+// Licensed under the MIT License. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include "Core/core_defines.h"
+
+#include "vulkan/vulkan.h"
+
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+
+VESPERENGINE_NAMESPACE_BEGIN
+
+class Device;
+
+/**
+ * Records render pass content in secondary command buffers on a set of worker threads.
+ * Command pools are not thread safe, so every worker owns one pool per frame in flight: the pools of a frame are reset
+ * all together at the beginning of the frame, when the fence of the frame guarantees the GPU is done with them.
+ * Tasks are assigned to the workers round robin, each one in its own secondary command buffer, and the command buffers
+ * are returned in the same order of the tasks, so the primary executes them in the order they were submitted.
+ */
+class VESPERENGINE_API ParallelCommandRecorder final
+{
+public:
+	using RecordTask = std::function<void(VkCommandBuffer)>;
+
+public:
+	ParallelCommandRecorder(Device& _device, uint32 _workerCount);
+	~ParallelCommandRecorder();
+
+	ParallelCommandRecorder(const ParallelCommandRecorder&) = delete;
+	ParallelCommandRecorder& operator=(const ParallelCommandRecorder&) = delete;
+
+public:
+	VESPERENGINE_INLINE uint32 GetWorkerCount() const { return static_cast<uint32>(m_workers.size()); }
+
+public:
+	// Call once per frame, after the fence of the frame has been waited
+	void BeginFrame(const int32 _frameIndex);
+	// Record every task in a secondary command buffer continuing the render pass in _inheritanceInfo, blocking until all of them are done.
+	// Viewport and scissor are not inherited, so they are set at the beginning of every secondary command buffer
+	void Record(const int32 _frameIndex, const VkCommandBufferInheritanceInfo& _inheritanceInfo, const VkViewport& _viewport, const VkRect2D& _scissor,
+		const std::vector<RecordTask>& _tasks, std::vector<VkCommandBuffer>& _outCommandBuffers);
+
+private:
+	struct WorkerFrameData
+	{
+		VkCommandPool CommandPool{ VK_NULL_HANDLE };
+		std::vector<VkCommandBuffer> CommandBuffers;	// allocated on demand and kept for the next frames
+		uint32 UsedCount{ 0 };
+	};
+
+	void WorkerLoop(uint32 _workerIndex);
+	void RecordTasks(uint32 _workerIndex);
+	VkCommandBuffer AcquireCommandBuffer(uint32 _workerIndex);
+
+private:
+	Device& m_device;
+
+	std::vector<std::thread> m_workers;
+	std::vector<std::vector<WorkerFrameData>> m_frameData;	// [worker][frame]
+
+	std::mutex m_mutex;
+	std::condition_variable m_workAvailable;
+	std::condition_variable m_workDone;
+
+	// current job, valid between the notification of m_workAvailable and the one of m_workDone
+	const std::vector<RecordTask>* m_tasks{ nullptr };
+	std::vector<VkCommandBuffer>* m_commandBuffers{ nullptr };
+	const VkCommandBufferInheritanceInfo* m_inheritanceInfo{ nullptr };
+	VkViewport m_viewport{};
+	VkRect2D m_scissor{};
+	int32 m_frameIndex{ 0 };
+
+	std::exception_ptr m_exception;
+	uint64 m_jobGeneration{ 0 };
+	uint32 m_pendingWorkers{ 0 };
+	bool m_isStopping{ false };
+};
+
+VESPERENGINE_NAMESPACE_END
@@ -5,9 +5,9 @@
 #include "Backend/pipeline.h"
 #include "Backend/model_data.h"
 #include "Backend/device.h"
+#include "Backend/shader_module_cache.h"
 
 #include <stdexcept>
-#include <fstream>
 
 
 VESPERENGINE_NAMESPACE_BEGIN
@@ -19,6 +19,32 @@ struct SpecializationData
 	std::vector<uint8_t> DataBuffer;
 };
 
+static void FillSpecializationData(const ShaderInfo& _shaderInfo, SpecializationData& _outSpecializationData)
+{
+	_outSpecializationData.MapEntries.resize(_shaderInfo.SpecializationConstants.size());
+
+	uint32 offset = 0;
+	_outSpecializationData.DataBuffer.clear();
+
+	for (size_t j = 0; j < _shaderInfo.SpecializationConstants.size(); ++j)
+	{
+		const auto& specConst = _shaderInfo.SpecializationConstants[j];
+
+		VkSpecializationMapEntry& entry = _outSpecializationData.MapEntries[j];
+		entry.constantID = specConst.ID;
+		entry.offset = offset;
+		entry.size = specConst.Value.size();
+
+		_outSpecializationData.DataBuffer.insert(_outSpecializationData.DataBuffer.end(), specConst.Value.begin(), specConst.Value.end());
+		offset += static_cast<uint32>(specConst.Value.size());
+	}
+
+	_outSpecializationData.SpecializationInfo.mapEntryCount = static_cast<uint32>(_outSpecializationData.MapEntries.size());
+	_outSpecializationData.SpecializationInfo.pMapEntries = _outSpecializationData.MapEntries.data();
+	_outSpecializationData.SpecializationInfo.dataSize = _outSpecializationData.DataBuffer.size();
+	_outSpecializationData.SpecializationInfo.pData = _outSpecializationData.DataBuffer.data();
+}
+
 void Pipeline::DefaultPipelineConfiguration(PipelineConfigInfo& _outConfigInfo)
 {
 	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -152,6 +178,22 @@ void Pipeline::OpaquePipelineConfiguration(PipelineConfigInfo& _outConfigInfo)
 	_outConfigInfo.ColorBlendAttachment.blendEnable = VK_FALSE;  // No blending
 }
 
+// Lays down the depth of the solid objects before they are shaded, with the same vertex stage and no fragment shader.
+// The subpass still has its color attachments, nothing is written in them.
+void Pipeline::DepthPrepassPipelineConfiguration(PipelineConfigInfo& _outConfigInfo)
+{
+	Pipeline::OpaquePipelineConfiguration(_outConfigInfo);
+	_outConfigInfo.ColorBlendAttachment.colorWriteMask = 0;
+}
+
+// Shades the solid objects over the depth of the prepass: only the nearest fragment passes, so every pixel is shaded once.
+void Pipeline::DepthEqualOpaquePipelineConfiguration(PipelineConfigInfo& _outConfigInfo)
+{
+	Pipeline::OpaquePipelineConfiguration(_outConfigInfo);
+	_outConfigInfo.DepthStencilInfo.depthWriteEnable = VK_FALSE;
+	_outConfigInfo.DepthStencilInfo.depthCompareOp = VK_COMPARE_OP_EQUAL;
+}
+
 // Renders objects with transparency.
 void Pipeline::TransparentPipelineConfiguration(PipelineConfigInfo& _outConfigInfo)
 {
@@ -170,6 +212,38 @@ void Pipeline::TransparentPipelineConfiguration(PipelineConfigInfo& _outConfigIn
 	_outConfigInfo.ColorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
 }
 
+// Renders objects with transparency into the weighted blended OIT targets, so no sorting is required.
+// Attachment 0 is the accumulation (RGBA16F), summed as is; attachment 1 is the revealage (R16F), multiplied by (1 - alpha).
+void Pipeline::WeightedBlendedTransparentPipelineConfiguration(PipelineConfigInfo& _outConfigInfo)
+{
+	Pipeline::DefaultPipelineConfiguration(_outConfigInfo);
+	_outConfigInfo.RasterizationInfo.cullMode = VK_CULL_MODE_NONE;
+	_outConfigInfo.DepthStencilInfo.depthTestEnable = VK_TRUE;
+	_outConfigInfo.DepthStencilInfo.depthWriteEnable = VK_FALSE;  // Avoid depth overwrites
+	_outConfigInfo.DepthStencilInfo.depthCompareOp = VK_COMPARE_OP_LESS;
+
+	VkPipelineColorBlendAttachmentState accumulation = _outConfigInfo.ColorBlendAttachment;
+	accumulation.blendEnable = VK_TRUE;
+	accumulation.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+	accumulation.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+	accumulation.colorBlendOp = VK_BLEND_OP_ADD;
+	accumulation.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	accumulation.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	accumulation.alphaBlendOp = VK_BLEND_OP_ADD;
+
+	VkPipelineColorBlendAttachmentState revealage = _outConfigInfo.ColorBlendAttachment;
+	revealage.colorWriteMask = VK_COLOR_COMPONENT_R_BIT;
+	revealage.blendEnable = VK_TRUE;
+	revealage.srcColorBlendFactor = VK_BLEND_FACTOR_ZERO;
+	revealage.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_COLOR;
+	revealage.colorBlendOp = VK_BLEND_OP_ADD;
+	revealage.srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+	revealage.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+	revealage.alphaBlendOp = VK_BLEND_OP_ADD;
+
+	_outConfigInfo.ColorBlendAttachments = { accumulation, revealage };
+}
+
 // Renders depth information to a shadow map.
 void Pipeline::ShadowPipelineConfig(PipelineConfigInfo& _outConfigInfo)
 {
@@ -178,9 +252,22 @@ void Pipeline::ShadowPipelineConfig(PipelineConfigInfo& _outConfigInfo)
 	_outConfigInfo.DepthStencilInfo.depthWriteEnable = VK_TRUE;
 	_outConfigInfo.DepthStencilInfo.depthCompareOp = VK_COMPARE_OP_LESS;
 
-	_outConfigInfo.ColorBlendAttachment.colorWriteMask = 0;  // Disable color writes
+	// Depth only render pass, no color attachment to write
+	_outConfigInfo.ColorBlendAttachment.colorWriteMask = 0;
 	_outConfigInfo.ColorBlendAttachment.blendEnable = VK_FALSE;
-	_outConfigInfo.RasterizationInfo.cullMode = VK_CULL_MODE_FRONT_BIT;  // Cull front faces for directional lights
+	_outConfigInfo.ColorBlendInfo.attachmentCount = 0;
+	_outConfigInfo.ColorBlendInfo.pAttachments = nullptr;
+
+	// Both faces cast, so open meshes do too: the acne is kept away by the depth bias, scaled by the slope of the triangle as seen by the light
+	_outConfigInfo.RasterizationInfo.cullMode = VK_CULL_MODE_NONE;
+	_outConfigInfo.RasterizationInfo.depthBiasEnable = VK_TRUE;
+	_outConfigInfo.RasterizationInfo.depthBiasConstantFactor = 1.25f;
+	_outConfigInfo.RasterizationInfo.depthBiasClamp = 0.0f;
+	_outConfigInfo.RasterizationInfo.depthBiasSlopeFactor = 1.75f;
+
+	// Only the position is read
+	_outConfigInfo.AttributeDescriptions.clear();
+	_outConfigInfo.AttributeDescriptions.push_back({ 0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, Position) });
 }
 
 // Applies post-process effects to the rendered image.
@@ -319,19 +406,26 @@ Pipeline::Pipeline(Device& _device, const std::vector<ShaderInfo>& _shadersInfo,
 	CreateGraphicsPipeline(_shadersInfo, _configInfo);
 }
 
+Pipeline::Pipeline(Device& _device, const ShaderInfo& _computeShaderInfo, VkPipelineLayout _pipelineLayout)
+	: m_device{ _device }
+	, m_bindPoint{ VK_PIPELINE_BIND_POINT_COMPUTE }
+{
+	CreateComputePipeline(_computeShaderInfo, _pipelineLayout);
+}
+
 Pipeline::~Pipeline()
 {
 	for (const VkShaderModule& shaderModule : m_shaderModules)
 	{
-		vkDestroyShaderModule(m_device.GetDevice(), shaderModule, nullptr);
+		m_device.GetShaderModuleCache().Release(shaderModule);
 	}
 	vkDestroyPipeline(m_device.GetDevice(), m_graphicPipeline, nullptr);
 }
 
 void Pipeline::Bind(VkCommandBuffer _commandBuffer)
 {
-	// VK_PIPELINE_BIND_POINT_GRAPHICS signal is a graphic pipeline (other are compute and ray tracing)
-	vkCmdBindPipeline(_commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicPipeline);
+	// VK_PIPELINE_BIND_POINT_GRAPHICS signal is a graphic pipeline, VK_PIPELINE_BIND_POINT_COMPUTE a compute one (other is ray tracing)
+	vkCmdBindPipeline(_commandBuffer, m_bindPoint, m_graphicPipeline);
 
 	// TODO: This break Skybox!
 	// fallback, to avoid validation error, since is expecting culling to be dynamic (for now)
@@ -342,26 +436,6 @@ void Pipeline::Bind(VkCommandBuffer _commandBuffer)
 	//vkCmdSetBlendConstants(_commandBuffer, blendConstants);       // if blending is dynamic
 }
 
-std::vector<int8> Pipeline::ReadFile(const std::string& _filepath)
-{
-	std::ifstream file { _filepath, std::ios::ate | std::ios::binary };
-
-	if (!file.is_open())
-	{
-		throw std::runtime_error("failed to open file: " + _filepath + "!");
-	}
-
-	std::size_t fileSize = static_cast<std::size_t>(file.tellg());
-	std::vector<int8> buffer(fileSize);
-
-	file.seekg(0);
-	file.read(buffer.data(), fileSize);
-
-	file.close();
-
-	return buffer;
-}
-
 VkShaderStageFlagBits Pipeline::ConvertShaderTypeToShaderFlag(ShaderType _type) const
 {
 	switch (_type)
@@ -371,6 +445,7 @@ VkShaderStageFlagBits Pipeline::ConvertShaderTypeToShaderFlag(ShaderType _type)
 	case vesper::ShaderType::TessellationControl:		return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
 	case vesper::ShaderType::Geometry:					return VK_SHADER_STAGE_GEOMETRY_BIT;
 	case vesper::ShaderType::Fragment:					return VK_SHADER_STAGE_FRAGMENT_BIT;
+	case vesper::ShaderType::Compute:					return VK_SHADER_STAGE_COMPUTE_BIT;
 	default:											return VK_SHADER_STAGE_FLAG_BITS_MAX_ENUM;
 	}
 }
@@ -394,9 +469,7 @@ void Pipeline::CreateGraphicsPipeline(const std::vector<ShaderInfo>& _shadersInf
 	{
 		const ShaderInfo& shaderInfo = _shadersInfo[i];
 
-		auto shader = ReadFile(shaderInfo.Filepath);
-
-		CreateShaderModule(shader, &m_shaderModules[i]);
+		m_shaderModules[i] = m_device.GetShaderModuleCache().Acquire(shaderInfo.Filepath);
 
 		shaderStages[i].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 		shaderStages[i].stage = ConvertShaderTypeToShaderFlag(shaderInfo.Type);
@@ -408,29 +481,7 @@ void Pipeline::CreateGraphicsPipeline(const std::vector<ShaderInfo>& _shadersInf
 		if (!shaderInfo.SpecializationConstants.empty())
 		{
 			SpecializationData& specData = specializationDatas[i];
-
-			specData.MapEntries.resize(shaderInfo.SpecializationConstants.size());
-
-			uint32 offset = 0;
-			specData.DataBuffer.clear();
-
-			for (size_t j = 0; j < shaderInfo.SpecializationConstants.size(); ++j)
-			{
-				const auto& specConst = shaderInfo.SpecializationConstants[j];
-
-				VkSpecializationMapEntry& entry = specData.MapEntries[j];
-				entry.constantID = specConst.ID;
-				entry.offset = offset;
-				entry.size = specConst.Value.size();
-
-				specData.DataBuffer.insert(specData.DataBuffer.end(), specConst.Value.begin(), specConst.Value.end());
-				offset += static_cast<uint32>(specConst.Value.size());
-			}
-
-			specData.SpecializationInfo.mapEntryCount = static_cast<uint32>(specData.MapEntries.size());
-			specData.SpecializationInfo.pMapEntries = specData.MapEntries.data();
-			specData.SpecializationInfo.dataSize = specData.DataBuffer.size();
-			specData.SpecializationInfo.pData = specData.DataBuffer.data();
+			FillSpecializationData(shaderInfo, specData);
 
 			shaderStages[i].pSpecializationInfo = &specData.SpecializationInfo;
 		}
@@ -460,7 +511,15 @@ void Pipeline::CreateGraphicsPipeline(const std::vector<ShaderInfo>& _shadersInf
 	pipelineInfo.pRasterizationState = &_configInfo.RasterizationInfo;
 	pipelineInfo.pMultisampleState = &_configInfo.MultisampleInfo;
 
-	pipelineInfo.pColorBlendState = &_configInfo.ColorBlendInfo;
+	// the config info cannot be copied and it is const here, so when multiple attachments are used a local blend state points to them
+	VkPipelineColorBlendStateCreateInfo colorBlendInfo = _configInfo.ColorBlendInfo;
+	if (!_configInfo.ColorBlendAttachments.empty())
+	{
+		colorBlendInfo.attachmentCount = static_cast<uint32>(_configInfo.ColorBlendAttachments.size());
+		colorBlendInfo.pAttachments = _configInfo.ColorBlendAttachments.data();
+	}
+
+	pipelineInfo.pColorBlendState = &colorBlendInfo;
 	pipelineInfo.pDepthStencilState = &_configInfo.DepthStencilInfo;
 	pipelineInfo.pDynamicState = &_configInfo.DynamicStateInfo;
 
@@ -473,22 +532,51 @@ void Pipeline::CreateGraphicsPipeline(const std::vector<ShaderInfo>& _shadersInf
 	pipelineInfo.basePipelineIndex = -1;
 	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-	if (vkCreateGraphicsPipelines(m_device.GetDevice(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_graphicPipeline) != VK_SUCCESS)
+	if (vkCreateGraphicsPipelines(m_device.GetDevice(), m_device.GetPipelineCache(), 1, &pipelineInfo, nullptr, &m_graphicPipeline) != VK_SUCCESS)
 	{
 		throw std::runtime_error("failed to create the graphic pipeline");
 	}
 }
 
-void Pipeline::CreateShaderModule(const std::vector<int8>& _buffer, VkShaderModule* _shaderModule)
+void Pipeline::CreateComputePipeline(const ShaderInfo& _computeShaderInfo, VkPipelineLayout _pipelineLayout)
 {
-	VkShaderModuleCreateInfo createInfo{};
-	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	createInfo.codeSize = _buffer.size();
-	createInfo.pCode =  reinterpret_cast<const uint32*>(_buffer.data());
+	assertMsgReturnVoid(_pipelineLayout != VK_NULL_HANDLE, "Cannot create compute pipeline: No PipelineLayout passed");
+	assertMsgReturnVoid(_computeShaderInfo.Type == ShaderType::Compute, "Cannot create compute pipeline: the shader is not a compute shader");
+
+	m_shaderModules.resize(1);
+
+	m_shaderModules[0] = m_device.GetShaderModuleCache().Acquire(_computeShaderInfo.Filepath);
+
+	SpecializationData specData;
+
+	VkPipelineShaderStageCreateInfo shaderStage{};
+	shaderStage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	shaderStage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	shaderStage.module = m_shaderModules[0];
+	shaderStage.pName = "main";
+	shaderStage.flags = 0;
+	shaderStage.pNext = nullptr;
+
+	if (!_computeShaderInfo.SpecializationConstants.empty())
+	{
+		FillSpecializationData(_computeShaderInfo, specData);
+		shaderStage.pSpecializationInfo = &specData.SpecializationInfo;
+	}
+	else
+	{
+		shaderStage.pSpecializationInfo = nullptr;
+	}
+
+	VkComputePipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage = shaderStage;
+	pipelineInfo.layout = _pipelineLayout;
+	pipelineInfo.basePipelineIndex = -1;
+	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-	if (vkCreateShaderModule(m_device.GetDevice(), &createInfo, nullptr, _shaderModule) != VK_SUCCESS)
+	if (vkCreateComputePipelines(m_device.GetDevice(), m_device.GetPipelineCache(), 1, &pipelineInfo, nullptr, &m_graphicPipeline) != VK_SUCCESS)
 	{
-		throw std::runtime_error("failed to create shader module!");
+		throw std::runtime_error("failed to create the compute pipeline");
 	}
 }
 
@@ -29,6 +29,8 @@ struct PipelineConfigInfo
 	VkPipelineRasterizationStateCreateInfo RasterizationInfo;
 	VkPipelineMultisampleStateCreateInfo MultisampleInfo;
 	VkPipelineColorBlendAttachmentState ColorBlendAttachment;
+	// when filled, it replaces ColorBlendAttachment, one entry per color attachment of the subpass (i.e. the OIT accumulation and revealage targets)
+	std::vector<VkPipelineColorBlendAttachmentState> ColorBlendAttachments{};
 	VkPipelineColorBlendStateCreateInfo ColorBlendInfo;
 	VkPipelineDepthStencilStateCreateInfo DepthStencilInfo;
 
@@ -46,7 +48,8 @@ enum class ShaderType : uint8
 	TessellationEvaluation,
 	TessellationControl,
 	Geometry,
-	Fragment
+	Fragment,
+	Compute
 };
 
 struct SpecializationConstant 
@@ -89,7 +92,10 @@ public:
 
 	// Core pipelines
 	static void OpaquePipelineConfiguration(PipelineConfigInfo& _outConfigInfo);
+	static void DepthPrepassPipelineConfiguration(PipelineConfigInfo& _outConfigInfo);
+	static void DepthEqualOpaquePipelineConfiguration(PipelineConfigInfo& _outConfigInfo);
 	static void TransparentPipelineConfiguration(PipelineConfigInfo& _outConfigInfo);
+	static void WeightedBlendedTransparentPipelineConfiguration(PipelineConfigInfo& _outConfigInfo);
 	static void ShadowPipelineConfig(PipelineConfigInfo& _outConfigInfo);
 	static void PostProcessingPipelineConfig(PipelineConfigInfo& _outConfigInfo);
 	static void SkyboxPipelineConfig(PipelineConfigInfo& _outConfigInfo);
@@ -110,26 +116,30 @@ public:
 
 public:
 	Pipeline(Device& _device, const std::vector<ShaderInfo>& _shadersInfo, const PipelineConfigInfo& _configInfo);
+	// compute pipeline, a single compute stage and the layout is all it needs
+	Pipeline(Device& _device, const ShaderInfo& _computeShaderInfo, VkPipelineLayout _pipelineLayout);
 	~Pipeline();
 
 	Pipeline(const Pipeline&) = delete;
 	Pipeline& operator=(const Pipeline&) = delete;
 
 public:
-	void Bind(VkCommandBuffer _commandBuffer);
+	VESPERENGINE_INLINE VkPipeline GetPipeline() const { return m_graphicPipeline; }
+	VESPERENGINE_INLINE VkPipelineBindPoint GetBindPoint() const { return m_bindPoint; }
 
-private:
-	static std::vector<int8> ReadFile(const std::string& _filepath);
+public:
+	void Bind(VkCommandBuffer _commandBuffer);
 
 private:
 	VkShaderStageFlagBits ConvertShaderTypeToShaderFlag(ShaderType _type) const;
 	void CreateGraphicsPipeline(const std::vector<ShaderInfo>& _shadersInfo, const PipelineConfigInfo& _configInfo);
-	void CreateShaderModule(const std::vector<int8>& _buffer, VkShaderModule* _shaderModule);
+	void CreateComputePipeline(const ShaderInfo& _computeShaderInfo, VkPipelineLayout _pipelineLayout);
 
 private:
 	Device& m_device;
 
 	VkPipeline m_graphicPipeline;
+	VkPipelineBindPoint m_bindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
 	std::vector<VkShaderModule> m_shaderModules;
 };
 
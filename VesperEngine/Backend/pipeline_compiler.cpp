@@ -0,0 +1,106 @@
+// Copyright (c) 2025-2025 Michele Condo'
+// File: C:\Projects\Vesper\VesperEngine\Backend\pipeline_compiler.cpp
+// Licensed under the MIT License. See LICENSE file in the project root for full license information.
+
+#include "Backend/pipeline_compiler.h"
+
+
+VESPERENGINE_NAMESPACE_BEGIN
+
+PipelineCompiler::PipelineCompiler(uint32 _workerCount)
+{
+	m_workers.reserve(_workerCount);
+	for (uint32 worker = 0; worker < _workerCount; ++worker)
+	{
+		m_workers.emplace_back(&PipelineCompiler::WorkerLoop, this);
+	}
+}
+
+PipelineCompiler::~PipelineCompiler()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_isStopping = true;
+	}
+	m_taskAvailable.notify_all();
+
+	// the tasks still queued are run anyway, they could be half of the pipelines of a system
+	for (std::thread& worker : m_workers)
+	{
+		worker.join();
+	}
+}
+
+void PipelineCompiler::Enqueue(CompileTask _task)
+{
+	if (m_workers.empty())
+	{
+		_task();
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_tasks.push_back(std::move(_task));
+	}
+	m_taskAvailable.notify_one();
+}
+
+void PipelineCompiler::Wait()
+{
+	std::exception_ptr exception;
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_tasksDone.wait(lock, [this]() { return m_tasks.empty() && m_runningTasks == 0; });
+
+		exception = m_exception;
+		m_exception = nullptr;
+	}
+
+	if (exception)
+	{
+		std::rethrow_exception(exception);
+	}
+}
+
+void PipelineCompiler::WorkerLoop()
+{
+	while (true)
+	{
+		CompileTask task;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_taskAvailable.wait(lock, [this]() { return m_isStopping || !m_tasks.empty(); });
+
+			if (m_tasks.empty())
+			{
+				return;
+			}
+
+			task = std::move(m_tasks.front());
+			m_tasks.pop_front();
+			++m_runningTasks;
+		}
+
+		try
+		{
+			task();
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (!m_exception)
+			{
+				m_exception = std::current_exception();
+			}
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			--m_runningTasks;
+		}
+		m_tasksDone.notify_all();
+	}
+}
+
+VESPERENGINE_NAMESPACE_END
@@ -0,0 +1,64 @@
+// Copyright (c) 2025-2025 Michele Condo'
+// File: C:\Projects\Vesper\VesperEngine\Backend\pipeline_compiler.h
+// Licensed under the MIT License. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include "Core/core_defines.h"
+
+#include <deque>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+
+VESPERENGINE_NAMESPACE_BEGIN
+
+/**
+ * Compiles pipelines on a set of worker threads while the calling thread goes on, i.e. with the loading of the assets.
+ * A task is the compile step of a system, the CreatePipeline called once its layouts are described: the shader modules and
+ * the pipelines are created on the worker, all of them through the pipeline cache of the device, which is internally synchronized.
+ * The tasks must not share state with each other nor with the calling thread until Wait returns, which must be called
+ * before any of the compiled pipelines is used.
+ * With no workers the tasks run on the calling thread as they are enqueued.
+ */
+class VESPERENGINE_API PipelineCompiler final
+{
+public:
+	using CompileTask = std::function<void()>;
+
+public:
+	PipelineCompiler(uint32 _workerCount);
+	~PipelineCompiler();
+
+	PipelineCompiler(const PipelineCompiler&) = delete;
+	PipelineCompiler& operator=(const PipelineCompiler&) = delete;
+
+public:
+	VESPERENGINE_INLINE uint32 GetWorkerCount() const { return static_cast<uint32>(m_workers.size()); }
+
+public:
+	void Enqueue(CompileTask _task);
+	// Block until every task enqueued so far is done, then rethrow the first exception thrown by any of them
+	void Wait();
+
+private:
+	void WorkerLoop();
+
+private:
+	std::vector<std::thread> m_workers;
+
+	std::mutex m_mutex;
+	std::condition_variable m_taskAvailable;
+	std::condition_variable m_tasksDone;
+
+	std::deque<CompileTask> m_tasks;
+	std::exception_ptr m_exception;
+	uint32 m_runningTasks{ 0 };
+	bool m_isStopping{ false };
+};
+
+VESPERENGINE_NAMESPACE_END
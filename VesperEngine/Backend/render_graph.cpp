@@ -0,0 +1,659 @@
+// Copyright (c) 2025-2025 Michele Condo'
+// File: C:\Projects\Vesper\VesperEngine\Backend\render_graph.cpp
+// Licensed under the MIT License. See LICENSE file in the project root for full license information.
+
+#include "Backend/render_graph.h"
+#include "Backend/device.h"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+
+VESPERENGINE_NAMESPACE_BEGIN
+
+namespace
+{
+	struct AccessInfo
+	{
+		VkPipelineStageFlags Stages;
+		VkAccessFlags Access;
+		VkImageLayout Layout;
+	};
+
+	// indexed by RenderGraphAccess
+	const std::array<AccessInfo, static_cast<std::size_t>(RenderGraphAccess::Count)> kAccessInfos{ {
+		{ VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED },
+		{ VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+		{ VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+		{ VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+		{ VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL },
+		{ VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL },
+		{ VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL },
+		{ VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL },
+		{ VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL },
+		{ VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL },
+		{ VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR },
+	} };
+
+	// only the writes have to be made available, the reads need just the execution dependency
+	constexpr VkAccessFlags kWriteAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT
+		| VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+	const AccessInfo& GetAccessInfo(RenderGraphAccess _access)
+	{
+		return kAccessInfos[static_cast<std::size_t>(_access)];
+	}
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::Read(RenderGraphResource _resource, RenderGraphAccess _access)
+{
+	m_graph.m_passes[m_passIndex].Accesses.push_back({ _resource, _access, false, false });
+	return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::Write(RenderGraphResource _resource, RenderGraphAccess _access)
+{
+	m_graph.m_passes[m_passIndex].Accesses.push_back({ _resource, _access, true, false });
+	return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::WriteSynchronized(RenderGraphResource _resource, RenderGraphAccess _finalAccess)
+{
+	m_graph.m_passes[m_passIndex].Accesses.push_back({ _resource, _finalAccess, true, true });
+	return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::SetSideEffects()
+{
+	m_graph.m_passes[m_passIndex].HasSideEffects = true;
+	return *this;
+}
+
+RenderGraph::RenderGraph(Device& _device)
+	: m_device(_device)
+{
+}
+
+RenderGraph::~RenderGraph()
+{
+	DestroyTransientImages();
+}
+
+RenderGraphResource RenderGraph::AddResource(const std::string& _name)
+{
+	assertMsgReturnValue(!m_isCompiled, "Cannot add resources to a compiled render graph, reset it first", kInvalidRenderGraphResource);
+
+	const RenderGraphResource handle = static_cast<RenderGraphResource>(m_resources.size());
+	m_resources.emplace_back().Name = _name;
+	return handle;
+}
+
+RenderGraphResource RenderGraph::ImportBuffer(const std::string& _name, RenderGraphAccess _initialAccess)
+{
+	const RenderGraphResource handle = AddResource(_name);
+	if (handle != kInvalidRenderGraphResource)
+	{
+		m_resources[handle].InitialAccess = _initialAccess;
+	}
+	return handle;
+}
+
+RenderGraphResource RenderGraph::ImportImage(const std::string& _name, VkImage _image, VkImageAspectFlags _aspect, RenderGraphAccess _initialAccess)
+{
+	const RenderGraphResource handle = AddResource(_name);
+	if (handle != kInvalidRenderGraphResource)
+	{
+		m_resources[handle].Image = _image;
+		m_resources[handle].Aspect = _aspect;
+		m_resources[handle].InitialAccess = _initialAccess;
+		m_resources[handle].IsImage = true;
+	}
+	return handle;
+}
+
+RenderGraphResource RenderGraph::CreateImage(const std::string& _name, const RenderGraphImageDesc& _desc)
+{
+	const RenderGraphResource handle = AddResource(_name);
+	if (handle != kInvalidRenderGraphResource)
+	{
+		m_resources[handle].Desc = _desc;
+		m_resources[handle].Aspect = _desc.Aspect;
+		m_resources[handle].IsImage = true;
+		m_resources[handle].IsTransient = true;
+	}
+	return handle;
+}
+
+void RenderGraph::MarkOutput(RenderGraphResource _resource)
+{
+	assertMsgReturnVoid(_resource < m_resources.size(), "Invalid render graph resource");
+	m_resources[_resource].IsOutput = true;
+}
+
+RenderGraph::PassBuilder RenderGraph::AddPass(const std::string& _name, ExecuteFunction _execute)
+{
+	assertMsgReturnValue(!m_isCompiled, "Cannot add passes to a compiled render graph, reset it first", PassBuilder(*this, 0));
+
+	Pass& pass = m_passes.emplace_back();
+	pass.Name = _name;
+	pass.Execute = std::move(_execute);
+
+	return PassBuilder(*this, static_cast<uint32>(m_passes.size() - 1));
+}
+
+void RenderGraph::SetImage(RenderGraphResource _resource, VkImage _image)
+{
+	assertMsgReturnVoid(_resource < m_resources.size() && m_resources[_resource].IsImage && !m_resources[_resource].IsTransient, "Not an imported render graph image");
+	m_resources[_resource].Image = _image;
+}
+
+VkImage RenderGraph::GetImage(RenderGraphResource _resource) const
+{
+	assertMsgReturnValue(_resource < m_resources.size(), "Invalid render graph resource", VK_NULL_HANDLE);
+	return m_resources[_resource].Image;
+}
+
+VkImageView RenderGraph::GetImageView(RenderGraphResource _resource) const
+{
+	assertMsgReturnValue(_resource < m_resources.size(), "Invalid render graph resource", VK_NULL_HANDLE);
+	return m_resources[_resource].ImageView;
+}
+
+void RenderGraph::Compile()
+{
+	assertMsgReturnVoid(!m_isCompiled, "Render graph already compiled");
+
+	CullPasses();
+	AllocateTransientImages();
+	ComputeBarriers();
+
+	m_barrierCount = m_finalBarrier.IsEmpty() ? 0u : 1u;
+	for (const Pass& pass : m_passes)
+	{
+		if (!pass.IsCulled && !pass.Before.IsEmpty())
+		{
+			++m_barrierCount;
+		}
+	}
+
+	m_isCompiled = true;
+}
+
+void RenderGraph::CullPasses()
+{
+	// backward: a pass is needed if it has side effects or writes something a needed pass, or the outside, reads
+	std::vector<uint8> isNeeded(m_resources.size(), 0);
+	for (RenderGraphResource i = 0; i < m_resources.size(); ++i)
+	{
+		isNeeded[i] = m_resources[i].IsOutput ? 1 : 0;
+	}
+
+	for (auto pass = m_passes.rbegin(); pass != m_passes.rend(); ++pass)
+	{
+		bool isPassNeeded = pass->HasSideEffects;
+		for (const PassAccess& access : pass->Accesses)
+		{
+			isPassNeeded |= access.IsWrite && isNeeded[access.Resource];
+		}
+
+		pass->IsCulled = !isPassNeeded;
+		if (pass->IsCulled)
+		{
+			continue;
+		}
+
+		// the written ones stay needed too: an earlier pass can write what this one only partially overwrites
+		for (const PassAccess& access : pass->Accesses)
+		{
+			isNeeded[access.Resource] = 1;
+		}
+	}
+}
+
+void RenderGraph::AllocateTransientImages()
+{
+	std::vector<RenderGraphResource> transients;
+
+	for (uint32 passIndex = 0; passIndex < m_passes.size(); ++passIndex)
+	{
+		if (m_passes[passIndex].IsCulled)
+		{
+			continue;
+		}
+
+		for (const PassAccess& access : m_passes[passIndex].Accesses)
+		{
+			Resource& resource = m_resources[access.Resource];
+			if (!resource.IsTransient)
+			{
+				continue;
+			}
+
+			if (resource.FirstPass == UINT32_MAX)
+			{
+				resource.FirstPass = passIndex;
+				transients.push_back(access.Resource);
+			}
+			resource.LastPass = passIndex;
+		}
+	}
+
+	for (const RenderGraphResource handle : transients)
+	{
+		Resource& resource = m_resources[handle];
+
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = resource.Desc.Format;
+		imageInfo.extent = { resource.Desc.Extent.width, resource.Desc.Extent.height, 1 };
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = resource.Desc.Usage;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		if (vkCreateImage(m_device.GetDevice(), &imageInfo, nullptr, &resource.Image) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create render graph transient image!");
+		}
+
+		vkGetImageMemoryRequirements(m_device.GetDevice(), resource.Image, &resource.MemoryRequirements);
+	}
+
+	// in order of first use: an image takes the memory of one whose last pass is already done, so their lifetimes never overlap
+	m_memorySlots.clear();
+	for (const RenderGraphResource handle : transients)
+	{
+		Resource& resource = m_resources[handle];
+
+		uint32 slotIndex = UINT32_MAX;
+		for (uint32 i = 0; i < m_memorySlots.size(); ++i)
+		{
+			const MemorySlot& slot = m_memorySlots[i];
+			if (slot.LastPass < resource.FirstPass && (slot.MemoryTypeBits & resource.MemoryRequirements.memoryTypeBits) != 0)
+			{
+				slotIndex = i;
+				break;
+			}
+		}
+
+		if (slotIndex == UINT32_MAX)
+		{
+			slotIndex = static_cast<uint32>(m_memorySlots.size());
+			m_memorySlots.emplace_back();
+		}
+
+		MemorySlot& slot = m_memorySlots[slotIndex];
+		slot.Size = std::max(slot.Size, resource.MemoryRequirements.size);
+		slot.Alignment = std::max(slot.Alignment, resource.MemoryRequirements.alignment);
+		slot.MemoryTypeBits &= resource.MemoryRequirements.memoryTypeBits;
+		slot.LastPass = resource.LastPass;
+		slot.LastResource = handle;
+
+		resource.MemorySlot = slotIndex;
+	}
+
+	m_transientMemorySize = 0;
+	for (MemorySlot& slot : m_memorySlots)
+	{
+		VkMemoryRequirements requirements{};
+		requirements.size = slot.Size;
+		requirements.alignment = slot.Alignment;
+		requirements.memoryTypeBits = slot.MemoryTypeBits;
+
+		VmaAllocationCreateInfo allocationInfo{};
+		allocationInfo.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+		if (vmaAllocateMemory(m_device.GetAllocator(), &requirements, &allocationInfo, &slot.Allocation, nullptr) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to allocate render graph transient memory!");
+		}
+
+		m_transientMemorySize += slot.Size;
+	}
+
+	for (const RenderGraphResource handle : transients)
+	{
+		Resource& resource = m_resources[handle];
+
+		vmaBindImageMemory(m_device.GetAllocator(), m_memorySlots[resource.MemorySlot].Allocation, resource.Image);
+
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = resource.Image;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = resource.Desc.Format;
+		viewInfo.subresourceRange.aspectMask = resource.Aspect;
+		viewInfo.subresourceRange.baseMipLevel = 0;
+		viewInfo.subresourceRange.levelCount = 1;
+		viewInfo.subresourceRange.baseArrayLayer = 0;
+		viewInfo.subresourceRange.layerCount = 1;
+
+		if (vkCreateImageView(m_device.GetDevice(), &viewInfo, nullptr, &resource.ImageView) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create render graph transient image view!");
+		}
+	}
+}
+
+void RenderGraph::ComputeBarriers()
+{
+	std::vector<ResourceState> states(m_resources.size());
+
+	// what was done before the graph, the previous frame included
+	for (RenderGraphResource i = 0; i < m_resources.size(); ++i)
+	{
+		const Resource& resource = m_resources[i];
+		if (resource.IsTransient || resource.InitialAccess == RenderGraphAccess::Count)
+		{
+			continue;
+		}
+
+		const AccessInfo& info = GetAccessInfo(resource.InitialAccess);
+		ResourceState& state = states[i];
+		if ((info.Access & kWriteAccessMask) != 0)
+		{
+			state.WriteStages = info.Stages;
+			state.WriteAccess = info.Access & kWriteAccessMask;
+		}
+		else
+		{
+			state.ReadStages = info.Stages;
+		}
+		state.Layout = resource.IsImage ? info.Layout : VK_IMAGE_LAYOUT_UNDEFINED;
+	}
+
+	// the transient images sharing memory: the first use of an image waits for the last one of the image before it in the same memory.
+	// The first image of every memory slot waits for the last image of the slot, used by the previous frame
+	std::vector<RenderGraphResource> previousInSlot(m_resources.size(), kInvalidRenderGraphResource);
+	{
+		std::vector<RenderGraphResource> lastInSlot(m_memorySlots.size(), kInvalidRenderGraphResource);
+		std::vector<RenderGraphResource> ordered;
+		for (RenderGraphResource i = 0; i < m_resources.size(); ++i)
+		{
+			if (m_resources[i].MemorySlot != UINT32_MAX)
+			{
+				ordered.push_back(i);
+			}
+		}
+		std::sort(ordered.begin(), ordered.end(), [this](RenderGraphResource _a, RenderGraphResource _b) { return m_resources[_a].FirstPass < m_resources[_b].FirstPass; });
+
+		for (const RenderGraphResource handle : ordered)
+		{
+			const uint32 slot = m_resources[handle].MemorySlot;
+			previousInSlot[handle] = lastInSlot[slot] != kInvalidRenderGraphResource ? lastInSlot[slot] : m_memorySlots[slot].LastResource;
+			lastInSlot[slot] = handle;
+		}
+	}
+
+	std::vector<uint8> isFirstUse(m_resources.size(), 1);
+	std::vector<std::pair<uint32, RenderGraphResource>> wrappingTransients;	// pass of the first use, image waiting the previous frame
+
+	for (uint32 passIndex = 0; passIndex < m_passes.size(); ++passIndex)
+	{
+		Pass& pass = m_passes[passIndex];
+		pass.Before = Barrier{};
+
+		if (pass.IsCulled)
+		{
+			continue;
+		}
+
+		for (const PassAccess& access : pass.Accesses)
+		{
+			const Resource& resource = m_resources[access.Resource];
+			ResourceState& state = states[access.Resource];
+
+			if (resource.IsTransient && isFirstUse[access.Resource])
+			{
+				// the content is not kept, the image starts from UNDEFINED after the previous user of its memory
+				const RenderGraphResource previous = previousInSlot[access.Resource];
+				if (m_resources[previous].FirstPass < resource.FirstPass)
+				{
+					state.WriteStages = states[previous].WriteStages | states[previous].ReadStages;
+					state.WriteAccess = states[previous].WriteAccess;
+				}
+				else
+				{
+					wrappingTransients.emplace_back(passIndex, access.Resource);
+				}
+				state.Layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			}
+			isFirstUse[access.Resource] = 0;
+
+			if (access.IsSynchronized)
+			{
+				// nothing to wait, the pass did it: the resource is as just accessed with the final access, which is visible
+				const AccessInfo& info = GetAccessInfo(access.Access);
+				state = ResourceState{};
+				if ((info.Access & kWriteAccessMask) != 0)
+				{
+					state.WriteStages = info.Stages;
+					state.WriteAccess = info.Access & kWriteAccessMask;
+				}
+				else
+				{
+					state.ReadStages = info.Stages;
+				}
+				state.Layout = resource.IsImage ? info.Layout : VK_IMAGE_LAYOUT_UNDEFINED;
+				continue;
+			}
+
+			AddAccess(resource, access.Resource, access.Access, access.IsWrite, state, pass.Before);
+		}
+	}
+
+	// with every pass walked, the final states of the memory slots are known
+	for (const auto& [passIndex, handle] : wrappingTransients)
+	{
+		const ResourceState& previousState = states[previousInSlot[handle]];
+		const VkPipelineStageFlags previousStages = previousState.WriteStages | previousState.ReadStages;
+
+		Barrier& barrier = m_passes[passIndex].Before;
+		barrier.SrcStages |= previousStages;
+		for (ImageTransition& transition : barrier.ImageTransitions)
+		{
+			if (transition.Resource == handle)
+			{
+				transition.SrcAccess |= previousState.WriteAccess;
+			}
+		}
+	}
+
+	// the imported images go back to the layout the next frame expects
+	m_finalBarrier = Barrier{};
+	for (RenderGraphResource i = 0; i < m_resources.size(); ++i)
+	{
+		const Resource& resource = m_resources[i];
+		if (!resource.IsImage || resource.IsTransient || resource.InitialAccess == RenderGraphAccess::Count)
+		{
+			continue;
+		}
+
+		if (states[i].Layout != GetAccessInfo(resource.InitialAccess).Layout)
+		{
+			AddAccess(resource, i, resource.InitialAccess, false, states[i], m_finalBarrier);
+		}
+	}
+}
+
+void RenderGraph::AddAccess(const Resource& _resource, RenderGraphResource _handle, RenderGraphAccess _access, bool _isWrite, ResourceState& _state, Barrier& _barrier) const
+{
+	const AccessInfo& info = GetAccessInfo(_access);
+
+	const bool isLayoutChange = _resource.IsImage && info.Layout != VK_IMAGE_LAYOUT_UNDEFINED && info.Layout != _state.Layout;
+
+	// write after write or read, read after a write not yet visible to this stage and access, or a layout transition, which is a write as well
+	bool isHazard;
+	VkPipelineStageFlags srcStages;
+	if (_isWrite || isLayoutChange)
+	{
+		isHazard = isLayoutChange || _state.WriteStages != 0 || _state.ReadStages != 0;
+		srcStages = _state.WriteStages | _state.ReadStages;
+	}
+	else
+	{
+		isHazard = _state.WriteStages != 0 && ((info.Stages & ~_state.VisibleStages) != 0 || (info.Access & ~_state.VisibleAccess) != 0);
+		srcStages = _state.WriteStages;
+	}
+
+	if (isHazard)
+	{
+		_barrier.SrcStages |= srcStages != 0 ? srcStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		_barrier.DstStages |= info.Stages;
+
+		if (_resource.IsImage)
+		{
+			ImageTransition& transition = _barrier.ImageTransitions.emplace_back();
+			transition.Resource = _handle;
+			transition.OldLayout = _state.Layout;
+			transition.NewLayout = info.Layout != VK_IMAGE_LAYOUT_UNDEFINED ? info.Layout : _state.Layout;
+			transition.SrcAccess = _state.WriteAccess;
+			transition.DstAccess = info.Access;
+		}
+		else if (_state.WriteAccess != 0)
+		{
+			_barrier.MemorySrcAccess |= _state.WriteAccess;
+			_barrier.MemoryDstAccess |= info.Access;
+		}
+	}
+
+	if (_isWrite)
+	{
+		_state = ResourceState{};
+		_state.WriteStages = info.Stages;
+		_state.WriteAccess = info.Access & kWriteAccessMask;
+	}
+	else
+	{
+		if (isHazard)
+		{
+			_state.VisibleStages |= info.Stages;
+			_state.VisibleAccess |= info.Access;
+		}
+		_state.ReadStages |= info.Stages;
+	}
+
+	if (_resource.IsImage && info.Layout != VK_IMAGE_LAYOUT_UNDEFINED)
+	{
+		_state.Layout = info.Layout;
+	}
+}
+
+void RenderGraph::Execute(const FrameInfo& _frameInfo) const
+{
+	assertMsgReturnVoid(m_isCompiled, "Render graph not compiled");
+
+	for (const Pass& pass : m_passes)
+	{
+		if (pass.IsCulled)
+		{
+			continue;
+		}
+
+		RecordBarrier(_frameInfo.CommandBuffer, pass.Before);
+		pass.Execute(_frameInfo);
+	}
+
+	RecordBarrier(_frameInfo.CommandBuffer, m_finalBarrier);
+}
+
+void RenderGraph::RecordBarrier(VkCommandBuffer _commandBuffer, const Barrier& _barrier) const
+{
+	if (_barrier.IsEmpty())
+	{
+		return;
+	}
+
+	VkMemoryBarrier memoryBarrier{};
+	memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memoryBarrier.srcAccessMask = _barrier.MemorySrcAccess;
+	memoryBarrier.dstAccessMask = _barrier.MemoryDstAccess;
+	const uint32 memoryBarrierCount = (_barrier.MemorySrcAccess != 0) ? 1u : 0u;
+
+	// few images per pass, no allocation on the recording path
+	constexpr uint32 kMaxImageBarrierCount = 16;
+	VkImageMemoryBarrier imageBarriers[kMaxImageBarrierCount]{};
+	const uint32 imageBarrierCount = std::min(static_cast<uint32>(_barrier.ImageTransitions.size()), kMaxImageBarrierCount);
+	assertMsg(_barrier.ImageTransitions.size() <= kMaxImageBarrierCount, "Too many image transitions before a render graph pass");
+
+	for (uint32 i = 0; i < imageBarrierCount; ++i)
+	{
+		const ImageTransition& transition = _barrier.ImageTransitions[i];
+		const Resource& resource = m_resources[transition.Resource];
+
+		VkImageMemoryBarrier& barrier = imageBarriers[i];
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.oldLayout = transition.OldLayout;
+		barrier.newLayout = transition.NewLayout;
+		barrier.srcAccessMask = transition.SrcAccess;
+		barrier.dstAccessMask = transition.DstAccess;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = resource.Image;
+		barrier.subresourceRange.aspectMask = resource.Aspect;
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+	}
+
+	vkCmdPipelineBarrier(
+		_commandBuffer,
+		_barrier.SrcStages,
+		_barrier.DstStages,
+		0,
+		memoryBarrierCount, &memoryBarrier,
+		0, nullptr,
+		imageBarrierCount, imageBarriers);
+}
+
+void RenderGraph::Reset()
+{
+	DestroyTransientImages();
+
+	m_resources.clear();
+	m_passes.clear();
+	m_finalBarrier = Barrier{};
+	m_transientMemorySize = 0;
+	m_barrierCount = 0;
+	m_isCompiled = false;
+}
+
+void RenderGraph::DestroyTransientImages()
+{
+	for (Resource& resource : m_resources)
+	{
+		if (!resource.IsTransient)
+		{
+			continue;
+		}
+
+		if (resource.ImageView != VK_NULL_HANDLE)
+		{
+			vkDestroyImageView(m_device.GetDevice(), resource.ImageView, nullptr);
+			resource.ImageView = VK_NULL_HANDLE;
+		}
+
+		if (resource.Image != VK_NULL_HANDLE)
+		{
+			vkDestroyImage(m_device.GetDevice(), resource.Image, nullptr);
+			resource.Image = VK_NULL_HANDLE;
+		}
+	}
+
+	for (MemorySlot& slot : m_memorySlots)
+	{
+		if (slot.Allocation != VK_NULL_HANDLE)
+		{
+			vmaFreeMemory(m_device.GetAllocator(), slot.Allocation);
+		}
+	}
+	m_memorySlots.clear();
+}
+
+VESPERENGINE_NAMESPACE_END
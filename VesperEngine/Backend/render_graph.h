@@ -0,0 +1,222 @@
+// Copyright (c) 2025-2025 Michele Condo'
+// File: C:\Projects\Vesper\VesperEngine\Backend\render_graph.h
+// Licensed under the MIT License. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include "Core/core_defines.h"
+
+#include "Backend/frame_info.h"
+
+#include "vulkan/vulkan.h"
+#include "vma/vk_mem_alloc.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+
+VESPERENGINE_NAMESPACE_BEGIN
+
+class Device;
+
+using RenderGraphResource = uint32;
+static constexpr RenderGraphResource kInvalidRenderGraphResource = UINT32_MAX;
+
+// how a pass uses a resource: the pipeline stages, the access and, for the images, the layout it needs
+enum class RenderGraphAccess : uint8
+{
+	IndirectRead = 0,
+	VertexShaderRead,
+	FragmentShaderRead,
+	ComputeShaderRead,
+	ComputeShaderWrite,
+	TransferRead,
+	TransferWrite,
+	ColorAttachmentWrite,
+	DepthAttachmentWrite,
+	DepthAttachmentRead,
+	Present,
+	Count
+};
+
+// transient image, created by the graph and living only between its first and its last pass
+struct RenderGraphImageDesc
+{
+	VkFormat Format{ VK_FORMAT_UNDEFINED };
+	VkExtent2D Extent{ 0, 0 };
+	VkImageUsageFlags Usage{ 0 };
+	VkImageAspectFlags Aspect{ VK_IMAGE_ASPECT_COLOR_BIT };
+};
+
+/**
+ * Frame render graph: the passes are added in execution order declaring the resources they read and write,
+ * Compile then culls the passes whose results nobody reads and computes the synchronization once.
+ * Before every pass at most one vkCmdPipelineBarrier is recorded, batching a global memory barrier for all the buffers
+ * and the image barriers of the layout transitions. The transient images whose lifetimes do not overlap share the same memory.
+ * Imported resources are owned outside. The buffers are synchronized by the global memory barrier, so their handles are not needed
+ * and can change every frame (i.e. one buffer per frame in flight), the images can be rebound with SetImage.
+ * A pass which synchronizes a resource by itself, i.e. with the layouts of its render pass or its own barriers, declares it with WriteSynchronized.
+ */
+class VESPERENGINE_API RenderGraph final
+{
+public:
+	using ExecuteFunction = std::function<void(const FrameInfo&)>;
+
+	class PassBuilder
+	{
+	public:
+		PassBuilder& Read(RenderGraphResource _resource, RenderGraphAccess _access);
+		PassBuilder& Write(RenderGraphResource _resource, RenderGraphAccess _access);
+		// no barrier is recorded before the pass for _resource, after it the resource is as just accessed with _finalAccess
+		PassBuilder& WriteSynchronized(RenderGraphResource _resource, RenderGraphAccess _finalAccess);
+		// the pass is never culled, i.e. it presents or writes something read outside of the graph
+		PassBuilder& SetSideEffects();
+
+	private:
+		friend class RenderGraph;
+		PassBuilder(RenderGraph& _graph, uint32 _passIndex) : m_graph(_graph), m_passIndex(_passIndex) {}
+
+		RenderGraph& m_graph;
+		uint32 m_passIndex;
+	};
+
+public:
+	RenderGraph(Device& _device);
+	~RenderGraph();
+
+	RenderGraph(const RenderGraph&) = delete;
+	RenderGraph& operator=(const RenderGraph&) = delete;
+
+public:
+	// _initialAccess is the last use of the resource before the graph, i.e. by the previous frame: the first pass waits for it.
+	// The images are brought back to the layout of _initialAccess at the end of the graph
+	RenderGraphResource ImportBuffer(const std::string& _name, RenderGraphAccess _initialAccess = RenderGraphAccess::Count);
+	RenderGraphResource ImportImage(const std::string& _name, VkImage _image, VkImageAspectFlags _aspect, RenderGraphAccess _initialAccess = RenderGraphAccess::Count);
+	RenderGraphResource CreateImage(const std::string& _name, const RenderGraphImageDesc& _desc);
+
+	// outside of the graph, the result is read after it: the passes writing it are not culled
+	void MarkOutput(RenderGraphResource _resource);
+
+	PassBuilder AddPass(const std::string& _name, ExecuteFunction _execute);
+
+	// rebind an imported image, before Execute
+	void SetImage(RenderGraphResource _resource, VkImage _image);
+
+	VkImage GetImage(RenderGraphResource _resource) const;
+	VkImageView GetImageView(RenderGraphResource _resource) const;
+
+	VESPERENGINE_INLINE bool IsCompiled() const { return m_isCompiled; }
+	VESPERENGINE_INLINE bool IsPassCulled(uint32 _passIndex) const { return m_passes[_passIndex].IsCulled; }
+	VESPERENGINE_INLINE uint32 GetPassCount() const { return static_cast<uint32>(m_passes.size()); }
+	// barriers recorded by every Execute, to monitor the batching
+	VESPERENGINE_INLINE uint32 GetBarrierCount() const { return m_barrierCount; }
+	// device memory of the transient images, after the aliasing
+	VESPERENGINE_INLINE VkDeviceSize GetTransientMemorySize() const { return m_transientMemorySize; }
+
+	void Compile();
+	void Execute(const FrameInfo& _frameInfo) const;
+	// destroy the transient images and forget passes and resources, the graph can be built again (i.e. after the swap chain is recreated)
+	void Reset();
+
+private:
+	struct Resource
+	{
+		std::string Name;
+		VkImage Image{ VK_NULL_HANDLE };
+		VkImageView ImageView{ VK_NULL_HANDLE };
+		VkImageAspectFlags Aspect{ 0 };
+		RenderGraphAccess InitialAccess{ RenderGraphAccess::Count };
+		RenderGraphImageDesc Desc{};
+		bool IsImage{ false };
+		bool IsTransient{ false };
+		bool IsOutput{ false };
+
+		// transient only, set by Compile
+		uint32 FirstPass{ UINT32_MAX };
+		uint32 LastPass{ 0 };
+		uint32 MemorySlot{ UINT32_MAX };
+		VkMemoryRequirements MemoryRequirements{};
+	};
+
+	struct PassAccess
+	{
+		RenderGraphResource Resource{ kInvalidRenderGraphResource };
+		RenderGraphAccess Access{ RenderGraphAccess::Count };
+		bool IsWrite{ false };
+		bool IsSynchronized{ false };
+	};
+
+	struct ImageTransition
+	{
+		RenderGraphResource Resource{ kInvalidRenderGraphResource };
+		VkImageLayout OldLayout{ VK_IMAGE_LAYOUT_UNDEFINED };
+		VkImageLayout NewLayout{ VK_IMAGE_LAYOUT_UNDEFINED };
+		VkAccessFlags SrcAccess{ 0 };
+		VkAccessFlags DstAccess{ 0 };
+	};
+
+	// everything waited before a pass, recorded in one call
+	struct Barrier
+	{
+		VkPipelineStageFlags SrcStages{ 0 };
+		VkPipelineStageFlags DstStages{ 0 };
+		VkAccessFlags MemorySrcAccess{ 0 };	// buffers, in a single global memory barrier
+		VkAccessFlags MemoryDstAccess{ 0 };
+		std::vector<ImageTransition> ImageTransitions;
+
+		VESPERENGINE_INLINE bool IsEmpty() const { return SrcStages == 0 && DstStages == 0; }
+	};
+
+	struct Pass
+	{
+		std::string Name;
+		ExecuteFunction Execute;
+		std::vector<PassAccess> Accesses;
+		Barrier Before;
+		bool HasSideEffects{ false };
+		bool IsCulled{ false };
+	};
+
+	// synchronization state of a resource while walking the passes
+	struct ResourceState
+	{
+		VkPipelineStageFlags WriteStages{ 0 };	// of the last write
+		VkAccessFlags WriteAccess{ 0 };
+		VkPipelineStageFlags ReadStages{ 0 };	// reading since the last write, the next write waits for them
+		VkPipelineStageFlags VisibleStages{ 0 };	// the last write is already visible to these
+		VkAccessFlags VisibleAccess{ 0 };
+		VkImageLayout Layout{ VK_IMAGE_LAYOUT_UNDEFINED };
+	};
+
+	struct MemorySlot
+	{
+		VmaAllocation Allocation{ VK_NULL_HANDLE };
+		VkDeviceSize Size{ 0 };
+		VkDeviceSize Alignment{ 0 };
+		uint32 MemoryTypeBits{ UINT32_MAX };
+		uint32 LastPass{ 0 };
+		RenderGraphResource LastResource{ kInvalidRenderGraphResource };
+	};
+
+	RenderGraphResource AddResource(const std::string& _name);
+	void CullPasses();
+	void AllocateTransientImages();
+	void ComputeBarriers();
+	// add to _barrier what _access needs after _state, then update _state
+	void AddAccess(const Resource& _resource, RenderGraphResource _handle, RenderGraphAccess _access, bool _isWrite, ResourceState& _state, Barrier& _barrier) const;
+	void RecordBarrier(VkCommandBuffer _commandBuffer, const Barrier& _barrier) const;
+	void DestroyTransientImages();
+
+private:
+	Device& m_device;
+	std::vector<Resource> m_resources;
+	std::vector<Pass> m_passes;
+	std::vector<MemorySlot> m_memorySlots;
+	Barrier m_finalBarrier;		// the imported images back to their initial layout
+	VkDeviceSize m_transientMemorySize{ 0 };
+	uint32 m_barrierCount{ 0 };
+	bool m_isCompiled{ false };
+};
+
+VESPERENGINE_NAMESPACE_END
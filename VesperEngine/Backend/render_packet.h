@@ -0,0 +1,122 @@
+// Copyright (c) 2025-2025 Michele Condo'
+// File: C:\Projects\Vesper\VesperEngine\Backend\render_packet.h
+// Licensed under the MIT License. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include "Core/core_defines.h"
+#include "Core/glm_config.h"
+
+#include "vulkan/vulkan.h"
+
+#include <array>
+#include <vector>
+
+
+VESPERENGINE_NAMESPACE_BEGIN
+
+// the render systems the packets are extracted for, every one reads only its own range of the list
+enum class RenderPacketPipeline : uint8
+{
+	PhongOpaque = 0,
+	PhongTransparent,
+	PBROpaque,
+	PBRTransparent,
+	Skybox,
+	Count
+};
+
+/**
+ * What a render system needs to record the draw of an entity, copied out of the components once per frame.
+ * Plain data only: the recording reads the packets sequentially and does not look up any component.
+ */
+struct RenderPacket
+{
+	glm::mat4 ModelMatrix{ 1.0f };				// the view projection without translation for the skybox, which has no model
+
+	// geometry, IndexBuffer is VK_NULL_HANDLE when the entity is not indexed
+	VkBuffer VertexBuffer{ VK_NULL_HANDLE };
+	VkBuffer IndexBuffer{ VK_NULL_HANDLE };
+	uint32 Count{ 0 };							// of the indices, of the vertices if not indexed
+	uint32 First{ 0 };							// first index, first vertex if not indexed
+	int32 VertexOffset{ 0 };					// indexed only
+
+	// material, the set is the one of the frame the packet has been extracted for
+	VkDescriptorSet MaterialDescriptorSet{ VK_NULL_HANDLE };
+	int32 MaterialIndex{ -1 };
+
+	// entity data, as in the DynamicOffsetComponent
+	uint32 DynamicOffsetIndex{ 0 };
+	uint32 DynamicOffset{ 0 };
+	uint32 EntityIndex{ 0 };					// for PerEntityRender and the instancing only
+
+	float ViewDepth{ 0.0f };					// of the bounds center, of the farthest corner for the transparent ones if so configured
+	uint32 SortFlags{ 0 };						// DrawSorter flags, pipeline permutation included
+	RenderPacketPipeline Pipeline{ RenderPacketPipeline::Count };
+	bool IsDoubleSided{ false };
+	bool IsMirrored{ false };
+};
+
+// contiguous packets of a single pipeline
+struct RenderPacketRange
+{
+	const RenderPacket* Packets{ nullptr };
+	uint32 Count{ 0 };
+
+	VESPERENGINE_INLINE const RenderPacket* begin() const { return Packets; }
+	VESPERENGINE_INLINE const RenderPacket* end() const { return Packets + Count; }
+	VESPERENGINE_INLINE const RenderPacket& operator[](uint32 _index) const { return Packets[_index]; }
+};
+
+/**
+ * Linear arena of the packets of one frame, grouped by pipeline.
+ * Cleared and refilled every frame without releasing its memory: after the first frames no allocation happens anymore.
+ */
+class VESPERENGINE_API RenderPacketList final
+{
+public:
+	RenderPacketList() = default;
+	~RenderPacketList() = default;
+
+	RenderPacketList(const RenderPacketList&) = delete;
+	RenderPacketList& operator=(const RenderPacketList&) = delete;
+
+	RenderPacketList(RenderPacketList&&) = default;
+	RenderPacketList& operator=(RenderPacketList&&) = default;
+
+public:
+	VESPERENGINE_INLINE void Reserve(uint32 _count) { m_packets.reserve(_count); }
+	VESPERENGINE_INLINE uint32 GetCount() const { return static_cast<uint32>(m_packets.size()); }
+
+	VESPERENGINE_INLINE void Clear()
+	{
+		m_packets.clear();
+		m_ranges.fill({ 0u, 0u });
+	}
+
+	VESPERENGINE_INLINE RenderPacket& Add() { return m_packets.emplace_back(); }
+
+	// the packets added since _first are the ones of _pipeline
+	VESPERENGINE_INLINE void CloseRange(RenderPacketPipeline _pipeline, uint32 _first)
+	{
+		m_ranges[static_cast<uint32>(_pipeline)] = { _first, GetCount() - _first };
+	}
+
+	VESPERENGINE_INLINE RenderPacketRange GetRange(RenderPacketPipeline _pipeline) const
+	{
+		const Range& range = m_ranges[static_cast<uint32>(_pipeline)];
+		return { m_packets.data() + range.First, range.Count };
+	}
+
+private:
+	struct Range
+	{
+		uint32 First{ 0 };
+		uint32 Count{ 0 };
+	};
+
+	std::vector<RenderPacket> m_packets;
+	std::array<Range, static_cast<uint32>(RenderPacketPipeline::Count)> m_ranges{};
+};
+
+VESPERENGINE_NAMESPACE_END
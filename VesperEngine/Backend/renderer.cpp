@@ -5,26 +5,47 @@
 #include "Backend/renderer.h"
 #include "Backend/device.h"
 #include "Backend/descriptors.h"
+#include "Backend/parallel_command_recorder.h"
+#include "Backend/dynamic_resolution.h"
 
 #include "App/window_handle.h"
 
 #include "Utility/logger.h"
 
+#include <algorithm>
 #include <array>
 
 
 VESPERENGINE_NAMESPACE_BEGIN
 
-Renderer::Renderer(WindowHandle& _window, Device& _device) 
+Renderer::Renderer(WindowHandle& _window, Device& _device, bool _useWeightedBlendedOIT, uint32 _recordingThreadCount,
+	bool _enableDynamicResolution, float _dynamicResolutionMinScale, float _dynamicResolutionTargetFrameTime)
 	: m_window {_window}
 	, m_device { _device }
+	, m_useWeightedBlendedOIT{ _useWeightedBlendedOIT }
 {
+	// before the swap chain, which creates the scene color targets only with dynamic resolution
+	if (_enableDynamicResolution)
+	{
+		m_dynamicResolution = std::make_unique<DynamicResolution>(m_device, _dynamicResolutionMinScale, _dynamicResolutionTargetFrameTime);
+	}
+
 	RecreateSwapChain();	// it does create the pipeline as well
 	CreateCommandBuffers();
+
+	if (_recordingThreadCount > 0)
+	{
+		m_parallelCommandRecorder = std::make_unique<ParallelCommandRecorder>(m_device, _recordingThreadCount);
+	}
 }
 
 Renderer::~Renderer()
 {
+	// the worker pools could still be in use by the last submitted frames
+	vkDeviceWaitIdle(m_device.GetDevice());
+	m_parallelCommandRecorder.reset();
+	m_dynamicResolution.reset();
+
 	FreeCommandBuffers();
 }
 
@@ -41,18 +62,20 @@ void Renderer::RecreateSwapChain()
 
 	if (m_swapChain == nullptr)
 	{
-		m_swapChain = std::make_unique<SwapChain>(m_device, extent);
+		m_swapChain = std::make_unique<SwapChain>(m_device, extent, m_useWeightedBlendedOIT, IsDynamicResolutionEnabled());
 	}
 	else
 	{
 		std::shared_ptr<SwapChain> oldSwapChain = std::move(m_swapChain);
-		m_swapChain = std::make_unique<SwapChain>(m_device, extent, oldSwapChain);
+		m_swapChain = std::make_unique<SwapChain>(m_device, extent, oldSwapChain, m_useWeightedBlendedOIT, IsDynamicResolutionEnabled());
 
 		if (!oldSwapChain->CompareSwapFormats(*m_swapChain.get()))
 		{
 			throw std::runtime_error("Swap chain image or depth format has change!");
 		}
 	}
+
+	++m_swapChainGeneration;
 }
 
 void Renderer::CreateCommandBuffers()
@@ -112,6 +135,30 @@ void Renderer::SetupGlobalDescriptors(const std::unordered_map<VkDescriptorType,
 	m_globalPool = descriptorBuilder.Build();
 }
 
+VkExtent2D Renderer::GetRenderExtent() const
+{
+	const VkExtent2D extent = m_swapChain->GetSwapChainExtent();
+	return m_dynamicResolution ? m_dynamicResolution->GetScaledExtent(extent) : extent;
+}
+
+void Renderer::ScaleToRenderExtent(VkViewport& _viewport, VkRect2D& _scissor) const
+{
+	const VkExtent2D extent = m_swapChain->GetSwapChainExtent();
+	const VkExtent2D renderExtent = GetRenderExtent();
+	const float scaleX = static_cast<float>(renderExtent.width) / static_cast<float>(extent.width);
+	const float scaleY = static_cast<float>(renderExtent.height) / static_cast<float>(extent.height);
+
+	_viewport.x *= scaleX;
+	_viewport.y *= scaleY;
+	_viewport.width *= scaleX;
+	_viewport.height *= scaleY;
+
+	_scissor.offset.x = static_cast<int32>(static_cast<float>(_scissor.offset.x) * scaleX);
+	_scissor.offset.y = static_cast<int32>(static_cast<float>(_scissor.offset.y) * scaleY);
+	_scissor.extent.width = (std::min)(static_cast<uint32>(static_cast<float>(_scissor.extent.width) * scaleX + 0.5f), renderExtent.width);
+	_scissor.extent.height = (std::min)(static_cast<uint32>(static_cast<float>(_scissor.extent.height) * scaleY + 0.5f), renderExtent.height);
+}
+
 VkCommandBuffer Renderer::BeginFrame()
 {
 	assertMsgReturnValue(!IsFrameStarted(), "Cannot call begin frame while is already in progress", VK_NULL_HANDLE);
@@ -132,6 +179,12 @@ VkCommandBuffer Renderer::BeginFrame()
 
 	m_isFrameStarted = true;
 
+	// the fence of this frame has been waited by AcquireNextImage, the secondary command buffers of this frame are free to be reused
+	if (m_parallelCommandRecorder)
+	{
+		m_parallelCommandRecorder->BeginFrame(m_currentFrameIndex);
+	}
+
 	auto commandBuffer = GetCurrentCommandBuffer();
 
 	VkCommandBufferBeginInfo beginInfo{};
@@ -141,6 +194,12 @@ VkCommandBuffer Renderer::BeginFrame()
 	{
 		throw std::runtime_error("failed to begin recording command buffer!");
 	}
+
+	// the GPU time of the last use of this frame picks the render extent of the whole frame
+	if (m_dynamicResolution)
+	{
+		m_dynamicResolution->BeginFrame(commandBuffer, m_currentFrameIndex);
+	}
 	
 	return commandBuffer;
 }
@@ -151,6 +210,11 @@ void Renderer::EndFrame()
 
 	auto commandBuffer = GetCurrentCommandBuffer();
 
+	if (m_dynamicResolution)
+	{
+		m_dynamicResolution->EndFrame(commandBuffer, m_currentFrameIndex);
+	}
+
 	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
 	{
 		throw std::runtime_error("failed to record command buffer!");
@@ -186,23 +250,29 @@ void Renderer::BeginSwapChainRenderPass(VkCommandBuffer _commandBuffer)
 	// we need to say which frame buffer this render pass is writing in
 	renderPassInfo.framebuffer = m_swapChain->GetFrameBuffer(m_currentImageIndex);
 
-	// define the area where the shader loads and stores will take place
+	// define the area where the shader loads and stores will take place, with dynamic resolution only the scaled corner of the targets
 	renderPassInfo.renderArea.offset = { 0, 0 };
-	renderPassInfo.renderArea.extent = m_swapChain->GetSwapChainExtent();
+	renderPassInfo.renderArea.extent = GetRenderExtent();
 
 	// clear values, which are the initial values of the frame buffer attachments
-	std::array<VkClearValue, 2> clearValues{};
+	std::array<VkClearValue, 4> clearValues{};
 	clearValues[0].color = { 0.01f, 0.01f, 0.01f, 1.0f };	// in the render pass, the attachment 0 is the color buffer
 	clearValues[1].depthStencil = { 1.0f, 0 };			// in the render pass, the attachment 1 is the depth buffer
+	clearValues[2].color = { 0.0f, 0.0f, 0.0f, 0.0f };	// OIT accumulation starts empty
+	clearValues[3].color = { 1.0f, 0.0f, 0.0f, 0.0f };	// OIT revealage starts fully revealed
 
-	renderPassInfo.clearValueCount = static_cast<uint32>(clearValues.size());
+	renderPassInfo.clearValueCount = m_useWeightedBlendedOIT ? static_cast<uint32>(clearValues.size()) : 2u;
 	renderPassInfo.pClearValues = clearValues.data();
 
 	// Now record this command buffer to begin this render pass
 	// VK_SUBPASS_CONTENTS_INLINE is signaling that the subsequent render pass commands 
 	// will be directly embedded in the primary command buffer itself and no secondary command buffer will be used
 	// So cannot be mixed, or the render pass is only from primary or is only from secondary
-	vkCmdBeginRenderPass(_commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+	// With parallel recording is VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS: the primary only executes the secondary command buffers
+	const VkSubpassContents subpassContents = m_parallelCommandRecorder ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE;
+	vkCmdBeginRenderPass(_commandBuffer, &renderPassInfo, subpassContents);
+
+	m_currentSubpass = 0;
 
 
 	// The Viewport describe the transformation between the pipeline's output and target image
@@ -213,8 +283,8 @@ void Renderer::BeginSwapChainRenderPass(VkCommandBuffer _commandBuffer)
 	VkViewport viewport{};
 	viewport.x = 0.0f;
 	viewport.y = 0.0f;
-	viewport.width = static_cast<float>(m_swapChain->GetSwapChainExtent().width);
-	viewport.height = static_cast<float>(m_swapChain->GetSwapChainExtent().height);
+	viewport.width = static_cast<float>(renderPassInfo.renderArea.extent.width);
+	viewport.height = static_cast<float>(renderPassInfo.renderArea.extent.height);
 	viewport.minDepth = 0.0f;
 	viewport.maxDepth = 1.0f;
 
@@ -222,10 +292,17 @@ void Renderer::BeginSwapChainRenderPass(VkCommandBuffer _commandBuffer)
 	// Any pixels outside of the Scissor rectangle (offset + extent) will be discarded.
 	VkRect2D scissor{};
 	scissor.offset = { 0, 0 };
-	scissor.extent = m_swapChain->GetSwapChainExtent();
+	scissor.extent = renderPassInfo.renderArea.extent;
 
-	vkCmdSetViewport(_commandBuffer, 0, 1, &viewport);
-	vkCmdSetScissor(_commandBuffer, 0, 1, &scissor);
+	m_currentViewport = viewport;
+	m_currentScissor = scissor;
+
+	// only vkCmdExecuteCommands is allowed in the primary, the secondary command buffers set them
+	if (!m_parallelCommandRecorder)
+	{
+		vkCmdSetViewport(_commandBuffer, 0, 1, &viewport);
+		vkCmdSetScissor(_commandBuffer, 0, 1, &scissor);
+	}
 }
 
 void Renderer::BeginSwapChainRenderPass(VkCommandBuffer _commandBuffer, VkViewport _viewport, VkRect2D _scissor)
@@ -243,24 +320,41 @@ void Renderer::BeginSwapChainRenderPass(VkCommandBuffer _commandBuffer, VkViewpo
 
 	// define the area where the shader loads and stores will take place
 	renderPassInfo.renderArea.offset = { 0, 0 };
-	renderPassInfo.renderArea.extent = m_swapChain->GetSwapChainExtent();
+	renderPassInfo.renderArea.extent = GetRenderExtent();
 
 	// clear values, which are the initial values of the frame buffer attachments
-	std::array<VkClearValue, 2> clearValues{};
+	std::array<VkClearValue, 4> clearValues{};
 	clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };	// in the render pass, the attachment 0 is the color buffer
 	clearValues[1].depthStencil = { 1.0f, 0 };			// in the render pass, the attachment 1 is the depth buffer
+	clearValues[2].color = { 0.0f, 0.0f, 0.0f, 0.0f };	// OIT accumulation starts empty
+	clearValues[3].color = { 1.0f, 0.0f, 0.0f, 0.0f };	// OIT revealage starts fully revealed
 
-	renderPassInfo.clearValueCount = static_cast<uint32>(clearValues.size());
+	renderPassInfo.clearValueCount = m_useWeightedBlendedOIT ? static_cast<uint32>(clearValues.size()) : 2u;
 	renderPassInfo.pClearValues = clearValues.data();
 
 	// Now record this command buffer to begin this render pass
 	// VK_SUBPASS_CONTENTS_INLINE is signaling that the subsequent render pass commands 
 	// will be directly embedded in the primary command buffer itself and no secondary command buffer will be used
 	// So cannot be mixed, or the render pass is only from primary or is only from secondary
-	vkCmdBeginRenderPass(_commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+	// With parallel recording is VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS: the primary only executes the secondary command buffers
+	const VkSubpassContents subpassContents = m_parallelCommandRecorder ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE;
+	vkCmdBeginRenderPass(_commandBuffer, &renderPassInfo, subpassContents);
+
+	m_currentSubpass = 0;
+
+	if (m_dynamicResolution)
+	{
+		ScaleToRenderExtent(_viewport, _scissor);
+	}
+
+	m_currentViewport = _viewport;
+	m_currentScissor = _scissor;
 
-	vkCmdSetViewport(_commandBuffer, 0, 1, &_viewport);
-	vkCmdSetScissor(_commandBuffer, 0, 1, &_scissor);
+	if (!m_parallelCommandRecorder)
+	{
+		vkCmdSetViewport(_commandBuffer, 0, 1, &_viewport);
+		vkCmdSetScissor(_commandBuffer, 0, 1, &_scissor);
+	}
 }
 
 void Renderer::EndSwapChainRenderPass(VkCommandBuffer _commandBuffer)
@@ -271,4 +365,107 @@ void Renderer::EndSwapChainRenderPass(VkCommandBuffer _commandBuffer)
 	vkCmdEndRenderPass(_commandBuffer);
 }
 
+void Renderer::BeginUpscaleRenderPass(VkCommandBuffer _commandBuffer)
+{
+	assertMsgReturnVoid(IsFrameStarted(), "Cannot call BeginUpscaleRenderPass while the frame is not in progress");
+	assertMsgReturnVoid(_commandBuffer == GetCurrentCommandBuffer(), "Cannot begin render pass on command buffer from a different frame");
+	assertMsgReturnVoid(IsDynamicResolutionEnabled(), "Cannot call BeginUpscaleRenderPass when dynamic resolution is disabled");
+
+	const VkExtent2D extent = m_swapChain->GetSwapChainExtent();
+
+	// nothing to clear, the full screen draw writes every pixel
+	VkRenderPassBeginInfo renderPassInfo{};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.renderPass = m_swapChain->GetUpscaleRenderPass();
+	renderPassInfo.framebuffer = m_swapChain->GetUpscaleFrameBuffer(m_currentImageIndex);
+	renderPassInfo.renderArea.offset = { 0, 0 };
+	renderPassInfo.renderArea.extent = extent;
+
+	vkCmdBeginRenderPass(_commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+	VkViewport viewport{};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = static_cast<float>(extent.width);
+	viewport.height = static_cast<float>(extent.height);
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+
+	VkRect2D scissor{};
+	scissor.offset = { 0, 0 };
+	scissor.extent = extent;
+
+	vkCmdSetViewport(_commandBuffer, 0, 1, &viewport);
+	vkCmdSetScissor(_commandBuffer, 0, 1, &scissor);
+}
+
+void Renderer::EndUpscaleRenderPass(VkCommandBuffer _commandBuffer)
+{
+	assertMsgReturnVoid(IsFrameStarted(), "Cannot call EndUpscaleRenderPass while the frame is not in progress");
+	assertMsgReturnVoid(_commandBuffer == GetCurrentCommandBuffer(), "Cannot end render pass on command buffer from a different frame");
+
+	vkCmdEndRenderPass(_commandBuffer);
+}
+
+void Renderer::NextSubpass(VkCommandBuffer _commandBuffer)
+{
+	assertMsgReturnVoid(IsFrameStarted(), "Cannot call NextSubpass while the frame is not in progress");
+	assertMsgReturnVoid(_commandBuffer == GetCurrentCommandBuffer(), "Cannot move to the next subpass on command buffer from a different frame");
+	assertMsgReturnVoid(m_useWeightedBlendedOIT, "Cannot call NextSubpass when the swap chain render pass has a single subpass");
+
+	const VkSubpassContents subpassContents = m_parallelCommandRecorder ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE;
+	vkCmdNextSubpass(_commandBuffer, subpassContents);
+
+	++m_currentSubpass;
+}
+
+void Renderer::RecordSubpass(const FrameInfo& _frameInfo, const std::vector<RenderFunction>& _renderFunctions, const RenderFunction& _secondaryPrologue)
+{
+	assertMsgReturnVoid(IsFrameStarted(), "Cannot call RecordSubpass while the frame is not in progress");
+	assertMsgReturnVoid(_frameInfo.CommandBuffer == GetCurrentCommandBuffer(), "Cannot record a subpass on command buffer from a different frame");
+
+	if (!m_parallelCommandRecorder)
+	{
+		for (const RenderFunction& renderFunction : _renderFunctions)
+		{
+			renderFunction(_frameInfo);
+		}
+		return;
+	}
+
+	if (_renderFunctions.empty())
+	{
+		return;
+	}
+
+	std::vector<ParallelCommandRecorder::RecordTask> tasks;
+	tasks.reserve(_renderFunctions.size());
+
+	for (const RenderFunction& renderFunction : _renderFunctions)
+	{
+		tasks.emplace_back([&_frameInfo, &renderFunction, &_secondaryPrologue](VkCommandBuffer _secondaryCommandBuffer)
+		{
+			FrameInfo secondaryFrameInfo = _frameInfo;
+			secondaryFrameInfo.CommandBuffer = _secondaryCommandBuffer;
+
+			if (_secondaryPrologue)
+			{
+				_secondaryPrologue(secondaryFrameInfo);
+			}
+
+			renderFunction(secondaryFrameInfo);
+		});
+	}
+
+	VkCommandBufferInheritanceInfo inheritanceInfo{};
+	inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritanceInfo.renderPass = m_swapChain->GetRenderPass();
+	inheritanceInfo.subpass = m_currentSubpass;
+	inheritanceInfo.framebuffer = m_swapChain->GetFrameBuffer(m_currentImageIndex);
+
+	m_parallelCommandRecorder->Record(m_currentFrameIndex, inheritanceInfo, m_currentViewport, m_currentScissor, tasks, m_secondaryCommandBuffers);
+
+	vkCmdExecuteCommands(_frameInfo.CommandBuffer, static_cast<uint32>(m_secondaryCommandBuffers.size()), m_secondaryCommandBuffers.data());
+}
+
 VESPERENGINE_NAMESPACE_END
@@ -7,11 +7,13 @@
 #include "Core/core_defines.h"
 
 #include "Backend/swap_chain.h"
+#include "Backend/frame_info.h"
 
 #include "vma/vk_mem_alloc.h"
 
 #include <memory>
 #include <vector>
+#include <functional>
 #include <unordered_map>
 
 
@@ -21,11 +23,20 @@ class SwapChain;
 class DescriptorPool;
 class Device;
 class WindowHandle;
+class ParallelCommandRecorder;
+class DynamicResolution;
 
 class VESPERENGINE_API Renderer final
 {
 public:
-	Renderer(WindowHandle& _window, Device& _device);
+	using RenderFunction = std::function<void(const FrameInfo&)>;
+
+public:
+	// _recordingThreadCount greater than 0 records the swap chain render pass in secondary command buffers on that many threads.
+	// _enableDynamicResolution renders the swap chain render pass at a scale between _dynamicResolutionMinScale and 1 of the swap chain extent,
+	// adjusted to keep the GPU frame time around _dynamicResolutionTargetFrameTime milliseconds: the upscale render pass then fills the swap chain image
+	Renderer(WindowHandle& _window, Device& _device, bool _useWeightedBlendedOIT = false, uint32 _recordingThreadCount = 0,
+		bool _enableDynamicResolution = false, float _dynamicResolutionMinScale = 0.5f, float _dynamicResolutionTargetFrameTime = 16.6f);
 	~Renderer();
 
 	Renderer(const Renderer&) = delete;
@@ -34,7 +45,22 @@ public:
 public:
 	VESPERENGINE_INLINE VkRenderPass GetSwapChainRenderPass() const { return m_swapChain->GetRenderPass(); }
 	VESPERENGINE_INLINE float GetAspectRatio() const { return m_swapChain->GetExtentAspectRatio(); };
+	VESPERENGINE_INLINE VkExtent2D GetSwapChainExtent() const { return m_swapChain->GetSwapChainExtent(); }
 	VESPERENGINE_INLINE DescriptorPool* GetDescriptorPool() const { return m_globalPool.get(); }
+	VESPERENGINE_INLINE std::size_t GetSwapChainImageCount() const { return m_swapChain->GetImageCount(); }
+	VESPERENGINE_INLINE uint32 GetCurrentImageIndex() const { return m_currentImageIndex; }
+	// increased every time the swap chain is recreated, so who holds swap chain resources (i.e. input attachments) knows when to update them
+	VESPERENGINE_INLINE uint32 GetSwapChainGeneration() const { return m_swapChainGeneration; }
+
+	VESPERENGINE_INLINE bool IsWeightedBlendedOITEnabled() const { return m_useWeightedBlendedOIT; }
+	VESPERENGINE_INLINE VkImageView GetOITAccumulationImageView(int32 _imageIndex) const { return m_swapChain->GetOITAccumulationImageView(_imageIndex); }
+	VESPERENGINE_INLINE VkImageView GetOITRevealageImageView(int32 _imageIndex) const { return m_swapChain->GetOITRevealageImageView(_imageIndex); }
+
+	VESPERENGINE_INLINE bool IsParallelRecordingEnabled() const { return m_parallelCommandRecorder != nullptr; }
+
+	VESPERENGINE_INLINE bool IsDynamicResolutionEnabled() const { return m_dynamicResolution != nullptr; }
+	VESPERENGINE_INLINE VkRenderPass GetUpscaleRenderPass() const { return m_swapChain->GetUpscaleRenderPass(); }
+	VESPERENGINE_INLINE VkImageView GetSceneColorImageView(int32 _imageIndex) const { return m_swapChain->GetSceneColorImageView(_imageIndex); }
 
 	VESPERENGINE_INLINE bool IsFrameStarted() const { return m_isFrameStarted; }
 	VESPERENGINE_INLINE VkCommandBuffer GetCurrentCommandBuffer() const 
@@ -49,6 +75,9 @@ public:
 		return m_currentFrameIndex;
 	}
 
+	// extent the swap chain render pass draws in this frame, the swap chain extent unless dynamic resolution scales it
+	VkExtent2D GetRenderExtent() const;
+
 public:
 	void SetupGlobalDescriptors(const std::unordered_map<VkDescriptorType, uint32>& _descriptorTypesAndSize, uint32 _maxSetCount);
 
@@ -59,10 +88,25 @@ public:
 	void BeginSwapChainRenderPass(VkCommandBuffer _commandBuffer, VkViewport _viewport, VkRect2D _scissor);
 	void EndSwapChainRenderPass(VkCommandBuffer _commandBuffer);
 
+	// only with dynamic resolution, after EndSwapChainRenderPass: the render pass presenting the swap chain image, recorded inline
+	void BeginUpscaleRenderPass(VkCommandBuffer _commandBuffer);
+	void EndUpscaleRenderPass(VkCommandBuffer _commandBuffer);
+
+	// move to the next subpass of the swap chain render pass, only meaningful when weighted blended OIT is enabled
+	void NextSubpass(VkCommandBuffer _commandBuffer);
+
+	// Record the content of the current subpass. Inline it calls the functions in order on the primary command buffer,
+	// with parallel recording each function records its own secondary command buffer on a worker thread and the primary executes them in order.
+	// Bound descriptor sets and dynamic states are not inherited by secondary command buffers: _secondaryPrologue, if any, is called
+	// at the beginning of each of them, i.e. to bind the global descriptor sets.
+	void RecordSubpass(const FrameInfo& _frameInfo, const std::vector<RenderFunction>& _renderFunctions, const RenderFunction& _secondaryPrologue = nullptr);
+
 private:
 	void RecreateSwapChain();
 	void CreateCommandBuffers();
 	void FreeCommandBuffers();
+	// the viewport and scissor given for the swap chain extent, moved in the render area
+	void ScaleToRenderExtent(VkViewport& _viewport, VkRect2D& _scissor) const;
 
 private:
 	WindowHandle& m_window;
@@ -71,9 +115,18 @@ private:
 	std::unique_ptr<DescriptorPool> m_globalPool;
 	std::vector<VkCommandBuffer> m_commandBuffers;
 
+	std::unique_ptr<ParallelCommandRecorder> m_parallelCommandRecorder;
+	std::unique_ptr<DynamicResolution> m_dynamicResolution;
+	std::vector<VkCommandBuffer> m_secondaryCommandBuffers;
+	VkViewport m_currentViewport{};
+	VkRect2D m_currentScissor{};
+	uint32 m_currentSubpass = 0;
+
 	uint32 m_currentImageIndex = 0;
+	uint32 m_swapChainGeneration = 0;
 	int32 m_currentFrameIndex = 0;
 	bool m_isFrameStarted = false;
+	bool m_useWeightedBlendedOIT = false;
 };
 
 VESPERENGINE_NAMESPACE_END
\ No newline at end of file
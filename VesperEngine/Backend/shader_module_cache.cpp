@@ -0,0 +1,178 @@
+// Copyright (c) 2025-2025 Michele Condo'
+// File: C:\Projects\Vesper\VesperEngine\Backend\shader_module_cache.cpp
+// Licensed under the MIT License. See LICENSE file in the project root for full license information.
+
+#include "Backend/shader_module_cache.h"
+#include "Backend/device.h"
+
+#include "Utility/hash.h"
+#include "Utility/logger.h"
+
+#include <stdexcept>
+#include <fstream>
+
+
+VESPERENGINE_NAMESPACE_BEGIN
+
+ShaderModuleCache::ShaderModuleCache(Device& _device)
+	: m_device{ _device }
+{
+}
+
+ShaderModuleCache::~ShaderModuleCache()
+{
+	for (const auto& [module, entry] : m_modules)
+	{
+		if (entry.ReferenceCount > 0)
+		{
+			LOG(Logger::WARNING, "Shader module of ", entry.Filepath, " still used by ", entry.ReferenceCount, " pipelines when the cache is destroyed");
+		}
+		vkDestroyShaderModule(m_device.GetDevice(), module, nullptr);
+	}
+}
+
+VkShaderModule ShaderModuleCache::Acquire(const std::string& _filepath)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	const auto current = m_currentModules.find(_filepath);
+	if (current != m_currentModules.end())
+	{
+		++m_modules[current->second].ReferenceCount;
+		return current->second;
+	}
+
+	std::size_t size = 0;
+	const std::vector<uint32> code = ReadFile(_filepath, size);
+
+	const VkShaderModule module = CreateShaderModule(code, size);
+
+	ModuleEntry& entry = m_modules[module];
+	entry.Filepath = _filepath;
+	entry.ContentHash = HashBytes(code.data(), size);
+	entry.ReferenceCount = 1;
+
+	m_currentModules[_filepath] = module;
+
+	return module;
+}
+
+void ShaderModuleCache::Release(VkShaderModule _module)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	const auto found = m_modules.find(_module);
+	assertMsgReturnVoid(found != m_modules.end(), "Cannot release shader module: not acquired from the cache");
+
+	ModuleEntry& entry = found->second;
+	if (--entry.ReferenceCount > 0)
+	{
+		return;
+	}
+
+	const auto current = m_currentModules.find(entry.Filepath);
+	if (current != m_currentModules.end() && current->second == _module)
+	{
+		m_currentModules.erase(current);
+	}
+
+	vkDestroyShaderModule(m_device.GetDevice(), _module, nullptr);
+	m_modules.erase(found);
+}
+
+uint32 ShaderModuleCache::Reload()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	uint32 reloadedCount = 0;
+
+	for (auto& [filepath, module] : m_currentModules)
+	{
+		std::size_t size = 0;
+		std::vector<uint32> code;
+		try
+		{
+			code = ReadFile(filepath, size);
+		}
+		catch (const std::exception& _exception)
+		{
+			// i.e. the file is being written by the compiler, the current module is kept
+			LOG(Logger::WARNING, "Shader ", filepath, " not reloaded: ", _exception.what());
+			continue;
+		}
+
+		const uint32 contentHash = HashBytes(code.data(), size);
+		if (contentHash == m_modules[module].ContentHash)
+		{
+			continue;
+		}
+
+		const VkShaderModule newModule = CreateShaderModule(code, size);
+
+		ModuleEntry& entry = m_modules[newModule];
+		entry.Filepath = filepath;
+		entry.ContentHash = contentHash;
+
+		// the replaced module lives on until its pipelines release it, the cache keeps no reference to it
+		ModuleEntry& replacedEntry = m_modules[module];
+		if (replacedEntry.ReferenceCount == 0)
+		{
+			vkDestroyShaderModule(m_device.GetDevice(), module, nullptr);
+			m_modules.erase(module);
+		}
+
+		module = newModule;
+		++reloadedCount;
+	}
+
+	return reloadedCount;
+}
+
+uint32 ShaderModuleCache::GetModuleCount() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return static_cast<uint32>(m_modules.size());
+}
+
+std::vector<uint32> ShaderModuleCache::ReadFile(const std::string& _filepath, std::size_t& _outSize)
+{
+	std::ifstream file{ _filepath, std::ios::ate | std::ios::binary };
+
+	if (!file.is_open())
+	{
+		throw std::runtime_error("failed to open file: " + _filepath + "!");
+	}
+
+	_outSize = static_cast<std::size_t>(file.tellg());
+
+	// SPIR-V is a stream of 32 bit words, the module creation needs them aligned
+	if (_outSize == 0 || _outSize % sizeof(uint32) != 0)
+	{
+		throw std::runtime_error("invalid SPIR-V size in file: " + _filepath + "!");
+	}
+
+	std::vector<uint32> code(_outSize / sizeof(uint32));
+
+	file.seekg(0);
+	file.read(reinterpret_cast<char*>(code.data()), _outSize);
+
+	return code;
+}
+
+VkShaderModule ShaderModuleCache::CreateShaderModule(const std::vector<uint32>& _code, std::size_t _size) const
+{
+	VkShaderModuleCreateInfo createInfo{};
+	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	createInfo.codeSize = _size;
+	createInfo.pCode = _code.data();
+
+	VkShaderModule module = VK_NULL_HANDLE;
+	if (vkCreateShaderModule(m_device.GetDevice(), &createInfo, nullptr, &module) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create shader module!");
+	}
+
+	return module;
+}
+
+VESPERENGINE_NAMESPACE_END
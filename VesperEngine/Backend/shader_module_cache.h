@@ -0,0 +1,69 @@
+// Copyright (c) 2025-2025 Michele Condo'
+// File: C:\Projects\Vesper\VesperEngine\Backend\shader_module_cache.h
+// Licensed under the MIT License. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include "Core/core_defines.h"
+
+#include "vulkan/vulkan.h"
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+
+
+VESPERENGINE_NAMESPACE_BEGIN
+
+class Device;
+
+/**
+ * Shader modules shared by all the pipelines, owned by the device.
+ * Every SPIR-V file is read and its module created once, the pipelines using the same stage (i.e. the vertex shader of the
+ * material permutations) get the same module. The modules are reference counted: a pipeline acquires its stages when created
+ * and releases them when destroyed, the last release destroys the module.
+ * The modules are identified by path and content hash: when Reload finds a file changed, the next Acquire of the path gets
+ * a new module, while the pipelines already created keep the previous one until they release it.
+ * Thread safe, the pipelines are compiled on the workers of the PipelineCompiler as well.
+ */
+class VESPERENGINE_API ShaderModuleCache final
+{
+public:
+	ShaderModuleCache(Device& _device);
+	~ShaderModuleCache();
+
+	ShaderModuleCache(const ShaderModuleCache&) = delete;
+	ShaderModuleCache& operator=(const ShaderModuleCache&) = delete;
+
+public:
+	// Module of the SPIR-V file at _filepath, created the first time: every Acquire must be matched by a Release
+	VkShaderModule Acquire(const std::string& _filepath);
+	void Release(VkShaderModule _module);
+
+	// Read again the files of the current modules, the changed ones get a new module. Returns how many changed.
+	// The pipelines must be created again to use the new modules
+	uint32 Reload();
+
+	uint32 GetModuleCount() const;
+
+private:
+	struct ModuleEntry
+	{
+		std::string Filepath;
+		uint32 ContentHash{ 0 };
+		uint32 ReferenceCount{ 0 };
+	};
+
+	static std::vector<uint32> ReadFile(const std::string& _filepath, std::size_t& _outSize);
+	VkShaderModule CreateShaderModule(const std::vector<uint32>& _code, std::size_t _size) const;
+
+private:
+	Device& m_device;
+
+	mutable std::mutex m_mutex;
+	std::unordered_map<VkShaderModule, ModuleEntry> m_modules;		// current and replaced by a reload, until released
+	std::unordered_map<std::string, VkShaderModule> m_currentModules;	// by path, the one the next Acquire returns
+};
+
+VESPERENGINE_NAMESPACE_END
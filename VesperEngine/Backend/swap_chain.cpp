@@ -20,17 +20,21 @@
 VESPERENGINE_NAMESPACE_BEGIN
 
 
-SwapChain::SwapChain(Device& _device, VkExtent2D _windowExtent)
+SwapChain::SwapChain(Device& _device, VkExtent2D _windowExtent, bool _useWeightedBlendedOIT, bool _useDynamicResolution)
 	: m_device{ _device }
 	, m_windowExtent{ _windowExtent }
+	, m_useWeightedBlendedOIT{ _useWeightedBlendedOIT }
+	, m_useDynamicResolution{ _useDynamicResolution }
 {
 	Init();
 }
 
-SwapChain::SwapChain(Device& _device, VkExtent2D _windowExtent, std::shared_ptr<SwapChain> _previous)
+SwapChain::SwapChain(Device& _device, VkExtent2D _windowExtent, std::shared_ptr<SwapChain> _previous, bool _useWeightedBlendedOIT, bool _useDynamicResolution)
 	: m_device{ _device }
 	, m_windowExtent{ _windowExtent }
 	, m_oldSwapChain{ _previous }
+	, m_useWeightedBlendedOIT{ _useWeightedBlendedOIT }
+	, m_useDynamicResolution{ _useDynamicResolution }
 {
 	Init();
 	m_oldSwapChain = nullptr;
@@ -42,8 +46,12 @@ void SwapChain::Init()
 	CreateSwapChain();
 	CreateImageViews();
 	CreateRenderPass();
+	CreateUpscaleRenderPass();
 	CreateDepthResources();
+	CreateOITResources();
+	CreateSceneColorResources();
 	CreateFramebuffers();
+	CreateUpscaleFramebuffers();
 	CreateSyncObjects();
 }
 
@@ -67,13 +75,37 @@ SwapChain::~SwapChain()
 		vmaDestroyImage(m_device.GetAllocator(), m_depthImages[i], m_depthImageMemorys[i]);
 	}
 
+	for (int32 i = 0; i < m_oitAccumulationImages.size(); ++i)
+	{
+		vkDestroyImageView(m_device.GetDevice(), m_oitAccumulationImageViews[i], nullptr);
+		vmaDestroyImage(m_device.GetAllocator(), m_oitAccumulationImages[i], m_oitAccumulationImageMemorys[i]);
+		vkDestroyImageView(m_device.GetDevice(), m_oitRevealageImageViews[i], nullptr);
+		vmaDestroyImage(m_device.GetAllocator(), m_oitRevealageImages[i], m_oitRevealageImageMemorys[i]);
+	}
+
+	for (int32 i = 0; i < m_sceneColorImages.size(); ++i)
+	{
+		vkDestroyImageView(m_device.GetDevice(), m_sceneColorImageViews[i], nullptr);
+		vmaDestroyImage(m_device.GetAllocator(), m_sceneColorImages[i], m_sceneColorImageMemorys[i]);
+	}
+
 	for (auto framebuffer : m_swapChainFramebuffers)
 	{
 		vkDestroyFramebuffer(m_device.GetDevice(), framebuffer, nullptr);
 	}
 
+	for (auto framebuffer : m_upscaleFramebuffers)
+	{
+		vkDestroyFramebuffer(m_device.GetDevice(), framebuffer, nullptr);
+	}
+
 	vkDestroyRenderPass(m_device.GetDevice(), m_renderPass, nullptr);
 
+	if (m_upscaleRenderPass != VK_NULL_HANDLE)
+	{
+		vkDestroyRenderPass(m_device.GetDevice(), m_upscaleRenderPass, nullptr);
+	}
+
 	// cleanup synchronization objects
 	for (std::size_t i = 0; i < kMaxFramesInFlight; ++i) 
 	{
@@ -254,7 +286,7 @@ void SwapChain::CreateRenderPass()
 	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
 	VkAttachmentReference depthAttachmentRef{};
-	depthAttachmentRef.attachment = 1;
+	depthAttachmentRef.attachment = kDepthAttachmentIndex;
 	depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
 	VkAttachmentDescription colorAttachment = {};
@@ -265,10 +297,11 @@ void SwapChain::CreateRenderPass()
 	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	// the scene color target is left to be sampled by the upscale render pass, which is the one presenting
+	colorAttachment.finalLayout = m_useDynamicResolution ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
 	VkAttachmentReference colorAttachmentRef = {};
-	colorAttachmentRef.attachment = 0;
+	colorAttachmentRef.attachment = kColorAttachmentIndex;
 	colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
 	VkSubpassDescription subpass = {};
@@ -285,6 +318,18 @@ void SwapChain::CreateRenderPass()
 	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
 	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 
+	if (m_useWeightedBlendedOIT)
+	{
+		CreateOITRenderPass(colorAttachment, depthAttachment, subpass, dependency);
+		return;
+	}
+
+	std::vector<VkSubpassDependency> dependencies = { dependency };
+	if (m_useDynamicResolution)
+	{
+		dependencies.push_back(GetSceneColorReadDependency(kOpaqueSubpass));
+	}
+
 	std::array<VkAttachmentDescription, 2> attachments = { colorAttachment, depthAttachment };
 	VkRenderPassCreateInfo renderPassInfo = {};
 	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
@@ -292,8 +337,8 @@ void SwapChain::CreateRenderPass()
 	renderPassInfo.pAttachments = attachments.data();
 	renderPassInfo.subpassCount = 1;
 	renderPassInfo.pSubpasses = &subpass;
-	renderPassInfo.dependencyCount = 1;
-	renderPassInfo.pDependencies = &dependency;
+	renderPassInfo.dependencyCount = static_cast<uint32>(dependencies.size());
+	renderPassInfo.pDependencies = dependencies.data();
 
 	if (vkCreateRenderPass(m_device.GetDevice(), &renderPassInfo, nullptr, &m_renderPass) != VK_SUCCESS)
 	{
@@ -301,12 +346,188 @@ void SwapChain::CreateRenderPass()
 	}
 }
 
+void SwapChain::CreateOITRenderPass(const VkAttachmentDescription& _colorAttachment, const VkAttachmentDescription& _depthAttachment,
+	const VkSubpassDescription& _opaqueSubpass, const VkSubpassDependency& _externalDependency)
+{
+	// Weighted blended OIT (McGuire and Bavoil 2013):
+	//	subpass 0: opaque geometry into color and depth
+	//	subpass 1: transparent geometry into accumulation and revealage, depth tested but not written
+	//	subpass 2: full screen composite of accumulation and revealage over the color, read as input attachments
+	// the OIT targets live only inside the render pass, so they are never stored
+	VkAttachmentDescription accumulationAttachment{};
+	accumulationAttachment.format = kOITAccumulationFormat;
+	accumulationAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	accumulationAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	accumulationAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	accumulationAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	accumulationAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	accumulationAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	accumulationAttachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	VkAttachmentDescription revealageAttachment = accumulationAttachment;
+	revealageAttachment.format = kOITRevealageFormat;
+
+	std::array<VkAttachmentReference, 2> oitColorAttachmentRefs{};
+	oitColorAttachmentRefs[0].attachment = kOITAccumulationAttachmentIndex;
+	oitColorAttachmentRefs[0].layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	oitColorAttachmentRefs[1].attachment = kOITRevealageAttachmentIndex;
+	oitColorAttachmentRefs[1].layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+	VkAttachmentReference readOnlyDepthAttachmentRef{};
+	readOnlyDepthAttachmentRef.attachment = kDepthAttachmentIndex;
+	readOnlyDepthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+	const uint32 preserveColorAttachment = kColorAttachmentIndex;
+
+	VkSubpassDescription transparentSubpass = {};
+	transparentSubpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	transparentSubpass.colorAttachmentCount = static_cast<uint32>(oitColorAttachmentRefs.size());
+	transparentSubpass.pColorAttachments = oitColorAttachmentRefs.data();
+	transparentSubpass.pDepthStencilAttachment = &readOnlyDepthAttachmentRef;
+	transparentSubpass.preserveAttachmentCount = 1;
+	transparentSubpass.pPreserveAttachments = &preserveColorAttachment;
+
+	std::array<VkAttachmentReference, 2> oitInputAttachmentRefs{};
+	oitInputAttachmentRefs[0].attachment = kOITAccumulationAttachmentIndex;
+	oitInputAttachmentRefs[0].layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	oitInputAttachmentRefs[1].attachment = kOITRevealageAttachmentIndex;
+	oitInputAttachmentRefs[1].layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	VkSubpassDescription compositeSubpass = {};
+	compositeSubpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	compositeSubpass.colorAttachmentCount = 1;
+	compositeSubpass.pColorAttachments = _opaqueSubpass.pColorAttachments;
+	compositeSubpass.inputAttachmentCount = static_cast<uint32>(oitInputAttachmentRefs.size());
+	compositeSubpass.pInputAttachments = oitInputAttachmentRefs.data();
+
+	std::vector<VkSubpassDependency> dependencies(4);
+	dependencies[0] = _externalDependency;
+
+	// opaque depth has to be written before the transparent geometry tests against it
+	dependencies[1].srcSubpass = kOpaqueSubpass;
+	dependencies[1].dstSubpass = kTransparentSubpass;
+	dependencies[1].srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependencies[1].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependencies[1].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+	dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+	// accumulation and revealage are read by the composite at the same pixel they have been written
+	dependencies[2].srcSubpass = kTransparentSubpass;
+	dependencies[2].dstSubpass = kCompositeSubpass;
+	dependencies[2].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependencies[2].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	dependencies[2].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	dependencies[2].dstAccessMask = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
+	dependencies[2].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+	// the composite blends over the opaque color
+	dependencies[3].srcSubpass = kOpaqueSubpass;
+	dependencies[3].dstSubpass = kCompositeSubpass;
+	dependencies[3].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependencies[3].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	dependencies[3].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependencies[3].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	dependencies[3].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+	if (m_useDynamicResolution)
+	{
+		dependencies.push_back(GetSceneColorReadDependency(kCompositeSubpass));
+	}
+
+	std::array<VkSubpassDescription, 3> subpasses = { _opaqueSubpass, transparentSubpass, compositeSubpass };
+	std::array<VkAttachmentDescription, 4> attachments = { _colorAttachment, _depthAttachment, accumulationAttachment, revealageAttachment };
+
+	VkRenderPassCreateInfo renderPassInfo = {};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	renderPassInfo.attachmentCount = static_cast<uint32>(attachments.size());
+	renderPassInfo.pAttachments = attachments.data();
+	renderPassInfo.subpassCount = static_cast<uint32>(subpasses.size());
+	renderPassInfo.pSubpasses = subpasses.data();
+	renderPassInfo.dependencyCount = static_cast<uint32>(dependencies.size());
+	renderPassInfo.pDependencies = dependencies.data();
+
+	if (vkCreateRenderPass(m_device.GetDevice(), &renderPassInfo, nullptr, &m_renderPass) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create OIT render pass!");
+	}
+}
+
+void SwapChain::CreateUpscaleRenderPass()
+{
+	if (!m_useDynamicResolution)
+	{
+		return;
+	}
+
+	// a full screen draw covers every pixel of the swap chain image, so its content is never loaded
+	VkAttachmentDescription colorAttachment = {};
+	colorAttachment.format = GetSwapChainImageFormat();
+	colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+	VkAttachmentReference colorAttachmentRef = {};
+	colorAttachmentRef.attachment = 0;
+	colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+	VkSubpassDescription subpass = {};
+	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpass.colorAttachmentCount = 1;
+	subpass.pColorAttachments = &colorAttachmentRef;
+
+	// the swap chain image is acquired at the color output stage, as for the scene render pass
+	VkSubpassDependency dependency = {};
+	dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependency.srcAccessMask = 0;
+	dependency.dstSubpass = 0;
+	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+	VkRenderPassCreateInfo renderPassInfo = {};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	renderPassInfo.attachmentCount = 1;
+	renderPassInfo.pAttachments = &colorAttachment;
+	renderPassInfo.subpassCount = 1;
+	renderPassInfo.pSubpasses = &subpass;
+	renderPassInfo.dependencyCount = 1;
+	renderPassInfo.pDependencies = &dependency;
+
+	if (vkCreateRenderPass(m_device.GetDevice(), &renderPassInfo, nullptr, &m_upscaleRenderPass) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create upscale render pass!");
+	}
+}
+
+VkSubpassDependency SwapChain::GetSceneColorReadDependency(uint32 _lastSubpass) const
+{
+	VkSubpassDependency dependency = {};
+	dependency.srcSubpass = _lastSubpass;
+	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	dependency.dstSubpass = VK_SUBPASS_EXTERNAL;
+	dependency.dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	dependency.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	return dependency;
+}
+
 void SwapChain::CreateFramebuffers()
 {
 	m_swapChainFramebuffers.resize(GetImageCount());
 	for (std::size_t i = 0; i < GetImageCount(); ++i) 
 	{
-		std::array<VkImageView, 2> attachments = { m_swapChainImageViews[i], m_depthImageViews[i] };
+		const VkImageView colorImageView = m_useDynamicResolution ? m_sceneColorImageViews[i] : m_swapChainImageViews[i];
+		std::vector<VkImageView> attachments = { colorImageView, m_depthImageViews[i] };
+		if (m_useWeightedBlendedOIT)
+		{
+			attachments.push_back(m_oitAccumulationImageViews[i]);
+			attachments.push_back(m_oitRevealageImageViews[i]);
+		}
 
 		VkExtent2D swapChainExtent = GetSwapChainExtent();
 		VkFramebufferCreateInfo framebufferInfo = {};
@@ -329,6 +550,33 @@ void SwapChain::CreateFramebuffers()
 	}
 }
 
+void SwapChain::CreateUpscaleFramebuffers()
+{
+	if (!m_useDynamicResolution)
+	{
+		return;
+	}
+
+	m_upscaleFramebuffers.resize(GetImageCount());
+	for (std::size_t i = 0; i < GetImageCount(); ++i)
+	{
+		VkExtent2D swapChainExtent = GetSwapChainExtent();
+		VkFramebufferCreateInfo framebufferInfo = {};
+		framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		framebufferInfo.renderPass = m_upscaleRenderPass;
+		framebufferInfo.attachmentCount = 1;
+		framebufferInfo.pAttachments = &m_swapChainImageViews[i];
+		framebufferInfo.width = swapChainExtent.width;
+		framebufferInfo.height = swapChainExtent.height;
+		framebufferInfo.layers = 1;
+
+		if (vkCreateFramebuffer(m_device.GetDevice(), &framebufferInfo, nullptr, &m_upscaleFramebuffers[i]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create upscale framebuffer!");
+		}
+	}
+}
+
 void SwapChain::CreateDepthResources() 
 {
 	VkFormat depthFormat = FindDepthFormat();
@@ -382,6 +630,91 @@ void SwapChain::CreateDepthResources()
 	}
 }
 
+void SwapChain::CreateOITResources()
+{
+	if (!m_useWeightedBlendedOIT)
+	{
+		return;
+	}
+
+	m_oitAccumulationImages.resize(GetImageCount());
+	m_oitAccumulationImageMemorys.resize(GetImageCount());
+	m_oitAccumulationImageViews.resize(GetImageCount());
+	m_oitRevealageImages.resize(GetImageCount());
+	m_oitRevealageImageMemorys.resize(GetImageCount());
+	m_oitRevealageImageViews.resize(GetImageCount());
+
+	// written and read only inside the render pass, so tile based GPUs can keep them on chip
+	const VkImageUsageFlags usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+
+	for (int32 i = 0; i < m_oitAccumulationImages.size(); ++i)
+	{
+		CreateColorAttachment(kOITAccumulationFormat, usage, m_oitAccumulationImages[i], m_oitAccumulationImageMemorys[i], m_oitAccumulationImageViews[i]);
+		CreateColorAttachment(kOITRevealageFormat, usage, m_oitRevealageImages[i], m_oitRevealageImageMemorys[i], m_oitRevealageImageViews[i]);
+	}
+}
+
+void SwapChain::CreateSceneColorResources()
+{
+	if (!m_useDynamicResolution)
+	{
+		return;
+	}
+
+	m_sceneColorImages.resize(GetImageCount());
+	m_sceneColorImageMemorys.resize(GetImageCount());
+	m_sceneColorImageViews.resize(GetImageCount());
+
+	// full extent, the scene renders only in the scaled render area: changing the scale never reallocates
+	for (int32 i = 0; i < m_sceneColorImages.size(); ++i)
+	{
+		CreateColorAttachment(m_swapChainImageFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+			m_sceneColorImages[i], m_sceneColorImageMemorys[i], m_sceneColorImageViews[i]);
+	}
+}
+
+void SwapChain::CreateColorAttachment(VkFormat _format, VkImageUsageFlags _usage, VkImage& _image, VmaAllocation& _imageMemory, VkImageView& _imageView)
+{
+	VkExtent2D swapChainExtent = GetSwapChainExtent();
+
+	VkImageCreateInfo imageInfo{};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.extent.width = swapChainExtent.width;
+	imageInfo.extent.height = swapChainExtent.height;
+	imageInfo.extent.depth = 1;
+	imageInfo.mipLevels = 1;
+	imageInfo.arrayLayers = 1;
+	imageInfo.format = _format;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageInfo.usage = _usage;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.flags = 0;
+
+	m_device.CreateImageWithInfo(
+		imageInfo,
+		_image,
+		_imageMemory);
+
+	VkImageViewCreateInfo viewInfo{};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = _image;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = _format;
+	viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	viewInfo.subresourceRange.baseMipLevel = 0;
+	viewInfo.subresourceRange.levelCount = 1;
+	viewInfo.subresourceRange.baseArrayLayer = 0;
+	viewInfo.subresourceRange.layerCount = 1;
+
+	if (vkCreateImageView(m_device.GetDevice(), &viewInfo, nullptr, &_imageView) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create color attachment image view!");
+	}
+}
+
 void SwapChain::CreateSyncObjects() 
 {
 	m_imageAvailableSemaphores.resize(kMaxFramesInFlight);
@@ -22,8 +22,24 @@ public:
 	// SwapChain image count can be 2 or 3, depending if the device support triple buffering
 	static constexpr int32 kMaxFramesInFlight = 3;
 
-	SwapChain(Device& _device, VkExtent2D _windowExtent);
-	SwapChain(Device& _device, VkExtent2D _windowExtent, std::shared_ptr<SwapChain> _previous);
+	// Subpasses of the render pass when weighted blended OIT is enabled, otherwise there is only kOpaqueSubpass
+	static constexpr uint32 kOpaqueSubpass = 0u;
+	static constexpr uint32 kTransparentSubpass = 1u;
+	static constexpr uint32 kCompositeSubpass = 2u;
+
+	// Attachments of the render pass, the OIT ones exist only when weighted blended OIT is enabled
+	static constexpr uint32 kColorAttachmentIndex = 0u;
+	static constexpr uint32 kDepthAttachmentIndex = 1u;
+	static constexpr uint32 kOITAccumulationAttachmentIndex = 2u;
+	static constexpr uint32 kOITRevealageAttachmentIndex = 3u;
+
+	static constexpr VkFormat kOITAccumulationFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+	static constexpr VkFormat kOITRevealageFormat = VK_FORMAT_R16_SFLOAT;
+
+	// With dynamic resolution the render pass draws in a scene color target instead of the swap chain image, left ready to be sampled,
+	// and the upscale render pass draws it over the swap chain image to be presented
+	SwapChain(Device& _device, VkExtent2D _windowExtent, bool _useWeightedBlendedOIT = false, bool _useDynamicResolution = false);
+	SwapChain(Device& _device, VkExtent2D _windowExtent, std::shared_ptr<SwapChain> _previous, bool _useWeightedBlendedOIT = false, bool _useDynamicResolution = false);
 	~SwapChain();
 
 	SwapChain(const SwapChain&) = delete;
@@ -37,6 +53,13 @@ public:
 	VESPERENGINE_INLINE const VkExtent2D GetSwapChainExtent() const { return m_swapChainExtent; }
 	VESPERENGINE_INLINE const uint32 GetWidth() const { return m_swapChainExtent.width; }
 	VESPERENGINE_INLINE const uint32 GetHeight() const { return m_swapChainExtent.height; }
+	VESPERENGINE_INLINE const bool IsWeightedBlendedOITEnabled() const { return m_useWeightedBlendedOIT; }
+	VESPERENGINE_INLINE const VkImageView GetOITAccumulationImageView(int32 _index) const { return m_oitAccumulationImageViews[_index]; }
+	VESPERENGINE_INLINE const VkImageView GetOITRevealageImageView(int32 _index) const { return m_oitRevealageImageViews[_index]; }
+	VESPERENGINE_INLINE const bool IsDynamicResolutionEnabled() const { return m_useDynamicResolution; }
+	VESPERENGINE_INLINE const VkImageView GetSceneColorImageView(int32 _index) const { return m_sceneColorImageViews[_index]; }
+	VESPERENGINE_INLINE const VkRenderPass GetUpscaleRenderPass() const { return m_upscaleRenderPass; }
+	VESPERENGINE_INLINE const VkFramebuffer GetUpscaleFrameBuffer(int32 _index) const { return m_upscaleFramebuffers[_index]; }
 
 	VESPERENGINE_INLINE float GetExtentAspectRatio() 
 	{
@@ -61,8 +84,18 @@ private:
 	void CreateSwapChain();
 	void CreateImageViews();
 	void CreateDepthResources();
+	void CreateOITResources();
+	void CreateSceneColorResources();
+	void CreateColorAttachment(VkFormat _format, VkImageUsageFlags _usage, VkImage& _image, VmaAllocation& _imageMemory, VkImageView& _imageView);
 	void CreateRenderPass();
+	void CreateOITRenderPass(const VkAttachmentDescription& _colorAttachment, const VkAttachmentDescription& _depthAttachment,
+		const VkSubpassDescription& _opaqueSubpass, const VkSubpassDependency& _externalDependency);
+	void CreateUpscaleRenderPass();
 	void CreateFramebuffers();
+	void CreateUpscaleFramebuffers();
+
+	// the scene color written by the last subpass is sampled by the upscale render pass
+	VkSubpassDependency GetSceneColorReadDependency(uint32 _lastSubpass) const;
 	void CreateSyncObjects();
 
 	// Helper functions
@@ -80,6 +113,17 @@ private:
 	std::vector<VkImage> m_depthImages;
 	std::vector<VmaAllocation> m_depthImageMemorys;
 	std::vector<VkImageView> m_depthImageViews;
+	std::vector<VkImage> m_oitAccumulationImages;
+	std::vector<VmaAllocation> m_oitAccumulationImageMemorys;
+	std::vector<VkImageView> m_oitAccumulationImageViews;
+	std::vector<VkImage> m_oitRevealageImages;
+	std::vector<VmaAllocation> m_oitRevealageImageMemorys;
+	std::vector<VkImageView> m_oitRevealageImageViews;
+	std::vector<VkImage> m_sceneColorImages;
+	std::vector<VmaAllocation> m_sceneColorImageMemorys;
+	std::vector<VkImageView> m_sceneColorImageViews;
+	std::vector<VkFramebuffer> m_upscaleFramebuffers;
+	VkRenderPass m_upscaleRenderPass{ VK_NULL_HANDLE };
 	std::vector<VkImage> m_swapChainImages;
 	std::vector<VkImageView> m_swapChainImageViews;
 
@@ -94,6 +138,9 @@ private:
 	std::vector<VkFence> m_inFlightFences;
 	std::vector<VkFence> m_imagesInFlight;
 	std::size_t m_currentFrame = 0;
+
+	bool m_useWeightedBlendedOIT = false;
+	bool m_useDynamicResolution = false;
 };
 
 VESPERENGINE_NAMESPACE_END
\ No newline at end of file
@@ -29,6 +29,7 @@ struct BufferComponent
 
 struct VertexBufferComponent : public BufferComponent
 {
+	uint32 FirstVertex{ 0 };							// first vertex of the mesh in Buffer, not 0 when the buffer is shared (i.e. GeometryArena)
 };
 
 // Special struct to set if we want to mark a render-able object having NOT a VB.
@@ -43,6 +44,8 @@ struct NotVertexBufferComponent
 
 struct IndexBufferComponent : public BufferComponent
 {
+	uint32 FirstIndex{ 0 };								// first index of the mesh in Buffer, not 0 when the buffer is shared (i.e. GeometryArena)
+	int32 VertexOffset{ 0 };							// added to the indices, the first vertex of the mesh in the bound vertex buffer
 };
 
 // 
@@ -61,6 +64,7 @@ struct MaterialComponent
 	using FieldType = int32;
 	int32 Index{ -1 };
 	bool IsDoubleSided{ false };
+	bool IsAlphaTested{ false };
 
 	// store the descriptor set bound to the resource per presentation frame (1,2 or 3)
 	std::vector<VkDescriptorSet> BoundDescriptorSet;
@@ -83,8 +87,21 @@ struct PhongMaterialComponent : public MaterialComponent
 };
 
 // used with PBRRenderSystem
+// PBR material features, the bits of the FeatureMask, the textures in the order of PBRMaterialUBO::TextureIndices.
+// Same bits of the kMaterialFeatures specialization constant of pbr_shader.frag: what is not in the mask is compiled out
+static constexpr uint32 kPBRFeatureRoughnessTexture = 1u << 0;
+static constexpr uint32 kPBRFeatureMetallicTexture = 1u << 1;
+static constexpr uint32 kPBRFeatureSheenTexture = 1u << 2;
+static constexpr uint32 kPBRFeatureEmissiveTexture = 1u << 3;
+static constexpr uint32 kPBRFeatureNormalTexture = 1u << 4;
+static constexpr uint32 kPBRFeatureBaseColorTexture = 1u << 5;
+static constexpr uint32 kPBRFeatureAOTexture = 1u << 6;
+static constexpr uint32 kPBRFeatureAlphaTest = 1u << 7;
+static constexpr uint32 kPBRFeatureAll = 0xFFu;		// every feature checked at run time, as with no permutation
+
 struct PBRMaterialComponent : public MaterialComponent
 {
+	uint32 FeatureMask{ kPBRFeatureAll };
 	VkDescriptorImageInfo RoughnessImageInfo{};
 	VkDescriptorImageInfo MetallicImageInfo{};
 	VkDescriptorImageInfo SheenImageInfo{};
@@ -103,6 +120,14 @@ struct SkyboxMaterialComponent : public MaterialComponent
 
 
 
+// Handle of the vertex/index buffers owned by the ModelSystem.
+// Entities loaded from the same ModelData share the same handle, so they share the buffers and can be drawn instanced
+struct GeometryComponent
+{
+	using FieldType = uint32;
+	uint32 Handle{ 0 };
+};
+
 struct DynamicOffsetComponent
 {
 	uint32 DynamicOffsetIndex{ 0 };
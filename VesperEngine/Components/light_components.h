@@ -22,6 +22,7 @@ struct DirectionalLightComponent
     glm::vec3 Direction{ 0.0f, -1.0f, 0.0f };
     glm::vec3 Color{ 1.0f, 1.0f, 1.0f };
     float Intensity{ 1.0f };
+    bool CastShadows{ true };
 };
 
 struct PointLightComponent
@@ -30,6 +31,7 @@ struct PointLightComponent
     float Intensity{ 1.0f };
     glm::vec3 Color{ 1.0f, 1.0f, 1.0f };
     glm::vec3 Attenuation{ 1.0f, 0.0f, 0.0f }; // constant, linear, quadratic
+    bool CastShadows{ true };
 };
 
 struct SpotLightComponent
@@ -40,6 +42,7 @@ struct SpotLightComponent
     float InnerCutoff{ 0.8f };
     glm::vec3 Color{ 1.0f, 1.0f, 1.0f };
     float OuterCutoff{ 0.9f };
+    bool CastShadows{ true };
 };
 
 VESPERENGINE_NAMESPACE_END
@@ -46,6 +46,13 @@ struct VisibilityComponent
 {
 };
 
+// local space axis aligned bounds of the vertices, filled at load time
+struct BoundsComponent
+{
+	glm::vec3 Min{ 0.0f, 0.0f, 0.0f };
+	glm::vec3 Max{ 0.0f, 0.0f, 0.0f };
+};
+
 
 struct MorphWeightsComponent
 {
@@ -220,6 +220,8 @@ typedef struct AlignedFloat
 //////////////////////////////////////////////////////////////////////////
 
 #define VESPERENGINE_PUSHCONSTANT_DEFAULTRANGE 128
+// with bindless the last int of the default range is the index of the material, the shaders declare it at this offset
+#define VESPERENGINE_PUSHCONSTANT_MATERIALINDEX_OFFSET (VESPERENGINE_PUSHCONSTANT_DEFAULTRANGE - 4)
 
 
 //////////////////////////////////////////////////////////////////////////
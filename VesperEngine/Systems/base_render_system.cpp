@@ -2,11 +2,15 @@
 // File: C:\Projects\Vesper\VesperEngine\Systems\base_render_system.cpp
 // Licensed under the MIT License. See LICENSE file in the project root for full license information.
 
+#include "Systems/uniform_buffer.h"
 #include "Systems/base_render_system.h"
 
 #include "Backend/device.h"
+#include "Backend/frame_info.h"
+#include "Backend/render_packet.h"
 
 #include "Components/graphics_components.h"
+#include "Components/object_components.h"
 
 #include "ECS/ECS/ecs.h"
 
@@ -45,7 +49,7 @@ void BaseRenderSystem::PushConstants(VkCommandBuffer _commandBuffer, const uint3
 {
 	assertMsgReturnVoid(_pushConstantIndex >= 0 && _pushConstantIndex < m_pushConstants.size(), "_pushConstantIndex out of range!");
 
-	vkCmdPushConstants(_commandBuffer, m_pipelineLayout,
+	m_commandRecorder.PushConstants(_commandBuffer, m_pipelineLayout,
 		m_pushConstants[_pushConstantIndex].stageFlags,
 		m_pushConstants[_pushConstantIndex].offset,
 		m_pushConstants[_pushConstantIndex].size,
@@ -56,7 +60,7 @@ void BaseRenderSystem::PushConstants(VkCommandBuffer _commandBuffer, const uint3
 {
 	assertMsgReturnVoid(_pushConstantIndex >= 0 && _pushConstantIndex < m_pushConstants.size(), "_pushConstantIndex out of range!");
 
-	vkCmdPushConstants(_commandBuffer, m_pipelineLayout,
+	m_commandRecorder.PushConstants(_commandBuffer, m_pipelineLayout,
 		m_pushConstants[_pushConstantIndex].stageFlags,
 		_overrideOffset,
 		_overrideSize,
@@ -76,26 +80,103 @@ void BaseRenderSystem::PushConstants(VkCommandBuffer _commandBuffer, std::vector
 
 void BaseRenderSystem::Bind(const VertexBufferComponent& _vertexBufferComponent, VkCommandBuffer _commandBuffer) const
 {
-	VkBuffer buffers[] = { _vertexBufferComponent.Buffer };
-	VkDeviceSize offsets[] = { 0 };
-
-	vkCmdBindVertexBuffers(_commandBuffer, 0, 1, buffers, offsets);
+	m_commandRecorder.BindVertexBuffer(_commandBuffer, _vertexBufferComponent.Buffer, 0);
 }
 
 void BaseRenderSystem::Bind(const VertexBufferComponent& _vertexBufferComponent, const IndexBufferComponent& _indexBufferComponent, VkCommandBuffer _commandBuffer) const
 {
 	Bind(_vertexBufferComponent, _commandBuffer);
-	vkCmdBindIndexBuffer(_commandBuffer, _indexBufferComponent.Buffer, 0, VK_INDEX_TYPE_UINT32);
+	m_commandRecorder.BindIndexBuffer(_commandBuffer, _indexBufferComponent.Buffer, 0, VK_INDEX_TYPE_UINT32);
+}
+
+void BaseRenderSystem::Draw(const VertexBufferComponent& _vertexBufferComponent, VkCommandBuffer _commandBuffer, uint32 _instanceCount, uint32 _firstInstance) const
+{
+	vkCmdDraw(_commandBuffer, _vertexBufferComponent.Count, _instanceCount, _vertexBufferComponent.FirstVertex, _firstInstance);
+}
+
+void BaseRenderSystem::Draw(const IndexBufferComponent& _indexBufferComponent, VkCommandBuffer _commandBuffer, uint32 _instanceCount, uint32 _firstInstance) const
+{
+	vkCmdDrawIndexed(_commandBuffer, _indexBufferComponent.Count, _instanceCount, _indexBufferComponent.FirstIndex, _indexBufferComponent.VertexOffset, _firstInstance);
+}
+
+void BaseRenderSystem::Bind(const RenderPacket& _packet, VkCommandBuffer _commandBuffer) const
+{
+	m_commandRecorder.BindVertexBuffer(_commandBuffer, _packet.VertexBuffer, 0);
+
+	if (_packet.IndexBuffer != VK_NULL_HANDLE)
+	{
+		m_commandRecorder.BindIndexBuffer(_commandBuffer, _packet.IndexBuffer, 0, VK_INDEX_TYPE_UINT32);
+	}
+}
+
+void BaseRenderSystem::Draw(const RenderPacket& _packet, VkCommandBuffer _commandBuffer, uint32 _instanceCount, uint32 _firstInstance) const
+{
+	if (_packet.IndexBuffer != VK_NULL_HANDLE)
+	{
+		vkCmdDrawIndexed(_commandBuffer, _packet.Count, _instanceCount, _packet.First, _packet.VertexOffset, _firstInstance);
+	}
+	else
+	{
+		vkCmdDraw(_commandBuffer, _packet.Count, _instanceCount, _packet.First, _firstInstance);
+	}
+}
+
+uint32 BaseRenderSystem::BindEntity(const FrameInfo& _frameInfo, uint32 _entitySetIndex, const DynamicOffsetComponent& _dynamicOffsetComponent) const
+{
+	if (_frameInfo.IsEntityStorageBuffer)
+	{
+		// the same set for every entity, the recorder skips it after the first draw
+		m_commandRecorder.BindDescriptorSet(
+			_frameInfo.CommandBuffer,
+			VK_PIPELINE_BIND_POINT_GRAPHICS,
+			m_pipelineLayout,
+			_entitySetIndex,
+			_frameInfo.EntityDescriptorSet
+		);
+
+		return _dynamicOffsetComponent.DynamicOffsetIndex;
+	}
+
+	m_commandRecorder.BindDescriptorSet(
+		_frameInfo.CommandBuffer,
+		VK_PIPELINE_BIND_POINT_GRAPHICS,
+		m_pipelineLayout,
+		_entitySetIndex,
+		_frameInfo.EntityDescriptorSet,
+		1,
+		&_dynamicOffsetComponent.DynamicOffset
+	);
+
+	return 0;
 }
 
-void BaseRenderSystem::Draw(const VertexBufferComponent& _vertexBufferComponent, VkCommandBuffer _commandBuffer, uint32 _instanceCount) const
+uint32 BaseRenderSystem::BindEntity(const FrameInfo& _frameInfo, uint32 _entitySetIndex, const RenderPacket& _packet) const
 {
-	vkCmdDraw(_commandBuffer, _vertexBufferComponent.Count, _instanceCount, 0, 0);
+	DynamicOffsetComponent dynamicOffsetComponent;
+	dynamicOffsetComponent.DynamicOffsetIndex = _packet.DynamicOffsetIndex;
+	dynamicOffsetComponent.DynamicOffset = _packet.DynamicOffset;
+
+	return BindEntity(_frameInfo, _entitySetIndex, dynamicOffsetComponent);
 }
 
-void BaseRenderSystem::Draw(const IndexBufferComponent& _indexBufferComponent, VkCommandBuffer _commandBuffer, uint32 _instanceCount) const
+void BaseRenderSystem::FillInstanceData(ecs::ComponentManager& _componentManager, const ecs::Entity& _entity, InstanceData& _instanceData) const
 {
-	vkCmdDrawIndexed(_commandBuffer, _indexBufferComponent.Count, _instanceCount, 0, 0, 0);
+	const UpdateComponent& updateComponent = _componentManager.GetComponent<UpdateComponent>(_entity);
+	_instanceData.ModelMatrix = updateComponent.ModelMatrix;
+
+	if (_componentManager.HasComponents<MorphWeightsComponent>(_entity))
+	{
+		const MorphWeightsComponent& morphWeightsComponent = _componentManager.GetComponent<MorphWeightsComponent>(_entity);
+		_instanceData.MorphWeights0 = morphWeightsComponent.Weights[0];
+		_instanceData.MorphWeights1 = morphWeightsComponent.Weights[1];
+		_instanceData.MorphTargetCount = static_cast<int32>(morphWeightsComponent.Count);
+	}
+	else
+	{
+		_instanceData.MorphWeights0 = glm::vec4(0.0f);
+		_instanceData.MorphWeights1 = glm::vec4(0.0f);
+		_instanceData.MorphTargetCount = 0;
+	}
 }
 
 VESPERENGINE_NAMESPACE_END
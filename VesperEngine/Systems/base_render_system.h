@@ -6,6 +6,8 @@
 
 #include "Core/core_defines.h"
 
+#include "Backend/command_recorder.h"
+
 #include "vulkan/vulkan.h"
 
 #include <vector>
@@ -20,8 +22,11 @@ VESPERENGINE_NAMESPACE_BEGIN
 
 class Device;
 struct FrameInfo;
+struct InstanceData;
 struct IndexBufferComponent;
 struct VertexBufferComponent;
+struct DynamicOffsetComponent;
+struct RenderPacket;
 
 class VESPERENGINE_API BaseRenderSystem
 {
@@ -34,6 +39,9 @@ public:
 
 	void CreatePipelineLayout(const std::vector<VkDescriptorSetLayout>& _descriptorSetLayouts);
 
+	// state commands recorded and elided during the last Render
+	VESPERENGINE_INLINE const CommandRecorderStatistics& GetCommandStatistics() const { return m_commandRecorder.GetStatistics(); }
+
 protected:
 	virtual void PerEntityUpdate(const FrameInfo& _frameInfo, ecs::ComponentManager& _componentManager, const ecs::Entity& _entity) {}
 	virtual void PerEntityRender(const FrameInfo& _frameInfo, ecs::ComponentManager& _componentManager, const ecs::Entity& _entity) {}
@@ -45,13 +53,27 @@ protected:
 	void Bind(const VertexBufferComponent& _vertexBufferComponent, VkCommandBuffer _commandBuffer) const;
 	void Bind(const VertexBufferComponent& _vertexBufferComponent, const IndexBufferComponent& _indexBufferComponent, VkCommandBuffer _commandBuffer) const;
 
-	void Draw(const VertexBufferComponent& _vertexBufferComponent, VkCommandBuffer _commandBuffer, uint32 _instanceCount = 1) const;
-	void Draw(const IndexBufferComponent& _indexBufferComponent, VkCommandBuffer _commandBuffer, uint32 _instanceCount = 1) const;
+	void Draw(const VertexBufferComponent& _vertexBufferComponent, VkCommandBuffer _commandBuffer, uint32 _instanceCount = 1, uint32 _firstInstance = 0) const;
+	void Draw(const IndexBufferComponent& _indexBufferComponent, VkCommandBuffer _commandBuffer, uint32 _instanceCount = 1, uint32 _firstInstance = 0) const;
+
+	// the geometry of a render packet, with its index buffer when it has one
+	void Bind(const RenderPacket& _packet, VkCommandBuffer _commandBuffer) const;
+	void Draw(const RenderPacket& _packet, VkCommandBuffer _commandBuffer, uint32 _instanceCount = 1, uint32 _firstInstance = 0) const;
+
+	// Select the data of the entity for its next draw and return the firstInstance to draw it with: the storage buffer is bound once
+	// and indexed by the firstInstance, the dynamic uniform buffer is bound again with the offset of the entity and drawn from 0
+	uint32 BindEntity(const FrameInfo& _frameInfo, uint32 _entitySetIndex, const DynamicOffsetComponent& _dynamicOffsetComponent) const;
+	uint32 BindEntity(const FrameInfo& _frameInfo, uint32 _entitySetIndex, const RenderPacket& _packet) const;
+
+	// same data the EntityHandlerSystem writes in the entity UBO, for the instanced draws
+	void FillInstanceData(ecs::ComponentManager& _componentManager, const ecs::Entity& _entity, InstanceData& _instanceData) const;
 
 protected:
 	Device& m_device;
 	VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
     std::vector<VkPushConstantRange> m_pushConstants;
+	// Bind and PushConstants go through it, Reset it at the beginning of Render and record any state command through it
+	mutable CommandRecorder m_commandRecorder;
 };
 
 VESPERENGINE_NAMESPACE_END
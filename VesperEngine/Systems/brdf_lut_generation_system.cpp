@@ -56,6 +56,8 @@ void BRDFLUTGenerationSystem::Generate(VkCommandBuffer _commandBuffer, uint32 _w
 		VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT
 	);
 
+	m_commandRecorder.Reset(_commandBuffer);
+
 	m_pipeline->Bind(_commandBuffer);
 
 	const PushResolution resolution{{ _width, _height }};
@@ -4,6 +4,7 @@
 
 #include "Systems/uniform_buffer.h"			// NOTE: dependency forced, compiler need to know the size of the UBOs used here first
 #include "Systems/entity_handler_system.h"
+#include "Systems/gpu_transform_system.h"
 
 #include "Backend/buffer.h"
 #include "Backend/swap_chain.h"
@@ -15,12 +16,20 @@
 #include "Components/object_components.h"
 
 #include "App/vesper_app.h"
+#include "App/config.h"
 
 #include "ECS/ECS/ecs.h"
 
+#include "Core/memory_copy.h"
+
+#include <cstring>
+
 
 VESPERENGINE_NAMESPACE_BEGIN
 
+static_assert(SwapChain::kMaxFramesInFlight <= 8, "The dirty frames of an entity are bits of an uint8");
+static constexpr uint8 kAllFramesMask = static_cast<uint8>((1u << SwapChain::kMaxFramesInFlight) - 1u);
+
 EntityHandlerSystem::EntityHandlerSystem(VesperApp& _app, Device& _device, Renderer& _renderer)
 	: m_app(_app)
 	, m_device(_device)
@@ -28,40 +37,129 @@ EntityHandlerSystem::EntityHandlerSystem(VesperApp& _app, Device& _device, Rende
 {
 	m_buffer = std::make_unique<Buffer>(m_device);
 
-	const uint32 minUboAlignment = static_cast<uint32>(m_device.GetLimits().minUniformBufferOffsetAlignment);
-	m_alignedSizeUBO = m_buffer->GetAlignment<uint32>(sizeof(EntityUBO), minUboAlignment);
+	m_isStorageBuffer = m_app.GetConfig().UseEntityStorageBuffer;
 
-	m_entitySetLayout = DescriptorSetLayout::Builder(m_device)
-		.AddBinding(kEntityBindingIndex, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_VERTEX_BIT)
-		.Build();
+	if (m_isStorageBuffer)
+	{
+		// packed one after the other, no dynamic offset to align
+		m_alignedSizeUBO = sizeof(EntityData);
+
+		m_entitySetLayout = DescriptorSetLayout::Builder(m_device)
+			.AddBinding(kEntityBindingIndex, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT)
+			.AddBinding(kEntityTransformBindingIndex, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT)
+			.Build();
+
+		m_transformSystem = std::make_unique<GPUTransformSystem>(m_app, m_device, m_renderer);
+	}
+	else
+	{
+		const uint32 minUboAlignment = static_cast<uint32>(m_device.GetLimits().minUniformBufferOffsetAlignment);
+		m_alignedSizeUBO = m_buffer->GetAlignment<uint32>(sizeof(EntityUBO), minUboAlignment);
+
+		m_entitySetLayout = DescriptorSetLayout::Builder(m_device)
+			.AddBinding(kEntityBindingIndex, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_VERTEX_BIT)
+			.Build();
+	}
 }
 
+EntityHandlerSystem::~EntityHandlerSystem() = default;
+
 void EntityHandlerSystem::Initialize()
 {
 	m_entityUboBuffers.resize(SwapChain::kMaxFramesInFlight);
 	m_entityDescriptorSets.resize(SwapChain::kMaxFramesInFlight);
+	m_entityMappedMemory.resize(SwapChain::kMaxFramesInFlight, nullptr);
+	m_capacities.resize(SwapChain::kMaxFramesInFlight, 0u);
+	m_transformVersions.resize(SwapChain::kMaxFramesInFlight, 0u);
+
+	uint32 capacity = kMinEntityCapacity;
+	while (capacity < GetEntityCount())
+	{
+		capacity *= 2;
+	}
+
+	if (m_transformSystem)
+	{
+		m_transformSystem->Initialize(capacity);
+		m_transformSystem->CreatePipeline();
+	}
 
-	const uint32 minUboAlignment = static_cast<uint32>(m_device.GetLimits().minUniformBufferOffsetAlignment);
 	for (int32 i = 0; i < SwapChain::kMaxFramesInFlight; ++i)
 	{
-		m_entityUboBuffers[i] = m_buffer->Create<BufferComponent>(
+		CreateFrameBuffer(i, capacity, false);
+	}
+}
+
+void EntityHandlerSystem::CreateFrameBuffer(const int32 _frameIndex, const uint32 _capacity, const bool _isRecreate)
+{
+	BufferComponent& frameBuffer = m_entityUboBuffers[_frameIndex];
+
+	// safe, the fence of this frame has been waited so the GPU is not reading it anymore
+	if (_isRecreate)
+	{
+		m_buffer->Destroy(frameBuffer);
+	}
+
+	if (m_isStorageBuffer)
+	{
+		frameBuffer = m_buffer->Create<BufferComponent>(
+			sizeof(EntityData),
+			_capacity,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
+			VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
+			/*minUboAlignment*/1,
+			true
+		);
+	}
+	else
+	{
+		const uint32 minUboAlignment = static_cast<uint32>(m_device.GetLimits().minUniformBufferOffsetAlignment);
+		frameBuffer = m_buffer->Create<BufferComponent>(
 			sizeof(EntityUBO),
-			GetEntityCount(),
+			_capacity,
 			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, //| VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 			VMA_MEMORY_USAGE_AUTO_PREFER_HOST, //VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE, //VMA_MEMORY_USAGE_AUTO_PREFER_HOST, //VMA_MEMORY_USAGE_AUTO,
-			VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT,//VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,//VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT,
+			VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,//VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT,
 			minUboAlignment,
 			true
 		);
 	}
 
-	for (int32 i = 0; i < SwapChain::kMaxFramesInFlight; ++i)
+	m_entityMappedMemory[_frameIndex] = static_cast<uint8*>(m_buffer->GetMappedMemory(frameBuffer));
+	m_capacities[_frameIndex] = _capacity;
+
+	WriteDescriptorSet(_frameIndex, _isRecreate);
+}
+
+void EntityHandlerSystem::WriteDescriptorSet(const int32 _frameIndex, const bool _isOverwrite)
+{
+	VkDescriptorBufferInfo bufferInfo = m_buffer->GetDescriptorInfo(m_entityUboBuffers[_frameIndex]);
+	if (m_isStorageBuffer)
+	{
+		// the whole buffer is visible to the shader, not only the first element
+		bufferInfo.range = VK_WHOLE_SIZE;
+	}
+
+	DescriptorWriter writer(*m_entitySetLayout, *m_renderer.GetDescriptorPool());
+	writer.WriteBuffer(kEntityBindingIndex, &bufferInfo);
+
+	VkDescriptorBufferInfo transformInfo;
+	if (m_transformSystem)
 	{
-		auto objectBufferInfo = m_buffer->GetDescriptorInfo(m_entityUboBuffers[i]);
+		transformInfo = VkDescriptorBufferInfo{ m_transformSystem->GetTransformBuffer(), 0, VK_WHOLE_SIZE };
+		writer.WriteBuffer(kEntityTransformBindingIndex, &transformInfo);
 
-		DescriptorWriter(*m_entitySetLayout, *m_renderer.GetDescriptorPool())
-			.WriteBuffer(kEntityBindingIndex, &objectBufferInfo)
-			.Build(m_entityDescriptorSets[i]);
+		m_transformVersions[_frameIndex] = m_transformSystem->GetTransformBufferVersion();
+	}
+
+	if (_isOverwrite)
+	{
+		writer.Overwrite(m_entityDescriptorSets[_frameIndex]);
+	}
+	else
+	{
+		writer.Build(m_entityDescriptorSets[_frameIndex]);
 	}
 }
 
@@ -70,6 +168,15 @@ void EntityHandlerSystem::UpdateEntities(const FrameInfo& _frameInfo)
 	ecs::EntityManager& entityManager = m_app.GetEntityManager();
 	ecs::ComponentManager& componentManager = m_app.GetComponentManager();
 
+	const int32 frameIndex = _frameInfo.FrameIndex;
+
+	// entities registered since the last update start dirty for all the frames, their buffer content is undefined
+	if (m_dirtyFrames.size() < m_internalCounter)
+	{
+		m_dirtyFrames.resize(m_internalCounter, kAllFramesMask);
+		m_entityData.resize(static_cast<std::size_t>(m_internalCounter) * m_alignedSizeUBO, 0u);
+	}
+
 	for (auto gameEntity : ecs::IterateEntitiesWithAll<DynamicOffsetComponent, UpdateComponent>(entityManager, componentManager))
 	{
 		const DynamicOffsetComponent& dynamicOffsetComponent = componentManager.GetComponent<DynamicOffsetComponent>(gameEntity);
@@ -86,14 +193,128 @@ void EntityHandlerSystem::UpdateEntities(const FrameInfo& _frameInfo)
 			morphCount = static_cast<int32>(comp.Count);
 		}
 
-		EntityUBO entityUBO{};
-		entityUBO.ModelMatrix = updateComponent.ModelMatrix;
-		entityUBO.MorphWeights0 = morphWeights0;
-		entityUBO.MorphWeights1 = morphWeights1;
-		entityUBO.MorphTargetCount = morphCount;
+		if (m_isStorageBuffer)
+		{
+			// only position, rotation and scale when they change, the matrices are composed on the GPU
+			const TransformComponent identityTransform;
+			const TransformComponent& transformComponent = componentManager.HasComponents<TransformComponent>(gameEntity)
+				? componentManager.GetComponent<TransformComponent>(gameEntity) : identityTransform;
+			m_transformSystem->SetTransform(dynamicOffsetComponent.DynamicOffsetIndex, transformComponent.Position, transformComponent.Rotation, transformComponent.Scale);
+
+			EntityData entityData{};
+			entityData.MorphWeights0 = morphWeights0;
+			entityData.MorphWeights1 = morphWeights1;
+			entityData.MorphTargetCount = morphCount;
+
+			if (componentManager.HasComponents<PBRMaterialComponent>(gameEntity))
+			{
+				entityData.MaterialIndex = componentManager.GetComponent<PBRMaterialComponent>(gameEntity).Index;
+			}
+			else if (componentManager.HasComponents<PhongMaterialComponent>(gameEntity))
+			{
+				entityData.MaterialIndex = componentManager.GetComponent<PhongMaterialComponent>(gameEntity).Index;
+			}
 
-		m_entityUboBuffers[_frameInfo.FrameIndex].MappedMemory = &entityUBO;
-		m_buffer->WriteToIndex(m_entityUboBuffers[_frameInfo.FrameIndex], dynamicOffsetComponent.DynamicOffsetIndex);
+			StageEntity(dynamicOffsetComponent.DynamicOffsetIndex, &entityData, sizeof(EntityData));
+		}
+		else
+		{
+			EntityUBO entityUBO{};
+			entityUBO.ModelMatrix = updateComponent.ModelMatrix;
+			entityUBO.MorphWeights0 = morphWeights0;
+			entityUBO.MorphWeights1 = morphWeights1;
+			entityUBO.MorphTargetCount = morphCount;
+
+			StageEntity(dynamicOffsetComponent.DynamicOffsetIndex, &entityUBO, sizeof(EntityUBO));
+		}
+	}
+
+	if (m_capacities[frameIndex] < m_internalCounter)
+	{
+		uint32 capacity = m_capacities[frameIndex];
+		while (capacity < m_internalCounter)
+		{
+			capacity *= 2;
+		}
+
+		CreateFrameBuffer(frameIndex, capacity, true);
+
+		// the new buffer is empty, all the entities have to be uploaded again for this frame
+		const uint8 frameBit = static_cast<uint8>(1u << frameIndex);
+		for (uint8& dirtyFrames : m_dirtyFrames)
+		{
+			dirtyFrames |= frameBit;
+		}
+	}
+
+	UploadDirtyEntities(frameIndex);
+}
+
+void EntityHandlerSystem::CreatePipeline()
+{
+	if (m_transformSystem)
+	{
+		m_transformSystem->CreatePipeline();
+	}
+}
+
+void EntityHandlerSystem::DispatchTransforms(const FrameInfo& _frameInfo)
+{
+	if (!m_transformSystem)
+	{
+		return;
+	}
+
+	const int32 frameIndex = _frameInfo.FrameIndex;
+
+	m_transformSystem->Dispatch(_frameInfo);
+
+	// the resident transforms could have been recreated, now or during the update of another frame
+	if (m_transformVersions[frameIndex] != m_transformSystem->GetTransformBufferVersion())
+	{
+		WriteDescriptorSet(frameIndex, true);
+	}
+}
+
+void EntityHandlerSystem::StageEntity(const uint32 _index, const void* _data, const std::size_t _size)
+{
+	uint8* const stagedData = m_entityData.data() + static_cast<std::size_t>(_index) * m_alignedSizeUBO;
+	if (std::memcmp(stagedData, _data, _size) != 0)
+	{
+		std::memcpy(stagedData, _data, _size);
+		m_dirtyFrames[_index] = kAllFramesMask;
+	}
+}
+
+void EntityHandlerSystem::UploadDirtyEntities(const int32 _frameIndex)
+{
+	const uint8 frameBit = static_cast<uint8>(1u << _frameIndex);
+	const uint32 entityCount = static_cast<uint32>(m_dirtyFrames.size());
+	uint8* const mappedMemory = m_entityMappedMemory[_frameIndex];
+
+	m_uploadedEntityCount = 0;
+
+	uint32 index = 0;
+	while (index < entityCount)
+	{
+		if ((m_dirtyFrames[index] & frameBit) == 0)
+		{
+			++index;
+			continue;
+		}
+
+		const uint32 firstIndex = index;
+		while (index < entityCount && (m_dirtyFrames[index] & frameBit) != 0)
+		{
+			m_dirtyFrames[index] &= static_cast<uint8>(~frameBit);
+			++index;
+		}
+
+		const std::size_t offset = static_cast<std::size_t>(firstIndex) * m_alignedSizeUBO;
+		const std::size_t size = static_cast<std::size_t>(index - firstIndex) * m_alignedSizeUBO;
+		MemCpy(mappedMemory + offset, m_entityData.data() + offset, size);
+
+		m_uploadedEntityCount += index - firstIndex;
 	}
 }
 
@@ -101,11 +322,22 @@ void EntityHandlerSystem::Cleanup()
 {
 	UnregisterEntities();
 
+	if (m_transformSystem)
+	{
+		m_transformSystem->Cleanup();
+	}
+
 	for (int32 i = 0; i < SwapChain::kMaxFramesInFlight; ++i)
 	{
 		m_buffer->Destroy(m_entityUboBuffers[i]);
 	}
 
+	m_entityMappedMemory.clear();
+	m_capacities.clear();
+	m_transformVersions.clear();
+	m_entityData.clear();
+	m_dirtyFrames.clear();
+
 	m_internalCounter = 0;
 }
 
@@ -22,18 +22,30 @@ class VesperApp;
 class Device;
 class Renderer;
 class Buffer;
+class GPUTransformSystem;
 
 struct FrameInfo;
 struct BufferComponent;
 
+/**
+ * Per entity data (model matrix, morph weights, ...) in one persistently mapped buffer per frame in flight.
+ * The data is first built in a CPU copy, only the entities whose data changed are flagged dirty for every frame in flight,
+ * then the dirty entities of the current frame are uploaded merging the consecutive ones in a single copy.
+ * The buffer of a frame grows (doubling) when more entities are registered than it can hold, at the next update of that frame,
+ * so entities can be registered at any time.
+ * In storage buffer mode the matrices are not part of the entity data: they are resident on the GPU and only the changed
+ * position, rotation and scale are uploaded, see GPUTransformSystem.
+ */
 class VESPERENGINE_API EntityHandlerSystem
 {
 public:
 	static constexpr uint32 kEntityBindingIndex = 0u;
+	static constexpr uint32 kEntityTransformBindingIndex = 1u;	// storage buffer mode only
+	static constexpr uint32 kMinEntityCapacity = 64u;
 
 public:
 	EntityHandlerSystem(VesperApp& _app, Device& _device, Renderer& _renderer);
-	virtual ~EntityHandlerSystem() = default;
+	virtual ~EntityHandlerSystem();
 
 	EntityHandlerSystem(const EntityHandlerSystem&) = delete;
 	EntityHandlerSystem& operator=(const EntityHandlerSystem&) = delete;
@@ -43,21 +55,38 @@ public:
 	VESPERENGINE_INLINE VkDescriptorSet GetEntityDescriptorSet(const int32 _frameIndex) const { return m_entityDescriptorSets[_frameIndex]; }
 
 	VESPERENGINE_INLINE uint32 GetEntityCount() const { return m_internalCounter; }
+	VESPERENGINE_INLINE uint32 GetEntityCapacity(const int32 _frameIndex) const { return m_capacities[_frameIndex]; }
+	// entities uploaded during the last update, to monitor how many changed
+	VESPERENGINE_INLINE uint32 GetUploadedEntityCount() const { return m_uploadedEntityCount; }
 	VESPERENGINE_INLINE uint32 GetAlignedSizeUBO() const { return m_alignedSizeUBO; }
+	// true if the entities are in a storage buffer indexed by the draw firstInstance, instead of a dynamic uniform buffer
+	VESPERENGINE_INLINE bool IsStorageBuffer() const { return m_isStorageBuffer; }
 
 public:
 	// Call this at the beginning, but after all the constructors of all the system is done
 	void Initialize();
+	// Create again the compute pipeline of the resident transforms, i.e. after the shaders are reloaded
+	void CreatePipeline();
 	// Register an entity to be valid renderable
 	void RegisterRenderableEntity(ecs::Entity _entity) const;
-	// Call this within the update the entities.
+	// Call this within the update the entities
 	void UpdateEntities(const FrameInfo& _frameInfo);
+	// Storage buffer mode only, after UpdateEntities: record the transform scatter, in a render graph pass writing the transforms
+	void DispatchTransforms(const FrameInfo& _frameInfo);
 	// Call at the end or at destruction time, anyway after the game loop is done.
 	void Cleanup();
 
 private:
 	void UnregisterEntities() const;
 
+	// (Re)create the buffer of the frame able to hold _capacity entities and point its descriptor set to it
+	void CreateFrameBuffer(const int32 _frameIndex, const uint32 _capacity, const bool _isRecreate);
+	// Copy the entity data in the CPU copy, if different flag it dirty for all the frames in flight
+	void StageEntity(const uint32 _index, const void* _data, const std::size_t _size);
+	// Copy to the buffer of the frame the dirty entities, one copy each range of consecutive ones
+	void UploadDirtyEntities(const int32 _frameIndex);
+	void WriteDescriptorSet(const int32 _frameIndex, const bool _isOverwrite);
+
 private:
 	VesperApp& m_app;
 	Device& m_device;
@@ -65,12 +94,21 @@ private:
 
 	std::unique_ptr<DescriptorSetLayout> m_entitySetLayout;
 	std::unique_ptr<Buffer> m_buffer;
+	std::unique_ptr<GPUTransformSystem> m_transformSystem;		// storage buffer mode only
 
 	std::vector<BufferComponent> m_entityUboBuffers;
 	std::vector<VkDescriptorSet> m_entityDescriptorSets;
+	std::vector<uint8*> m_entityMappedMemory;	// per frame, persistent mapping cached at creation
+	std::vector<uint32> m_capacities;			// per frame, entities the buffer can hold
+	std::vector<uint32> m_transformVersions;	// per frame, version of the resident transform buffer its descriptor set points to
+
+	std::vector<uint8> m_entityData;			// CPU copy of the data of all the entities, m_alignedSizeUBO each
+	std::vector<uint8> m_dirtyFrames;			// per entity, bit N set if the buffer of frame N has to be updated
 
 	uint32 m_alignedSizeUBO{ 0 };
+	uint32 m_uploadedEntityCount{ 0 };
 	mutable uint32 m_internalCounter{ 0 };
+	bool m_isStorageBuffer{ false };
 };
 
 VESPERENGINE_NAMESPACE_END
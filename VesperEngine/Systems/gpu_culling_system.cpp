@@ -0,0 +1,483 @@
+// Copyright (c) 2025-2025 Michele Condo'
+// File: C:\Projects\Vesper\VesperEngine\Systems\gpu_culling_system.cpp
+// Licensed under the MIT License. See LICENSE file in the project root for full license information.
+
+#include "Systems/gpu_culling_system.h"
+
+#include "Backend/buffer.h"
+#include "Backend/descriptors.h"
+#include "Backend/device.h"
+#include "Backend/frame_info.h"
+#include "Backend/instance_buffer.h"
+#include "Backend/pipeline.h"
+#include "Backend/renderer.h"
+#include "Backend/swap_chain.h"
+
+#include "Components/graphics_components.h"
+
+#include "App/vesper_app.h"
+#include "App/config.h"
+
+#include "Core/memory_copy.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+VESPERENGINE_NAMESPACE_BEGIN
+
+static constexpr uint8 kAllFramesMask = static_cast<uint8>((1u << SwapChain::kMaxFramesInFlight) - 1u);
+
+GPUCullingSystem::GPUCullingSystem(VesperApp& _app, Device& _device, Renderer& _renderer, InstanceBuffer& _instanceBuffer, uint32 _maxObjectCount)
+	: BaseRenderSystem{ _device }
+	, m_app(_app)
+	, m_renderer(_renderer)
+	, m_instanceBuffer(_instanceBuffer)
+	, m_maxObjectCount(_maxObjectCount)
+{
+	m_buffer = std::make_unique<Buffer>(m_device);
+
+	m_cullingSetLayout = DescriptorSetLayout::Builder(m_device)
+		.AddBinding(kInstanceBindingIndex, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+		.AddBinding(kObjectBindingIndex, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+		.AddBinding(kBatchBindingIndex, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+		.AddBinding(kDrawCommandBindingIndex, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+		.AddBinding(kDrawCountBindingIndex, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+		.Build();
+
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(GPUCullingPushConstants);
+	m_pushConstants.push_back(pushConstantRange);
+
+	m_objectBuffers.resize(SwapChain::kMaxFramesInFlight);
+	m_batchBuffers.resize(SwapChain::kMaxFramesInFlight);
+	m_drawCommandBuffers.resize(SwapChain::kMaxFramesInFlight);
+	m_drawCountBuffers.resize(SwapChain::kMaxFramesInFlight);
+	m_cullingDescriptorSets.resize(SwapChain::kMaxFramesInFlight);
+	m_objectMappedMemory.resize(SwapChain::kMaxFramesInFlight, nullptr);
+	m_batchMappedMemory.resize(SwapChain::kMaxFramesInFlight, nullptr);
+
+	// at most one batch per object, so every buffer is sized on the object count
+	for (int32 i = 0; i < SwapChain::kMaxFramesInFlight; ++i)
+	{
+		m_objectBuffers[i] = m_buffer->Create<BufferComponent>(
+			sizeof(GPUObjectData),
+			m_maxObjectCount,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
+			VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
+			/*minUboAlignment*/1,
+			true
+		);
+
+		m_batchBuffers[i] = m_buffer->Create<BufferComponent>(
+			sizeof(GPUBatchData),
+			m_maxObjectCount,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
+			VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
+			/*minUboAlignment*/1,
+			true
+		);
+
+		m_objectMappedMemory[i] = static_cast<uint8*>(m_buffer->GetMappedMemory(m_objectBuffers[i]));
+		m_batchMappedMemory[i] = static_cast<uint8*>(m_buffer->GetMappedMemory(m_batchBuffers[i]));
+
+		// written and read only by the GPU. The ranges of the batches are twice their objects, see LayoutBatches
+		m_drawCommandBuffers[i] = m_buffer->Create<BufferComponent>(
+			sizeof(VkDrawIndexedIndirectCommand),
+			m_maxObjectCount * 2,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+			VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+			0
+		);
+
+		m_drawCountBuffers[i] = m_buffer->Create<BufferComponent>(
+			sizeof(uint32),
+			m_maxObjectCount,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+			0
+		);
+
+		VkDescriptorBufferInfo instanceInfo{ m_instanceBuffer.GetBuffer(i), 0, VK_WHOLE_SIZE };
+		VkDescriptorBufferInfo objectInfo{ m_objectBuffers[i].Buffer, 0, VK_WHOLE_SIZE };
+		VkDescriptorBufferInfo batchInfo{ m_batchBuffers[i].Buffer, 0, VK_WHOLE_SIZE };
+		VkDescriptorBufferInfo drawCommandInfo{ m_drawCommandBuffers[i].Buffer, 0, VK_WHOLE_SIZE };
+		VkDescriptorBufferInfo drawCountInfo{ m_drawCountBuffers[i].Buffer, 0, VK_WHOLE_SIZE };
+
+		DescriptorWriter(*m_cullingSetLayout, *m_renderer.GetDescriptorPool())
+			.WriteBuffer(kInstanceBindingIndex, &instanceInfo)
+			.WriteBuffer(kObjectBindingIndex, &objectInfo)
+			.WriteBuffer(kBatchBindingIndex, &batchInfo)
+			.WriteBuffer(kDrawCommandBindingIndex, &drawCommandInfo)
+			.WriteBuffer(kDrawCountBindingIndex, &drawCountInfo)
+			.Build(m_cullingDescriptorSets[i]);
+	}
+
+	m_objects.resize(m_maxObjectCount);
+	m_instances.resize(m_maxObjectCount);
+	m_objectDirtyFrames.resize(m_maxObjectCount, 0);
+	m_objectUpdates.resize(m_maxObjectCount, 0);
+
+	m_batches.reserve(m_maxObjectCount);
+	m_batchObjectCounts.reserve(m_maxObjectCount);
+	m_batchDirtyFrames.reserve(m_maxObjectCount);
+
+	CreatePipelineLayout({ m_cullingSetLayout->GetDescriptorSetLayout() });
+}
+
+void GPUCullingSystem::CreatePipeline()
+{
+	ShaderInfo computeShader(m_app.GetConfig().ShadersPath + "gpu_culling.comp.spv", ShaderType::Compute);
+
+	m_cullingPipeline = std::make_unique<Pipeline>(m_device, computeShader, m_pipelineLayout);
+}
+
+void GPUCullingSystem::BeginUpdate()
+{
+	// 0 marks the objects not set
+	if (++m_update == 0)
+	{
+		m_update = 1;
+	}
+	m_setObjectCount = 0;
+}
+
+uint32 GPUCullingSystem::AcquireBatch(uint64 _key, const IndexBufferComponent& _indexBufferComponent)
+{
+	uint32 batchIndex;
+
+	const auto it = m_batchIndices.find(_key);
+	if (it != m_batchIndices.end())
+	{
+		batchIndex = it->second;
+	}
+	else
+	{
+		// at most one batch per object, the draw count buffer is sized on it
+		if (m_batches.size() >= m_maxObjectCount)
+		{
+			return kInvalidIndex;
+		}
+
+		batchIndex = static_cast<uint32>(m_batches.size());
+		m_batchIndices.emplace(_key, batchIndex);
+
+		// no commands yet, the first object added lays the batches out
+		m_batches.emplace_back();
+		m_batchObjectCounts.push_back(0);
+		m_batchDirtyFrames.push_back(kAllFramesMask);
+	}
+
+	// the geometry can move in its arena
+	GPUBatchData& batch = m_batches[batchIndex];
+	if (batch.IndexCount != _indexBufferComponent.Count || batch.FirstIndex != _indexBufferComponent.FirstIndex || batch.VertexOffset != _indexBufferComponent.VertexOffset)
+	{
+		batch.IndexCount = _indexBufferComponent.Count;
+		batch.FirstIndex = _indexBufferComponent.FirstIndex;
+		batch.VertexOffset = _indexBufferComponent.VertexOffset;
+		m_batchDirtyFrames[batchIndex] = kAllFramesMask;
+	}
+
+	return batchIndex;
+}
+
+void GPUCullingSystem::SetObject(uint32 _objectIndex, uint32 _batchIndex, const InstanceData& _instanceData, const glm::vec3& _boundsMin, const glm::vec3& _boundsMax, bool _isVisible)
+{
+	assertMsgReturnVoid(_objectIndex < m_maxObjectCount, "GPU culling objects are full");
+	assertMsgReturnVoid(_batchIndex < m_batches.size(), "_batchIndex out of range!");
+	assertMsgReturnVoid(m_objectUpdates[_objectIndex] != m_update, "GPU culling object set twice in the same update");
+
+	if (m_objectUpdates[_objectIndex] == 0)
+	{
+		// its slot could still hold a removed object never uploaded, whatever is staged
+		m_objectDirtyFrames[_objectIndex] = kAllFramesMask;
+		AddToBatch(_batchIndex);
+
+		m_objectRange = std::max(m_objectRange, _objectIndex + 1);
+		++m_objectCount;
+	}
+	else if (m_objects[_objectIndex].BatchIndex != _batchIndex)
+	{
+		--m_batchObjectCounts[m_objects[_objectIndex].BatchIndex];
+		AddToBatch(_batchIndex);
+	}
+
+	m_objectUpdates[_objectIndex] = m_update;
+	++m_setObjectCount;
+
+	GPUObjectData object{};
+	object.BoundsMin = glm::vec4(_boundsMin, 1.0f);
+	object.BoundsMax = glm::vec4(_boundsMax, 1.0f);
+	object.BatchIndex = _batchIndex;
+	object.Flags = _isVisible ? kObjectVisibleFlag : 0u;
+
+	StageObject(_objectIndex, object, _instanceData);
+}
+
+void GPUCullingSystem::EndUpdate(const int32 _frameIndex)
+{
+	// the set objects are counted anyway, so this scan runs only when some of them are gone
+	if (m_setObjectCount != m_objectCount)
+	{
+		for (uint32 i = 0; i < m_objectRange; ++i)
+		{
+			if (m_objectUpdates[i] != 0 && m_objectUpdates[i] != m_update)
+			{
+				RemoveObject(i);
+			}
+		}
+
+		while (m_objectRange > 0 && m_objectUpdates[m_objectRange - 1] == 0)
+		{
+			--m_objectRange;
+		}
+	}
+
+	if (m_isLayoutDirty)
+	{
+		LayoutBatches();
+	}
+
+	const uint8 frameBit = static_cast<uint8>(1u << _frameIndex);
+	if ((m_residentFrames & frameBit) == 0)
+	{
+		for (uint32 i = 0; i < m_objectRange; ++i)
+		{
+			m_objectDirtyFrames[i] |= frameBit;
+		}
+		for (uint8& dirtyFrames : m_batchDirtyFrames)
+		{
+			dirtyFrames |= frameBit;
+		}
+		m_residentFrames |= frameBit;
+	}
+
+	UploadDirtyObjects(_frameIndex);
+	UploadDirtyBatches(_frameIndex);
+}
+
+void GPUCullingSystem::Invalidate(const int32 _frameIndex)
+{
+	m_residentFrames &= static_cast<uint8>(~(1u << _frameIndex));
+}
+
+void GPUCullingSystem::StageObject(uint32 _objectIndex, const GPUObjectData& _object, const InstanceData& _instanceData)
+{
+	GPUObjectData& stagedObject = m_objects[_objectIndex];
+	InstanceData& stagedInstance = m_instances[_objectIndex];
+
+	// the object and its instance are uploaded together, at the same index
+	if (std::memcmp(&stagedObject, &_object, sizeof(GPUObjectData)) != 0 || std::memcmp(&stagedInstance, &_instanceData, sizeof(InstanceData)) != 0)
+	{
+		std::memcpy(&stagedObject, &_object, sizeof(GPUObjectData));
+		std::memcpy(&stagedInstance, &_instanceData, sizeof(InstanceData));
+		m_objectDirtyFrames[_objectIndex] = kAllFramesMask;
+	}
+}
+
+void GPUCullingSystem::AddToBatch(uint32 _batchIndex)
+{
+	if (++m_batchObjectCounts[_batchIndex] > m_batches[_batchIndex].Capacity)
+	{
+		m_isLayoutDirty = true;
+	}
+}
+
+void GPUCullingSystem::RemoveObject(uint32 _objectIndex)
+{
+	// never visible again, the culling skips it
+	--m_batchObjectCounts[m_objects[_objectIndex].BatchIndex];
+	m_objects[_objectIndex].Flags = 0u;
+	m_objectDirtyFrames[_objectIndex] = kAllFramesMask;
+
+	m_objectUpdates[_objectIndex] = 0;
+	--m_objectCount;
+}
+
+void GPUCullingSystem::LayoutBatches()
+{
+	// twice the objects of every batch are at most twice the objects, the size of the commands buffer
+	uint32 firstCommand = 0;
+	for (uint32 i = 0; i < static_cast<uint32>(m_batches.size()); ++i)
+	{
+		GPUBatchData& batch = m_batches[i];
+		const uint32 capacity = m_batchObjectCounts[i] * 2;
+
+		if (batch.FirstCommand != firstCommand || batch.Capacity != capacity)
+		{
+			batch.FirstCommand = firstCommand;
+			batch.Capacity = capacity;
+			m_batchDirtyFrames[i] = kAllFramesMask;
+		}
+
+		firstCommand += capacity;
+	}
+
+	m_isLayoutDirty = false;
+}
+
+void GPUCullingSystem::UploadDirtyObjects(const int32 _frameIndex)
+{
+	const uint8 frameBit = static_cast<uint8>(1u << _frameIndex);
+	uint8* const mappedMemory = m_objectMappedMemory[_frameIndex];
+
+	m_uploadedObjectCount = 0;
+
+	uint32 index = 0;
+	while (index < m_objectRange)
+	{
+		if ((m_objectDirtyFrames[index] & frameBit) == 0)
+		{
+			++index;
+			continue;
+		}
+
+		const uint32 firstIndex = index;
+		while (index < m_objectRange && (m_objectDirtyFrames[index] & frameBit) != 0)
+		{
+			m_objectDirtyFrames[index] &= static_cast<uint8>(~frameBit);
+			++index;
+		}
+
+		const uint32 count = index - firstIndex;
+		MemCpy(mappedMemory + static_cast<std::size_t>(firstIndex) * sizeof(GPUObjectData), &m_objects[firstIndex], static_cast<std::size_t>(count) * sizeof(GPUObjectData));
+		m_instanceBuffer.Write(_frameIndex, firstIndex, &m_instances[firstIndex], count);
+
+		m_uploadedObjectCount += count;
+	}
+}
+
+void GPUCullingSystem::UploadDirtyBatches(const int32 _frameIndex)
+{
+	const uint8 frameBit = static_cast<uint8>(1u << _frameIndex);
+	const uint32 batchCount = static_cast<uint32>(m_batches.size());
+	uint8* const mappedMemory = m_batchMappedMemory[_frameIndex];
+
+	uint32 index = 0;
+	while (index < batchCount)
+	{
+		if ((m_batchDirtyFrames[index] & frameBit) == 0)
+		{
+			++index;
+			continue;
+		}
+
+		const uint32 firstIndex = index;
+		while (index < batchCount && (m_batchDirtyFrames[index] & frameBit) != 0)
+		{
+			m_batchDirtyFrames[index] &= static_cast<uint8>(~frameBit);
+			++index;
+		}
+
+		MemCpy(mappedMemory + static_cast<std::size_t>(firstIndex) * sizeof(GPUBatchData), &m_batches[firstIndex], static_cast<std::size_t>(index - firstIndex) * sizeof(GPUBatchData));
+	}
+}
+
+void GPUCullingSystem::Dispatch(const FrameInfo& _frameInfo, const glm::mat4& _viewProjectionMatrix)
+{
+	if (m_objectCount == 0 || !m_cullingPipeline)
+	{
+		return;
+	}
+
+	m_commandRecorder.Reset(_frameInfo.CommandBuffer);
+
+	const BufferComponent& drawCountBuffer = m_drawCountBuffers[_frameInfo.FrameIndex];
+	const BufferComponent& drawCommandBuffer = m_drawCommandBuffers[_frameInfo.FrameIndex];
+
+	// counts restart from zero every frame
+	vkCmdFillBuffer(_frameInfo.CommandBuffer, drawCountBuffer.Buffer, 0, sizeof(uint32) * m_batches.size(), 0);
+
+	VkBufferMemoryBarrier clearBarrier{};
+	clearBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	clearBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	clearBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	clearBarrier.buffer = drawCountBuffer.Buffer;
+	clearBarrier.offset = 0;
+	clearBarrier.size = VK_WHOLE_SIZE;
+
+	vkCmdPipelineBarrier(
+		_frameInfo.CommandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0,
+		0, nullptr,
+		1, &clearBarrier,
+		0, nullptr);
+
+	m_cullingPipeline->Bind(_frameInfo.CommandBuffer);
+
+	vkCmdBindDescriptorSets(
+		_frameInfo.CommandBuffer,
+		VK_PIPELINE_BIND_POINT_COMPUTE,
+		m_pipelineLayout,
+		0,
+		1,
+		&m_cullingDescriptorSets[_frameInfo.FrameIndex],
+		0,
+		nullptr);
+
+	GPUCullingPushConstants pushConstants;
+	pushConstants.ViewProjectionMatrix = _viewProjectionMatrix;
+	pushConstants.ObjectCount = m_objectRange;		// the removed objects in between are not visible
+	PushConstants(_frameInfo.CommandBuffer, 0, &pushConstants);
+
+	const uint32 groupCount = (m_objectRange + kWorkGroupSize - 1) / kWorkGroupSize;
+	vkCmdDispatch(_frameInfo.CommandBuffer, groupCount, 1, 1);
+
+	// no barrier here: the render graph batches the wait of the indirect draws with the other ones before the render pass
+}
+
+void GPUCullingSystem::DrawBatch(const FrameInfo& _frameInfo, uint32 _batchIndex) const
+{
+	assertMsgReturnVoid(_batchIndex < m_batches.size(), "_batchIndex out of range!");
+
+	const GPUBatchData& batch = m_batches[_batchIndex];
+
+	vkCmdDrawIndexedIndirectCountKHR(
+		_frameInfo.CommandBuffer,
+		m_drawCommandBuffers[_frameInfo.FrameIndex].Buffer,
+		static_cast<VkDeviceSize>(batch.FirstCommand) * sizeof(VkDrawIndexedIndirectCommand),
+		m_drawCountBuffers[_frameInfo.FrameIndex].Buffer,
+		static_cast<VkDeviceSize>(_batchIndex) * sizeof(uint32),
+		batch.Capacity,
+		sizeof(VkDrawIndexedIndirectCommand));
+}
+
+void GPUCullingSystem::Cleanup()
+{
+	for (int32 i = 0; i < SwapChain::kMaxFramesInFlight; ++i)
+	{
+		m_buffer->Destroy(m_objectBuffers[i]);
+		m_buffer->Destroy(m_batchBuffers[i]);
+		m_buffer->Destroy(m_drawCommandBuffers[i]);
+		m_buffer->Destroy(m_drawCountBuffers[i]);
+	}
+
+	m_objectMappedMemory.clear();
+	m_batchMappedMemory.clear();
+
+	m_objects.clear();
+	m_instances.clear();
+	m_objectDirtyFrames.clear();
+	m_objectUpdates.clear();
+
+	m_batches.clear();
+	m_batchObjectCounts.clear();
+	m_batchDirtyFrames.clear();
+	m_batchIndices.clear();
+
+	m_objectCount = 0;
+	m_objectRange = 0;
+	m_setObjectCount = 0;
+	m_residentFrames = 0;
+	m_isLayoutDirty = false;
+}
+
+VESPERENGINE_NAMESPACE_END
@@ -0,0 +1,140 @@
+// Copyright (c) 2025-2025 Michele Condo'
+// File: C:\Projects\Vesper\VesperEngine\Systems\gpu_culling_system.h
+// Licensed under the MIT License. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include "Core/core_defines.h"
+#include "Core/glm_config.h"
+
+#include "Systems/base_render_system.h"
+#include "Systems/uniform_buffer.h"
+
+#include "vulkan/vulkan.h"
+
+#include <memory>
+#include <vector>
+#include <unordered_map>
+
+
+VESPERENGINE_NAMESPACE_BEGIN
+
+class VesperApp;
+class Device;
+class Renderer;
+class Pipeline;
+class DescriptorSetLayout;
+class Buffer;
+class InstanceBuffer;
+
+struct FrameInfo;
+struct BufferComponent;
+struct IndexBufferComponent;
+
+/**
+ * Frustum culling on the GPU for the GPU driven draws.
+ * The objects and their batches (objects sharing the same indexed geometry) are resident: an object keeps the index of its entity
+ * and a batch the index it got the first time its key was set. Their records are staged in a CPU copy and, as for the entities,
+ * only the ones which changed are uploaded to every frame, merging the consecutive ones in a single copy.
+ * Each batch owns a range of the indirect commands buffer with room to grow, the ranges are laid out again only when one overflows.
+ * The compute pass tests the bounds of every object and appends the visible ones in the range of their batch, counting them:
+ * each batch is then drawn with a single vkCmdDrawIndexedIndirectCount.
+ * The object index is the firstInstance of its draw, so the vertex shader reads its InstanceData through gl_InstanceIndex.
+ */
+class VESPERENGINE_API GPUCullingSystem : public BaseRenderSystem
+{
+public:
+	static constexpr uint32 kInstanceBindingIndex = 0u;
+	static constexpr uint32 kObjectBindingIndex = 1u;
+	static constexpr uint32 kBatchBindingIndex = 2u;
+	static constexpr uint32 kDrawCommandBindingIndex = 3u;
+	static constexpr uint32 kDrawCountBindingIndex = 4u;
+
+	static constexpr uint32 kWorkGroupSize = 64u;	// local_size_x of gpu_culling.comp
+	static constexpr uint32 kObjectVisibleFlag = 1u << 0;
+
+	static constexpr uint32 kInvalidIndex = ~0u;
+
+public:
+	GPUCullingSystem(VesperApp& _app, Device& _device, Renderer& _renderer, InstanceBuffer& _instanceBuffer, uint32 _maxObjectCount);
+	virtual ~GPUCullingSystem() = default;
+
+	GPUCullingSystem(const GPUCullingSystem&) = delete;
+	GPUCullingSystem& operator=(const GPUCullingSystem&) = delete;
+
+public:
+	VESPERENGINE_INLINE uint32 GetObjectCount() const { return m_objectCount; }
+	VESPERENGINE_INLINE uint32 GetBatchCount() const { return static_cast<uint32>(m_batches.size()); }
+	VESPERENGINE_INLINE uint32 GetBatchObjectCount(uint32 _batchIndex) const { return m_batchObjectCounts[_batchIndex]; }
+	VESPERENGINE_INLINE uint32 GetUploadedObjectCount() const { return m_uploadedObjectCount; }
+
+public:
+	void CreatePipeline();
+	// Call once per frame, before setting the objects
+	void BeginUpdate();
+	// The batch of _key, added with the geometry of _indexBufferComponent the first time. kInvalidIndex when the batches are full
+	uint32 AcquireBatch(uint64 _key, const IndexBufferComponent& _indexBufferComponent);
+	// Set the object at _objectIndex, at most once per update: it is flagged dirty only if it differs from the staged one.
+	// Its instance data goes in the InstanceBuffer at the same index
+	void SetObject(uint32 _objectIndex, uint32 _batchIndex, const InstanceData& _instanceData, const glm::vec3& _boundsMin, const glm::vec3& _boundsMax, bool _isVisible);
+	// Call after the last SetObject: remove the objects not set in this update and upload the dirty records of the frame
+	void EndUpdate(const int32 _frameIndex);
+	// The instance buffer of the frame has been overwritten (i.e. by the CPU instancing), upload every record again next time
+	void Invalidate(const int32 _frameIndex);
+	// Call outside of the render pass, after all the objects have been added: clear the counts, cull and compact the draws.
+	// The indirect draws wait for it through the render graph: its pass writes the draw command and count buffers, the drawing one reads them
+	void Dispatch(const FrameInfo& _frameInfo, const glm::mat4& _viewProjectionMatrix);
+	// Call inside the render pass, with the pipeline and the batch geometry bound
+	void DrawBatch(const FrameInfo& _frameInfo, uint32 _batchIndex) const;
+	// Call at the end or at destruction time, anyway after the game loop is done.
+	void Cleanup();
+
+private:
+	void StageObject(uint32 _objectIndex, const GPUObjectData& _object, const InstanceData& _instanceData);
+	void AddToBatch(uint32 _batchIndex);
+	void RemoveObject(uint32 _objectIndex);
+	// give every batch a range of the commands twice as big as its objects
+	void LayoutBatches();
+	void UploadDirtyObjects(const int32 _frameIndex);
+	void UploadDirtyBatches(const int32 _frameIndex);
+
+private:
+	VesperApp& m_app;
+	Renderer& m_renderer;
+	InstanceBuffer& m_instanceBuffer;
+
+	std::unique_ptr<Pipeline> m_cullingPipeline;
+	std::unique_ptr<DescriptorSetLayout> m_cullingSetLayout;
+	std::unique_ptr<Buffer> m_buffer;
+
+	std::vector<BufferComponent> m_objectBuffers;
+	std::vector<BufferComponent> m_batchBuffers;
+	std::vector<BufferComponent> m_drawCommandBuffers;
+	std::vector<BufferComponent> m_drawCountBuffers;
+	std::vector<VkDescriptorSet> m_cullingDescriptorSets;
+	std::vector<uint8*> m_objectMappedMemory;	// per frame, persistent mapping cached at creation
+	std::vector<uint8*> m_batchMappedMemory;	// per frame, persistent mapping cached at creation
+
+	// staged records, by object index
+	std::vector<GPUObjectData> m_objects;
+	std::vector<InstanceData> m_instances;
+	std::vector<uint8> m_objectDirtyFrames;		// bit per frame in flight still to upload
+	std::vector<uint32> m_objectUpdates;		// update of the last SetObject, 0 if the object is not set
+
+	// staged records, by batch index
+	std::vector<GPUBatchData> m_batches;
+	std::vector<uint32> m_batchObjectCounts;
+	std::vector<uint8> m_batchDirtyFrames;
+	std::unordered_map<uint64, uint32> m_batchIndices;
+
+	uint32 m_maxObjectCount{ 0 };
+	uint32 m_objectCount{ 0 };			// set objects
+	uint32 m_objectRange{ 0 };			// highest set object index + 1, the culling dispatch covers it
+	uint32 m_setObjectCount{ 0 };		// set in the current update
+	uint32 m_update{ 0 };
+	uint32 m_uploadedObjectCount{ 0 };
+	uint8 m_residentFrames{ 0 };		// bit per frame whose buffers hold the staged records, but the dirty ones
+	bool m_isLayoutDirty{ false };
+};
+
+VESPERENGINE_NAMESPACE_END
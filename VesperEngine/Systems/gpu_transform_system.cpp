@@ -0,0 +1,265 @@
+// Copyright (c) 2025-2025 Michele Condo'
+// File: C:\Projects\Vesper\VesperEngine\Systems\gpu_transform_system.cpp
+// Licensed under the MIT License. See LICENSE file in the project root for full license information.
+
+#include "Systems/gpu_transform_system.h"
+
+#include "Backend/buffer.h"
+#include "Backend/descriptors.h"
+#include "Backend/device.h"
+#include "Backend/frame_info.h"
+#include "Backend/pipeline.h"
+#include "Backend/renderer.h"
+#include "Backend/swap_chain.h"
+
+#include "App/vesper_app.h"
+#include "App/config.h"
+
+#include "Core/memory_copy.h"
+
+#include <cstring>
+
+
+VESPERENGINE_NAMESPACE_BEGIN
+
+GPUTransformSystem::GPUTransformSystem(VesperApp& _app, Device& _device, Renderer& _renderer)
+	: BaseRenderSystem{ _device }
+	, m_app(_app)
+	, m_renderer(_renderer)
+{
+	m_buffer = std::make_unique<Buffer>(m_device);
+
+	m_scatterSetLayout = DescriptorSetLayout::Builder(m_device)
+		.AddBinding(kUpdateBindingIndex, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+		.AddBinding(kTransformBindingIndex, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT)
+		.Build();
+
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(GPUTransformPushConstants);
+	m_pushConstants.push_back(pushConstantRange);
+
+	CreatePipelineLayout({ m_scatterSetLayout->GetDescriptorSetLayout() });
+}
+
+void GPUTransformSystem::Initialize(uint32 _capacity)
+{
+	m_updateBuffers.resize(SwapChain::kMaxFramesInFlight);
+	m_updateMappedMemory.resize(SwapChain::kMaxFramesInFlight, nullptr);
+	m_updateCapacities.resize(SwapChain::kMaxFramesInFlight, 0u);
+	m_scatterDescriptorSets.resize(SwapChain::kMaxFramesInFlight);
+	m_descriptorSetVersions.resize(SwapChain::kMaxFramesInFlight, 0u);
+
+	CreateTransformBuffer(_capacity);
+
+	for (int32 i = 0; i < SwapChain::kMaxFramesInFlight; ++i)
+	{
+		CreateUpdateBuffer(i, kMinUpdateCapacity);
+		WriteDescriptorSet(i, false);
+	}
+}
+
+void GPUTransformSystem::CreatePipeline()
+{
+	ShaderInfo computeShader(m_app.GetConfig().ShadersPath + "transform_scatter.comp.spv", ShaderType::Compute);
+
+	m_scatterPipeline = std::make_unique<Pipeline>(m_device, computeShader, m_pipelineLayout);
+}
+
+void GPUTransformSystem::SetTransform(uint32 _entityIndex, const glm::vec3& _position, const glm::quat& _rotation, const glm::vec3& _scale)
+{
+	if (_entityIndex >= m_transforms.size())
+	{
+		GPUTransformUpdate neverSet;
+		neverSet.EntityIndex = kInvalidEntityIndex;
+		m_transforms.resize(static_cast<std::size_t>(_entityIndex) + 1, neverSet);
+	}
+
+	GPUTransformUpdate update;
+	update.Rotation = glm::vec4(_rotation.x, _rotation.y, _rotation.z, _rotation.w);
+	update.Position = glm::vec4(_position, 0.0f);
+	update.Scale = glm::vec4(_scale, 0.0f);
+	update.EntityIndex = _entityIndex;
+
+	// every member is explicit, padding included, so the whole struct can be compared
+	if (std::memcmp(&m_transforms[_entityIndex], &update, sizeof(GPUTransformUpdate)) == 0)
+	{
+		return;
+	}
+
+	m_transforms[_entityIndex] = update;
+	m_pendingUpdates.push_back(update);
+}
+
+void GPUTransformSystem::Dispatch(const FrameInfo& _frameInfo)
+{
+	ReleaseRetiredBuffers(false);
+
+	if (!m_scatterPipeline)
+	{
+		return;
+	}
+
+	const int32 frameIndex = _frameInfo.FrameIndex;
+
+	if (m_transforms.size() > m_transformCapacity)
+	{
+		uint32 capacity = m_transformCapacity;
+		while (capacity < m_transforms.size())
+		{
+			capacity *= 2;
+		}
+
+		// frames in flight could still read the old one
+		m_retiredBuffers.push_back({ m_transformBuffer, SwapChain::kMaxFramesInFlight });
+		CreateTransformBuffer(capacity);
+
+		// the new buffer is empty, so every transform is uploaded again, the pending ones are among them
+		m_pendingUpdates.clear();
+		for (const GPUTransformUpdate& transform : m_transforms)
+		{
+			if (transform.EntityIndex != kInvalidEntityIndex)
+			{
+				m_pendingUpdates.push_back(transform);
+			}
+		}
+	}
+
+	const uint32 updateCount = static_cast<uint32>(m_pendingUpdates.size());
+	m_uploadedTransformCount = updateCount;
+
+	if (updateCount == 0)
+	{
+		return;
+	}
+
+	// safe, the fence of this frame has been waited so the GPU is not reading its staging buffer or its descriptor set anymore
+	if (m_updateCapacities[frameIndex] < updateCount)
+	{
+		uint32 capacity = m_updateCapacities[frameIndex];
+		while (capacity < updateCount)
+		{
+			capacity *= 2;
+		}
+
+		m_buffer->Destroy(m_updateBuffers[frameIndex]);
+		CreateUpdateBuffer(frameIndex, capacity);
+		WriteDescriptorSet(frameIndex, true);
+	}
+	else if (m_descriptorSetVersions[frameIndex] != m_transformBufferVersion)
+	{
+		WriteDescriptorSet(frameIndex, true);
+	}
+
+	MemCpy(m_updateMappedMemory[frameIndex], m_pendingUpdates.data(), sizeof(GPUTransformUpdate) * updateCount);
+	m_pendingUpdates.clear();
+
+	// the wait for the vertex shaders of the previous frames, and the one of this frame for the scatter, are recorded by the render graph
+	m_scatterPipeline->Bind(_frameInfo.CommandBuffer);
+
+	vkCmdBindDescriptorSets(
+		_frameInfo.CommandBuffer,
+		VK_PIPELINE_BIND_POINT_COMPUTE,
+		m_pipelineLayout,
+		0,
+		1,
+		&m_scatterDescriptorSets[frameIndex],
+		0,
+		nullptr);
+
+	GPUTransformPushConstants pushConstants;
+	pushConstants.UpdateCount = updateCount;
+	vkCmdPushConstants(_frameInfo.CommandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(GPUTransformPushConstants), &pushConstants);
+
+	const uint32 groupCount = (updateCount + kWorkGroupSize - 1) / kWorkGroupSize;
+	vkCmdDispatch(_frameInfo.CommandBuffer, groupCount, 1, 1);
+}
+
+void GPUTransformSystem::Cleanup()
+{
+	ReleaseRetiredBuffers(true);
+
+	for (int32 i = 0; i < static_cast<int32>(m_updateBuffers.size()); ++i)
+	{
+		m_buffer->Destroy(m_updateBuffers[i]);
+	}
+	m_buffer->Destroy(m_transformBuffer);
+
+	m_updateBuffers.clear();
+	m_updateMappedMemory.clear();
+	m_updateCapacities.clear();
+	m_descriptorSetVersions.clear();
+	m_transforms.clear();
+	m_pendingUpdates.clear();
+
+	m_transformCapacity = 0;
+	m_uploadedTransformCount = 0;
+}
+
+void GPUTransformSystem::CreateTransformBuffer(uint32 _capacity)
+{
+	// written and read only by the GPU
+	m_transformBuffer = m_buffer->Create<BufferComponent>(
+		sizeof(EntityTransform),
+		_capacity,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+		0
+	);
+
+	m_transformCapacity = _capacity;
+	++m_transformBufferVersion;
+}
+
+void GPUTransformSystem::CreateUpdateBuffer(const int32 _frameIndex, uint32 _capacity)
+{
+	m_updateBuffers[_frameIndex] = m_buffer->Create<BufferComponent>(
+		sizeof(GPUTransformUpdate),
+		_capacity,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
+		VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
+		/*minUboAlignment*/1,
+		true
+	);
+
+	m_updateMappedMemory[_frameIndex] = static_cast<uint8*>(m_buffer->GetMappedMemory(m_updateBuffers[_frameIndex]));
+	m_updateCapacities[_frameIndex] = _capacity;
+}
+
+void GPUTransformSystem::WriteDescriptorSet(const int32 _frameIndex, bool _isOverwrite)
+{
+	VkDescriptorBufferInfo updateInfo{ m_updateBuffers[_frameIndex].Buffer, 0, VK_WHOLE_SIZE };
+	VkDescriptorBufferInfo transformInfo{ m_transformBuffer.Buffer, 0, VK_WHOLE_SIZE };
+
+	DescriptorWriter writer(*m_scatterSetLayout, *m_renderer.GetDescriptorPool());
+	writer.WriteBuffer(kUpdateBindingIndex, &updateInfo)
+		.WriteBuffer(kTransformBindingIndex, &transformInfo);
+
+	if (_isOverwrite)
+	{
+		writer.Overwrite(m_scatterDescriptorSets[_frameIndex]);
+	}
+	else
+	{
+		writer.Build(m_scatterDescriptorSets[_frameIndex]);
+	}
+
+	m_descriptorSetVersions[_frameIndex] = m_transformBufferVersion;
+}
+
+void GPUTransformSystem::ReleaseRetiredBuffers(bool _isForced)
+{
+	for (int32 i = static_cast<int32>(m_retiredBuffers.size()) - 1; i >= 0; --i)
+	{
+		RetiredBuffer& retired = m_retiredBuffers[i];
+		if (_isForced || --retired.FrameCount <= 0)
+		{
+			m_buffer->Destroy(retired.Buffer);
+			m_retiredBuffers.erase(m_retiredBuffers.begin() + i);
+		}
+	}
+}
+
+VESPERENGINE_NAMESPACE_END
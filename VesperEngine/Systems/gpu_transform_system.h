@@ -0,0 +1,114 @@
+// Copyright (c) 2025-2025 Michele Condo'
+// File: C:\Projects\Vesper\VesperEngine\Systems\gpu_transform_system.h
+// Licensed under the MIT License. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include "Core/core_defines.h"
+#include "Core/glm_config.h"
+
+#include "Systems/base_render_system.h"
+#include "Systems/uniform_buffer.h"
+
+#include "Components/graphics_components.h"
+
+#include "vulkan/vulkan.h"
+
+#include <memory>
+#include <vector>
+
+
+VESPERENGINE_NAMESPACE_BEGIN
+
+class VesperApp;
+class Device;
+class Renderer;
+class Pipeline;
+class DescriptorSetLayout;
+class Buffer;
+
+struct FrameInfo;
+
+/**
+ * Transforms of the entities resident on the GPU, in a device local buffer of EntityTransform indexed like the entities.
+ * Every frame only the entities whose position, rotation or scale changed are uploaded, as a compact list of GPUTransformUpdate
+ * in a small per frame staging buffer, then a compute pass scatters them composing the model and normal matrices in place.
+ * The resident buffer is one for all the frames in flight: the render graph pass recording the scatter declares the write,
+ * so the graph orders it after the vertex shaders of the previous frame and before the ones of this frame.
+ * When it has to grow, every transform is uploaded again and the old buffer is destroyed once no frame in flight can use it anymore,
+ * who binds the resident buffer has to point to the new one when GetTransformBufferVersion changes.
+ */
+class VESPERENGINE_API GPUTransformSystem : public BaseRenderSystem
+{
+public:
+	static constexpr uint32 kUpdateBindingIndex = 0u;
+	static constexpr uint32 kTransformBindingIndex = 1u;
+
+	static constexpr uint32 kWorkGroupSize = 64u;	// local_size_x of transform_scatter.comp
+	static constexpr uint32 kMinUpdateCapacity = 256u;
+	static constexpr uint32 kInvalidEntityIndex = ~0u;
+
+public:
+	GPUTransformSystem(VesperApp& _app, Device& _device, Renderer& _renderer);
+	virtual ~GPUTransformSystem() = default;
+
+	GPUTransformSystem(const GPUTransformSystem&) = delete;
+	GPUTransformSystem& operator=(const GPUTransformSystem&) = delete;
+
+public:
+	VESPERENGINE_INLINE VkBuffer GetTransformBuffer() const { return m_transformBuffer.Buffer; }
+	VESPERENGINE_INLINE uint32 GetTransformBufferVersion() const { return m_transformBufferVersion; }
+	VESPERENGINE_INLINE uint32 GetTransformCapacity() const { return m_transformCapacity; }
+	// transforms uploaded by the last Dispatch, to monitor how many changed
+	VESPERENGINE_INLINE uint32 GetUploadedTransformCount() const { return m_uploadedTransformCount; }
+
+public:
+	// Create the resident buffer able to hold _capacity entities and the staging buffers
+	void Initialize(uint32 _capacity);
+	void CreatePipeline();
+	// Queue the transform of the entity for the next Dispatch, only if it changed since the last time. Call it at most once per entity per frame
+	void SetTransform(uint32 _entityIndex, const glm::vec3& _position, const glm::quat& _rotation, const glm::vec3& _scale);
+	// Call outside of the render pass, before any draw reading the transforms: upload the queued transforms and scatter them.
+	// Inside a render graph pass writing the transforms, the graph records the barriers
+	void Dispatch(const FrameInfo& _frameInfo);
+	// Call at the end or at destruction time, anyway after the game loop is done.
+	void Cleanup();
+
+private:
+	struct RetiredBuffer
+	{
+		BufferComponent Buffer{};
+		int32 FrameCount{ 0 };		// Dispatch calls left before it can be destroyed
+	};
+
+	void CreateTransformBuffer(uint32 _capacity);
+	void CreateUpdateBuffer(const int32 _frameIndex, uint32 _capacity);
+	void WriteDescriptorSet(const int32 _frameIndex, bool _isOverwrite);
+	void ReleaseRetiredBuffers(bool _isForced);
+
+private:
+	VesperApp& m_app;
+	Renderer& m_renderer;
+
+	std::unique_ptr<Pipeline> m_scatterPipeline;
+	std::unique_ptr<DescriptorSetLayout> m_scatterSetLayout;
+	std::unique_ptr<Buffer> m_buffer;
+
+	BufferComponent m_transformBuffer{};
+	std::vector<RetiredBuffer> m_retiredBuffers;
+
+	std::vector<BufferComponent> m_updateBuffers;
+	std::vector<uint8*> m_updateMappedMemory;		// per frame, persistent mapping cached at creation
+	std::vector<uint32> m_updateCapacities;			// per frame
+	std::vector<VkDescriptorSet> m_scatterDescriptorSets;
+	std::vector<uint32> m_descriptorSetVersions;	// per frame, version of the resident buffer its descriptor set points to
+
+	std::vector<GPUTransformUpdate> m_transforms;		// per entity, the last transform queued, EntityIndex is kInvalidEntityIndex if never set
+	std::vector<GPUTransformUpdate> m_pendingUpdates;
+
+	uint32 m_transformCapacity{ 0 };
+	uint32 m_transformBufferVersion{ 0 };
+	uint32 m_uploadedTransformCount{ 0 };
+};
+
+VESPERENGINE_NAMESPACE_END
@@ -142,6 +142,8 @@ void IrradianceConvolutionGenerationSystem::Generate(
             .Build(m_descriptorSet);
     }
 
+    m_commandRecorder.Reset(_commandBuffer);
+
     m_pipeline->Bind(_commandBuffer);
     vkCmdBindDescriptorSets(_commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &m_descriptorSet, 0, nullptr);
 
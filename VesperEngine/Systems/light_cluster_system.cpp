@@ -0,0 +1,254 @@
+// Copyright (c) 2025-2025 Michele Condo'
+// File: C:\Projects\Vesper\VesperEngine\Systems\light_cluster_system.cpp
+// Licensed under the MIT License. See LICENSE file in the project root for full license information.
+
+#include "Systems/light_cluster_system.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+
+VESPERENGINE_NAMESPACE_BEGIN
+
+LightClusterSystem::LightClusterSystem()
+{
+	m_clusters.resize(kClusterCount);
+}
+
+void LightClusterSystem::Build(const std::vector<PointLight>& _pointLights, const std::vector<SpotLight>& _spotLights,
+	const glm::mat4& _viewMatrix, const glm::mat4& _projectionMatrix, const glm::vec2& _viewportSize)
+{
+	// near and far back from the projection, left handed with depth from 0 to 1 (see glm_config.h)
+	m_projectionMatrix = _projectionMatrix;
+	m_isOrthographic = _projectionMatrix[2][3] == 0.0f;
+	if (m_isOrthographic)
+	{
+		m_near = -_projectionMatrix[3][2] / _projectionMatrix[2][2];
+		m_far = (1.0f - _projectionMatrix[3][2]) / _projectionMatrix[2][2];
+	}
+	else
+	{
+		m_near = -_projectionMatrix[3][2] / _projectionMatrix[2][2];
+		m_far = _projectionMatrix[3][2] / (1.0f - _projectionMatrix[2][2]);
+	}
+	m_near = std::max(m_near, kMinNearPlane);
+	m_far = std::max(m_far, m_near * 2.0f);
+
+	// slice = log(depth) * scale + bias, so slice 0 starts at near and the last one ends at far
+	const float logDepthRange = std::log(m_far / m_near);
+	m_sliceScale = static_cast<float>(kClusterCountZ) / logDepthRange;
+	m_sliceBias = -static_cast<float>(kClusterCountZ) * std::log(m_near) / logDepthRange;
+
+	m_clusterSize = _viewportSize / glm::vec2(static_cast<float>(kClusterCountX), static_cast<float>(kClusterCountY));
+
+	std::fill(m_clusters.begin(), m_clusters.end(), LightClusterData{});
+	m_pointRanges.clear();
+	m_spotRanges.clear();
+
+	// first pass: the clusters overlapped by every light, counting the lights of each cluster
+	for (uint32 i = 0; i < static_cast<uint32>(_pointLights.size()); ++i)
+	{
+		ClusterRange range;
+		const glm::vec3 viewCenter = glm::vec3(_viewMatrix * glm::vec4(glm::vec3(_pointLights[i].Position), 1.0f));
+		if (!ComputeClusterRange(viewCenter, ComputePointLightRadius(_pointLights[i]), range))
+		{
+			continue;
+		}
+
+		range.LightIndex = i;
+		m_pointRanges.push_back(range);
+
+		for (uint32 z = range.MinZ; z <= range.MaxZ; ++z)
+		{
+			for (uint32 y = range.MinY; y <= range.MaxY; ++y)
+			{
+				for (uint32 x = range.MinX; x <= range.MaxX; ++x)
+				{
+					++m_clusters[GetClusterIndex(x, y, z)].PointCount;
+				}
+			}
+		}
+	}
+
+	for (uint32 i = 0; i < static_cast<uint32>(_spotLights.size()); ++i)
+	{
+		ClusterRange range;
+		const glm::vec3 viewCenter = glm::vec3(_viewMatrix * glm::vec4(glm::vec3(_spotLights[i].Position), 1.0f));
+		if (!ComputeClusterRange(viewCenter, ComputeSpotLightRadius(_spotLights[i]), range))
+		{
+			continue;
+		}
+
+		range.LightIndex = i;
+		m_spotRanges.push_back(range);
+
+		for (uint32 z = range.MinZ; z <= range.MaxZ; ++z)
+		{
+			for (uint32 y = range.MinY; y <= range.MaxY; ++y)
+			{
+				for (uint32 x = range.MinX; x <= range.MaxX; ++x)
+				{
+					++m_clusters[GetClusterIndex(x, y, z)].SpotCount;
+				}
+			}
+		}
+	}
+
+	// every cluster owns a contiguous range of the index list, its point lights followed by its spot lights
+	uint32 indexCount = 0;
+	for (LightClusterData& cluster : m_clusters)
+	{
+		cluster.PointOffset = indexCount;
+		indexCount += cluster.PointCount;
+		cluster.SpotOffset = indexCount;
+		indexCount += cluster.SpotCount;
+
+		cluster.PointCount = 0;
+		cluster.SpotCount = 0;
+	}
+
+	m_lightIndices.resize(indexCount);
+
+	// second pass: fill the ranges, counting again
+	for (const ClusterRange& range : m_pointRanges)
+	{
+		for (uint32 z = range.MinZ; z <= range.MaxZ; ++z)
+		{
+			for (uint32 y = range.MinY; y <= range.MaxY; ++y)
+			{
+				for (uint32 x = range.MinX; x <= range.MaxX; ++x)
+				{
+					LightClusterData& cluster = m_clusters[GetClusterIndex(x, y, z)];
+					m_lightIndices[cluster.PointOffset + cluster.PointCount++] = range.LightIndex;
+				}
+			}
+		}
+	}
+
+	for (const ClusterRange& range : m_spotRanges)
+	{
+		for (uint32 z = range.MinZ; z <= range.MaxZ; ++z)
+		{
+			for (uint32 y = range.MinY; y <= range.MaxY; ++y)
+			{
+				for (uint32 x = range.MinX; x <= range.MaxX; ++x)
+				{
+					LightClusterData& cluster = m_clusters[GetClusterIndex(x, y, z)];
+					m_lightIndices[cluster.SpotOffset + cluster.SpotCount++] = range.LightIndex;
+				}
+			}
+		}
+	}
+}
+
+void LightClusterSystem::FillLightsUBO(LightsUBO& _outLights) const
+{
+	_outLights.ClusterCount = glm::uvec4(kClusterCountX, kClusterCountY, kClusterCountZ, 0u);
+	_outLights.ClusterParams = glm::vec4(m_clusterSize, m_sliceScale, m_sliceBias);
+}
+
+bool LightClusterSystem::ComputeClusterRange(const glm::vec3& _viewCenter, float _radius, ClusterRange& _outRange) const
+{
+	if (_radius <= 0.0f)
+	{
+		return false;
+	}
+
+	const float minDepth = _viewCenter.z - _radius;
+	const float maxDepth = _viewCenter.z + _radius;
+	if (maxDepth < m_near || minDepth > m_far)
+	{
+		return false;
+	}
+
+	_outRange.MinZ = GetDepthSlice(std::max(minDepth, m_near));
+	_outRange.MaxZ = GetDepthSlice(std::min(maxDepth, m_far));
+
+	// crossing the camera plane the perspective projection of the box flips, it could be anywhere on screen
+	if (!m_isOrthographic && minDepth <= m_near)
+	{
+		_outRange.MinX = 0;
+		_outRange.MaxX = kClusterCountX - 1;
+		_outRange.MinY = 0;
+		_outRange.MaxY = kClusterCountY - 1;
+		return true;
+	}
+
+	// the box around the sphere, all in front of the camera: its projection is within the projection of its corners
+	glm::vec2 ndcMin(FLT_MAX);
+	glm::vec2 ndcMax(-FLT_MAX);
+	for (int32 i = 0; i < 8; ++i)
+	{
+		const glm::vec4 corner(
+			_viewCenter.x + ((i & 1) ? _radius : -_radius),
+			_viewCenter.y + ((i & 2) ? _radius : -_radius),
+			_viewCenter.z + ((i & 4) ? _radius : -_radius),
+			1.0f);
+
+		const glm::vec4 clip = m_projectionMatrix * corner;
+		const glm::vec2 ndc = glm::vec2(clip) / clip.w;
+		ndcMin = glm::min(ndcMin, ndc);
+		ndcMax = glm::max(ndcMax, ndc);
+	}
+
+	if (ndcMax.x < -1.0f || ndcMin.x > 1.0f || ndcMax.y < -1.0f || ndcMin.y > 1.0f)
+	{
+		return false;
+	}
+
+	// same mapping of gl_FragCoord / cluster size in the shader, y from the top as the viewport
+	const glm::vec2 clusterCount(static_cast<float>(kClusterCountX), static_cast<float>(kClusterCountY));
+	const glm::vec2 minCluster = glm::clamp((ndcMin * 0.5f + 0.5f) * clusterCount, glm::vec2(0.0f), clusterCount - 1.0f);
+	const glm::vec2 maxCluster = glm::clamp((ndcMax * 0.5f + 0.5f) * clusterCount, glm::vec2(0.0f), clusterCount - 1.0f);
+
+	_outRange.MinX = static_cast<uint32>(minCluster.x);
+	_outRange.MaxX = static_cast<uint32>(maxCluster.x);
+	_outRange.MinY = static_cast<uint32>(minCluster.y);
+	_outRange.MaxY = static_cast<uint32>(maxCluster.y);
+
+	return true;
+}
+
+uint32 LightClusterSystem::GetDepthSlice(float _viewDepth) const
+{
+	const float slice = std::log(_viewDepth) * m_sliceScale + m_sliceBias;
+	return static_cast<uint32>(std::clamp(slice, 0.0f, static_cast<float>(kClusterCountZ - 1)));
+}
+
+float LightClusterSystem::ComputePointLightRadius(const PointLight& _light)
+{
+	// distance where color * intensity / (constant + linear * d + quadratic * d^2) falls under the threshold
+	const float luminance = std::max(std::max(_light.Color.r, _light.Color.g), _light.Color.b) * _light.Color.a;
+	const float constant = _light.Attenuation.x;
+	const float linear = _light.Attenuation.y;
+	const float quadratic = _light.Attenuation.z;
+
+	const float attenuationAtRadius = luminance / kLightInfluenceThreshold;
+	if (attenuationAtRadius <= constant)
+	{
+		return 0.0f;
+	}
+
+	if (quadratic > 0.0f)
+	{
+		return (-linear + std::sqrt(linear * linear + 4.0f * quadratic * (attenuationAtRadius - constant))) / (2.0f * quadratic);
+	}
+
+	if (linear > 0.0f)
+	{
+		return (attenuationAtRadius - constant) / linear;
+	}
+
+	// never attenuated, it reaches everything
+	return FLT_MAX;
+}
+
+float LightClusterSystem::ComputeSpotLightRadius(const SpotLight& _light)
+{
+	// spot lights are attenuated by the square of the distance only
+	const float luminance = std::max(std::max(_light.Color.r, _light.Color.g), _light.Color.b) * _light.Color.a;
+	return std::sqrt(std::max(luminance, 0.0f) / kLightInfluenceThreshold);
+}
+
+VESPERENGINE_NAMESPACE_END
@@ -0,0 +1,93 @@
+// Copyright (c) 2025-2025 Michele Condo'
+// File: C:\Projects\Vesper\VesperEngine\Systems\light_cluster_system.h
+// Licensed under the MIT License. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include "Core/core_defines.h"
+#include "Core/glm_config.h"
+
+#include "Systems/uniform_buffer.h"
+
+#include <vector>
+
+
+VESPERENGINE_NAMESPACE_BEGIN
+
+/**
+ * Clustered forward shading: the view frustum is divided in a grid of clusters, tiles in screen space and exponential slices in depth,
+ * and every point and spot light is assigned to the clusters its sphere of influence overlaps.
+ * The result is a LightClusterData per cluster, pointing to a range of the compact light index list, so the fragment shader
+ * iterates only the lights of its own cluster.
+ * The sphere of influence is where the attenuated light falls under kLightInfluenceThreshold, the spot cone is not taken into account.
+ * Built on the CPU every frame, each light touches only the clusters of its bounding box.
+ */
+class VESPERENGINE_API LightClusterSystem final
+{
+public:
+	static constexpr uint32 kClusterCountX = 16u;
+	static constexpr uint32 kClusterCountY = 9u;
+	static constexpr uint32 kClusterCountZ = 24u;
+	static constexpr uint32 kClusterCount = kClusterCountX * kClusterCountY * kClusterCountZ;
+
+	static constexpr float kLightInfluenceThreshold = 1.0f / 256.0f;
+	static constexpr float kMinNearPlane = 0.01f;	// the depth slices are logarithmic, the near plane cannot be 0
+
+public:
+	LightClusterSystem();
+	~LightClusterSystem() = default;
+
+	LightClusterSystem(const LightClusterSystem&) = delete;
+	LightClusterSystem& operator=(const LightClusterSystem&) = delete;
+
+public:
+	VESPERENGINE_INLINE const std::vector<LightClusterData>& GetClusters() const { return m_clusters; }
+	VESPERENGINE_INLINE const std::vector<uint32>& GetLightIndices() const { return m_lightIndices; }
+
+public:
+	// Assign the lights to the clusters of the frustum of the camera, _viewportSize in pixels
+	void Build(const std::vector<PointLight>& _pointLights, const std::vector<SpotLight>& _spotLights,
+		const glm::mat4& _viewMatrix, const glm::mat4& _projectionMatrix, const glm::vec2& _viewportSize);
+	// Write the grid the shader needs to find its cluster
+	void FillLightsUBO(LightsUBO& _outLights) const;
+
+	// Radius of the sphere of influence, FLT_MAX if the light is never attenuated
+	static float ComputePointLightRadius(const PointLight& _light);
+	static float ComputeSpotLightRadius(const SpotLight& _light);
+
+private:
+	struct ClusterRange
+	{
+		uint32 LightIndex{ 0 };
+		uint32 MinX{ 0 };
+		uint32 MaxX{ 0 };
+		uint32 MinY{ 0 };
+		uint32 MaxY{ 0 };
+		uint32 MinZ{ 0 };
+		uint32 MaxZ{ 0 };
+	};
+
+	// false if the sphere, in view space, is outside of the frustum
+	bool ComputeClusterRange(const glm::vec3& _viewCenter, float _radius, ClusterRange& _outRange) const;
+	uint32 GetDepthSlice(float _viewDepth) const;
+
+	VESPERENGINE_INLINE static uint32 GetClusterIndex(uint32 _x, uint32 _y, uint32 _z) { return _x + kClusterCountX * (_y + kClusterCountY * _z); }
+
+private:
+	std::vector<LightClusterData> m_clusters;
+	std::vector<uint32> m_lightIndices;
+
+	// per frame scratch, kept to not allocate every frame
+	std::vector<ClusterRange> m_pointRanges;
+	std::vector<ClusterRange> m_spotRanges;
+
+	glm::mat4 m_projectionMatrix{ 1.0f };
+	glm::vec2 m_clusterSize{ 1.0f };	// pixels
+	float m_near{ kMinNearPlane };
+	float m_far{ 1.0f };
+	float m_sliceScale{ 0.0f };
+	float m_sliceBias{ 0.0f };
+	bool m_isOrthographic{ false };
+};
+
+VESPERENGINE_NAMESPACE_END
@@ -10,12 +10,21 @@
 #include "Systems/game_entity_system.h"
 #include "Systems/uniform_buffer.h"
 
+#include "Backend/swap_chain.h"
+
 #include "App/vesper_app.h"
 
+#include "Core/memory_copy.h"
+
 #include "ECS/ECS/ecs.h"
 
+#include <cstring>
+
 VESPERENGINE_NAMESPACE_BEGIN
 
+static_assert(SwapChain::kMaxFramesInFlight <= 8, "The dirty frames of a light are bits of an uint8");
+static constexpr uint8 kAllFramesMask = static_cast<uint8>((1u << SwapChain::kMaxFramesInFlight) - 1u);
+
 LightSystem::LightSystem(VesperApp& _app, GameEntitySystem& _gameEntitySystem)
     : m_app(_app)
     , m_gameEntitySystem(_gameEntitySystem)
@@ -56,44 +65,161 @@ ecs::Entity LightSystem::CreateSpotLight(const glm::vec3& _position, const glm::
     return entity;
 }
 
-void LightSystem::FillLightsUBO(LightsUBO& _outLights) const
+void LightSystem::UpdateLights()
 {
     ecs::EntityManager& entityManager = m_app.GetEntityManager();
     ecs::ComponentManager& componentManager = m_app.GetComponentManager();
-    
-    _outLights.DirectionalCount = 0;
-    _outLights.PointCount = 0;
-    _outLights.SpotCount = 0;
-    
+
+    m_directionalLights.Count = 0;
+    m_pointLights.Count = 0;
+    m_spotLights.Count = 0;
+    m_shadowViewCount = 0;
+
     for (auto entity : ecs::IterateEntitiesWithAll<DirectionalLightComponent>(entityManager, componentManager))
     {
-        if (_outLights.DirectionalCount >= static_cast<int32>(kMaxDirectionalLights)) break;
         const DirectionalLightComponent& comp = componentManager.GetComponent<DirectionalLightComponent>(entity);
-        _outLights.DirectionalLights[_outLights.DirectionalCount].Direction = glm::vec4(comp.Direction, 0.0f);
-        _outLights.DirectionalLights[_outLights.DirectionalCount].Color = glm::vec4(comp.Color, comp.Intensity);
-        _outLights.DirectionalCount++;
+        DirectionalLight light;
+        light.Direction = glm::vec4(comp.Direction, ReserveShadowViews(comp.CastShadows, kShadowCascadeCount));
+        light.Color = glm::vec4(comp.Color, comp.Intensity);
+        Stage(m_directionalLights, light);
     }
 
     for (auto entity : ecs::IterateEntitiesWithAll<PointLightComponent>(entityManager, componentManager))
     {
-        if (_outLights.PointCount >= static_cast<int32>(kMaxPointLights)) break;
         const PointLightComponent& comp = componentManager.GetComponent<PointLightComponent>(entity);
-        _outLights.PointLights[_outLights.PointCount].Position = glm::vec4(comp.Position, 0.0f);
-        _outLights.PointLights[_outLights.PointCount].Color = glm::vec4(comp.Color, comp.Intensity);
-        _outLights.PointLights[_outLights.PointCount].Attenuation = glm::vec4(comp.Attenuation, 0.0f);
-        _outLights.PointCount++;
+        PointLight light;
+        light.Position = glm::vec4(comp.Position, ReserveShadowViews(comp.CastShadows, kPointShadowFaceCount));
+        light.Color = glm::vec4(comp.Color, comp.Intensity);
+        light.Attenuation = glm::vec4(comp.Attenuation, 0.0f);
+        Stage(m_pointLights, light);
     }
 
     for (auto entity : ecs::IterateEntitiesWithAll<SpotLightComponent>(entityManager, componentManager))
     {
-        if (_outLights.SpotCount >= static_cast<int32>(kMaxSpotLights)) break;
         const SpotLightComponent& comp = componentManager.GetComponent<SpotLightComponent>(entity);
-        _outLights.SpotLights[_outLights.SpotCount].Position = glm::vec4(comp.Position, 0.0f);
-        _outLights.SpotLights[_outLights.SpotCount].Direction = glm::vec4(comp.Direction, 0.0f);
-        _outLights.SpotLights[_outLights.SpotCount].Color = glm::vec4(comp.Color, comp.Intensity);
-        _outLights.SpotLights[_outLights.SpotCount].Params = glm::vec4(comp.InnerCutoff, comp.OuterCutoff, 0.0f, 0.0f);
-        _outLights.SpotCount++;
+        SpotLight light;
+        light.Position = glm::vec4(comp.Position, ReserveShadowViews(comp.CastShadows, 1));
+        light.Direction = glm::vec4(comp.Direction, 0.0f);
+        light.Color = glm::vec4(comp.Color, comp.Intensity);
+        light.Params = glm::vec4(comp.InnerCutoff, comp.OuterCutoff, 0.0f, 0.0f);
+        Stage(m_spotLights, light);
+    }
+
+    Finalize(m_directionalLights);
+    Finalize(m_pointLights);
+    Finalize(m_spotLights);
+}
+
+void LightSystem::FillLightsUBO(LightsUBO& _outLights) const
+{
+    _outLights.DirectionalCount = static_cast<int32>(m_directionalLights.Lights.size());
+    _outLights.PointCount = static_cast<int32>(m_pointLights.Lights.size());
+    _outLights.SpotCount = static_cast<int32>(m_spotLights.Lights.size());
+}
+
+void LightSystem::InvalidateLights(const int32 _frameIndex)
+{
+    const uint8 frameBit = static_cast<uint8>(1u << _frameIndex);
+    for (uint8& dirtyFrames : m_directionalLights.DirtyFrames)
+    {
+        dirtyFrames |= frameBit;
+    }
+
+    for (uint8& dirtyFrames : m_pointLights.DirtyFrames)
+    {
+        dirtyFrames |= frameBit;
+    }
+
+    for (uint8& dirtyFrames : m_spotLights.DirtyFrames)
+    {
+        dirtyFrames |= frameBit;
+    }
+}
+
+uint32 LightSystem::UploadDirectionalLights(const int32 _frameIndex, void* _mappedMemory)
+{
+    return Upload(m_directionalLights, _frameIndex, _mappedMemory);
+}
+
+uint32 LightSystem::UploadPointLights(const int32 _frameIndex, void* _mappedMemory)
+{
+    return Upload(m_pointLights, _frameIndex, _mappedMemory);
+}
+
+uint32 LightSystem::UploadSpotLights(const int32 _frameIndex, void* _mappedMemory)
+{
+    return Upload(m_spotLights, _frameIndex, _mappedMemory);
+}
+
+float LightSystem::ReserveShadowViews(bool _isCastingShadows, uint32 _viewCount)
+{
+    if (!_isCastingShadows || m_shadowViewCount + _viewCount > kMaxShadowViews)
+    {
+        return -1.0f;
     }
+
+    // stored in the spare w of the light, exact as float way above kMaxShadowViews
+    const float firstView = static_cast<float>(m_shadowViewCount);
+    m_shadowViewCount += _viewCount;
+    return firstView;
+}
+
+template<typename LightType>
+void LightSystem::Stage(LightList<LightType>& _list, const LightType& _light)
+{
+    const uint32 index = _list.Count++;
+    if (index >= _list.Lights.size())
+    {
+        _list.Lights.push_back(_light);
+        _list.DirtyFrames.push_back(kAllFramesMask);
+        return;
+    }
+
+    // the light types are made only of vec4, no padding, so they can be compared as memory
+    if (std::memcmp(&_list.Lights[index], &_light, sizeof(LightType)) != 0)
+    {
+        _list.Lights[index] = _light;
+        _list.DirtyFrames[index] = kAllFramesMask;
+    }
+}
+
+template<typename LightType>
+void LightSystem::Finalize(LightList<LightType>& _list)
+{
+    // lights removed since the last gather, the count in the LightsUBO already excludes them from the buffers
+    _list.Lights.resize(_list.Count);
+    _list.DirtyFrames.resize(_list.Count);
+}
+
+template<typename LightType>
+uint32 LightSystem::Upload(LightList<LightType>& _list, const int32 _frameIndex, void* _mappedMemory)
+{
+    const uint8 frameBit = static_cast<uint8>(1u << _frameIndex);
+    const uint32 lightCount = static_cast<uint32>(_list.Lights.size());
+    uint8* const mappedMemory = static_cast<uint8*>(_mappedMemory);
+
+    uint32 uploadedCount = 0;
+    uint32 index = 0;
+    while (index < lightCount)
+    {
+        if ((_list.DirtyFrames[index] & frameBit) == 0)
+        {
+            ++index;
+            continue;
+        }
+
+        const uint32 firstIndex = index;
+        while (index < lightCount && (_list.DirtyFrames[index] & frameBit) != 0)
+        {
+            _list.DirtyFrames[index] &= static_cast<uint8>(~frameBit);
+            ++index;
+        }
+
+        MemCpy(mappedMemory + firstIndex * sizeof(LightType), &_list.Lights[firstIndex], (index - firstIndex) * sizeof(LightType));
+        uploadedCount += index - firstIndex;
+    }
+
+    return uploadedCount;
 }
 
 VESPERENGINE_NAMESPACE_END
\ No newline at end of file
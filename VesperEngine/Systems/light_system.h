@@ -7,6 +7,8 @@
 #include "Core/core_defines.h"
 #include "Components/light_components.h"
 
+#include "Systems/uniform_buffer.h"
+
 #include "ECS/ECS/entity.h"
 
 #include <vector>
@@ -16,8 +18,12 @@ VESPERENGINE_NAMESPACE_BEGIN
 class VesperApp;
 class GameEntitySystem;
 
-struct LightsUBO;
-
+/**
+ * Gathers the light components in one packed array per light type, uploaded by the MasterRenderSystem in storage buffers
+ * sized on the actual count, so there is no maximum number of lights.
+ * Every gathered light is compared with the one at the same slot of the previous gather: only when different it is flagged dirty
+ * for all the frames in flight, so every frame uploads only the lights changed since its last upload.
+ */
 class VESPERENGINE_API LightSystem final
 {
 public:
@@ -32,11 +38,52 @@ public:
     ecs::Entity CreatePointLight(const glm::vec3& _position, const glm::vec3& _color, float _intensity, const glm::vec3& _attenuation) const;
     ecs::Entity CreateSpotLight(const glm::vec3& _position, const glm::vec3& _direction, const glm::vec3& _color, float _intensity, float _innerCutoff, float _outerCutoff) const;
 
+    VESPERENGINE_INLINE const std::vector<DirectionalLight>& GetDirectionalLights() const { return m_directionalLights.Lights; }
+    VESPERENGINE_INLINE const std::vector<PointLight>& GetPointLights() const { return m_pointLights.Lights; }
+    VESPERENGINE_INLINE const std::vector<SpotLight>& GetSpotLights() const { return m_spotLights.Lights; }
+    // ShadowData needed by the shadow casting lights gathered by the last UpdateLights, see ShadowSystem
+    VESPERENGINE_INLINE uint32 GetShadowViewCount() const { return m_shadowViewCount; }
+
+    // Call once per frame: gather the lights from the components and flag the changed ones.
+    // Every shadow casting light gets its range of ShadowData, in order, as long as they are within kMaxShadowViews
+    void UpdateLights();
     void FillLightsUBO(LightsUBO& _outLights) const;
+    // Flag all the lights dirty for the frame, i.e. when its buffers have been recreated
+    void InvalidateLights(const int32 _frameIndex);
+
+    // Copy the lights dirty for the frame in the mapped buffers of the frame, one copy each range of consecutive ones, return the lights copied
+    uint32 UploadDirectionalLights(const int32 _frameIndex, void* _mappedMemory);
+    uint32 UploadPointLights(const int32 _frameIndex, void* _mappedMemory);
+    uint32 UploadSpotLights(const int32 _frameIndex, void* _mappedMemory);
+
+private:
+    template<typename LightType>
+    struct LightList
+    {
+        std::vector<LightType> Lights;
+        std::vector<uint8> DirtyFrames;     // per light, bit N set if the buffer of frame N has to be updated
+        uint32 Count{ 0 };                  // lights gathered so far by the current UpdateLights
+    };
+
+    template<typename LightType>
+    static void Stage(LightList<LightType>& _list, const LightType& _light);
+    template<typename LightType>
+    static void Finalize(LightList<LightType>& _list);
+    template<typename LightType>
+    static uint32 Upload(LightList<LightType>& _list, const int32 _frameIndex, void* _mappedMemory);
+
+    // first ShadowData of a light needing _viewCount of them, -1 if it does not cast shadows or there is no room left
+    float ReserveShadowViews(bool _isCastingShadows, uint32 _viewCount);
 
 private:
     VesperApp& m_app;
     GameEntitySystem& m_gameEntitySystem;
+
+    LightList<DirectionalLight> m_directionalLights;
+    LightList<PointLight> m_pointLights;
+    LightList<SpotLight> m_spotLights;
+
+    uint32 m_shadowViewCount{ 0 };
 };
 
 VESPERENGINE_NAMESPACE_END
\ No newline at end of file
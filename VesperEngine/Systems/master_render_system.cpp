@@ -5,6 +5,7 @@
 #include "Systems/master_render_system.h"
 #include "Systems/uniform_buffer.h"
 #include "Systems/light_system.h"
+#include "Systems/shadow_system.h"
 
 #include "Backend/swap_chain.h"
 #include "Backend/buffer.h"
@@ -18,10 +19,16 @@
 #include "Systems/texture_system.h"
 #include "Systems/material_system.h"
 
+#include "Core/memory_copy.h"
+
+#include <array>
+#include <stdexcept>
+
 
 VESPERENGINE_NAMESPACE_BEGIN
 
-MasterRenderSystem::MasterRenderSystem(Device& _device, Renderer& _renderer, LightSystem& _lightSystem)
+MasterRenderSystem::MasterRenderSystem(Device& _device, Renderer& _renderer, LightSystem& _lightSystem,
+	uint32 _bindlessTextureCapacity, uint32 _bindlessBufferCapacity)
 	: BaseRenderSystem(_device)
 	, m_renderer(_renderer)
 	, m_lightSystem(_lightSystem)
@@ -44,16 +51,18 @@ MasterRenderSystem::MasterRenderSystem(Device& _device, Renderer& _renderer, Lig
 			.AddBinding(kGlobalBindingIrradianceIndex, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT)
 			.AddBinding(kGlobalBindingPrefilteredEnvIndex, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT)
 			.AddBinding(kGlobalBindingBrdfLutIndex, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT)
+			.AddBinding(kGlobalBindingDirectionalLightsIndex, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT)
+			.AddBinding(kGlobalBindingPointLightsIndex, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT)
+			.AddBinding(kGlobalBindingSpotLightsIndex, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT)
+			.AddBinding(kGlobalBindingLightClustersIndex, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT)
+			.AddBinding(kGlobalBindingLightIndicesIndex, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT)
+			.AddBinding(kGlobalBindingShadowAtlasIndex, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT)
+			.AddBinding(kGlobalBindingShadowsIndex, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT)
 			.Build();
 
-		m_bindlesslSetLayout = DescriptorSetLayout::Builder(m_device)
-			.SetFlags(VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT)
-			.AddBinding(kBindlessBindingTexturesIndex, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, kMaxBindlessTextures, kMaxBindlessTextures >> 3)
-			.AddBinding(kBindlessBindingBuffersIndex, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, kMaxBindlessBuffers, kMaxBindlessBuffers >> 3)
-			.Build();
-
+		m_bindlessRegistry = std::make_unique<BindlessRegistry>(m_device, _bindlessTextureCapacity, _bindlessBufferCapacity);
 
-		CreatePipelineLayout(std::vector<VkDescriptorSetLayout>{ m_globalSetLayout->GetDescriptorSetLayout(), m_bindlesslSetLayout->GetDescriptorSetLayout() });
+		CreatePipelineLayout(std::vector<VkDescriptorSetLayout>{ m_globalSetLayout->GetDescriptorSetLayout(), m_bindlessRegistry->GetDescriptorSetLayout() });
 	}
 	else
 	{
@@ -63,13 +72,20 @@ MasterRenderSystem::MasterRenderSystem(Device& _device, Renderer& _renderer, Lig
 			.AddBinding(kGlobalBindingIrradianceIndex, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT)
 			.AddBinding(kGlobalBindingPrefilteredEnvIndex, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT)
 			.AddBinding(kGlobalBindingBrdfLutIndex, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT)
+			.AddBinding(kGlobalBindingDirectionalLightsIndex, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT)
+			.AddBinding(kGlobalBindingPointLightsIndex, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT)
+			.AddBinding(kGlobalBindingSpotLightsIndex, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT)
+			.AddBinding(kGlobalBindingLightClustersIndex, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT)
+			.AddBinding(kGlobalBindingLightIndicesIndex, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT)
+			.AddBinding(kGlobalBindingShadowAtlasIndex, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT)
+			.AddBinding(kGlobalBindingShadowsIndex, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT)
 			.Build();
 
 		CreatePipelineLayout(std::vector<VkDescriptorSetLayout>{ m_globalSetLayout->GetDescriptorSetLayout() });
 	}
 }
 
-void MasterRenderSystem::Initialize(TextureSystem& _textureSystem, MaterialSystem& _materialSystem,
+void MasterRenderSystem::Initialize(TextureSystem& _textureSystem, MaterialSystem& _materialSystem, const ShadowSystem& _shadowSystem,
 	std::shared_ptr<TextureData> _irradianceMap,
 	std::shared_ptr<TextureData> _prefilteredEnvMap,
 	std::shared_ptr<TextureData> _brdfLut)
@@ -86,12 +102,31 @@ void MasterRenderSystem::Initialize(TextureSystem& _textureSystem, MaterialSyste
 	m_brdfLutInfo.imageView = _brdfLut ? _brdfLut->ImageView : VK_NULL_HANDLE;
 	m_brdfLutInfo.sampler = _brdfLut ? _brdfLut->Sampler : VK_NULL_HANDLE;
 
+	m_shadowAtlasInfo = _shadowSystem.GetAtlasImageInfo();
+
 	m_globalDescriptorSets.resize(SwapChain::kMaxFramesInFlight);
-	m_bindlessBindingDescriptorSets.resize(SwapChain::kMaxFramesInFlight);
 
 	m_globalSceneUboBuffers.resize(SwapChain::kMaxFramesInFlight);
 	m_globalLightsUboBuffers.resize(SwapChain::kMaxFramesInFlight);
 
+	m_directionalLightBuffers.ElementSize = sizeof(DirectionalLight);
+	m_directionalLightBuffers.BindingIndex = kGlobalBindingDirectionalLightsIndex;
+	m_pointLightBuffers.ElementSize = sizeof(PointLight);
+	m_pointLightBuffers.BindingIndex = kGlobalBindingPointLightsIndex;
+	m_spotLightBuffers.ElementSize = sizeof(SpotLight);
+	m_spotLightBuffers.BindingIndex = kGlobalBindingSpotLightsIndex;
+	m_lightClusterBuffers.ElementSize = sizeof(LightClusterData);
+	m_lightClusterBuffers.BindingIndex = kGlobalBindingLightClustersIndex;
+	m_lightIndexBuffers.ElementSize = sizeof(uint32);
+	m_lightIndexBuffers.BindingIndex = kGlobalBindingLightIndicesIndex;
+
+	for (LightBuffers* lightBuffers : { &m_directionalLightBuffers, &m_pointLightBuffers, &m_spotLightBuffers, &m_lightClusterBuffers, &m_lightIndexBuffers })
+	{
+		lightBuffers->Buffers.resize(SwapChain::kMaxFramesInFlight);
+		lightBuffers->MappedMemory.resize(SwapChain::kMaxFramesInFlight, nullptr);
+		lightBuffers->Capacities.resize(SwapChain::kMaxFramesInFlight, 0u);
+	}
+
 	for (int32 i = 0; i < SwapChain::kMaxFramesInFlight; ++i)
 	{
 		m_globalSceneUboBuffers[i] = m_buffer->Create<BufferComponent>(
@@ -113,48 +148,87 @@ void MasterRenderSystem::Initialize(TextureSystem& _textureSystem, MaterialSyste
 			1,
 			true
 		);
+
+		CreateLightBuffer(m_directionalLightBuffers, i, kMinLightCapacity);
+		CreateLightBuffer(m_pointLightBuffers, i, kMinLightCapacity);
+		CreateLightBuffer(m_spotLightBuffers, i, kMinLightCapacity);
+		CreateLightBuffer(m_lightClusterBuffers, i, LightClusterSystem::kClusterCount);
+		CreateLightBuffer(m_lightIndexBuffers, i, kMinLightIndexCapacity);
 	}
 
+	// the buffers of the global sets, per frame: they are pointed by the batch until it is flushed
+	struct GlobalBufferInfos
+	{
+		VkDescriptorBufferInfo Scene;
+		VkDescriptorBufferInfo Lights;
+		VkDescriptorBufferInfo DirectionalLights;
+		VkDescriptorBufferInfo PointLights;
+		VkDescriptorBufferInfo SpotLights;
+		VkDescriptorBufferInfo LightClusters;
+		VkDescriptorBufferInfo LightIndices;
+		VkDescriptorBufferInfo Shadows;
+	};
+	std::array<GlobalBufferInfos, SwapChain::kMaxFramesInFlight> globalBufferInfos;
+
+	// all the global sets written with a single update
+	DescriptorUpdateBatch globalSetsBatch(m_device);
 	for (int32 i = 0; i < SwapChain::kMaxFramesInFlight; ++i)
 	{
-		auto sceneBufferInfo = m_buffer->GetDescriptorInfo(m_globalSceneUboBuffers[i]);
-		auto lightBufferInfo = m_buffer->GetDescriptorInfo(m_globalLightsUboBuffers[i]);
+		// the whole light buffers are visible to the shaders, the LightsUBO counts tell how many lights are valid
+		GlobalBufferInfos& infos = globalBufferInfos[i];
+		infos.Scene = m_buffer->GetDescriptorInfo(m_globalSceneUboBuffers[i]);
+		infos.Lights = m_buffer->GetDescriptorInfo(m_globalLightsUboBuffers[i]);
+		infos.DirectionalLights = { m_directionalLightBuffers.Buffers[i].Buffer, 0, VK_WHOLE_SIZE };
+		infos.PointLights = { m_pointLightBuffers.Buffers[i].Buffer, 0, VK_WHOLE_SIZE };
+		infos.SpotLights = { m_spotLightBuffers.Buffers[i].Buffer, 0, VK_WHOLE_SIZE };
+		infos.LightClusters = { m_lightClusterBuffers.Buffers[i].Buffer, 0, VK_WHOLE_SIZE };
+		infos.LightIndices = { m_lightIndexBuffers.Buffers[i].Buffer, 0, VK_WHOLE_SIZE };
+		infos.Shadows = { _shadowSystem.GetShadowBuffer(i), 0, VK_WHOLE_SIZE };
+
+		if (!m_renderer.GetDescriptorPool()->AllocateDescriptorSet(*m_globalSetLayout, m_globalDescriptorSets[i]))
+		{
+			throw std::runtime_error("failed to allocate the global descriptor set!");
+		}
 
-		DescriptorWriter(*m_globalSetLayout, *m_renderer.GetDescriptorPool())
-			.WriteBuffer(kGlobalBindingSceneIndex, &sceneBufferInfo)
-			.WriteBuffer(kGlobalBindingLightsIndex, &lightBufferInfo)
+		DescriptorWriter writer(*m_globalSetLayout, *m_renderer.GetDescriptorPool());
+		writer.WriteBuffer(kGlobalBindingSceneIndex, &infos.Scene)
+			.WriteBuffer(kGlobalBindingLightsIndex, &infos.Lights)
 			.WriteImage(kGlobalBindingIrradianceIndex, &m_irradianceInfo)
 			.WriteImage(kGlobalBindingPrefilteredEnvIndex, &m_prefilteredEnvInfo)
 			.WriteImage(kGlobalBindingBrdfLutIndex, &m_brdfLutInfo)
-			.Build(m_globalDescriptorSets[i]);
+			.WriteBuffer(kGlobalBindingDirectionalLightsIndex, &infos.DirectionalLights)
+			.WriteBuffer(kGlobalBindingPointLightsIndex, &infos.PointLights)
+			.WriteBuffer(kGlobalBindingSpotLightsIndex, &infos.SpotLights)
+			.WriteBuffer(kGlobalBindingLightClustersIndex, &infos.LightClusters)
+			.WriteBuffer(kGlobalBindingLightIndicesIndex, &infos.LightIndices)
+			.WriteImage(kGlobalBindingShadowAtlasIndex, &m_shadowAtlasInfo)
+			.WriteBuffer(kGlobalBindingShadowsIndex, &infos.Shadows);
+
+		globalSetsBatch.Add(writer, m_globalDescriptorSets[i]);
 	}
+	globalSetsBatch.Flush();
 
-	if (m_device.IsBindlessResourcesSupported())
+	if (m_bindlessRegistry)
 	{
+		// the materials refer to the textures by their index in the TextureSystem, and the shaders to the materials by their index
+		// in the MaterialSystem: the registry is empty, so the slots are given in the same order
 		const auto& textures = _textureSystem.GetTextures();
-		const uint32 textureCount = static_cast<uint32>(textures.size());
-		std::vector<VkDescriptorImageInfo> imageInfos(textureCount);
-		for (size_t i = 0; i < textureCount; ++i)
+		for (size_t i = 0; i < textures.size(); ++i)
 		{
-			imageInfos[i].imageView = textures[i]->ImageView;
-			imageInfos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-			imageInfos[i].sampler = textures[i]->Sampler;
+			VkDescriptorImageInfo imageInfo{};
+			imageInfo.imageView = textures[i]->ImageView;
+			imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			imageInfo.sampler = textures[i]->Sampler;
+
+			const uint32 slot = m_bindlessRegistry->RegisterTexture(imageInfo);
+			assertMsg(slot == i, "Bindless texture slot not matching the texture index");
 		}
 
 		const auto& materials = _materialSystem.GetMaterials();
-		const uint32 materialCount = static_cast<uint32>(materials.size());
-		std::vector<VkDescriptorBufferInfo> bufferInfos(materialCount);
-		for (size_t i = 0; i < materialCount; ++i) 
+		for (size_t i = 0; i < materials.size(); ++i) 
 		{
-			bufferInfos[i] = m_buffer->GetDescriptorInfo(materials[i]->UniformBuffer);
-		}
-		
-		for (int32 i = 0; i < SwapChain::kMaxFramesInFlight; ++i)
-		{
-			DescriptorWriter(*m_bindlesslSetLayout, *m_renderer.GetDescriptorPool())
-				.WriteImage(kBindlessBindingTexturesIndex, imageInfos.data(), textureCount)
-				.WriteBuffer(kBindlessBindingBuffersIndex, bufferInfos.data(), materialCount)
-				.Build(m_bindlessBindingDescriptorSets[i]);
+			const uint32 slot = m_bindlessRegistry->RegisterBuffer(m_buffer->GetDescriptorInfo(materials[i]->UniformBuffer));
+			assertMsg(slot == i, "Bindless material slot not matching the material index");
 		}
 	}
 }
@@ -172,10 +246,52 @@ void MasterRenderSystem::UpdateScene(const FrameInfo& _frameInfo, const CameraCo
 	m_globalSceneUboBuffers[_frameInfo.FrameIndex].MappedMemory = &sceneUBO;
 	m_buffer->WriteToBuffer(m_globalSceneUboBuffers[_frameInfo.FrameIndex]);
 
+	// the clusters tile the area actually rendered, smaller than the swap chain with dynamic resolution
+	const VkExtent2D extent = m_renderer.GetRenderExtent();
+
+	m_lightSystem.UpdateLights();
+	m_lightClusterSystem.Build(m_lightSystem.GetPointLights(), m_lightSystem.GetSpotLights(),
+		_cameraComponent.ViewMatrix, _cameraComponent.ProjectionMatrix, glm::vec2(static_cast<float>(extent.width), static_cast<float>(extent.height)));
+
 	m_lightSystem.FillLightsUBO(lightsUBO);
+	m_lightClusterSystem.FillLightsUBO(lightsUBO);
 
 	m_globalLightsUboBuffers[_frameInfo.FrameIndex].MappedMemory = &lightsUBO;
 	m_buffer->WriteToBuffer(m_globalLightsUboBuffers[_frameInfo.FrameIndex]);
+
+	const int32 frameIndex = _frameInfo.FrameIndex;
+
+	// the bindless slots registered, changed or released since this frame was last recorded
+	if (m_bindlessRegistry)
+	{
+		m_bindlessRegistry->BeginFrame(frameIndex);
+	}
+
+	bool isRecreated = ReserveLightBuffer(m_directionalLightBuffers, frameIndex, static_cast<uint32>(lightsUBO.DirectionalCount));
+	isRecreated |= ReserveLightBuffer(m_pointLightBuffers, frameIndex, static_cast<uint32>(lightsUBO.PointCount));
+	isRecreated |= ReserveLightBuffer(m_spotLightBuffers, frameIndex, static_cast<uint32>(lightsUBO.SpotCount));
+
+	// new buffers are empty, all the lights have to be uploaded again for this frame
+	if (isRecreated)
+	{
+		m_lightSystem.InvalidateLights(frameIndex);
+	}
+
+	m_lightSystem.UploadDirectionalLights(frameIndex, m_directionalLightBuffers.MappedMemory[frameIndex]);
+	m_lightSystem.UploadPointLights(frameIndex, m_pointLightBuffers.MappedMemory[frameIndex]);
+	m_lightSystem.UploadSpotLights(frameIndex, m_spotLightBuffers.MappedMemory[frameIndex]);
+
+	// the clusters follow the camera, so they are uploaded whole every frame
+	const std::vector<LightClusterData>& clusters = m_lightClusterSystem.GetClusters();
+	const std::vector<uint32>& lightIndices = m_lightClusterSystem.GetLightIndices();
+
+	ReserveLightBuffer(m_lightIndexBuffers, frameIndex, static_cast<uint32>(lightIndices.size()));
+
+	MemCpy(m_lightClusterBuffers.MappedMemory[frameIndex], clusters.data(), sizeof(LightClusterData) * clusters.size());
+	if (!lightIndices.empty())
+	{
+		MemCpy(m_lightIndexBuffers.MappedMemory[frameIndex], lightIndices.data(), sizeof(uint32) * lightIndices.size());
+	}
 }
 
 void MasterRenderSystem::BindGlobalDescriptor(const FrameInfo& _frameInfo)
@@ -193,28 +309,84 @@ void MasterRenderSystem::BindGlobalDescriptor(const FrameInfo& _frameInfo)
 		nullptr
 	);
 
-	if (m_device.IsBindlessResourcesSupported())
+	if (m_bindlessRegistry)
 	{
+		const VkDescriptorSet bindlessSet = m_bindlessRegistry->GetDescriptorSet(_frameInfo.FrameIndex);
 		vkCmdBindDescriptorSets(
 			_frameInfo.CommandBuffer,
 			VK_PIPELINE_BIND_POINT_GRAPHICS,	// for now is only graphics, in future we want also the compute version
 			m_pipelineLayout,
 			1,
 			1,
-			&m_bindlessBindingDescriptorSets[_frameInfo.FrameIndex],
+			&bindlessSet,
 			0,
 			nullptr
 		);
 	}
 }
 
+void MasterRenderSystem::EndFrame()
+{
+	if (m_bindlessRegistry)
+	{
+		m_bindlessRegistry->EndFrame();
+	}
+}
+
 void MasterRenderSystem::Cleanup()
 {
 	for (int32 i = 0; i < SwapChain::kMaxFramesInFlight; ++i)
 	{
 		m_buffer->Destroy(m_globalSceneUboBuffers[i]);
 		m_buffer->Destroy(m_globalLightsUboBuffers[i]);
+
+		m_buffer->Destroy(m_directionalLightBuffers.Buffers[i]);
+		m_buffer->Destroy(m_pointLightBuffers.Buffers[i]);
+		m_buffer->Destroy(m_spotLightBuffers.Buffers[i]);
+		m_buffer->Destroy(m_lightClusterBuffers.Buffers[i]);
+		m_buffer->Destroy(m_lightIndexBuffers.Buffers[i]);
 	}
 }
 
+void MasterRenderSystem::CreateLightBuffer(LightBuffers& _lightBuffers, const int32 _frameIndex, uint32 _capacity)
+{
+	_lightBuffers.Buffers[_frameIndex] = m_buffer->Create<BufferComponent>(
+		_lightBuffers.ElementSize,
+		_capacity,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
+		VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
+		/*minUboAlignment*/1,
+		true
+	);
+
+	_lightBuffers.MappedMemory[_frameIndex] = static_cast<uint8*>(m_buffer->GetMappedMemory(_lightBuffers.Buffers[_frameIndex]));
+	_lightBuffers.Capacities[_frameIndex] = _capacity;
+}
+
+bool MasterRenderSystem::ReserveLightBuffer(LightBuffers& _lightBuffers, const int32 _frameIndex, uint32 _lightCount)
+{
+	if (_lightBuffers.Capacities[_frameIndex] >= _lightCount)
+	{
+		return false;
+	}
+
+	uint32 capacity = _lightBuffers.Capacities[_frameIndex];
+	while (capacity < _lightCount)
+	{
+		capacity *= 2;
+	}
+
+	// safe, the fence of this frame has been waited so the GPU is not reading it anymore
+	m_buffer->Destroy(_lightBuffers.Buffers[_frameIndex]);
+	CreateLightBuffer(_lightBuffers, _frameIndex, capacity);
+
+	VkDescriptorBufferInfo lightsInfo{ _lightBuffers.Buffers[_frameIndex].Buffer, 0, VK_WHOLE_SIZE };
+	DescriptorWriter(*m_globalSetLayout, *m_renderer.GetDescriptorPool())
+		.WriteBuffer(_lightBuffers.BindingIndex, &lightsInfo)
+		.Overwrite(m_globalDescriptorSets[_frameIndex]);
+
+	return true;
+}
+
 VESPERENGINE_NAMESPACE_END
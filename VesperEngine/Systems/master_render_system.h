@@ -8,8 +8,10 @@
 
 #include "Backend/device.h"
 #include "Backend/descriptors.h"
+#include "Backend/bindless_registry.h"
 
 #include "Systems/base_render_system.h"
+#include "Systems/light_cluster_system.h"
 
 #include "vulkan/vulkan.h"
 
@@ -24,6 +26,7 @@ class DescriptorSetLayout;
 class Buffer;
 class Renderer;
 class LightSystem;
+class ShadowSystem;
 
 struct TextureData;
 struct CameraTransformComponent;
@@ -50,16 +53,22 @@ public:
 	static constexpr uint32 kGlobalBindingIrradianceIndex = 2u;
 	static constexpr uint32 kGlobalBindingPrefilteredEnvIndex = 3u;
 	static constexpr uint32 kGlobalBindingBrdfLutIndex = 4u;
-
-	// bindless settings
-	static constexpr uint32 kBindlessBindingTexturesIndex = 0u;
-	static constexpr uint32 kBindlessBindingBuffersIndex = 1u;
-
-	static constexpr uint32 kMaxBindlessTextures = 1024;
-	static constexpr uint32 kMaxBindlessBuffers = 1024;
+	static constexpr uint32 kGlobalBindingDirectionalLightsIndex = 5u;
+	static constexpr uint32 kGlobalBindingPointLightsIndex = 6u;
+	static constexpr uint32 kGlobalBindingSpotLightsIndex = 7u;
+	static constexpr uint32 kGlobalBindingLightClustersIndex = 8u;
+	static constexpr uint32 kGlobalBindingLightIndicesIndex = 9u;
+	static constexpr uint32 kGlobalBindingShadowAtlasIndex = 10u;
+	static constexpr uint32 kGlobalBindingShadowsIndex = 11u;
+
+	// initial capacity of the light storage buffers, they double when the lights of a type exceed it
+	static constexpr uint32 kMinLightCapacity = 16u;
+	static constexpr uint32 kMinLightIndexCapacity = LightClusterSystem::kClusterCount;
 
 public:
-	MasterRenderSystem(Device& _device, Renderer& _renderer, LightSystem& _lightSystem);
+	// the bindless capacities are used only if the device supports bindless, clamped to its limits
+	MasterRenderSystem(Device& _device, Renderer& _renderer, LightSystem& _lightSystem,
+		uint32 _bindlessTextureCapacity, uint32 _bindlessBufferCapacity);
 	virtual ~MasterRenderSystem() = default;
 
 	MasterRenderSystem(const MasterRenderSystem&) = delete;
@@ -68,43 +77,73 @@ public:
 public:
 	VESPERENGINE_INLINE VkDescriptorSetLayout GetGlobalDescriptorSetLayout() const { return m_globalSetLayout->GetDescriptorSetLayout(); }
 	VESPERENGINE_INLINE VkDescriptorSet GetGlobalDescriptorSet(const int32 _frameIndex) const { return m_globalDescriptorSets[_frameIndex]; }
-	VESPERENGINE_INLINE VkDescriptorSet GetBindlessBindingDescriptorSet(const int32 _frameIndex) const { return m_bindlessBindingDescriptorSets[_frameIndex]; }
+	VESPERENGINE_INLINE VkDescriptorSet GetBindlessBindingDescriptorSet(const int32 _frameIndex) const 
+	{ 
+		return m_bindlessRegistry ? m_bindlessRegistry->GetDescriptorSet(_frameIndex) : VK_NULL_HANDLE; 
+	}
 	
 	// this might be present or not
 	VESPERENGINE_INLINE VkDescriptorSetLayout GetBindlessBindingDescriptorSetLayout() const 
 	{ 
-		return m_device.IsBindlessResourcesSupported() ? m_bindlesslSetLayout->GetDescriptorSetLayout() : VK_NULL_HANDLE; 
+		return m_bindlessRegistry ? m_bindlessRegistry->GetDescriptorSetLayout() : VK_NULL_HANDLE; 
 	}
+	// this might be present or not, the textures and materials loaded after Initialize join the bindless arrays through it
+	VESPERENGINE_INLINE BindlessRegistry* GetBindlessRegistry() const { return m_bindlessRegistry.get(); }
 
 public:
 	// Call this at the beginning, but after all the constructors of all the system is done
-	void Initialize(TextureSystem& _textureSystem, MaterialSystem& _materialSystem,
+	void Initialize(TextureSystem& _textureSystem, MaterialSystem& _materialSystem, const ShadowSystem& _shadowSystem,
 		std::shared_ptr<TextureData> _irradianceMap,
 		std::shared_ptr<TextureData> _prefilteredEnvMap,
 		std::shared_ptr<TextureData> _brdfLut);
-	// Call this within the update/render loop. Does not need to be between the swapchain, and need to be done before the render and the BindGlobalDescriptor
+	// Call this within the update/render loop, after the fence of the frame has been waited, and before the render and the BindGlobalDescriptor
 	void UpdateScene(const FrameInfo& _frameInfo, const CameraComponent& _cameraComponen, const CameraTransformComponent& _cameraTransform);
 	// Call this after the UpdateScene, but before every other Render from every other system, this is the global descriptor binding point
 	void BindGlobalDescriptor(const FrameInfo& _frameInfo);
+	// Call this once the frame has been submitted, the bindless slots changed until the next UpdateScene are written then
+	void EndFrame();
 	// Call at the end or at destruction time, anyway after the game loop is done.
 	void Cleanup();
 
+private:
+	// Storage buffers of one kind of light data (a light type, the clusters, the light indices), one per frame, persistently mapped
+	struct LightBuffers
+	{
+		std::vector<BufferComponent> Buffers;
+		std::vector<uint8*> MappedMemory;
+		std::vector<uint32> Capacities;
+		uint32 ElementSize{ 0 };
+		uint32 BindingIndex{ 0 };
+	};
+
+	void CreateLightBuffer(LightBuffers& _lightBuffers, const int32 _frameIndex, uint32 _capacity);
+	// Recreate the buffer of the frame if it cannot hold _lightCount lights, return true if recreated
+	bool ReserveLightBuffer(LightBuffers& _lightBuffers, const int32 _frameIndex, uint32 _lightCount);
+
 private:
 	Renderer& m_renderer;
 	LightSystem& m_lightSystem;
 
 	std::unique_ptr<DescriptorSetLayout> m_globalSetLayout;
-	std::unique_ptr<DescriptorSetLayout> m_bindlesslSetLayout;
+	std::unique_ptr<BindlessRegistry> m_bindlessRegistry;
 
 	std::vector<BufferComponent> m_globalSceneUboBuffers;
 	std::vector<BufferComponent> m_globalLightsUboBuffers;
 
+	LightBuffers m_directionalLightBuffers;
+	LightBuffers m_pointLightBuffers;
+	LightBuffers m_spotLightBuffers;
+	LightBuffers m_lightClusterBuffers;
+	LightBuffers m_lightIndexBuffers;
+
+	LightClusterSystem m_lightClusterSystem;
+
 	std::vector<VkDescriptorSet> m_globalDescriptorSets;
-	std::vector<VkDescriptorSet> m_bindlessBindingDescriptorSets;
 
 	VkDescriptorImageInfo m_irradianceInfo{};
 	VkDescriptorImageInfo m_prefilteredEnvInfo{};
 	VkDescriptorImageInfo m_brdfLutInfo{};
+	VkDescriptorImageInfo m_shadowAtlasInfo{};
 
     std::unique_ptr<Buffer> m_buffer;
 };
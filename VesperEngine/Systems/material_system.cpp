@@ -223,6 +223,8 @@ std::shared_ptr<MaterialData> MaterialSystem::CreateMaterial(
         pbrUBO.AnisotropyRotation = std::any_cast<float>(_values[6]);
         pbrUBO.AlphaCutoff = std::any_cast<float>(_values[7]);
         pbrUBO.BaseColorAlpha = std::any_cast<float>(_values[8]);
+        material->IsAlphaTested = pbrUBO.AlphaCutoff >= 0.0f;
+        material->FeatureMask = ComputePBRFeatureMask(pbrUBO);
 
         material->UniformBuffer.MappedMemory = &pbrUBO;
         m_buffer->WriteToBuffer(material->UniformBuffer);
@@ -379,6 +381,8 @@ std::shared_ptr<MaterialData> MaterialSystem::CreateMaterial(
         pbrUBO.AnisotropyRotation = std::any_cast<float>(_values[6]);
         pbrUBO.AlphaCutoff = std::any_cast<float>(_values[7]);
         pbrUBO.BaseColorAlpha = std::any_cast<float>(_values[8]);
+        material->IsAlphaTested = pbrUBO.AlphaCutoff >= 0.0f;
+        material->FeatureMask = ComputePBRFeatureMask(pbrUBO);
 
         material->UniformBuffer.MappedMemory = &pbrUBO;
         m_buffer->WriteToBuffer(material->UniformBuffer);
@@ -457,6 +461,26 @@ std::shared_ptr<MaterialData> MaterialSystem::CreateMaterial(const DefaultMateri
 	return CreateMaterial(_defaultMaterial.Name, _defaultMaterial.Textures, _defaultMaterial.Values, _defaultMaterial.IsTransparent, _defaultMaterial.IsDoubleSided, _defaultMaterial.Type, {});
 }
 
+uint32 MaterialSystem::ComputePBRFeatureMask(const PBRMaterialUBO& _materialUBO)
+{
+    // the feature bits follow the order of the texture indices
+    uint32 featureMask = 0;
+    for (uint32 i = 0; i < 7; ++i)
+    {
+        if (_materialUBO.TextureIndices[i] != -1)
+        {
+            featureMask |= 1u << i;
+        }
+    }
+
+    if (_materialUBO.AlphaCutoff >= 0.0f)
+    {
+        featureMask |= kPBRFeatureAlphaTest;
+    }
+
+    return featureMask;
+}
+
 void MaterialSystem::Cleanup()
 {
 	for (const auto& material : m_materials)
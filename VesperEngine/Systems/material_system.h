@@ -138,6 +138,10 @@ public:
 
 	void Cleanup();
 
+private:
+	// the kPBRFeature bits of the textures the material sets and of its alpha test
+	static uint32 ComputePBRFeatureMask(const PBRMaterialUBO& _materialUBO);
+
 private:
 	Device& m_device;
 	TextureSystem& m_textureSystem;
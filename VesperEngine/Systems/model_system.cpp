@@ -25,6 +25,19 @@ ModelSystem::ModelSystem(VesperApp& _app, Device& _device, MaterialSystem& _mate
 	, m_materialSystem{ _materialSystem }
 {
 	m_buffer = std::make_unique<Buffer>(m_device);
+
+	if (m_app.GetConfig().UseGeometryArena)
+	{
+		m_geometryArena = std::make_unique<GeometryArena>(m_device, m_app.GetConfig().GeometryArenaPageVertexCount, m_app.GetConfig().GeometryArenaPageIndexCount);
+	}
+}
+
+ModelSystem::~ModelSystem()
+{
+	if (m_geometryArena)
+	{
+		m_geometryArena->Cleanup();
+	}
 }
 
 void ModelSystem::LoadModel(ecs::Entity _entity, std::shared_ptr<ModelData> _data) const
@@ -69,6 +82,8 @@ void ModelSystem::LoadModel(ecs::Entity _entity, std::shared_ptr<ModelData> _dat
 
 			pbrMaterialComponent.Index = _data->Material->Index;
 			pbrMaterialComponent.IsDoubleSided = _data->Material->IsDoubleSided;
+			pbrMaterialComponent.IsAlphaTested = _data->Material->IsAlphaTested;
+			pbrMaterialComponent.FeatureMask = _data->Material->FeatureMask;
 
 			pbrMaterialComponent.RoughnessImageInfo.sampler = _data->Material->Textures[0]->Sampler;
 			pbrMaterialComponent.RoughnessImageInfo.imageView = _data->Material->Textures[0]->ImageView;
@@ -121,40 +136,38 @@ void ModelSystem::LoadModel(ecs::Entity _entity, std::shared_ptr<ModelData> _dat
 		m_app.GetComponentManager().AddComponent<StaticComponent>(_entity);
 	}
 
-	if (_data->Vertices.size() > 0)
+	// the buffers are created only by the first entity loading this data, the others share them
+	const uint32 geometryHandle = AcquireGeometry(_data);
+	const SharedGeometry& geometry = m_geometries[geometryHandle];
+
+	m_app.GetComponentManager().AddComponent<GeometryComponent>(_entity);
+	GeometryComponent& geometryComponent = m_app.GetComponentManager().GetComponent<GeometryComponent>(_entity);
+	geometryComponent.Handle = geometryHandle;
+
+	if (geometry.VertexBuffer.Buffer != VK_NULL_HANDLE)
 	{
 		m_app.GetComponentManager().AddComponent<VertexBufferComponent>(_entity);
 
 		VertexBufferComponent& vertexBuffer = m_app.GetComponentManager().GetComponent<VertexBufferComponent>(_entity);
+		vertexBuffer = geometry.VertexBuffer;
 
-		if (m_app.GetComponentManager().HasComponents<StaticComponent>(_entity))
-		{
-			vertexBuffer = CreateVertexBuffersWithStagingBuffer(_data->Vertices);
-		}
-		else
-		{
-			vertexBuffer = CreateVertexBuffers(_data->Vertices);
-		}
+		m_app.GetComponentManager().AddComponent<BoundsComponent>(_entity);
+
+		BoundsComponent& boundsComponent = m_app.GetComponentManager().GetComponent<BoundsComponent>(_entity);
+		boundsComponent.Min = geometry.BoundsMin;
+		boundsComponent.Max = geometry.BoundsMax;
 	}
 	else
 	{
 		m_app.GetComponentManager().AddComponent<NotVertexBufferComponent>(_entity);
 	}
 
-	if (_data->Indices.size() > 0)
+	if (geometry.IndexBuffer.Buffer != VK_NULL_HANDLE)
 	{
 		m_app.GetComponentManager().AddComponent<IndexBufferComponent>(_entity);
 
 		IndexBufferComponent& indexBuffer = m_app.GetComponentManager().GetComponent<IndexBufferComponent>(_entity);
-
-		if (_data->IsStatic)
-		{
-			indexBuffer = CreateIndexBufferWithStagingBuffer(_data->Indices);
-		}
-		else
-		{
-			indexBuffer = CreateIndexBuffer(_data->Indices);
-		}
+		indexBuffer = geometry.IndexBuffer;
 	}
 	else
 	{
@@ -244,11 +257,86 @@ void ModelSystem::LoadSkyboxModel(ecs::Entity _entity, std::shared_ptr<ModelData
 
 void ModelSystem::UnloadModel(ecs::Entity _entity) const
 {
+	// the holes left in the arena are compacted only when they are splitting its free space too much
+	if (RemoveModelComponents(_entity) && m_geometryArena->IsDefragmentationNeeded())
+	{
+		DefragmentGeometry();
+	}
+}
+
+void ModelSystem::UnloadModels() const
+{
+	ecs::EntityManager& entityManager = m_app.GetEntityManager();
+	ecs::ComponentManager& componentManager = m_app.GetComponentManager();
+
+	for (auto iterator : ecs::IterateEntitiesWithAny<VertexBufferComponent, IndexBufferComponent>(entityManager, componentManager))
+	{
+		RemoveModelComponents(iterator);
+	}
+
+	// nothing is left to compact, it only destroys the empty pages
+	if (m_geometryArena)
+	{
+		m_geometryArena->Defragment();
+	}
+}
+
+void ModelSystem::DefragmentGeometry() const
+{
+	if (!m_geometryArena || !m_geometryArena->Defragment())
+	{
+		return;
+	}
+
+	for (SharedGeometry& geometry : m_geometries)
+	{
+		if (geometry.ReferenceCount > 0 && geometry.ArenaHandle != GeometryArena::kInvalidHandle)
+		{
+			RefreshArenaGeometry(geometry);
+		}
+	}
+
+	// the entities hold a copy of the buffers of their geometry
+	ecs::EntityManager& entityManager = m_app.GetEntityManager();
+	ecs::ComponentManager& componentManager = m_app.GetComponentManager();
+
+	for (auto gameEntity : ecs::IterateEntitiesWithAll<GeometryComponent, VertexBufferComponent>(entityManager, componentManager))
+	{
+		const GeometryComponent& geometryComponent = componentManager.GetComponent<GeometryComponent>(gameEntity);
+		componentManager.GetComponent<VertexBufferComponent>(gameEntity) = m_geometries[geometryComponent.Handle].VertexBuffer;
+	}
+
+	for (auto gameEntity : ecs::IterateEntitiesWithAll<GeometryComponent, IndexBufferComponent>(entityManager, componentManager))
+	{
+		const GeometryComponent& geometryComponent = componentManager.GetComponent<GeometryComponent>(gameEntity);
+		componentManager.GetComponent<IndexBufferComponent>(gameEntity) = m_geometries[geometryComponent.Handle].IndexBuffer;
+	}
+}
+
+bool ModelSystem::RemoveModelComponents(ecs::Entity _entity) const
+{
+	// shared geometry buffers are destroyed by the ModelSystem with the last reference,
+	// entities without geometry handle (i.e. skybox) own their buffers
+	bool ownsBuffers = true;
+	bool hasReleasedArenaGeometry = false;
+	if (m_app.GetComponentManager().HasComponents<GeometryComponent>(_entity))
+	{
+		const GeometryComponent& geometryComponent = m_app.GetComponentManager().GetComponent<GeometryComponent>(_entity);
+		const bool isInArena = m_geometries[geometryComponent.Handle].ArenaHandle != GeometryArena::kInvalidHandle;
+		hasReleasedArenaGeometry = ReleaseGeometry(geometryComponent.Handle) && isInArena;
+		ownsBuffers = false;
+
+		m_app.GetComponentManager().RemoveComponent<GeometryComponent>(_entity);
+	}
+
 	if (m_app.GetComponentManager().HasComponents<VertexBufferComponent>(_entity))
 	{
 		VertexBufferComponent& vertexBuffer = m_app.GetComponentManager().GetComponent<VertexBufferComponent>(_entity);
 
-		m_buffer->Destroy(vertexBuffer);
+		if (ownsBuffers)
+		{
+			m_buffer->Destroy(vertexBuffer);
+		}
 
 		m_app.GetComponentManager().RemoveComponent<VertexBufferComponent>(_entity);
 	}
@@ -257,7 +345,10 @@ void ModelSystem::UnloadModel(ecs::Entity _entity) const
 	{
 		IndexBufferComponent& indexBuffer = m_app.GetComponentManager().GetComponent<IndexBufferComponent>(_entity);
 
-		m_buffer->Destroy(indexBuffer);
+		if (ownsBuffers)
+		{
+			m_buffer->Destroy(indexBuffer);
+		}
 
 		m_app.GetComponentManager().RemoveComponent<IndexBufferComponent>(_entity);
 	}
@@ -277,6 +368,11 @@ void ModelSystem::UnloadModel(ecs::Entity _entity) const
 		m_app.GetComponentManager().RemoveComponent<StaticComponent>(_entity);
 	}
 
+	if (m_app.GetComponentManager().HasComponents<BoundsComponent>(_entity))
+	{
+		m_app.GetComponentManager().RemoveComponent<BoundsComponent>(_entity);
+	}
+
 	if (m_app.GetComponentManager().HasComponents<PhongMaterialComponent>(_entity))
 	{
 		m_app.GetComponentManager().RemoveComponent<PhongMaterialComponent>(_entity);
@@ -320,17 +416,157 @@ void ModelSystem::UnloadModel(ecs::Entity _entity) const
 	{
 		m_app.GetComponentManager().RemoveComponent<MorphAnimationComponent>(_entity);
 	}
+
+	return hasReleasedArenaGeometry;
 }
 
-void ModelSystem::UnloadModels() const
+uint32 ModelSystem::AcquireGeometry(const std::shared_ptr<ModelData>& _data) const
 {
-	ecs::EntityManager& entityManager = m_app.GetEntityManager();
-	ecs::ComponentManager& componentManager = m_app.GetComponentManager();
+	auto found = m_geometryLookup.find(_data.get());
+	if (found != m_geometryLookup.end())
+	{
+		SharedGeometry& geometry = m_geometries[found->second];
 
-	for (auto iterator : ecs::IterateEntitiesWithAny<VertexBufferComponent, IndexBufferComponent>(entityManager, componentManager))
+		// the address can be reused by a new ModelData after the old one is released: only share if it is still the same data
+		if (!geometry.SourceData.expired())
+		{
+			++geometry.ReferenceCount;
+			return found->second;
+		}
+	}
+
+	uint32 handle;
+	if (!m_freeGeometryHandles.empty())
+	{
+		handle = m_freeGeometryHandles.back();
+		m_freeGeometryHandles.pop_back();
+	}
+	else
+	{
+		handle = static_cast<uint32>(m_geometries.size());
+		m_geometries.emplace_back();
+	}
+
+	SharedGeometry& geometry = m_geometries[handle];
+	geometry = SharedGeometry{};
+	geometry.Source = _data.get();
+	geometry.SourceData = _data;
+	geometry.ReferenceCount = 1;
+
+	// the static batching merges the vertices on the CPU, after the loading has already released its ModelData
+	if (m_app.GetConfig().EnableStaticBatching && _data->IsStatic)
 	{
-		UnloadModel(iterator);
+		geometry.RetainedData = _data;
 	}
+
+	// static meshes are never written again, so vertices and indices can be sub-allocated in the shared buffers of the arena
+	if (m_geometryArena && _data->IsStatic && _data->Vertices.size() > 0)
+	{
+		geometry.ArenaHandle = m_geometryArena->Allocate(_data->Vertices, _data->Indices);
+		RefreshArenaGeometry(geometry);
+	}
+	else
+	{
+		if (_data->Vertices.size() > 0)
+		{
+			if (_data->IsStatic)
+			{
+				geometry.VertexBuffer = CreateVertexBuffersWithStagingBuffer(_data->Vertices);
+			}
+			else
+			{
+				geometry.VertexBuffer = CreateVertexBuffers(_data->Vertices);
+			}
+		}
+
+		if (_data->Indices.size() > 0)
+		{
+			if (_data->IsStatic)
+			{
+				geometry.IndexBuffer = CreateIndexBufferWithStagingBuffer(_data->Indices);
+			}
+			else
+			{
+				geometry.IndexBuffer = CreateIndexBuffer(_data->Indices);
+			}
+		}
+	}
+
+	if (_data->Vertices.size() > 0)
+	{
+		geometry.BoundsMin = _data->Vertices[0].Position;
+		geometry.BoundsMax = _data->Vertices[0].Position;
+		for (const Vertex& vertex : _data->Vertices)
+		{
+			geometry.BoundsMin = glm::min(geometry.BoundsMin, vertex.Position);
+			geometry.BoundsMax = glm::max(geometry.BoundsMax, vertex.Position);
+		}
+	}
+
+	m_geometryLookup[_data.get()] = handle;
+
+	return handle;
+}
+
+bool ModelSystem::ReleaseGeometry(uint32 _handle) const
+{
+	assertMsgReturnValue(_handle < m_geometries.size() && m_geometries[_handle].ReferenceCount > 0, "Releasing a geometry not in use", false);
+
+	SharedGeometry& geometry = m_geometries[_handle];
+	if (--geometry.ReferenceCount > 0)
+	{
+		return false;
+	}
+
+	if (geometry.ArenaHandle != GeometryArena::kInvalidHandle)
+	{
+		m_geometryArena->Free(geometry.ArenaHandle);
+	}
+	else
+	{
+		if (geometry.VertexBuffer.Buffer != VK_NULL_HANDLE)
+		{
+			m_buffer->Destroy(geometry.VertexBuffer);
+		}
+
+		if (geometry.IndexBuffer.Buffer != VK_NULL_HANDLE)
+		{
+			m_buffer->Destroy(geometry.IndexBuffer);
+		}
+	}
+
+	// a newer geometry could have taken the lookup slot, if the ModelData address was reused
+	auto found = m_geometryLookup.find(geometry.Source);
+	if (found != m_geometryLookup.end() && found->second == _handle)
+	{
+		m_geometryLookup.erase(found);
+	}
+
+	geometry = SharedGeometry{};
+	m_freeGeometryHandles.push_back(_handle);
+
+	return true;
+}
+
+void ModelSystem::ReleaseRetainedGeometryData() const
+{
+	for (SharedGeometry& geometry : m_geometries)
+	{
+		geometry.RetainedData.reset();
+	}
+}
+
+void ModelSystem::RefreshArenaGeometry(SharedGeometry& _geometry) const
+{
+	if (_geometry.ArenaHandle == GeometryArena::kInvalidHandle)
+	{
+		return;
+	}
+
+	const GeometryAllocation& allocation = m_geometryArena->GetAllocation(_geometry.ArenaHandle);
+
+	_geometry.VertexBuffer = m_geometryArena->GetVertexBufferComponent(_geometry.ArenaHandle);
+	_geometry.IndexBuffer = allocation.IndexCount > 0 ? m_geometryArena->GetIndexBufferComponent(_geometry.ArenaHandle) : IndexBufferComponent{};
 }
 
 VertexBufferComponent ModelSystem::CreateVertexBuffers(const std::vector<Vertex>& _vertices) const
@@ -8,12 +8,17 @@
 
 #include "Components/graphics_components.h"
 
+#include "Backend/geometry_arena.h"
+
 #include "ECS/ECS/entity.h"
 
+#include "Core/glm_config.h"
+
 #include "vulkan/vulkan.h"
 
 #include <vector>
 #include <memory>
+#include <unordered_map>
 
 
 VESPERENGINE_NAMESPACE_BEGIN
@@ -31,7 +36,7 @@ class VESPERENGINE_API ModelSystem
 {
 public:
 	ModelSystem(VesperApp& _app, Device& _device, MaterialSystem& _materialSystem);
-	~ModelSystem() = default;
+	~ModelSystem();
 
 	ModelSystem(const ModelSystem&) = delete;
 	ModelSystem& operator=(const ModelSystem&) = delete;
@@ -41,8 +46,41 @@ public:
 	void LoadSkyboxModel(ecs::Entity _entity, std::shared_ptr<ModelData> _modelData, std::shared_ptr<TextureData> _textureData) const;
 	void UnloadModel(ecs::Entity _entity) const;
 	void UnloadModels() const;
+	// Compact the geometry arena and update the buffers of the entities whose geometry moved.
+	// Called by UnloadModel when the arena is fragmented enough, it waits the graphics queue to be idle so not during the frame.
+	void DefragmentGeometry() const;
+
+	// how many entities are sharing the geometry, 0 if the handle is not in use
+	VESPERENGINE_INLINE uint32 GetGeometryReferenceCount(uint32 _handle) const { return _handle < m_geometries.size() ? m_geometries[_handle].ReferenceCount : 0; }
+	// CPU copy of the vertices and indices of a static geometry, kept only if Config::EnableStaticBatching is set, null otherwise
+	VESPERENGINE_INLINE const ModelData* GetRetainedGeometryData(uint32 _handle) const { return _handle < m_geometries.size() ? m_geometries[_handle].RetainedData.get() : nullptr; }
+	// drop the CPU copies kept for the static batching, once the batches are built
+	void ReleaseRetainedGeometryData() const;
 
 private:
+	// Buffers created once per ModelData and shared by all the entities loaded from it
+	struct SharedGeometry
+	{
+		const ModelData* Source{ nullptr };		// key in the lookup, never dereferenced
+		std::weak_ptr<ModelData> SourceData;	// expired when the ModelData is gone, the entry is not reused anymore by new loads
+		std::shared_ptr<ModelData> RetainedData;	// static batching only, keeps SourceData alive until ReleaseRetainedGeometryData
+		VertexBufferComponent VertexBuffer{};
+		IndexBufferComponent IndexBuffer{};
+		uint32 ArenaHandle{ GeometryArena::kInvalidHandle };	// valid if the buffers are sub-allocated in the geometry arena, otherwise they are owned
+		glm::vec3 BoundsMin{ 0.0f };
+		glm::vec3 BoundsMax{ 0.0f };
+		uint32 ReferenceCount{ 0 };
+	};
+
+	// return the handle of the geometry created from _data, creating the buffers only the first time
+	uint32 AcquireGeometry(const std::shared_ptr<ModelData>& _data) const;
+	// return true if it was the last reference and the buffers have been destroyed
+	bool ReleaseGeometry(uint32 _handle) const;
+	// remove the model components, return true if the last reference of a geometry in the arena has been released
+	bool RemoveModelComponents(ecs::Entity _entity) const;
+	// read again the buffers of the geometry from the arena, after the allocation has been created or moved
+	void RefreshArenaGeometry(SharedGeometry& _geometry) const;
+
 	VertexBufferComponent CreateVertexBuffers(const std::vector<Vertex>& _vertices) const;
 	IndexBufferComponent CreateIndexBuffer(const std::vector<uint32>& _indices) const;
 	VertexBufferComponent CreateVertexBuffersWithStagingBuffer(const std::vector<Vertex>& _vertices) const;
@@ -53,6 +91,11 @@ private:
 	Device& m_device;
 	MaterialSystem& m_materialSystem;
 	std::unique_ptr<Buffer> m_buffer;
+	std::unique_ptr<GeometryArena> m_geometryArena;		// null if the static meshes own their buffers
+
+	mutable std::vector<SharedGeometry> m_geometries;
+	mutable std::vector<uint32> m_freeGeometryHandles;
+	mutable std::unordered_map<const ModelData*, uint32> m_geometryLookup;
 };
 
 VESPERENGINE_NAMESPACE_END
@@ -0,0 +1,166 @@
+// Copyright (c) 2025-2025 Michele Condo'
+// File: C:\Projects\Vesper\VesperEngine\Systems\oit_composite_render_system.cpp
+// Licensed under the MIT License. See LICENSE file in the project root for full license information.
+
+#include "Systems/oit_composite_render_system.h"
+
+#include "Backend/device.h"
+#include "Backend/buffer.h"
+#include "Backend/model_data.h"
+#include "Backend/pipeline.h"
+#include "Backend/frame_info.h"
+#include "Backend/descriptors.h"
+#include "Backend/renderer.h"
+#include "Backend/swap_chain.h"
+
+#include "App/vesper_app.h"
+#include "App/config.h"
+
+
+VESPERENGINE_NAMESPACE_BEGIN
+
+OITCompositeRenderSystem::OITCompositeRenderSystem(VesperApp& _app, Device& _device, Renderer& _renderer)
+    : BaseRenderSystem{ _device }
+    , m_app(_app)
+    , m_renderer(_renderer)
+{
+    assertMsgReturnVoid(m_renderer.IsWeightedBlendedOITEnabled(), "OITCompositeRenderSystem requires a renderer created with weighted blended OIT enabled");
+
+    m_buffer = std::make_unique<Buffer>(m_device);
+
+    // the full screen triangle is generated from gl_VertexIndex, but fullscreen.vert still declares the vertex inputs
+    const uint32 vertexCount = 3;
+    const uint32 vertexSize = sizeof(Vertex);
+
+    m_fullscreenVertexBufferComponent = m_buffer->Create<VertexBufferComponent>(
+        vertexSize,
+        vertexCount,
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+        VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
+        VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT
+    );
+
+    m_inputAttachmentSetLayout = DescriptorSetLayout::Builder(_device)
+        .AddBinding(kAccumulationBindingIndex, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, VK_SHADER_STAGE_FRAGMENT_BIT)
+        .AddBinding(kRevealageBindingIndex, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, VK_SHADER_STAGE_FRAGMENT_BIT)
+        .Build();
+
+    // own pool, the global one is sized by the application and does not know about input attachments.
+    // One set per swap chain image, the image count is 2 or 3 so kMaxFramesInFlight is always enough
+    m_inputAttachmentPool = DescriptorPool::Builder(_device)
+        .SetMaxSets(SwapChain::kMaxFramesInFlight)
+        .AddPoolSize(VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, SwapChain::kMaxFramesInFlight * 2)
+        .Build();
+
+    CreatePipelineLayout(std::vector<VkDescriptorSetLayout>{ m_inputAttachmentSetLayout->GetDescriptorSetLayout() });
+
+    UpdateInputAttachments();
+}
+
+OITCompositeRenderSystem::~OITCompositeRenderSystem()
+{
+}
+
+void OITCompositeRenderSystem::UpdateInputAttachments()
+{
+    if (!m_inputAttachmentDescriptorSets.empty() && m_swapChainGeneration == m_renderer.GetSwapChainGeneration())
+    {
+        return;
+    }
+
+    // the swap chain recreation waits for the device to be idle, so none of the old sets is in use anymore
+    m_inputAttachmentPool->ResetPool();
+
+    const std::size_t imageCount = m_renderer.GetSwapChainImageCount();
+    m_inputAttachmentDescriptorSets.resize(imageCount);
+
+    for (int32 i = 0; i < imageCount; ++i)
+    {
+        VkDescriptorImageInfo accumulationInfo{};
+        accumulationInfo.sampler = VK_NULL_HANDLE;
+        accumulationInfo.imageView = m_renderer.GetOITAccumulationImageView(i);
+        accumulationInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        VkDescriptorImageInfo revealageInfo{};
+        revealageInfo.sampler = VK_NULL_HANDLE;
+        revealageInfo.imageView = m_renderer.GetOITRevealageImageView(i);
+        revealageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        DescriptorWriter(*m_inputAttachmentSetLayout, *m_inputAttachmentPool)
+            .WriteImage(kAccumulationBindingIndex, &accumulationInfo)
+            .WriteImage(kRevealageBindingIndex, &revealageInfo)
+            .Build(m_inputAttachmentDescriptorSets[i]);
+    }
+
+    m_swapChainGeneration = m_renderer.GetSwapChainGeneration();
+}
+
+void OITCompositeRenderSystem::Render(const FrameInfo& _frameInfo)
+{
+    UpdateInputAttachments();
+
+    m_commandRecorder.Reset(_frameInfo.CommandBuffer);
+
+    m_pipeline->Bind(_frameInfo.CommandBuffer);
+
+    vkCmdBindDescriptorSets(
+        _frameInfo.CommandBuffer,
+        VK_PIPELINE_BIND_POINT_GRAPHICS,
+        m_pipelineLayout,
+        0,
+        1,
+        &m_inputAttachmentDescriptorSets[m_renderer.GetCurrentImageIndex()],
+        0,
+        nullptr
+    );
+
+    //if (vkCmdSetCullModeEXT && vkCmdSetFrontFaceEXT)  // no need, we do throw and exception if not supported
+    {
+        vkCmdSetCullModeEXT(_frameInfo.CommandBuffer, VK_CULL_MODE_NONE);
+        vkCmdSetFrontFaceEXT(_frameInfo.CommandBuffer, VK_FRONT_FACE_COUNTER_CLOCKWISE);
+    }
+
+    Bind(m_fullscreenVertexBufferComponent, _frameInfo.CommandBuffer);
+    Draw(m_fullscreenVertexBufferComponent, _frameInfo.CommandBuffer);
+}
+
+void OITCompositeRenderSystem::CreatePipeline(VkRenderPass _renderPass)
+{
+    assertMsgReturnVoid(m_pipelineLayout != nullptr, "Cannot create pipeline before pipeline layout");
+
+    PipelineConfigInfo pipelineConfig{};
+
+    Pipeline::DefaultPipelineConfiguration(pipelineConfig);
+
+    pipelineConfig.RenderPass = _renderPass;
+    pipelineConfig.PipelineLayout = m_pipelineLayout;
+    pipelineConfig.Subpass = SwapChain::kCompositeSubpass;
+
+    pipelineConfig.DepthStencilInfo.depthTestEnable = VK_FALSE;
+    pipelineConfig.DepthStencilInfo.depthWriteEnable = VK_FALSE;
+    pipelineConfig.DepthStencilInfo.stencilTestEnable = VK_FALSE;
+
+    pipelineConfig.RasterizationInfo.cullMode = VK_CULL_MODE_NONE;
+
+    // the shader outputs the average transparent color with (1 - revealage) as alpha, blended over the opaque color
+    pipelineConfig.ColorBlendAttachment.blendEnable = VK_TRUE;
+    pipelineConfig.ColorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    pipelineConfig.ColorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    pipelineConfig.ColorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+    pipelineConfig.ColorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    pipelineConfig.ColorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    pipelineConfig.ColorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+    m_pipeline = std::make_unique<Pipeline>(
+        m_device,
+        std::vector{ ShaderInfo{m_app.GetConfig().ShadersPath + "fullscreen.vert.spv", ShaderType::Vertex}, ShaderInfo{m_app.GetConfig().ShadersPath + "oit_composite.frag.spv", ShaderType::Fragment}, },
+        pipelineConfig
+    );
+}
+
+void OITCompositeRenderSystem::Cleanup()
+{
+    m_buffer->Destroy(m_fullscreenVertexBufferComponent);
+}
+
+VESPERENGINE_NAMESPACE_END
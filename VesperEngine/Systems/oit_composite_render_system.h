@@ -0,0 +1,69 @@
+// Copyright (c) 2025-2025 Michele Condo'
+// File: C:\Projects\Vesper\VesperEngine\Systems\oit_composite_render_system.h
+// Licensed under the MIT License. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include "Core/core_defines.h"
+
+#include "Systems/base_render_system.h"
+
+#include "Components/graphics_components.h"
+
+#include "vulkan/vulkan.h"
+
+#include <memory>
+#include <vector>
+
+
+VESPERENGINE_NAMESPACE_BEGIN
+
+class VesperApp;
+class Device;
+class Renderer;
+class Pipeline;
+class Buffer;
+class DescriptorSetLayout;
+class DescriptorPool;
+
+struct FrameInfo;
+
+/**
+ * Resolves the weighted blended OIT targets over the opaque color, in the composite subpass of the swap chain render pass.
+ * Accumulation and revealage are read as input attachments, so the whole OIT stays inside a single render pass.
+ */
+class VESPERENGINE_API OITCompositeRenderSystem : public BaseRenderSystem
+{
+public:
+    static constexpr uint32 kAccumulationBindingIndex = 0u;
+    static constexpr uint32 kRevealageBindingIndex = 1u;
+
+public:
+    OITCompositeRenderSystem(VesperApp& _app, Device& _device, Renderer& _renderer);
+    virtual ~OITCompositeRenderSystem();
+
+    OITCompositeRenderSystem(const OITCompositeRenderSystem&) = delete;
+    OITCompositeRenderSystem& operator=(const OITCompositeRenderSystem&) = delete;
+
+public:
+    void CreatePipeline(VkRenderPass _renderPass);
+    void Render(const FrameInfo& _frameInfo);
+    void Cleanup();
+
+private:
+    // input attachments are swap chain images, so the sets have to follow the swap chain when it is recreated
+    void UpdateInputAttachments();
+
+private:
+    VesperApp& m_app;
+    Renderer& m_renderer;
+    std::unique_ptr<Pipeline> m_pipeline;
+    std::unique_ptr<DescriptorSetLayout> m_inputAttachmentSetLayout;
+    std::unique_ptr<DescriptorPool> m_inputAttachmentPool;
+    std::vector<VkDescriptorSet> m_inputAttachmentDescriptorSets;
+    std::unique_ptr<Buffer> m_buffer;
+    VertexBufferComponent m_fullscreenVertexBufferComponent;
+    uint32 m_swapChainGeneration = 0;
+};
+
+VESPERENGINE_NAMESPACE_END
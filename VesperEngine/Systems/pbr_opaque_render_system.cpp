@@ -10,14 +10,18 @@
 #include "Backend/frame_info.h"
 #include "Backend/descriptors.h"
 #include "Backend/renderer.h"
-#include "Backend/buffer.h"
+#include "Backend/render_packet.h"
 #include "Backend/swap_chain.h"
+#include "Backend/instance_buffer.h"
+#include "Backend/device.h"
 
 #include "Components/graphics_components.h"
 #include "Components/object_components.h"
 #include "Components/pipeline_components.h"
+#include "Components/camera_components.h"
 
 #include "Systems/uniform_buffer.h"
+#include "Systems/gpu_culling_system.h"
 
 #include "App/vesper_app.h"
 #include "App/config.h"
@@ -25,7 +29,9 @@
 #include "ECS/ECS/ecs.h"
 
 #include <array>
+#include <algorithm>
 #include <stdexcept>
+#include <cstddef>
 
 VESPERENGINE_NAMESPACE_BEGIN
 
@@ -37,7 +43,18 @@ PBROpaqueRenderSystem::PBROpaqueRenderSystem(VesperApp& _app, Device& _device, R
     , m_app(_app)
     , m_renderer(_renderer)
 {
-    m_buffer = std::make_unique<Buffer>(m_device);
+    m_instanceBuffer = std::make_unique<InstanceBuffer>(m_device, m_renderer, m_app.GetConfig().MaxEntities);
+
+    m_instanceCandidates.reserve(m_app.GetConfig().MaxEntities);
+    m_instancedEntities.resize(m_app.GetConfig().MaxEntities, 0);
+    m_instancedBatches.reserve(m_app.GetConfig().MaxEntities);
+    m_drawSorter.Reserve(m_app.GetConfig().MaxEntities);
+
+    if (m_device.IsGPUDrivenRenderingSupported())
+    {
+        // the culling shares the instance buffer: on a GPU driven frame the CPU instancing is skipped
+        m_gpuCullingSystem = std::make_unique<GPUCullingSystem>(m_app, m_device, m_renderer, *m_instanceBuffer, m_app.GetConfig().MaxEntities);
+    }
 
     VkPushConstantRange defaultRange{};
     defaultRange.stageFlags = VK_SHADER_STAGE_ALL;
@@ -45,13 +62,8 @@ PBROpaqueRenderSystem::PBROpaqueRenderSystem(VesperApp& _app, Device& _device, R
     defaultRange.size = VESPERENGINE_PUSHCONSTANT_DEFAULTRANGE;
     m_pushConstants.push_back(defaultRange);
 
-    if (m_device.IsBindlessResourcesSupported())
-    {
-        m_materialSetLayout = DescriptorSetLayout::Builder(_device)
-            .AddBinding(kPBRUniformBufferOnlyBindingIndex, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT)
-            .Build();
-    }
-    else
+    // with bindless the material is read from the bindless arrays at the index pushed with the draws, there is no material set
+    if (!m_device.IsBindlessResourcesSupported())
     {
         m_materialSetLayout = DescriptorSetLayout::Builder(_device)
             .AddBinding(kPBRRoughnessTextureBindingIndex, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT)
@@ -62,22 +74,23 @@ PBROpaqueRenderSystem::PBROpaqueRenderSystem(VesperApp& _app, Device& _device, R
             .AddBinding(kPBRBaseColorTextureBindingIndex,VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT)
             .AddBinding(kPBRAOTextureBindingIndex, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT)
             .AddBinding(kPBRUniformBufferBindingIndex, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT)
+            .SetUpdateTemplate(GetMaterialTemplateEntries())
             .Build();
     }
 
     if (m_device.IsBindlessResourcesSupported())
     {
         m_entitySetIndex = 2;
-        m_materialSetIndex = 3;
+        m_instanceSetIndex = 3;
 
         CreatePipelineLayout(std::vector<VkDescriptorSetLayout>
-        { _globalDescriptorSetLayout, _bindlessBindingDescriptorSetLayout, _entityDescriptorSetLayout, m_materialSetLayout->GetDescriptorSetLayout() }
+        { _globalDescriptorSetLayout, _bindlessBindingDescriptorSetLayout, _entityDescriptorSetLayout, m_instanceBuffer->GetDescriptorSetLayout() }
         );
     }
     else
     {
         CreatePipelineLayout(std::vector<VkDescriptorSetLayout>
-        { _globalDescriptorSetLayout, _entityDescriptorSetLayout, m_materialSetLayout->GetDescriptorSetLayout() }
+        { _globalDescriptorSetLayout, _entityDescriptorSetLayout, m_materialSetLayout->GetDescriptorSetLayout(), m_instanceBuffer->GetDescriptorSetLayout() }
         );
     }
 }
@@ -87,59 +100,93 @@ void PBROpaqueRenderSystem::MaterialBinding()
     ecs::EntityManager& entityManager = m_app.GetEntityManager();
     ecs::ComponentManager& componentManager = m_app.GetComponentManager();
 
+    const bool isBindless = m_device.IsBindlessResourcesSupported();
+
     for (auto gameEntity : ecs::IterateEntitiesWithAll<PipelineOpaqueComponent, PBRMaterialComponent>(entityManager, componentManager))
     {
         PBRMaterialComponent& materialComponent = m_app.GetComponentManager().GetComponent<PBRMaterialComponent>(gameEntity);
-        materialComponent.BoundDescriptorSet.resize(SwapChain::kMaxFramesInFlight);
 
-        if (m_device.IsBindlessResourcesSupported())
+        // every feature mask in the scene gets its pipelines now, the draws only look them up
+        PreparePermutation(materialComponent.FeatureMask);
+
+        // no set with bindless, BindMaterial pushes the material index
+        if (isBindless)
         {
-            for (int32 i = 0; i < SwapChain::kMaxFramesInFlight; ++i)
-            {
-                m_bindlessBindingMaterialIndexUbos.emplace_back(m_buffer->Create<BufferComponent>(
-                    sizeof(PhongBindlessMaterialIndexUBO),
-                    1,
-                    VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                    VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
-                    VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT,
-                    /*minUboAlignment*/1,
-                    true
-                ));
-
-                BufferComponent& currentBuffer = m_bindlessBindingMaterialIndexUbos.back();
-
-                PhongBindlessMaterialIndexUBO pbrIndexUBO; // same layout
-                pbrIndexUBO.MaterialIndex = materialComponent.Index;
-
-                currentBuffer.MappedMemory = &pbrIndexUBO;
-                m_buffer->WriteToBuffer(currentBuffer);
-
-                VkDescriptorBufferInfo bufferInfo;
-                bufferInfo.buffer = currentBuffer.Buffer;
-                bufferInfo.offset = 0;
-                bufferInfo.range = currentBuffer.AlignedSize;
-
-                DescriptorWriter(*m_materialSetLayout, *m_renderer.GetDescriptorPool())
-                    .WriteBuffer(kPBRUniformBufferOnlyBindingIndex, &bufferInfo)
-                    .Build(materialComponent.BoundDescriptorSet[i]);
-            }
+            materialComponent.BoundDescriptorSet.assign(SwapChain::kMaxFramesInFlight, VK_NULL_HANDLE);
+            continue;
+        }
+
+        // the set depends only on the material: built once, shared by all its entities and by all the frames in flight
+        VkDescriptorSet materialSet = VK_NULL_HANDLE;
+        if (materialComponent.Index < 0)
+        {
+            // not from the MaterialSystem, the resources are only of the entity
+            materialSet = BuildMaterialDescriptorSet(materialComponent);
         }
         else
         {
-            for (int32 i = 0; i < SwapChain::kMaxFramesInFlight; ++i)
+            auto [materialSetIt, isNewMaterial] = m_materialDescriptorSets.try_emplace(materialComponent.Index, VK_NULL_HANDLE);
+            if (isNewMaterial)
             {
-                DescriptorWriter(*m_materialSetLayout, *m_renderer.GetDescriptorPool())
-                    .WriteImage(kPBRRoughnessTextureBindingIndex, &materialComponent.RoughnessImageInfo)
-                    .WriteImage(kPBRMetallicTextureBindingIndex, &materialComponent.MetallicImageInfo)
-                    .WriteImage(kPBRSheenTextureBindingIndex, &materialComponent.SheenImageInfo)
-                    .WriteImage(kPBREmissiveTextureBindingIndex, &materialComponent.EmissiveImageInfo)
-                    .WriteImage(kPBRNormalTextureBindingIndex, &materialComponent.NormalImageInfo)
-                    .WriteImage(kPBRBaseColorTextureBindingIndex, &materialComponent.BaseColorImageInfo)
-                    .WriteImage(kPBRAOTextureBindingIndex, &materialComponent.AOImageInfo)
-                    .WriteBuffer(kPBRUniformBufferBindingIndex, &materialComponent.UniformBufferInfo)
-                    .Build(materialComponent.BoundDescriptorSet[i]);
+                materialSetIt->second = BuildMaterialDescriptorSet(materialComponent);
             }
+            materialSet = materialSetIt->second;
         }
+
+        materialComponent.BoundDescriptorSet.assign(SwapChain::kMaxFramesInFlight, materialSet);
+    }
+}
+
+std::vector<DescriptorTemplateEntry> PBROpaqueRenderSystem::GetMaterialTemplateEntries()
+{
+    return {
+        { kPBRRoughnessTextureBindingIndex, offsetof(PBRMaterialDescriptorData, RoughnessImageInfo) },
+        { kPBRMetallicTextureBindingIndex, offsetof(PBRMaterialDescriptorData, MetallicImageInfo) },
+        { kPBRSheenTextureBindingIndex, offsetof(PBRMaterialDescriptorData, SheenImageInfo) },
+        { kPBREmissiveTextureBindingIndex, offsetof(PBRMaterialDescriptorData, EmissiveImageInfo) },
+        { kPBRNormalTextureBindingIndex, offsetof(PBRMaterialDescriptorData, NormalImageInfo) },
+        { kPBRBaseColorTextureBindingIndex, offsetof(PBRMaterialDescriptorData, BaseColorImageInfo) },
+        { kPBRAOTextureBindingIndex, offsetof(PBRMaterialDescriptorData, AOImageInfo) },
+        { kPBRUniformBufferBindingIndex, offsetof(PBRMaterialDescriptorData, UniformBufferInfo) }
+    };
+}
+
+VkDescriptorSet PBROpaqueRenderSystem::BuildMaterialDescriptorSet(PBRMaterialComponent& _materialComponent)
+{
+    VkDescriptorSet materialSet = VK_NULL_HANDLE;
+
+    const PBRMaterialDescriptorData descriptorData{
+        _materialComponent.RoughnessImageInfo,
+        _materialComponent.MetallicImageInfo,
+        _materialComponent.SheenImageInfo,
+        _materialComponent.EmissiveImageInfo,
+        _materialComponent.NormalImageInfo,
+        _materialComponent.BaseColorImageInfo,
+        _materialComponent.AOImageInfo,
+        _materialComponent.UniformBufferInfo
+    };
+
+    DescriptorWriter(*m_materialSetLayout, *m_renderer.GetDescriptorPool())
+        .BuildFromTemplate(materialSet, &descriptorData);
+
+    return materialSet;
+}
+
+void PBROpaqueRenderSystem::BindMaterial(const FrameInfo& _frameInfo, int32 _materialIndex, VkDescriptorSet _materialSet)
+{
+    if (m_device.IsBindlessResourcesSupported())
+    {
+        PushConstants(_frameInfo.CommandBuffer, 0, VESPERENGINE_PUSHCONSTANT_MATERIALINDEX_OFFSET, sizeof(int32), &_materialIndex);
+    }
+    else
+    {
+        m_commandRecorder.BindDescriptorSet(
+            _frameInfo.CommandBuffer,
+            VK_PIPELINE_BIND_POINT_GRAPHICS,
+            m_pipelineLayout,
+            m_materialSetIndex,
+            _materialSet
+        );
     }
 }
 
@@ -161,135 +208,491 @@ void PBROpaqueRenderSystem::Update(const FrameInfo& _frameInfo)
     }
 }
 
+void PBROpaqueRenderSystem::PrepareDraws(const FrameInfo& _frameInfo, const CameraComponent& _cameraComponent)
+{
+    // the draws are ordered front to back by the view of this frame, GPU driven or not
+    m_viewMatrix = _cameraComponent.ViewMatrix;
+
+    m_isGPUDrivenFrame = m_gpuCullingSystem && m_allowInstancing && m_instancedPipeline && m_app.GetConfig().EnableGPUDrivenRendering;
+    if (!m_isGPUDrivenFrame)
+    {
+        return;
+    }
+
+    ecs::EntityManager& entityManager = m_app.GetEntityManager();
+    ecs::ComponentManager& componentManager = m_app.GetComponentManager();
+
+    std::fill(m_instancedEntities.begin(), m_instancedEntities.end(), static_cast<uint8>(0));
+
+    // the objects and batches are resident in the culling, which uploads only the ones changed since the last time.
+    // Only indexed geometry, the draw commands are indexed ones. Not visible entities are set too, the culling discards them
+    m_gpuCullingSystem->BeginUpdate();
+
+    for (auto gameEntity : ecs::IterateEntitiesWithAll<GeometryComponent, PBRMaterialComponent, PipelineOpaqueComponent, DynamicOffsetComponent, VertexBufferComponent, IndexBufferComponent, UpdateComponent, BoundsComponent>(entityManager, componentManager))
+    {
+        const GeometryComponent& geometryComponent = componentManager.GetComponent<GeometryComponent>(gameEntity);
+        const PBRMaterialComponent& materialComponent = componentManager.GetComponent<PBRMaterialComponent>(gameEntity);
+        const UpdateComponent& updateComponent = componentManager.GetComponent<UpdateComponent>(gameEntity);
+        const IndexBufferComponent& indexBufferComponent = componentManager.GetComponent<IndexBufferComponent>(gameEntity);
+        const BoundsComponent& boundsComponent = componentManager.GetComponent<BoundsComponent>(gameEntity);
+
+        // same key of PrepareInstancedBatches: geometry | material | winding
+        const uint64 key = (static_cast<uint64>(geometryComponent.Handle) << 33)
+            | (static_cast<uint64>(static_cast<uint32>(materialComponent.Index)) << 1)
+            | (updateComponent.IsMirrored ? 1ull : 0ull);
+
+        // the batches are full, drawn one by one
+        const uint32 batchIndex = m_gpuCullingSystem->AcquireBatch(key, indexBufferComponent);
+        if (batchIndex == GPUCullingSystem::kInvalidIndex)
+        {
+            continue;
+        }
+
+        if (batchIndex == static_cast<uint32>(m_gpuDrivenBatches.size()))
+        {
+            InstancedBatch& batch = m_gpuDrivenBatches.emplace_back();
+            batch.BatchIndex = batchIndex;
+            batch.FeatureMask = materialComponent.FeatureMask;
+            batch.IsAlphaTested = materialComponent.IsAlphaTested;
+
+            m_isGPUDrivenBatchOrderDirty = true;
+        }
+
+        // the entities come and go, any of this frame binds the geometry and the material of the batch
+        m_gpuDrivenBatches[batchIndex].EntityIndex = gameEntity.GetIndex();
+
+        InstanceData instanceData{};
+        FillInstanceData(componentManager, gameEntity, instanceData);
+        m_gpuCullingSystem->SetObject(gameEntity.GetIndex(), batchIndex, instanceData, boundsComponent.Min, boundsComponent.Max, componentManager.HasComponents<VisibilityComponent>(gameEntity));
+
+        m_instancedEntities[gameEntity.GetIndex()] = 1;
+    }
+
+    m_gpuCullingSystem->EndUpdate(_frameInfo.FrameIndex);
+
+    if (m_isGPUDrivenBatchOrderDirty)
+    {
+        SortGPUDrivenBatches();
+    }
+
+    m_instancedBatches.clear();
+    for (const uint32 batchIndex : m_gpuDrivenBatchOrder)
+    {
+        const uint32 objectCount = m_gpuCullingSystem->GetBatchObjectCount(batchIndex);
+        if (objectCount > 0)
+        {
+            InstancedBatch& batch = m_instancedBatches.emplace_back(m_gpuDrivenBatches[batchIndex]);
+            batch.InstanceCount = objectCount;
+        }
+    }
+
+    if (m_instancedBatches.empty())
+    {
+        m_isGPUDrivenFrame = false;
+        return;
+    }
+
+    m_gpuCullingSystem->Dispatch(_frameInfo, _cameraComponent.ProjectionMatrix * _cameraComponent.ViewMatrix);
+}
+
 void PBROpaqueRenderSystem::Render(const FrameInfo& _frameInfo)
 {
-    m_pipeline->Bind(_frameInfo.CommandBuffer);
+    m_commandRecorder.Reset(_frameInfo.CommandBuffer);
+
+    // on a GPU driven frame the batches, and the entities drawn by them, are already set by PrepareDraws
+    if (!m_isGPUDrivenFrame)
+    {
+        std::fill(m_instancedEntities.begin(), m_instancedEntities.end(), static_cast<uint8>(0));
+        m_instancedBatches.clear();
+
+        if (m_allowInstancing && m_instancedPipeline && m_app.GetConfig().EnableInstancing)
+        {
+            PrepareInstancedBatches(_frameInfo);
+        }
+    }
+
+    CollectEntityDraws(_frameInfo);
+
+    // the depth of everything first, front to back: the shading below then runs the fragment stage once per pixel
+    if (m_depthPrepassPipeline)
+    {
+        RenderInstanced(_frameInfo, true);
+        RenderEntities(_frameInfo, true);
+    }
+
+    // the shading binds the materials, so the entities are grouped by material keeping the front to back order inside every group
+    m_drawSorter.SortByMaterial();
+
+    RenderInstanced(_frameInfo, false);
+    RenderEntities(_frameInfo, false);
+}
 
+void PBROpaqueRenderSystem::PrepareInstancedBatches(const FrameInfo& _frameInfo)
+{
     ecs::EntityManager& entityManager = m_app.GetEntityManager();
     ecs::ComponentManager& componentManager = m_app.GetComponentManager();
 
-    auto entitiesGroupedAndCollected = ecs::EntityCollector::CollectAndGroupEntitiesWithAllByField<PBRMaterialComponent, PipelineOpaqueComponent, DynamicOffsetComponent, VertexBufferComponent, IndexBufferComponent, VisibilityComponent, UpdateComponent>(entityManager, componentManager, &PBRMaterialComponent::Index);
+    m_instanceBuffer->Reset();
+    m_instanceCandidates.clear();
 
-    for (const auto& [key, entities] : entitiesGroupedAndCollected)
+    // the pushed instances overwrite the resident ones of the culling in this frame buffer
+    if (m_gpuCullingSystem)
     {
-        const PBRMaterialComponent& materialComponent = componentManager.GetComponent<PBRMaterialComponent>(entities[0]);
+        m_gpuCullingSystem->Invalidate(_frameInfo.FrameIndex);
+    }
 
-        vkCmdBindDescriptorSets(
-            _frameInfo.CommandBuffer,
-            VK_PIPELINE_BIND_POINT_GRAPHICS,
-            m_pipelineLayout,
-            m_materialSetIndex,
-            1,
-            &materialComponent.BoundDescriptorSet[_frameInfo.FrameIndex],
-            0,
-            nullptr
-        );
+    for (auto gameEntity : ecs::IterateEntitiesWithAll<GeometryComponent, PBRMaterialComponent, PipelineOpaqueComponent, DynamicOffsetComponent, VertexBufferComponent, VisibilityComponent, UpdateComponent>(entityManager, componentManager))
+    {
+        const GeometryComponent& geometryComponent = componentManager.GetComponent<GeometryComponent>(gameEntity);
+        const PBRMaterialComponent& materialComponent = componentManager.GetComponent<PBRMaterialComponent>(gameEntity);
+        const UpdateComponent& updateComponent = componentManager.GetComponent<UpdateComponent>(gameEntity);
+
+        // geometry | material | winding: entities with the same key can go in the same draw
+        const uint64 key = (static_cast<uint64>(geometryComponent.Handle) << 33)
+            | (static_cast<uint64>(static_cast<uint32>(materialComponent.Index)) << 1)
+            | (updateComponent.IsMirrored ? 1ull : 0ull);
+
+        m_instanceCandidates.emplace_back(key, gameEntity.GetIndex());
+    }
+
+    std::sort(m_instanceCandidates.begin(), m_instanceCandidates.end());
+
+    std::size_t batchBegin = 0;
+    while (batchBegin < m_instanceCandidates.size())
+    {
+        std::size_t batchEnd = batchBegin + 1;
+        while (batchEnd < m_instanceCandidates.size() && m_instanceCandidates[batchEnd].first == m_instanceCandidates[batchBegin].first)
+        {
+            ++batchEnd;
+        }
 
-        for (const auto& entityCollected : entities)
+        const uint32 instanceCount = static_cast<uint32>(batchEnd - batchBegin);
+        if (instanceCount >= kMinInstanceCount)
         {
-            const DynamicOffsetComponent& dynamicOffsetComponent = componentManager.GetComponent<DynamicOffsetComponent>(entityCollected);
-            const VertexBufferComponent& vertexBufferComponent = componentManager.GetComponent<VertexBufferComponent>(entityCollected);
-            const IndexBufferComponent& indexBufferComponent = componentManager.GetComponent<IndexBufferComponent>(entityCollected);
-            const UpdateComponent& updateComponent = componentManager.GetComponent<UpdateComponent>(entityCollected);
-
-            vkCmdBindDescriptorSets(
-                _frameInfo.CommandBuffer,
-                VK_PIPELINE_BIND_POINT_GRAPHICS,
-                m_pipelineLayout,
-                m_entitySetIndex,
-                1,
-                &_frameInfo.EntityDescriptorSet,
-                1,
-                &dynamicOffsetComponent.DynamicOffset
-            );
+            const ecs::Entity firstEntity = entityManager.GetEntity(static_cast<uint16>(m_instanceCandidates[batchBegin].second));
+            const PBRMaterialComponent& materialComponent = componentManager.GetComponent<PBRMaterialComponent>(firstEntity);
+
+            InstancedBatch& batch = m_instancedBatches.emplace_back();
+            batch.EntityIndex = m_instanceCandidates[batchBegin].second;
+            batch.InstanceCount = instanceCount;
+            batch.BatchIndex = m_instanceBuffer->GetInstanceCount();
+            batch.FeatureMask = materialComponent.FeatureMask;
+            batch.IsAlphaTested = materialComponent.IsAlphaTested;
+
+            for (std::size_t i = batchBegin; i < batchEnd; ++i)
+            {
+                const ecs::Entity instanceEntity = entityManager.GetEntity(static_cast<uint16>(m_instanceCandidates[i].second));
+
+                InstanceData instanceData{};
+                FillInstanceData(componentManager, instanceEntity, instanceData);
+                m_instanceBuffer->Push(_frameInfo.FrameIndex, instanceData);
+
+                batch.ViewDepth = std::min(batch.ViewDepth, ComputeViewDepth(componentManager, instanceEntity));
 
-            const VkCullModeFlags cullMode = materialComponent.IsDoubleSided ? VK_CULL_MODE_NONE : VK_CULL_MODE_BACK_BIT;
-            const VkFrontFace frontFace = updateComponent.IsMirrored ? VK_FRONT_FACE_CLOCKWISE : VK_FRONT_FACE_COUNTER_CLOCKWISE;
+                m_instancedEntities[m_instanceCandidates[i].second] = 1;
+            }
+        }
 
-            //if (vkCmdSetCullModeEXT && vkCmdSetFrontFaceEXT)  // no need, we do throw and exception if not supported
+        batchBegin = batchEnd;
+    }
+
+    SortInstancedBatches();
+}
+
+void PBROpaqueRenderSystem::SortInstancedBatches()
+{
+    // the alpha tested batches last, they need their own pipeline, then by the nearest instance
+    std::sort(m_instancedBatches.begin(), m_instancedBatches.end(),
+        [](const InstancedBatch& _a, const InstancedBatch& _b)
+        {
+            if (_a.IsAlphaTested != _b.IsAlphaTested)
             {
-                vkCmdSetCullModeEXT(_frameInfo.CommandBuffer, cullMode);
-                vkCmdSetFrontFaceEXT(_frameInfo.CommandBuffer, frontFace);
+                return !_a.IsAlphaTested;
             }
+            return _a.ViewDepth < _b.ViewDepth;
+        });
+}
 
-            PerEntityRender(_frameInfo, componentManager, entityCollected);
+void PBROpaqueRenderSystem::SortGPUDrivenBatches()
+{
+    // no front to back between the batches, the depth prepass already takes care of the overdraw
+    m_gpuDrivenBatchOrder.resize(m_gpuDrivenBatches.size());
+    for (uint32 i = 0; i < static_cast<uint32>(m_gpuDrivenBatchOrder.size()); ++i)
+    {
+        m_gpuDrivenBatchOrder[i] = i;
+    }
 
-            Bind(vertexBufferComponent, indexBufferComponent, _frameInfo.CommandBuffer);
-            Draw(indexBufferComponent, _frameInfo.CommandBuffer);
+    std::sort(m_gpuDrivenBatchOrder.begin(), m_gpuDrivenBatchOrder.end(),
+        [this](uint32 _a, uint32 _b)
+        {
+            const InstancedBatch& batchA = m_gpuDrivenBatches[_a];
+            const InstancedBatch& batchB = m_gpuDrivenBatches[_b];
+            if (batchA.IsAlphaTested != batchB.IsAlphaTested)
+            {
+                return !batchA.IsAlphaTested;
+            }
+            if (batchA.FeatureMask != batchB.FeatureMask)
+            {
+                return batchA.FeatureMask < batchB.FeatureMask;
+            }
+            return _a < _b;
+        });
+
+    m_isGPUDrivenBatchOrderDirty = false;
+}
+
+void PBROpaqueRenderSystem::CollectEntityDraws(const FrameInfo& _frameInfo)
+{
+    assertMsgReturnVoid(_frameInfo.RenderPackets != nullptr, "The render packets must be extracted before recording");
+    m_packets = _frameInfo.RenderPackets->GetRange(RenderPacketPipeline::PBROpaque);
+
+    // indexed and not indexed entities in the same list, the prepass orders all of them front to back
+    m_drawSorter.Clear();
+    for (uint32 i = 0; i < m_packets.Count; ++i)
+    {
+        const RenderPacket& packet = m_packets[i];
+        if (m_instancedEntities[packet.EntityIndex])
+        {
+            continue;
         }
+
+        m_drawSorter.Add(packet.ViewDepth, i, packet.MaterialIndex, packet.SortFlags);
+    }
+
+    m_drawSorter.SortFrontToBack();
+}
+
+void PBROpaqueRenderSystem::RenderInstanced(const FrameInfo& _frameInfo, bool _isDepthPrepass)
+{
+    if (m_instancedBatches.empty())
+    {
+        return;
     }
 
-    entitiesGroupedAndCollected.clear();
+    ecs::EntityManager& entityManager = m_app.GetEntityManager();
+    ecs::ComponentManager& componentManager = m_app.GetComponentManager();
 
-    entitiesGroupedAndCollected = ecs::EntityCollector::CollectAndGroupEntitiesWithAllByField<PBRMaterialComponent, PipelineOpaqueComponent, DynamicOffsetComponent, VertexBufferComponent, NotIndexBufferComponent, VisibilityComponent, UpdateComponent>(entityManager, componentManager, &PBRMaterialComponent::Index);
+    // filled by the CPU or by the culling, the same set for every batch
+    const VkDescriptorSet instanceDescriptorSet = m_instanceBuffer->GetDescriptorSet(_frameInfo.FrameIndex);
+    m_commandRecorder.BindDescriptorSet(
+        _frameInfo.CommandBuffer,
+        VK_PIPELINE_BIND_POINT_GRAPHICS,
+        m_pipelineLayout,
+        m_instanceSetIndex,
+        instanceDescriptorSet
+    );
 
-    for (const auto& [key, entities] : entitiesGroupedAndCollected)
+    for (const InstancedBatch& batch : m_instancedBatches)
     {
-        const PBRMaterialComponent& materialComponent = componentManager.GetComponent<PBRMaterialComponent>(entities[0]);
+        // the depth of the alpha tested ones is known only after the discard of the fragment stage
+        if (_isDepthPrepass && batch.IsAlphaTested)
+        {
+            continue;
+        }
 
-        vkCmdBindDescriptorSets(
-            _frameInfo.CommandBuffer,
-            VK_PIPELINE_BIND_POINT_GRAPHICS,
-            m_pipelineLayout,
-            m_materialSetIndex,
-            1,
-            &materialComponent.BoundDescriptorSet[_frameInfo.FrameIndex],
-            0,
-            nullptr
-        );
+        m_commandRecorder.BindPipeline(_frameInfo.CommandBuffer, SelectPipeline(true, _isDepthPrepass, batch.IsAlphaTested, batch.FeatureMask));
+
+        const ecs::Entity batchEntity = entityManager.GetEntity(static_cast<uint16>(batch.EntityIndex));
 
-        for (const auto& entityCollected : entities)
+        const PBRMaterialComponent& materialComponent = componentManager.GetComponent<PBRMaterialComponent>(batchEntity);
+        const VertexBufferComponent& vertexBufferComponent = componentManager.GetComponent<VertexBufferComponent>(batchEntity);
+        const UpdateComponent& updateComponent = componentManager.GetComponent<UpdateComponent>(batchEntity);
+
+        // no fragment stage in the prepass, no material to bind
+        if (!_isDepthPrepass)
         {
-            const DynamicOffsetComponent& dynamicOffsetComponent = componentManager.GetComponent<DynamicOffsetComponent>(entityCollected);
-            const VertexBufferComponent& vertexBufferComponent = componentManager.GetComponent<VertexBufferComponent>(entityCollected);
-            const UpdateComponent& updateComponent = componentManager.GetComponent<UpdateComponent>(entityCollected);
-
-            std::cout << "Entity " << entityCollected.GetIndex() << " det: " << glm::determinant(updateComponent.ModelMatrix) << "\n";
-
-            vkCmdBindDescriptorSets(
-                _frameInfo.CommandBuffer,
-                VK_PIPELINE_BIND_POINT_GRAPHICS,
-                m_pipelineLayout,
-                m_entitySetIndex,
-                1,
-                &_frameInfo.EntityDescriptorSet,
-                1,
-                &dynamicOffsetComponent.DynamicOffset
-            );
+            BindMaterial(_frameInfo, materialComponent.Index, materialComponent.BoundDescriptorSet[_frameInfo.FrameIndex]);
+        }
 
-            const VkCullModeFlags cullMode = materialComponent.IsDoubleSided ? VK_CULL_MODE_NONE : VK_CULL_MODE_BACK_BIT;
-            const VkFrontFace frontFace = updateComponent.IsMirrored ? VK_FRONT_FACE_CLOCKWISE :  VK_FRONT_FACE_COUNTER_CLOCKWISE;
+        const VkCullModeFlags cullMode = materialComponent.IsDoubleSided ? VK_CULL_MODE_NONE : VK_CULL_MODE_BACK_BIT;
+        const VkFrontFace frontFace = updateComponent.IsMirrored ? VK_FRONT_FACE_CLOCKWISE : VK_FRONT_FACE_COUNTER_CLOCKWISE;
 
-			//if (vkCmdSetCullModeEXT && vkCmdSetFrontFaceEXT)  // no need, we do throw and exception if not supported
-            {
-                vkCmdSetCullModeEXT(_frameInfo.CommandBuffer, cullMode);
-                vkCmdSetFrontFaceEXT(_frameInfo.CommandBuffer, frontFace);
-            }
+        m_commandRecorder.SetCullMode(_frameInfo.CommandBuffer, cullMode);
+        m_commandRecorder.SetFrontFace(_frameInfo.CommandBuffer, frontFace);
 
-            PerEntityRender(_frameInfo, componentManager, entityCollected);
+        if (m_isGPUDrivenFrame)
+        {
+            const IndexBufferComponent& indexBufferComponent = componentManager.GetComponent<IndexBufferComponent>(batchEntity);
 
+            Bind(vertexBufferComponent, indexBufferComponent, _frameInfo.CommandBuffer);
+            m_gpuCullingSystem->DrawBatch(_frameInfo, batch.BatchIndex);
+        }
+        else if (componentManager.HasComponents<IndexBufferComponent>(batchEntity))
+        {
+            const IndexBufferComponent& indexBufferComponent = componentManager.GetComponent<IndexBufferComponent>(batchEntity);
+
+            Bind(vertexBufferComponent, indexBufferComponent, _frameInfo.CommandBuffer);
+            Draw(indexBufferComponent, _frameInfo.CommandBuffer, batch.InstanceCount, batch.BatchIndex);
+        }
+        else
+        {
             Bind(vertexBufferComponent, _frameInfo.CommandBuffer);
-            Draw(vertexBufferComponent, _frameInfo.CommandBuffer);
+            Draw(vertexBufferComponent, _frameInfo.CommandBuffer, batch.InstanceCount, batch.BatchIndex);
+        }
+    }
+}
+
+void PBROpaqueRenderSystem::RenderEntities(const FrameInfo& _frameInfo, bool _isDepthPrepass)
+{
+    ecs::EntityManager& entityManager = m_app.GetEntityManager();
+    ecs::ComponentManager& componentManager = m_app.GetComponentManager();
+
+    bool isMaterialBound = false;
+    int32 boundMaterialIndex = -1;
+
+    for (const DrawSortEntry& entry : m_drawSorter.GetEntries())
+    {
+        const bool isAlphaTested = (entry.Flags & DrawSorter::kFlagAlphaTested) != 0;
+        if (_isDepthPrepass && isAlphaTested)
+        {
+            continue;
+        }
+
+        const uint32 featureMask = entry.Flags >> DrawSorter::kFlagPermutationShift;
+        m_commandRecorder.BindPipeline(_frameInfo.CommandBuffer, SelectPipeline(false, _isDepthPrepass, isAlphaTested, featureMask));
+
+        const RenderPacket& packet = m_packets[entry.PacketIndex];
+
+        if (!_isDepthPrepass && (!isMaterialBound || entry.MaterialIndex != boundMaterialIndex))
+        {
+            BindMaterial(_frameInfo, packet.MaterialIndex, packet.MaterialDescriptorSet);
+
+            isMaterialBound = true;
+            boundMaterialIndex = entry.MaterialIndex;
+        }
+
+        const uint32 firstInstance = BindEntity(_frameInfo, m_entitySetIndex, packet);
+
+        const VkCullModeFlags cullMode = packet.IsDoubleSided ? VK_CULL_MODE_NONE : VK_CULL_MODE_BACK_BIT;
+        const VkFrontFace frontFace = packet.IsMirrored ? VK_FRONT_FACE_CLOCKWISE : VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+        m_commandRecorder.SetCullMode(_frameInfo.CommandBuffer, cullMode);
+        m_commandRecorder.SetFrontFace(_frameInfo.CommandBuffer, frontFace);
+
+        PerEntityRender(_frameInfo, componentManager, entityManager.GetEntity(static_cast<uint16>(packet.EntityIndex)));
+
+        Bind(packet, _frameInfo.CommandBuffer);
+        Draw(packet, _frameInfo.CommandBuffer, 1, firstInstance);
+    }
+}
+
+const Pipeline& PBROpaqueRenderSystem::SelectPipeline(bool _isInstanced, bool _isDepthPrepass, bool _isAlphaTested, uint32 _featureMask) const
+{
+    if (_isDepthPrepass)
+    {
+        return _isInstanced ? *m_instancedDepthPrepassPipeline : *m_depthPrepassPipeline;
+    }
+
+    // a permutation already has the depth state of its alpha test
+    if (m_useMaterialPermutations)
+    {
+        auto it = m_permutations.find(_featureMask);
+        if (it != m_permutations.end())
+        {
+            return _isInstanced ? *it->second.InstancedPipeline : *it->second.EntityPipeline;
         }
     }
 
-    entitiesGroupedAndCollected.clear();
+    // without the prepass there are no alpha tested pipelines: the shading ones already test LESS and write the depth
+    if (_isAlphaTested && m_alphaTestedPipeline)
+    {
+        return _isInstanced ? *m_instancedAlphaTestedPipeline : *m_alphaTestedPipeline;
+    }
+
+    return _isInstanced ? *m_instancedPipeline : *m_pipeline;
+}
+
+float PBROpaqueRenderSystem::ComputeViewDepth(ecs::ComponentManager& _componentManager, const ecs::Entity& _entity) const
+{
+    const UpdateComponent& updateComponent = _componentManager.GetComponent<UpdateComponent>(_entity);
+    const glm::mat4 viewModel = m_viewMatrix * updateComponent.ModelMatrix;
+
+    if (_componentManager.HasComponents<BoundsComponent>(_entity))
+    {
+        const BoundsComponent& boundsComponent = _componentManager.GetComponent<BoundsComponent>(_entity);
+        return DrawSorter::ComputeViewDepth(viewModel, boundsComponent.Min, boundsComponent.Max, false);
+    }
+
+    return viewModel[3].z;
+}
+
+void PBROpaqueRenderSystem::PreparePermutation(uint32 _featureMask)
+{
+    if (!m_useMaterialPermutations || m_permutations.find(_featureMask) != m_permutations.end())
+    {
+        return;
+    }
+
+    // the alpha tested materials are not in the depth prepass, they test and write the depth as if there were none
+    const bool isAlphaTested = (_featureMask & kPBRFeatureAlphaTest) != 0;
+
+    PipelineConfigInfo pipelineConfig{};
+
+    if (m_app.GetConfig().EnableDepthPrepass && !isAlphaTested)
+    {
+        Pipeline::DepthEqualOpaquePipelineConfiguration(pipelineConfig);
+    }
+    else
+    {
+        Pipeline::OpaquePipelineConfiguration(pipelineConfig);
+    }
+
+    pipelineConfig.RenderPass = m_renderPass;
+    pipelineConfig.PipelineLayout = m_pipelineLayout;
+
+    ShaderInfo vertexShader(m_vertexShaderFilepath, ShaderType::Vertex);
+    ShaderInfo instancedVertexShader(m_instancedVertexShaderFilepath, ShaderType::Vertex);
+    ShaderInfo fragmentShader(m_fragmentShaderFilepath, ShaderType::Fragment);
+
+    fragmentShader.AddSpecializationConstant(kMaterialFeaturesConstantID, _featureMask);
+
+    PipelinePermutation& permutation = m_permutations[_featureMask];
+
+    permutation.EntityPipeline = std::make_unique<Pipeline>(
+        m_device,
+        std::vector{
+                vertexShader,
+                fragmentShader,
+        },
+        pipelineConfig
+        );
+
+    permutation.InstancedPipeline = std::make_unique<Pipeline>(
+        m_device,
+        std::vector{
+                instancedVertexShader,
+                fragmentShader,
+        },
+        pipelineConfig
+        );
 }
 
 void PBROpaqueRenderSystem::CreatePipeline(VkRenderPass _renderPass)
 {
     assertMsgReturnVoid(m_pipelineLayout != nullptr, "Cannot create pipeline before pipeline layout");
 
+    // with the depth prepass the shading only tests EQUAL against the depth already laid down
+    const bool useDepthPrepass = m_app.GetConfig().EnableDepthPrepass;
+
     PipelineConfigInfo pipelineConfig{};
 
-    Pipeline::OpaquePipelineConfiguration(pipelineConfig);
+    if (useDepthPrepass)
+    {
+        Pipeline::DepthEqualOpaquePipelineConfiguration(pipelineConfig);
+    }
+    else
+    {
+        Pipeline::OpaquePipelineConfiguration(pipelineConfig);
+    }
 
     pipelineConfig.RenderPass = _renderPass;
     pipelineConfig.PipelineLayout = m_pipelineLayout;
 
+    // with the entity storage buffer the vertex stage reads the entity data indexed by the draw firstInstance
+    const std::string vertexShaderName = m_app.GetConfig().UseEntityStorageBuffer ? "entity_storage_shader" : "pbr_shader";
     const std::string vertexShaderFilepath = m_device.IsBindlessResourcesSupported()
-        ? m_app.GetConfig().ShadersPath + "pbr_shader_bindless1.vert.spv"
-        : m_app.GetConfig().ShadersPath + "pbr_shader_bindless0.vert.spv";
+        ? m_app.GetConfig().ShadersPath + vertexShaderName + "_bindless1.vert.spv"
+        : m_app.GetConfig().ShadersPath + vertexShaderName + "_bindless0.vert.spv";
 
     ShaderInfo vertexShader(
         vertexShaderFilepath,
@@ -307,6 +710,13 @@ void PBROpaqueRenderSystem::CreatePipeline(VkRenderPass _renderPass)
 
     //fragmentShader.AddSpecializationConstant(0, 2.0f);
 
+    // what the permutations are created from, by MaterialBinding once the materials are loaded
+    m_useMaterialPermutations = m_app.GetConfig().EnableMaterialPermutations;
+    m_renderPass = _renderPass;
+    m_vertexShaderFilepath = vertexShaderFilepath;
+    m_fragmentShaderFilepath = fragmentShaderFilepath;
+    m_permutations.clear();
+
     m_pipeline = std::make_unique<Pipeline>(
         m_device,
         std::vector{
@@ -315,14 +725,115 @@ void PBROpaqueRenderSystem::CreatePipeline(VkRenderPass _renderPass)
         },
         pipelineConfig
         );
+
+    // same fragment stage, the vertex stage reads the entity data from the instance buffer
+    const std::string instancedVertexShaderFilepath = m_device.IsBindlessResourcesSupported()
+        ? m_app.GetConfig().ShadersPath + "instanced_shader_bindless1.vert.spv"
+        : m_app.GetConfig().ShadersPath + "instanced_shader_bindless0.vert.spv";
+
+    ShaderInfo instancedVertexShader(
+        instancedVertexShaderFilepath,
+        ShaderType::Vertex
+    );
+
+    m_instancedVertexShaderFilepath = instancedVertexShaderFilepath;
+
+    m_instancedPipeline = std::make_unique<Pipeline>(
+        m_device,
+        std::vector{
+                instancedVertexShader,
+                fragmentShader,
+        },
+        pipelineConfig
+        );
+
+    if (useDepthPrepass)
+    {
+        // same vertex stages, no fragment one
+        PipelineConfigInfo depthPrepassPipelineConfig{};
+
+        Pipeline::DepthPrepassPipelineConfiguration(depthPrepassPipelineConfig);
+
+        depthPrepassPipelineConfig.RenderPass = _renderPass;
+        depthPrepassPipelineConfig.PipelineLayout = m_pipelineLayout;
+
+        m_depthPrepassPipeline = std::make_unique<Pipeline>(
+            m_device,
+            std::vector{
+                    vertexShader,
+            },
+            depthPrepassPipelineConfig
+            );
+
+        m_instancedDepthPrepassPipeline = std::make_unique<Pipeline>(
+            m_device,
+            std::vector{
+                    instancedVertexShader,
+            },
+            depthPrepassPipelineConfig
+            );
+
+        // the alpha tested entities are not in the prepass, they test and write the depth as if there were none
+        PipelineConfigInfo alphaTestedPipelineConfig{};
+
+        Pipeline::OpaquePipelineConfiguration(alphaTestedPipelineConfig);
+
+        alphaTestedPipelineConfig.RenderPass = _renderPass;
+        alphaTestedPipelineConfig.PipelineLayout = m_pipelineLayout;
+
+        m_alphaTestedPipeline = std::make_unique<Pipeline>(
+            m_device,
+            std::vector{
+                    vertexShader,
+                    fragmentShader,
+            },
+            alphaTestedPipelineConfig
+            );
+
+        m_instancedAlphaTestedPipeline = std::make_unique<Pipeline>(
+            m_device,
+            std::vector{
+                    instancedVertexShader,
+                    fragmentShader,
+            },
+            alphaTestedPipelineConfig
+            );
+    }
+
+    if (m_gpuCullingSystem)
+    {
+        m_gpuCullingSystem->CreatePipeline();
+    }
+
+    // called again, i.e. after the shaders are reloaded, the permutations already needed are created again as well
+    std::vector<uint32> featureMasks;
+    featureMasks.reserve(m_permutations.size());
+    for (const auto& [featureMask, permutation] : m_permutations)
+    {
+        featureMasks.push_back(featureMask);
+    }
+
+    m_permutations.clear();
+    for (const uint32 featureMask : featureMasks)
+    {
+        PreparePermutation(featureMask);
+    }
 }
 
 void PBROpaqueRenderSystem::Cleanup()
 {
-    for (int32 i = 0; i < m_bindlessBindingMaterialIndexUbos.size(); ++i)
+    m_materialDescriptorSets.clear();
+
+    m_instanceBuffer->Cleanup();
+
+    if (m_gpuCullingSystem)
     {
-        m_buffer->Destroy(m_bindlessBindingMaterialIndexUbos[i]);
+        m_gpuCullingSystem->Cleanup();
     }
+
+    m_gpuDrivenBatches.clear();
+    m_gpuDrivenBatchOrder.clear();
+    m_isGPUDrivenBatchOrderDirty = false;
 }
 
 VESPERENGINE_NAMESPACE_END
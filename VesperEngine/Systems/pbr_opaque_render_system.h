@@ -5,11 +5,19 @@
 #pragma once
 
 #include "Core/core_defines.h"
+#include "Core/glm_config.h"
 #include "Systems/base_render_system.h"
+#include "Components/graphics_components.h"
+#include "Backend/render_packet.h"
+#include "Utility/draw_sorter.h"
 #include "vulkan/vulkan.h"
 
 #include <memory>
 #include <vector>
+#include <utility>
+#include <limits>
+#include <string>
+#include <unordered_map>
 
 VESPERENGINE_NAMESPACE_BEGIN
 
@@ -18,10 +26,12 @@ class Device;
 class Renderer;
 class Pipeline;
 class DescriptorSetLayout;
-class Buffer;
+class InstanceBuffer;
+class GPUCullingSystem;
 
 struct FrameInfo;
-struct BufferComponent;
+struct DescriptorTemplateEntry;
+struct CameraComponent;
 
 class VESPERENGINE_API PBROpaqueRenderSystem : public BaseRenderSystem
 {
@@ -35,7 +45,27 @@ public:
     static constexpr uint32 kPBRAOTextureBindingIndex = 6u;
     static constexpr uint32 kPBRUniformBufferBindingIndex = 7u;
 
-    static constexpr uint32 kPBRUniformBufferOnlyBindingIndex = 0u;
+    // the resources of a material set in the order of its bindings above, written with one call through the update template of the layout
+    struct PBRMaterialDescriptorData
+    {
+        VkDescriptorImageInfo RoughnessImageInfo;
+        VkDescriptorImageInfo MetallicImageInfo;
+        VkDescriptorImageInfo SheenImageInfo;
+        VkDescriptorImageInfo EmissiveImageInfo;
+        VkDescriptorImageInfo NormalImageInfo;
+        VkDescriptorImageInfo BaseColorImageInfo;
+        VkDescriptorImageInfo AOImageInfo;
+        VkDescriptorBufferInfo UniformBufferInfo;
+    };
+
+    // where the bindings are in PBRMaterialDescriptorData, the layout of the transparent system uses them as well
+    static std::vector<DescriptorTemplateEntry> GetMaterialTemplateEntries();
+
+    // below this count the entities sharing geometry and material are drawn one by one
+    static constexpr uint32 kMinInstanceCount = 2u;
+
+    // kMaterialFeatures of pbr_shader.frag
+    static constexpr uint32 kMaterialFeaturesConstantID = 1u;
 
 public:
     PBROpaqueRenderSystem(VesperApp& _app, Device& _device, Renderer& _renderer,
@@ -47,25 +77,101 @@ public:
     PBROpaqueRenderSystem(const PBROpaqueRenderSystem&) = delete;
     PBROpaqueRenderSystem& operator=(const PBROpaqueRenderSystem&) = delete;
 
+public:
+    // PrepareDraws writes the indirect draws with a compute dispatch
+    VESPERENGINE_INLINE bool IsGPUDriven() const { return m_gpuCullingSystem != nullptr; }
+
 public:
     virtual void CreatePipeline(VkRenderPass _renderPass);
+    // Call after CreatePipeline, once the materials are loaded: it binds them and creates the permutations of their feature masks
     void MaterialBinding();
     virtual void Update(const FrameInfo& _frameInfo);
+    // Call every frame after the entities are uploaded and before the render pass begins: it takes the view the draws are sorted by
+    // and, with GPU driven rendering, records the culling dispatch
+    void PrepareDraws(const FrameInfo& _frameInfo, const CameraComponent& _cameraComponent);
     virtual void Render(const FrameInfo& _frameInfo);
     void Cleanup();
 
+protected:
+    // the entities sharing geometry, material and winding, drawn with a single instanced draw
+    struct InstancedBatch
+    {
+        float ViewDepth{ std::numeric_limits<float>::max() };  // of the nearest instance
+        uint32 EntityIndex{ 0 };        // an entity of the batch, to bind geometry and material
+        uint32 BatchIndex{ 0 };         // in the GPU culling on a GPU driven frame, otherwise the first instance in the instance buffer
+        uint32 InstanceCount{ 0 };
+        uint32 FeatureMask{ kPBRFeatureAll };
+        bool IsAlphaTested{ false };
+    };
+
+    // shading pipelines specialized on the kPBRFeature bits of a material
+    struct PipelinePermutation
+    {
+        std::unique_ptr<Pipeline> EntityPipeline;
+        std::unique_ptr<Pipeline> InstancedPipeline;
+    };
+
+    // Fill the instance buffer with the visible entities sharing geometry, material and winding, marking them in m_instancedEntities.
+    // PerEntityRender is not called for them, derived systems relying on it should set m_allowInstancing to false
+    void PrepareInstancedBatches(const FrameInfo& _frameInfo);
+    void SortInstancedBatches();
+    // the resident GPU driven batches by pipeline, the alpha tested last. Only when one is added
+    void SortGPUDrivenBatches();
+    // the packets of the visible entities not instanced, front to back
+    void CollectEntityDraws(const FrameInfo& _frameInfo);
+    // Draw the batches, one instanced draw each or, on a GPU driven frame, one indirect count draw each
+    void RenderInstanced(const FrameInfo& _frameInfo, bool _isDepthPrepass);
+    void RenderEntities(const FrameInfo& _frameInfo, bool _isDepthPrepass);
+    const Pipeline& SelectPipeline(bool _isInstanced, bool _isDepthPrepass, bool _isAlphaTested, uint32 _featureMask) const;
+    // the material set of _materialComponent with its resources, only without bindless
+    VkDescriptorSet BuildMaterialDescriptorSet(PBRMaterialComponent& _materialComponent);
+    // with bindless push the index of the material in the bindless arrays, otherwise bind its set
+    void BindMaterial(const FrameInfo& _frameInfo, int32 _materialIndex, VkDescriptorSet _materialSet);
+    // create the permutation of _featureMask if it is not cached yet. Only at load time, SelectPipeline falls back on the base pipelines
+    void PreparePermutation(uint32 _featureMask);
+    float ComputeViewDepth(ecs::ComponentManager& _componentManager, const ecs::Entity& _entity) const;
+
 protected:
     VesperApp& m_app;
     Renderer& m_renderer;
     std::unique_ptr<Pipeline> m_pipeline;
+    std::unique_ptr<Pipeline> m_instancedPipeline;
+    // only with the depth prepass, the shading pipelines above then test EQUAL and do not write the depth
+    std::unique_ptr<Pipeline> m_depthPrepassPipeline;
+    std::unique_ptr<Pipeline> m_instancedDepthPrepassPipeline;
+    std::unique_ptr<Pipeline> m_alphaTestedPipeline;
+    std::unique_ptr<Pipeline> m_instancedAlphaTestedPipeline;
+    // only with the material permutations, the pipelines above are used by the draws of a permutation not created
+    std::unordered_map<uint32, PipelinePermutation> m_permutations;
+    VkRenderPass m_renderPass{ VK_NULL_HANDLE };
+    std::string m_vertexShaderFilepath;
+    std::string m_instancedVertexShaderFilepath;
+    std::string m_fragmentShaderFilepath;
     std::unique_ptr<DescriptorSetLayout> m_materialSetLayout;
 
-    std::unique_ptr<Buffer> m_buffer;
+    std::unordered_map<int32, VkDescriptorSet> m_materialDescriptorSets; // by material index, shared by its entities
+
+    std::unique_ptr<InstanceBuffer> m_instanceBuffer;
+    std::vector<std::pair<uint64, uint32>> m_instanceCandidates;    // batch key, entity index
+    std::vector<uint8> m_instancedEntities;                          // per entity index, 1 if already drawn instanced this frame
+
+    std::vector<InstancedBatch> m_instancedBatches;                 // of the frame, the alpha tested last then front to back
+    std::vector<InstancedBatch> m_gpuDrivenBatches;                 // resident, by batch index of the GPU culling
+    std::vector<uint32> m_gpuDrivenBatchOrder;                       // batch indices in drawing order
+
+    std::unique_ptr<GPUCullingSystem> m_gpuCullingSystem;           // only when the device supports the indirect count draws
 
-    std::vector<BufferComponent> m_bindlessBindingMaterialIndexUbos;
+    DrawSorter m_drawSorter;                                         // the entities drawn one by one
+    RenderPacketRange m_packets;                                     // of this frame, what the draw sorter entries point to
+    glm::mat4 m_viewMatrix{ 1.0f };
 
     uint32 m_entitySetIndex = 1;
     uint32 m_materialSetIndex = 2;
+    uint32 m_instanceSetIndex = 3;
+    bool m_allowInstancing = true;
+    bool m_isGPUDrivenFrame = false;
+    bool m_isGPUDrivenBatchOrderDirty = false;
+    bool m_useMaterialPermutations = false;
 };
 
 VESPERENGINE_NAMESPACE_END
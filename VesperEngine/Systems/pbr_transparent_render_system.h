@@ -6,10 +6,12 @@
 
 #include "Core/core_defines.h"
 #include "Systems/base_render_system.h"
+#include "Utility/draw_sorter.h"
 #include "vulkan/vulkan.h"
 
 #include <memory>
 #include <vector>
+#include <unordered_map>
 
 VESPERENGINE_NAMESPACE_BEGIN
 
@@ -18,10 +20,9 @@ class Device;
 class Renderer;
 class Pipeline;
 class DescriptorSetLayout;
-class Buffer;
 
 struct FrameInfo;
-struct BufferComponent;
+struct PBRMaterialComponent;
 
 class VESPERENGINE_API PBRTransparentRenderSystem : public BaseRenderSystem
 {
@@ -35,7 +36,7 @@ public:
     static constexpr uint32 kPBRAOTextureBindingIndex = 6u;
     static constexpr uint32 kPBRUniformBufferBindingIndex = 7u;
 
-    static constexpr uint32 kPBRUniformBufferOnlyBindingIndex = 0u;
+    static constexpr uint32 kWeightedBlendedOITConstantID = 0u;
 
 public:
     PBRTransparentRenderSystem(VesperApp& _app, Device& _device, Renderer& _renderer,
@@ -54,15 +55,21 @@ public:
     virtual void Render(const FrameInfo& _frameInfo);
     void Cleanup();
 
+protected:
+    // the material set of _materialComponent with its resources, only without bindless
+    VkDescriptorSet BuildMaterialDescriptorSet(PBRMaterialComponent& _materialComponent);
+    // with bindless push the index of the material in the bindless arrays, otherwise bind its set
+    void BindMaterial(const FrameInfo& _frameInfo, int32 _materialIndex, VkDescriptorSet _materialSet);
+
 protected:
     VesperApp& m_app;
     Renderer& m_renderer;
     std::unique_ptr<Pipeline> m_pipeline;
     std::unique_ptr<DescriptorSetLayout> m_materialSetLayout;
 
-    std::unique_ptr<Buffer> m_buffer;
+    std::unordered_map<int32, VkDescriptorSet> m_materialDescriptorSets; // by material index, shared by its entities
 
-    std::vector<BufferComponent> m_bindlessBindingMaterialIndexUbos;
+    DrawSorter m_drawSorter;
 
     uint32 m_entitySetIndex = 1;
     uint32 m_materialSetIndex = 2;
@@ -10,9 +10,10 @@
 #include "Backend/frame_info.h"
 #include "Backend/descriptors.h"
 #include "Backend/renderer.h"
+#include "Backend/render_packet.h"
 
-#include "Backend/buffer.h"
 #include "Backend/swap_chain.h"
+#include "Backend/instance_buffer.h"
 
 #include "Components/graphics_components.h"
 #include "Components/object_components.h"
@@ -26,12 +27,13 @@
 #include "ECS/ECS/ecs.h"
 
 #include <array>
+#include <algorithm>
 #include <stdexcept>
+#include <cstddef>
 
 
 VESPERENGINE_NAMESPACE_BEGIN
 
-
 PhongOpaqueRenderSystem::PhongOpaqueRenderSystem(VesperApp& _app, Device& _device, Renderer& _renderer,
         VkDescriptorSetLayout _globalDescriptorSetLayout,
         VkDescriptorSetLayout _entityDescriptorSetLayout,
@@ -40,7 +42,11 @@ PhongOpaqueRenderSystem::PhongOpaqueRenderSystem(VesperApp& _app, Device& _devic
         , m_app(_app)
         , m_renderer(_renderer)
 {
-    m_buffer = std::make_unique<Buffer>(m_device);
+	m_instanceBuffer = std::make_unique<InstanceBuffer>(m_device, m_renderer, m_app.GetConfig().MaxEntities);
+
+	m_instanceCandidates.reserve(m_app.GetConfig().MaxEntities);
+	m_instancedEntities.resize(m_app.GetConfig().MaxEntities, 0);
+	m_drawSorter.Reserve(m_app.GetConfig().MaxEntities);
 
 	VkPushConstantRange defaultRange{};
 	defaultRange.stageFlags = VK_SHADER_STAGE_ALL;
@@ -48,14 +54,8 @@ PhongOpaqueRenderSystem::PhongOpaqueRenderSystem(VesperApp& _app, Device& _devic
 	defaultRange.size = VESPERENGINE_PUSHCONSTANT_DEFAULTRANGE;
 	m_pushConstants.push_back(defaultRange);
 
-	if (m_device.IsBindlessResourcesSupported())
-	{
-		// in this case is just for the indices!
-		m_materialSetLayout = DescriptorSetLayout::Builder(_device)
-			.AddBinding(kPhongUniformBufferOnlyBindingIndex, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT)
-			.Build();
-	}
-	else
+	// with bindless the material is read from the bindless arrays at the index pushed with the draws, there is no material set
+	if (!m_device.IsBindlessResourcesSupported())
 	{
 		m_materialSetLayout = DescriptorSetLayout::Builder(_device)
 			.AddBinding(kPhongAmbientTextureBindingIndex, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT)
@@ -64,6 +64,7 @@ PhongOpaqueRenderSystem::PhongOpaqueRenderSystem(VesperApp& _app, Device& _devic
 			.AddBinding(kPhongNormalTextureBindingIndex, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT)
 			.AddBinding(kPhongAlphaTextureBindingIndex, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT)
 			.AddBinding(kPhongUniformBufferBindingIndex, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT)
+			.SetUpdateTemplate(GetMaterialTemplateEntries())
 			.Build();
 	}
 
@@ -71,24 +72,24 @@ PhongOpaqueRenderSystem::PhongOpaqueRenderSystem(VesperApp& _app, Device& _devic
 	// set 0: global descriptor set layout
 	// set 1: bindless textures and buffer descriptor set layout
 	// set 2: entity descriptor set layout
-	// set 3: material descriptor set layout
 	// OR
 	// set 0: global descriptor set layout
 	// set 1: entity descriptor set layout
 	// set 2: material descriptor set layout
+	// plus the instance set as last one
 	if (m_device.IsBindlessResourcesSupported())
 	{
 		m_entitySetIndex = 2;	// normally is 1
-		m_materialSetIndex = 3;	// normally is 2
+		m_instanceSetIndex = 3;	// the same, in place of the material set
 
 		CreatePipelineLayout(std::vector<VkDescriptorSetLayout>
-			{ _globalDescriptorSetLayout, _bindlessBindingDescriptorSetLayout, _entityDescriptorSetLayout, m_materialSetLayout->GetDescriptorSetLayout() }
+			{ _globalDescriptorSetLayout, _bindlessBindingDescriptorSetLayout, _entityDescriptorSetLayout, m_instanceBuffer->GetDescriptorSetLayout() }
 		);
 	}
 	else
 	{
 		CreatePipelineLayout(std::vector<VkDescriptorSetLayout>
-			{ _globalDescriptorSetLayout, _entityDescriptorSetLayout, m_materialSetLayout->GetDescriptorSetLayout() }
+			{ _globalDescriptorSetLayout, _entityDescriptorSetLayout, m_materialSetLayout->GetDescriptorSetLayout(), m_instanceBuffer->GetDescriptorSetLayout() }
 		);
 	}
 
@@ -100,59 +101,87 @@ void PhongOpaqueRenderSystem::MaterialBinding()
 	ecs::EntityManager& entityManager = m_app.GetEntityManager();
 	ecs::ComponentManager& componentManager = m_app.GetComponentManager();
 
+	const bool isBindless = m_device.IsBindlessResourcesSupported();
+
 	for (auto gameEntity : ecs::IterateEntitiesWithAll<PipelineOpaqueComponent, PhongMaterialComponent>(entityManager, componentManager))
 	{
 		PhongMaterialComponent& materialComponent = m_app.GetComponentManager().GetComponent<PhongMaterialComponent>(gameEntity);
-		materialComponent.BoundDescriptorSet.resize(SwapChain::kMaxFramesInFlight);
 
-		if (m_device.IsBindlessResourcesSupported())
+		// no set with bindless, BindMaterial pushes the material index
+		if (isBindless)
 		{
-			for (int32 i = 0; i < SwapChain::kMaxFramesInFlight; ++i)
-			{
-				m_bindlessBindingMaterialIndexUbos.emplace_back(m_buffer->Create<BufferComponent>(
-					sizeof(PhongBindlessMaterialIndexUBO),
-					1,
-					VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-					VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
-					VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT,
-					/*minUboAlignment*/1,
-					true
-				));
-
-				BufferComponent& currentBuffer = m_bindlessBindingMaterialIndexUbos.back();
-
-				PhongBindlessMaterialIndexUBO phongIndexUBO;
-				phongIndexUBO.MaterialIndex = materialComponent.Index;
-
-				currentBuffer.MappedMemory = &phongIndexUBO;
-				m_buffer->WriteToBuffer(currentBuffer);
-
-				VkDescriptorBufferInfo bufferInfo;
-				bufferInfo.buffer = currentBuffer.Buffer;
-				bufferInfo.offset = 0;
-				bufferInfo.range = currentBuffer.AlignedSize;
-
- 				DescriptorWriter(*m_materialSetLayout, *m_renderer.GetDescriptorPool())
- 					.WriteBuffer(kPhongUniformBufferOnlyBindingIndex, &bufferInfo)
- 					.Build(materialComponent.BoundDescriptorSet[i]);
-			}
+			materialComponent.BoundDescriptorSet.assign(SwapChain::kMaxFramesInFlight, VK_NULL_HANDLE);
+			continue;
+		}
+
+		// the set depends only on the material: built once, shared by all its entities and by all the frames in flight
+		VkDescriptorSet materialSet = VK_NULL_HANDLE;
+		if (materialComponent.Index < 0)
+		{
+			// not from the MaterialSystem, the resources are only of the entity
+			materialSet = BuildMaterialDescriptorSet(materialComponent);
 		}
 		else
 		{
-			for (int32 i = 0; i < SwapChain::kMaxFramesInFlight; ++i)
+			auto [materialSetIt, isNewMaterial] = m_materialDescriptorSets.try_emplace(materialComponent.Index, VK_NULL_HANDLE);
+			if (isNewMaterial)
 			{
-				DescriptorWriter(*m_materialSetLayout, *m_renderer.GetDescriptorPool())
-					.WriteImage(kPhongAmbientTextureBindingIndex, &materialComponent.AmbientImageInfo)
-					.WriteImage(kPhongDiffuseTextureBindingIndex, &materialComponent.DiffuseImageInfo)
-                    .WriteImage(kPhongSpecularTextureBindingIndex, &materialComponent.SpecularImageInfo)
-                    .WriteImage(kPhongNormalTextureBindingIndex, &materialComponent.NormalImageInfo)
-                    .WriteImage(kPhongAlphaTextureBindingIndex, &materialComponent.AlphaImageInfo)
-                    .WriteBuffer(kPhongUniformBufferBindingIndex, &materialComponent.UniformBufferInfo)
-                    .Build(materialComponent.BoundDescriptorSet[i]);
+				materialSetIt->second = BuildMaterialDescriptorSet(materialComponent);
 			}
+			materialSet = materialSetIt->second;
 		}
+
+		materialComponent.BoundDescriptorSet.assign(SwapChain::kMaxFramesInFlight, materialSet);
 	}
+}
 
+std::vector<DescriptorTemplateEntry> PhongOpaqueRenderSystem::GetMaterialTemplateEntries()
+{
+	return {
+		{ kPhongAmbientTextureBindingIndex, offsetof(PhongMaterialDescriptorData, AmbientImageInfo) },
+		{ kPhongDiffuseTextureBindingIndex, offsetof(PhongMaterialDescriptorData, DiffuseImageInfo) },
+		{ kPhongSpecularTextureBindingIndex, offsetof(PhongMaterialDescriptorData, SpecularImageInfo) },
+		{ kPhongNormalTextureBindingIndex, offsetof(PhongMaterialDescriptorData, NormalImageInfo) },
+		{ kPhongAlphaTextureBindingIndex, offsetof(PhongMaterialDescriptorData, AlphaImageInfo) },
+		{ kPhongUniformBufferBindingIndex, offsetof(PhongMaterialDescriptorData, UniformBufferInfo) }
+	};
+}
+
+VkDescriptorSet PhongOpaqueRenderSystem::BuildMaterialDescriptorSet(PhongMaterialComponent& _materialComponent)
+{
+	VkDescriptorSet materialSet = VK_NULL_HANDLE;
+
+	const PhongMaterialDescriptorData descriptorData{
+		_materialComponent.AmbientImageInfo,
+		_materialComponent.DiffuseImageInfo,
+		_materialComponent.SpecularImageInfo,
+		_materialComponent.NormalImageInfo,
+		_materialComponent.AlphaImageInfo,
+		_materialComponent.UniformBufferInfo
+	};
+
+	DescriptorWriter(*m_materialSetLayout, *m_renderer.GetDescriptorPool())
+		.BuildFromTemplate(materialSet, &descriptorData);
+
+	return materialSet;
+}
+
+void PhongOpaqueRenderSystem::BindMaterial(const FrameInfo& _frameInfo, int32 _materialIndex, VkDescriptorSet _materialSet)
+{
+	if (m_device.IsBindlessResourcesSupported())
+	{
+		PushConstants(_frameInfo.CommandBuffer, 0, VESPERENGINE_PUSHCONSTANT_MATERIALINDEX_OFFSET, sizeof(int32), &_materialIndex);
+	}
+	else
+	{
+		m_commandRecorder.BindDescriptorSet(
+			_frameInfo.CommandBuffer,
+			VK_PIPELINE_BIND_POINT_GRAPHICS,
+			m_pipelineLayout,
+			m_materialSetIndex,
+			_materialSet
+		);
+	}
 }
 
 void PhongOpaqueRenderSystem::Update(const FrameInfo& _frameInfo)
@@ -175,122 +204,166 @@ void PhongOpaqueRenderSystem::Update(const FrameInfo& _frameInfo)
 
 void PhongOpaqueRenderSystem::Render(const FrameInfo& _frameInfo)
 {
+	m_commandRecorder.Reset(_frameInfo.CommandBuffer);
+
+	std::fill(m_instancedEntities.begin(), m_instancedEntities.end(), static_cast<uint8>(0));
+
+	// 0. Render with one draw the entities sharing geometry and material
+	if (m_allowInstancing && m_instancedPipeline && m_app.GetConfig().EnableInstancing)
+	{
+		RenderInstanced(_frameInfo);
+	}
+
 	// this bind only the opaque pipeline
-	m_opaquePipeline->Bind(_frameInfo.CommandBuffer);
+	m_commandRecorder.BindPipeline(_frameInfo.CommandBuffer, *m_opaquePipeline);
 
 	ecs::EntityManager& entityManager = m_app.GetEntityManager();
 	ecs::ComponentManager& componentManager = m_app.GetComponentManager();
 
-	// 1. Render whatever has vertex buffers and index buffer
-    auto entitiesGroupedAndCollected = ecs::EntityCollector::CollectAndGroupEntitiesWithAllByField<PhongMaterialComponent, PipelineOpaqueComponent, DynamicOffsetComponent, VertexBufferComponent, IndexBufferComponent, VisibilityComponent, UpdateComponent>(entityManager, componentManager, &PhongMaterialComponent::Index);
+	assertMsgReturnVoid(_frameInfo.RenderPackets != nullptr, "The render packets must be extracted before recording");
+	const RenderPacketRange packets = _frameInfo.RenderPackets->GetRange(RenderPacketPipeline::PhongOpaque);
 
-	for (const auto& [key, entities] : entitiesGroupedAndCollected)
+	// 1. Group by material the entities not instanced, indexed or not, so every material is bound once
+	m_drawSorter.Clear();
+	for (uint32 i = 0; i < packets.Count; ++i)
 	{
-		// From the first one and only, we can the material and we bind it.
-		const PhongMaterialComponent& phongMaterialComponent = componentManager.GetComponent<PhongMaterialComponent>(entities[0]);
+		if (!m_instancedEntities[packets[i].EntityIndex])
+		{
+			m_drawSorter.Add(packets[i].ViewDepth, i, packets[i].MaterialIndex, packets[i].SortFlags);
+		}
+	}
 
-		vkCmdBindDescriptorSets(
-			_frameInfo.CommandBuffer,
-			VK_PIPELINE_BIND_POINT_GRAPHICS,
-			m_pipelineLayout,
-			m_materialSetIndex,
-			1,
-			&phongMaterialComponent.BoundDescriptorSet[_frameInfo.FrameIndex],
-			0,
-			nullptr
-		);
+	m_drawSorter.SortByMaterial();
+
+	// 2. Render them
+	bool isMaterialBound = false;
+	int32 boundMaterialIndex = -1;
+
+	for (const DrawSortEntry& entry : m_drawSorter.GetEntries())
+	{
+		const RenderPacket& packet = packets[entry.PacketIndex];
 
-		for (const auto& entityCollected : entities)
+		if (!isMaterialBound || entry.MaterialIndex != boundMaterialIndex)
 		{
-            const DynamicOffsetComponent& dynamicOffsetComponent = componentManager.GetComponent<DynamicOffsetComponent>(entityCollected);
-            const VertexBufferComponent& vertexBufferComponent = componentManager.GetComponent<VertexBufferComponent>(entityCollected);
-            const IndexBufferComponent& indexBufferComponent = componentManager.GetComponent<IndexBufferComponent>(entityCollected);
-			const UpdateComponent& updateComponent = componentManager.GetComponent<UpdateComponent>(entityCollected);
-
-			vkCmdBindDescriptorSets(
-				_frameInfo.CommandBuffer,
-				VK_PIPELINE_BIND_POINT_GRAPHICS,	// for now is only graphics, in future we want also the compute version
-				m_pipelineLayout,
-				m_entitySetIndex,
-				1,
-				&_frameInfo.EntityDescriptorSet,
-				1,
-				&dynamicOffsetComponent.DynamicOffset
-			);
+			BindMaterial(_frameInfo, packet.MaterialIndex, packet.MaterialDescriptorSet);
 
-			const VkCullModeFlags cullMode = phongMaterialComponent.IsDoubleSided ? VK_CULL_MODE_NONE : VK_CULL_MODE_BACK_BIT;
-			const VkFrontFace frontFace = updateComponent.IsMirrored ? VK_FRONT_FACE_CLOCKWISE : VK_FRONT_FACE_COUNTER_CLOCKWISE;
+			isMaterialBound = true;
+			boundMaterialIndex = entry.MaterialIndex;
+		}
 
-			//if (vkCmdSetCullModeEXT && vkCmdSetFrontFaceEXT)  // no need, we do throw and exception if not supported
-			{
-				vkCmdSetCullModeEXT(_frameInfo.CommandBuffer, cullMode);
-				vkCmdSetFrontFaceEXT(_frameInfo.CommandBuffer, frontFace);
-			}
+		const uint32 firstInstance = BindEntity(_frameInfo, m_entitySetIndex, packet);
 
-			PerEntityRender(_frameInfo, componentManager, entityCollected);
+		const VkCullModeFlags cullMode = packet.IsDoubleSided ? VK_CULL_MODE_NONE : VK_CULL_MODE_BACK_BIT;
+		const VkFrontFace frontFace = packet.IsMirrored ? VK_FRONT_FACE_CLOCKWISE : VK_FRONT_FACE_COUNTER_CLOCKWISE;
 
-            Bind(vertexBufferComponent, indexBufferComponent, _frameInfo.CommandBuffer);
-            Draw(indexBufferComponent, _frameInfo.CommandBuffer);
+		//if (vkCmdSetCullModeEXT && vkCmdSetFrontFaceEXT)  // no need, we do throw and exception if not supported
+		{
+			m_commandRecorder.SetCullMode(_frameInfo.CommandBuffer, cullMode);
+			m_commandRecorder.SetFrontFace(_frameInfo.CommandBuffer, frontFace);
 		}
-	}
 
-	entitiesGroupedAndCollected.clear();
+		PerEntityRender(_frameInfo, componentManager, entityManager.GetEntity(static_cast<uint16>(packet.EntityIndex)));
 
+		Bind(packet, _frameInfo.CommandBuffer);
+		Draw(packet, _frameInfo.CommandBuffer, 1, firstInstance);
+	}
+}
 
+void PhongOpaqueRenderSystem::RenderInstanced(const FrameInfo& _frameInfo)
+{
+	ecs::EntityManager& entityManager = m_app.GetEntityManager();
+	ecs::ComponentManager& componentManager = m_app.GetComponentManager();
 
-	// 2. Render only entities having Vertex buffers only
-    entitiesGroupedAndCollected = ecs::EntityCollector::CollectAndGroupEntitiesWithAllByField<PhongMaterialComponent, PipelineOpaqueComponent, DynamicOffsetComponent, VertexBufferComponent, NotIndexBufferComponent, VisibilityComponent, UpdateComponent>(entityManager, componentManager, &PhongMaterialComponent::Index);
+	m_instanceBuffer->Reset();
+	m_instanceCandidates.clear();
 
-	for (const auto& [key, entities] : entitiesGroupedAndCollected)
+	for (auto gameEntity : ecs::IterateEntitiesWithAll<GeometryComponent, PhongMaterialComponent, PipelineOpaqueComponent, DynamicOffsetComponent, VertexBufferComponent, VisibilityComponent, UpdateComponent>(entityManager, componentManager))
 	{
-		// From the first one and only, we can the material and we bind it.
-		const PhongMaterialComponent& phongMaterialComponent = componentManager.GetComponent<PhongMaterialComponent>(entities[0]);
+		const GeometryComponent& geometryComponent = componentManager.GetComponent<GeometryComponent>(gameEntity);
+		const PhongMaterialComponent& phongMaterialComponent = componentManager.GetComponent<PhongMaterialComponent>(gameEntity);
+		const UpdateComponent& updateComponent = componentManager.GetComponent<UpdateComponent>(gameEntity);
 
-		vkCmdBindDescriptorSets(
-			_frameInfo.CommandBuffer,
-			VK_PIPELINE_BIND_POINT_GRAPHICS,
-			m_pipelineLayout,
-			m_materialSetIndex,
-			1,
-			&phongMaterialComponent.BoundDescriptorSet[_frameInfo.FrameIndex],
-			0,
-			nullptr
-		);
+		// geometry | material | winding: entities with the same key can go in the same draw
+		const uint64 key = (static_cast<uint64>(geometryComponent.Handle) << 33)
+			| (static_cast<uint64>(static_cast<uint32>(phongMaterialComponent.Index)) << 1)
+			| (updateComponent.IsMirrored ? 1ull : 0ull);
+
+		m_instanceCandidates.emplace_back(key, gameEntity.GetIndex());
+	}
+
+	std::sort(m_instanceCandidates.begin(), m_instanceCandidates.end());
 
-		for (const auto& entityCollected : entities)
+	bool isPipelineBound = false;
+	std::size_t batchBegin = 0;
+	while (batchBegin < m_instanceCandidates.size())
+	{
+		std::size_t batchEnd = batchBegin + 1;
+		while (batchEnd < m_instanceCandidates.size() && m_instanceCandidates[batchEnd].first == m_instanceCandidates[batchBegin].first)
+		{
+			++batchEnd;
+		}
+
+		const uint32 instanceCount = static_cast<uint32>(batchEnd - batchBegin);
+		if (instanceCount >= kMinInstanceCount)
 		{
-            const DynamicOffsetComponent& dynamicOffsetComponent = componentManager.GetComponent<DynamicOffsetComponent>(entityCollected);
-            const VertexBufferComponent& vertexBufferComponent = componentManager.GetComponent<VertexBufferComponent>(entityCollected);
-			const UpdateComponent& updateComponent = componentManager.GetComponent<UpdateComponent>(entityCollected);
-
-			vkCmdBindDescriptorSets(
-				_frameInfo.CommandBuffer,
-				VK_PIPELINE_BIND_POINT_GRAPHICS,	// for now is only graphics, in future we want also the compute version
-				m_pipelineLayout,
-				m_entitySetIndex,
-				1,
-				&_frameInfo.EntityDescriptorSet,
-				1,
-				&dynamicOffsetComponent.DynamicOffset
-			);
+			const ecs::Entity firstEntity = entityManager.GetEntity(static_cast<uint16>(m_instanceCandidates[batchBegin].second));
+
+			const PhongMaterialComponent& phongMaterialComponent = componentManager.GetComponent<PhongMaterialComponent>(firstEntity);
+			const VertexBufferComponent& vertexBufferComponent = componentManager.GetComponent<VertexBufferComponent>(firstEntity);
+			const UpdateComponent& updateComponent = componentManager.GetComponent<UpdateComponent>(firstEntity);
+
+			if (!isPipelineBound)
+			{
+				m_commandRecorder.BindPipeline(_frameInfo.CommandBuffer, *m_instancedPipeline);
+
+				const VkDescriptorSet instanceDescriptorSet = m_instanceBuffer->GetDescriptorSet(_frameInfo.FrameIndex);
+				m_commandRecorder.BindDescriptorSet(
+					_frameInfo.CommandBuffer,
+					VK_PIPELINE_BIND_POINT_GRAPHICS,
+					m_pipelineLayout,
+					m_instanceSetIndex,
+					instanceDescriptorSet
+				);
+
+				isPipelineBound = true;
+			}
+
+			BindMaterial(_frameInfo, phongMaterialComponent.Index, phongMaterialComponent.BoundDescriptorSet[_frameInfo.FrameIndex]);
 
 			const VkCullModeFlags cullMode = phongMaterialComponent.IsDoubleSided ? VK_CULL_MODE_NONE : VK_CULL_MODE_BACK_BIT;
 			const VkFrontFace frontFace = updateComponent.IsMirrored ? VK_FRONT_FACE_CLOCKWISE : VK_FRONT_FACE_COUNTER_CLOCKWISE;
 
-			//if (vkCmdSetCullModeEXT && vkCmdSetFrontFaceEXT)  // no need, we do throw and exception if not supported
+			m_commandRecorder.SetCullMode(_frameInfo.CommandBuffer, cullMode);
+			m_commandRecorder.SetFrontFace(_frameInfo.CommandBuffer, frontFace);
+
+			const uint32 firstInstance = m_instanceBuffer->GetInstanceCount();
+			for (std::size_t i = batchBegin; i < batchEnd; ++i)
 			{
-				vkCmdSetCullModeEXT(_frameInfo.CommandBuffer, cullMode);
-				vkCmdSetFrontFaceEXT(_frameInfo.CommandBuffer, frontFace);
+				const ecs::Entity instanceEntity = entityManager.GetEntity(static_cast<uint16>(m_instanceCandidates[i].second));
+
+				InstanceData instanceData{};
+				FillInstanceData(componentManager, instanceEntity, instanceData);
+				m_instanceBuffer->Push(_frameInfo.FrameIndex, instanceData);
+
+				m_instancedEntities[m_instanceCandidates[i].second] = 1;
 			}
 
-			PerEntityRender(_frameInfo, componentManager, entityCollected);
+			if (componentManager.HasComponents<IndexBufferComponent>(firstEntity))
+			{
+				const IndexBufferComponent& indexBufferComponent = componentManager.GetComponent<IndexBufferComponent>(firstEntity);
 
-            Bind(vertexBufferComponent, _frameInfo.CommandBuffer);
-            Draw(vertexBufferComponent, _frameInfo.CommandBuffer);
+				Bind(vertexBufferComponent, indexBufferComponent, _frameInfo.CommandBuffer);
+				Draw(indexBufferComponent, _frameInfo.CommandBuffer, instanceCount, firstInstance);
+			}
+			else
+			{
+				Bind(vertexBufferComponent, _frameInfo.CommandBuffer);
+				Draw(vertexBufferComponent, _frameInfo.CommandBuffer, instanceCount, firstInstance);
+			}
 		}
-	}
 
-	entitiesGroupedAndCollected.clear();
+		batchBegin = batchEnd;
+	}
 }
 
 void PhongOpaqueRenderSystem::CreatePipeline(VkRenderPass _renderPass)
@@ -305,9 +378,10 @@ void PhongOpaqueRenderSystem::CreatePipeline(VkRenderPass _renderPass)
 	pipelineConfig.PipelineLayout = m_pipelineLayout;
 
 
+	const std::string vertexShaderName = m_app.GetConfig().UseEntityStorageBuffer ? "entity_storage_shader" : "phong_shader";
 	const std::string vertexShaderFilepath = m_device.IsBindlessResourcesSupported()
-		? m_app.GetConfig().ShadersPath + "phong_shader_bindless1.vert.spv"
-		: m_app.GetConfig().ShadersPath + "phong_shader_bindless0.vert.spv";
+		? m_app.GetConfig().ShadersPath + vertexShaderName + "_bindless1.vert.spv"
+		: m_app.GetConfig().ShadersPath + vertexShaderName + "_bindless0.vert.spv";
 
 	ShaderInfo vertexShader(
 		vertexShaderFilepath,
@@ -335,14 +409,32 @@ void PhongOpaqueRenderSystem::CreatePipeline(VkRenderPass _renderPass)
 		},
 		pipelineConfig
 		);
+
+	// same fragment stage, the vertex stage reads the entity data from the instance buffer
+	const std::string instancedVertexShaderFilepath = m_device.IsBindlessResourcesSupported()
+		? m_app.GetConfig().ShadersPath + "instanced_shader_bindless1.vert.spv"
+		: m_app.GetConfig().ShadersPath + "instanced_shader_bindless0.vert.spv";
+
+	ShaderInfo instancedVertexShader(
+		instancedVertexShaderFilepath,
+		ShaderType::Vertex
+	);
+
+	m_instancedPipeline = std::make_unique<Pipeline>(
+		m_device,
+		std::vector{
+			instancedVertexShader,
+			fragmentShader,
+		},
+		pipelineConfig
+		);
 }
 
 void PhongOpaqueRenderSystem::Cleanup()
 {
-	for (int32 i = 0; i < m_bindlessBindingMaterialIndexUbos.size(); ++i)
-	{
-		m_buffer->Destroy(m_bindlessBindingMaterialIndexUbos[i]);
-	}
+	m_materialDescriptorSets.clear();
+
+	m_instanceBuffer->Cleanup();
 }
 
 VESPERENGINE_NAMESPACE_END
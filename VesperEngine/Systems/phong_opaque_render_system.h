@@ -7,22 +7,27 @@
 #include "Core/core_defines.h"
 
 #include "Systems/base_render_system.h"
+#include "Utility/draw_sorter.h"
 
 #include "vulkan/vulkan.h"
 
 #include <memory>
 #include <vector>
+#include <utility>
+#include <unordered_map>
 
 // USING BINDLESS
 // set 0: global descriptor set layout
 // set 1: bindless textures and buffer descriptor set layout
 // set 2: entity descriptor set layout
-// set 3: material descriptor set layout
+// the material index is pushed with the draws, at VESPERENGINE_PUSHCONSTANT_MATERIALINDEX_OFFSET
 // 
 // OR NORMAL BINDING
 // set 0: global descriptor set layout
 // set 1: entity descriptor set layout
 // set 2: material descriptor set layout
+//
+// The instanced pipeline appends the instance storage buffer as last set (3 in both cases)
 
 VESPERENGINE_NAMESPACE_BEGIN
 
@@ -31,10 +36,11 @@ class Device;
 class Renderer;
 class Pipeline;
 class DescriptorSetLayout;
-class Buffer;
+class InstanceBuffer;
 
 struct FrameInfo;
-struct BufferComponent;
+struct DescriptorTemplateEntry;
+struct PhongMaterialComponent;
 
 class VESPERENGINE_API PhongOpaqueRenderSystem : public BaseRenderSystem
 {
@@ -46,8 +52,22 @@ public:
     static constexpr uint32 kPhongAlphaTextureBindingIndex = 4u;
     static constexpr uint32 kPhongUniformBufferBindingIndex = 5u;
 
-	// used during bindless, but is not the bindless index, is the standard binding buffer, which contains the index for the bindless material
-	static constexpr uint32 kPhongUniformBufferOnlyBindingIndex = 0u;
+	// the resources of a material set in the order of its bindings above, written with one call through the update template of the layout
+	struct PhongMaterialDescriptorData
+	{
+		VkDescriptorImageInfo AmbientImageInfo;
+		VkDescriptorImageInfo DiffuseImageInfo;
+		VkDescriptorImageInfo SpecularImageInfo;
+		VkDescriptorImageInfo NormalImageInfo;
+		VkDescriptorImageInfo AlphaImageInfo;
+		VkDescriptorBufferInfo UniformBufferInfo;
+	};
+
+	// where the bindings are in PhongMaterialDescriptorData, the layout of the transparent system uses them as well
+	static std::vector<DescriptorTemplateEntry> GetMaterialTemplateEntries();
+
+	// below this count the entities sharing geometry and material are drawn one by one
+	static constexpr uint32 kMinInstanceCount = 2u;
 
 public:
     PhongOpaqueRenderSystem(VesperApp& _app, Device& _device, Renderer& _renderer,
@@ -71,18 +91,34 @@ public:
 	// Call at the end or at destruction time, anyway after the game loop is done.
 	void Cleanup();
 
+protected:
+	// the material set of _materialComponent with its resources, only without bindless
+	VkDescriptorSet BuildMaterialDescriptorSet(PhongMaterialComponent& _materialComponent);
+	// with bindless push the index of the material in the bindless arrays, otherwise bind its set
+	void BindMaterial(const FrameInfo& _frameInfo, int32 _materialIndex, VkDescriptorSet _materialSet);
+	// Draw with a single instanced draw the visible entities sharing geometry, material and winding, marking them in m_instancedEntities.
+	// PerEntityRender is not called for them, derived systems relying on it should set m_allowInstancing to false
+	void RenderInstanced(const FrameInfo& _frameInfo);
+
 protected:
 	VesperApp& m_app;
 	Renderer& m_renderer;
 	std::unique_ptr<Pipeline> m_opaquePipeline;
+	std::unique_ptr<Pipeline> m_instancedPipeline;
 	std::unique_ptr<DescriptorSetLayout> m_materialSetLayout;
 
-    std::unique_ptr<Buffer> m_buffer;
+    std::unordered_map<int32, VkDescriptorSet> m_materialDescriptorSets; // by material index, shared by its entities
+
+	std::unique_ptr<InstanceBuffer> m_instanceBuffer;
+	std::vector<std::pair<uint64, uint32>> m_instanceCandidates;	// batch key, entity index
+	std::vector<uint8> m_instancedEntities;							// per entity index, 1 if already drawn instanced this frame
 
-    std::vector<BufferComponent> m_bindlessBindingMaterialIndexUbos;
+	DrawSorter m_drawSorter;										// the entities drawn one by one, grouped by material
 
     uint32 m_entitySetIndex = 1;
     uint32 m_materialSetIndex = 2;
+	uint32 m_instanceSetIndex = 3;
+	bool m_allowInstancing = true;
 };
 
 VESPERENGINE_NAMESPACE_END
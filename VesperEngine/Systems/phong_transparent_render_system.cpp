@@ -3,6 +3,7 @@
 // Licensed under the MIT License. See LICENSE file in the project root for full license information.
 
 #include "Systems/phong_transparent_render_system.h"
+#include "Systems/phong_opaque_render_system.h"
 
 #include "Core/glm_config.h"
 
@@ -10,8 +11,8 @@
 #include "Backend/frame_info.h"
 #include "Backend/descriptors.h"
 #include "Backend/renderer.h"
+#include "Backend/render_packet.h"
 
-#include "Backend/buffer.h"
 #include "Backend/swap_chain.h"
 
 #include "Components/graphics_components.h"
@@ -36,7 +37,7 @@ PhongTransparentRenderSystem::PhongTransparentRenderSystem(VesperApp& _app, Devi
         , m_app(_app)
         , m_renderer(_renderer)
 {
-    m_buffer = std::make_unique<Buffer>(m_device);
+    m_drawSorter.Reserve(m_app.GetConfig().MaxEntities);
 
     VkPushConstantRange defaultRange{};
     defaultRange.stageFlags = VK_SHADER_STAGE_ALL;
@@ -44,13 +45,8 @@ PhongTransparentRenderSystem::PhongTransparentRenderSystem(VesperApp& _app, Devi
     defaultRange.size = VESPERENGINE_PUSHCONSTANT_DEFAULTRANGE;
     m_pushConstants.push_back(defaultRange);
 
-    if (m_device.IsBindlessResourcesSupported())
-    {
-        m_materialSetLayout = DescriptorSetLayout::Builder(_device)
-                .AddBinding(kPhongUniformBufferOnlyBindingIndex, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT)
-                .Build();
-    }
-    else
+    // with bindless the material is read from the bindless arrays at the index pushed with the draws, there is no material set
+    if (!m_device.IsBindlessResourcesSupported())
     {
         m_materialSetLayout = DescriptorSetLayout::Builder(_device)
                 .AddBinding(kPhongAmbientTextureBindingIndex, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT)
@@ -59,6 +55,7 @@ PhongTransparentRenderSystem::PhongTransparentRenderSystem(VesperApp& _app, Devi
                 .AddBinding(kPhongNormalTextureBindingIndex, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT)
                 .AddBinding(kPhongAlphaTextureBindingIndex, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT)
                 .AddBinding(kPhongUniformBufferBindingIndex, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT)
+                .SetUpdateTemplate(PhongOpaqueRenderSystem::GetMaterialTemplateEntries())
                 .Build();
     }
 
@@ -66,10 +63,9 @@ PhongTransparentRenderSystem::PhongTransparentRenderSystem(VesperApp& _app, Devi
     if (m_device.IsBindlessResourcesSupported())
     {
         m_entitySetIndex = 2;
-        m_materialSetIndex = 3;
 
         CreatePipelineLayout(std::vector<VkDescriptorSetLayout>
-                { _globalDescriptorSetLayout, _bindlessBindingDescriptorSetLayout, _entityDescriptorSetLayout, m_materialSetLayout->GetDescriptorSetLayout() }
+                { _globalDescriptorSetLayout, _bindlessBindingDescriptorSetLayout, _entityDescriptorSetLayout }
         );
     }
     else
@@ -87,57 +83,74 @@ void PhongTransparentRenderSystem::MaterialBinding()
     ecs::EntityManager& entityManager = m_app.GetEntityManager();
     ecs::ComponentManager& componentManager = m_app.GetComponentManager();
 
+    const bool isBindless = m_device.IsBindlessResourcesSupported();
+
     for (auto gameEntity : ecs::IterateEntitiesWithAll<PipelineTransparentComponent, PhongMaterialComponent>(entityManager, componentManager))
     {
         PhongMaterialComponent& materialComponent = m_app.GetComponentManager().GetComponent<PhongMaterialComponent>(gameEntity);
-        materialComponent.BoundDescriptorSet.resize(SwapChain::kMaxFramesInFlight);
 
-        if (m_device.IsBindlessResourcesSupported())
+        // no set with bindless, BindMaterial pushes the material index
+        if (isBindless)
         {
-            for (int32 i = 0; i < SwapChain::kMaxFramesInFlight; ++i)
-            {
-                m_bindlessBindingMaterialIndexUbos.emplace_back(m_buffer->Create<BufferComponent>(
-                        sizeof(PhongBindlessMaterialIndexUBO),
-                        1,
-                        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                        VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
-                        VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT,
-                        /*minUboAlignment*/1,
-                        true
-                ));
-
-                BufferComponent& currentBuffer = m_bindlessBindingMaterialIndexUbos.back();
-
-                PhongBindlessMaterialIndexUBO phongIndexUBO;
-                phongIndexUBO.MaterialIndex = materialComponent.Index;
-
-                currentBuffer.MappedMemory = &phongIndexUBO;
-                m_buffer->WriteToBuffer(currentBuffer);
-
-                VkDescriptorBufferInfo bufferInfo;
-                bufferInfo.buffer = currentBuffer.Buffer;
-                bufferInfo.offset = 0;
-                bufferInfo.range = currentBuffer.AlignedSize;
-
-                DescriptorWriter(*m_materialSetLayout, *m_renderer.GetDescriptorPool())
-                        .WriteBuffer(kPhongUniformBufferOnlyBindingIndex, &bufferInfo)
-                        .Build(materialComponent.BoundDescriptorSet[i]);
-            }
+            materialComponent.BoundDescriptorSet.assign(SwapChain::kMaxFramesInFlight, VK_NULL_HANDLE);
+            continue;
+        }
+
+        // the set depends only on the material: built once, shared by all its entities and by all the frames in flight
+        VkDescriptorSet materialSet = VK_NULL_HANDLE;
+        if (materialComponent.Index < 0)
+        {
+            // not from the MaterialSystem, the resources are only of the entity
+            materialSet = BuildMaterialDescriptorSet(materialComponent);
         }
         else
         {
-            for (int32 i = 0; i < SwapChain::kMaxFramesInFlight; ++i)
+            auto [materialSetIt, isNewMaterial] = m_materialDescriptorSets.try_emplace(materialComponent.Index, VK_NULL_HANDLE);
+            if (isNewMaterial)
             {
-                DescriptorWriter(*m_materialSetLayout, *m_renderer.GetDescriptorPool())
-                        .WriteImage(kPhongAmbientTextureBindingIndex, &materialComponent.AmbientImageInfo)
-                        .WriteImage(kPhongDiffuseTextureBindingIndex, &materialComponent.DiffuseImageInfo)
-                        .WriteImage(kPhongSpecularTextureBindingIndex, &materialComponent.SpecularImageInfo)
-                        .WriteImage(kPhongNormalTextureBindingIndex, &materialComponent.NormalImageInfo)
-                        .WriteImage(kPhongAlphaTextureBindingIndex, &materialComponent.AlphaImageInfo)
-                        .WriteBuffer(kPhongUniformBufferBindingIndex, &materialComponent.UniformBufferInfo)
-                        .Build(materialComponent.BoundDescriptorSet[i]);
+                materialSetIt->second = BuildMaterialDescriptorSet(materialComponent);
             }
+            materialSet = materialSetIt->second;
         }
+
+        materialComponent.BoundDescriptorSet.assign(SwapChain::kMaxFramesInFlight, materialSet);
+    }
+}
+
+VkDescriptorSet PhongTransparentRenderSystem::BuildMaterialDescriptorSet(PhongMaterialComponent& _materialComponent)
+{
+    VkDescriptorSet materialSet = VK_NULL_HANDLE;
+
+    const PhongOpaqueRenderSystem::PhongMaterialDescriptorData descriptorData{
+        _materialComponent.AmbientImageInfo,
+        _materialComponent.DiffuseImageInfo,
+        _materialComponent.SpecularImageInfo,
+        _materialComponent.NormalImageInfo,
+        _materialComponent.AlphaImageInfo,
+        _materialComponent.UniformBufferInfo
+    };
+
+    DescriptorWriter(*m_materialSetLayout, *m_renderer.GetDescriptorPool())
+        .BuildFromTemplate(materialSet, &descriptorData);
+
+    return materialSet;
+}
+
+void PhongTransparentRenderSystem::BindMaterial(const FrameInfo& _frameInfo, int32 _materialIndex, VkDescriptorSet _materialSet)
+{
+    if (m_device.IsBindlessResourcesSupported())
+    {
+        PushConstants(_frameInfo.CommandBuffer, 0, VESPERENGINE_PUSHCONSTANT_MATERIALINDEX_OFFSET, sizeof(int32), &_materialIndex);
+    }
+    else
+    {
+        m_commandRecorder.BindDescriptorSet(
+            _frameInfo.CommandBuffer,
+            VK_PIPELINE_BIND_POINT_GRAPHICS,
+            m_pipelineLayout,
+            m_materialSetIndex,
+            _materialSet
+        );
     }
 }
 
@@ -161,116 +174,64 @@ void PhongTransparentRenderSystem::Update(const FrameInfo& _frameInfo)
 
 void PhongTransparentRenderSystem::Render(const FrameInfo& _frameInfo)
 {
-    m_transparentPipeline->Bind(_frameInfo.CommandBuffer);
+    m_commandRecorder.Reset(_frameInfo.CommandBuffer);
+
+    m_commandRecorder.BindPipeline(_frameInfo.CommandBuffer, *m_transparentPipeline);
 
     ecs::EntityManager& entityManager = m_app.GetEntityManager();
     ecs::ComponentManager& componentManager = m_app.GetComponentManager();
 
-    auto entitiesGroupedAndCollected = ecs::EntityCollector::CollectAndGroupEntitiesWithAllByField<PhongMaterialComponent, PipelineTransparentComponent, DynamicOffsetComponent, VertexBufferComponent, IndexBufferComponent, VisibilityComponent, UpdateComponent>(entityManager, componentManager, &PhongMaterialComponent::Index);
+    assertMsgReturnVoid(_frameInfo.RenderPackets != nullptr, "The render packets must be extracted before recording");
+    const RenderPacketRange packets = _frameInfo.RenderPackets->GetRange(RenderPacketPipeline::PhongTransparent);
 
-    for (const auto& [key, entities] : entitiesGroupedAndCollected)
-    {
-        const PhongMaterialComponent& phongMaterialComponent = componentManager.GetComponent<PhongMaterialComponent>(entities[0]);
-
-        vkCmdBindDescriptorSets(
-                _frameInfo.CommandBuffer,
-                VK_PIPELINE_BIND_POINT_GRAPHICS,
-                m_pipelineLayout,
-                m_materialSetIndex,
-                1,
-                &phongMaterialComponent.BoundDescriptorSet[_frameInfo.FrameIndex],
-                0,
-                nullptr
-        );
-
-        for (const auto& entityCollected : entities)
-        {
-            const DynamicOffsetComponent& dynamicOffsetComponent = componentManager.GetComponent<DynamicOffsetComponent>(entityCollected);
-            const VertexBufferComponent& vertexBufferComponent = componentManager.GetComponent<VertexBufferComponent>(entityCollected);
-            const IndexBufferComponent& indexBufferComponent = componentManager.GetComponent<IndexBufferComponent>(entityCollected);
-            const UpdateComponent& updateComponent = componentManager.GetComponent<UpdateComponent>(entityCollected);
-
-            vkCmdBindDescriptorSets(
-                    _frameInfo.CommandBuffer,
-                    VK_PIPELINE_BIND_POINT_GRAPHICS,
-                    m_pipelineLayout,
-                    m_entitySetIndex,
-                    1,
-                    &_frameInfo.EntityDescriptorSet,
-                    1,
-                    &dynamicOffsetComponent.DynamicOffset
-            );
-
-            //const VkCullModeFlags cullMode = phongMaterialComponent.IsDoubleSided ? VK_CULL_MODE_NONE : VK_CULL_MODE_BACK_BIT;
-            const VkFrontFace frontFace = updateComponent.IsMirrored ? VK_FRONT_FACE_CLOCKWISE : VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    const bool useWeightedBlendedOIT = m_renderer.IsWeightedBlendedOITEnabled();
 
-            //if (vkCmdSetCullModeEXT && vkCmdSetFrontFaceEXT)  // no need, we do throw and exception if not supported
-            {
-                vkCmdSetCullModeEXT(_frameInfo.CommandBuffer, VK_CULL_MODE_NONE);
-                vkCmdSetFrontFaceEXT(_frameInfo.CommandBuffer, frontFace);
-            }
-
-            PerEntityRender(_frameInfo, componentManager, entityCollected);
-
-            Bind(vertexBufferComponent, indexBufferComponent, _frameInfo.CommandBuffer);
-            Draw(indexBufferComponent, _frameInfo.CommandBuffer);
-        }
+    // indexed and not indexed entities go in the same list, blending needs a single back to front order across both
+    m_drawSorter.Clear();
+    for (uint32 i = 0; i < packets.Count; ++i)
+    {
+        m_drawSorter.Add(packets[i].ViewDepth, i, packets[i].MaterialIndex, packets[i].SortFlags);
     }
 
-    entitiesGroupedAndCollected.clear();
+    // weighted blended OIT does not depend on the draw order
+    if (!useWeightedBlendedOIT)
+    {
+        m_drawSorter.SortBackToFront();
+    }
 
-    entitiesGroupedAndCollected = ecs::EntityCollector::CollectAndGroupEntitiesWithAllByField<PhongMaterialComponent, PipelineTransparentComponent, DynamicOffsetComponent, VertexBufferComponent, NotIndexBufferComponent, VisibilityComponent, UpdateComponent>(entityManager, componentManager, &PhongMaterialComponent::Index);
+    bool isMaterialBound = false;
+    int32 boundMaterialIndex = -1;
 
-    for (const auto& [key, entities] : entitiesGroupedAndCollected)
+    for (const DrawSortEntry& entry : m_drawSorter.GetEntries())
     {
-        const PhongMaterialComponent& phongMaterialComponent = componentManager.GetComponent<PhongMaterialComponent>(entities[0]);
-
-        vkCmdBindDescriptorSets(
-                _frameInfo.CommandBuffer,
-                VK_PIPELINE_BIND_POINT_GRAPHICS,
-                m_pipelineLayout,
-                m_materialSetIndex,
-                1,
-                &phongMaterialComponent.BoundDescriptorSet[_frameInfo.FrameIndex],
-                0,
-                nullptr
-        );
+        const RenderPacket& packet = packets[entry.PacketIndex];
 
-        for (const auto& entityCollected : entities)
+        // sorting breaks the grouping by material, so rebind only when it actually changes between two consecutive draws
+        if (!isMaterialBound || entry.MaterialIndex != boundMaterialIndex)
         {
-            const DynamicOffsetComponent& dynamicOffsetComponent = componentManager.GetComponent<DynamicOffsetComponent>(entityCollected);
-            const VertexBufferComponent& vertexBufferComponent = componentManager.GetComponent<VertexBufferComponent>(entityCollected);
-            const UpdateComponent& updateComponent = componentManager.GetComponent<UpdateComponent>(entityCollected);
-
-            vkCmdBindDescriptorSets(
-                    _frameInfo.CommandBuffer,
-                    VK_PIPELINE_BIND_POINT_GRAPHICS,
-                    m_pipelineLayout,
-                    m_entitySetIndex,
-                    1,
-                    &_frameInfo.EntityDescriptorSet,
-                    1,
-                    &dynamicOffsetComponent.DynamicOffset
-            );
+            BindMaterial(_frameInfo, packet.MaterialIndex, packet.MaterialDescriptorSet);
 
-            // for transparent object always cull mode none for us
-            //const VkCullModeFlags cullMode = phongMaterialComponent.IsDoubleSided ? VK_CULL_MODE_NONE : VK_CULL_MODE_BACK_BIT;
-            const VkFrontFace frontFace = updateComponent.IsMirrored ? VK_FRONT_FACE_CLOCKWISE : VK_FRONT_FACE_COUNTER_CLOCKWISE;
+            isMaterialBound = true;
+            boundMaterialIndex = entry.MaterialIndex;
+        }
 
-            //if (vkCmdSetCullModeEXT && vkCmdSetFrontFaceEXT)  // no need, we do throw and exception if not supported
-            {
-                //vkCmdSetCullModeEXT(_frameInfo.CommandBuffer, cullMode);
-                vkCmdSetFrontFaceEXT(_frameInfo.CommandBuffer, frontFace);
-            }
+        const uint32 firstInstance = BindEntity(_frameInfo, m_entitySetIndex, packet);
 
-            PerEntityRender(_frameInfo, componentManager, entityCollected);
+        // always cull mode none for transparent for us
+        //const VkCullModeFlags cullMode = packet.IsDoubleSided ? VK_CULL_MODE_NONE : VK_CULL_MODE_BACK_BIT;
+        const VkFrontFace frontFace = packet.IsMirrored ? VK_FRONT_FACE_CLOCKWISE : VK_FRONT_FACE_COUNTER_CLOCKWISE;
 
-            Bind(vertexBufferComponent, _frameInfo.CommandBuffer);
-            Draw(vertexBufferComponent, _frameInfo.CommandBuffer);
+        //if (vkCmdSetCullModeEXT && vkCmdSetFrontFaceEXT)  // no need, we do throw and exception if not supported
+        {
+            m_commandRecorder.SetCullMode(_frameInfo.CommandBuffer, VK_CULL_MODE_NONE);
+            m_commandRecorder.SetFrontFace(_frameInfo.CommandBuffer, frontFace);
         }
-    }
 
-    entitiesGroupedAndCollected.clear();
+        PerEntityRender(_frameInfo, componentManager, entityManager.GetEntity(static_cast<uint16>(packet.EntityIndex)));
+
+        Bind(packet, _frameInfo.CommandBuffer);
+        Draw(packet, _frameInfo.CommandBuffer, 1, firstInstance);
+    }
 }
 
 void PhongTransparentRenderSystem::CreatePipeline(VkRenderPass _renderPass)
@@ -279,14 +240,25 @@ void PhongTransparentRenderSystem::CreatePipeline(VkRenderPass _renderPass)
 
     PipelineConfigInfo pipelineConfig{};
 
-    Pipeline::TransparentPipelineConfiguration(pipelineConfig);
+    // the OIT pipeline writes accumulation and revealage in the transparent subpass instead of blending over the color
+    const bool useWeightedBlendedOIT = m_renderer.IsWeightedBlendedOITEnabled();
+    if (useWeightedBlendedOIT)
+    {
+        Pipeline::WeightedBlendedTransparentPipelineConfiguration(pipelineConfig);
+        pipelineConfig.Subpass = SwapChain::kTransparentSubpass;
+    }
+    else
+    {
+        Pipeline::TransparentPipelineConfiguration(pipelineConfig);
+    }
 
     pipelineConfig.RenderPass = _renderPass;
     pipelineConfig.PipelineLayout = m_pipelineLayout;
 
+    const std::string vertexShaderName = m_app.GetConfig().UseEntityStorageBuffer ? "entity_storage_shader" : "phong_shader";
     const std::string vertexShaderFilepath = m_device.IsBindlessResourcesSupported()
-            ? m_app.GetConfig().ShadersPath + "phong_shader_bindless1.vert.spv"
-            : m_app.GetConfig().ShadersPath + "phong_shader_bindless0.vert.spv";
+            ? m_app.GetConfig().ShadersPath + vertexShaderName + "_bindless1.vert.spv"
+            : m_app.GetConfig().ShadersPath + vertexShaderName + "_bindless0.vert.spv";
 
     ShaderInfo vertexShader(
             vertexShaderFilepath,
@@ -303,6 +275,7 @@ void PhongTransparentRenderSystem::CreatePipeline(VkRenderPass _renderPass)
     );
 
     //fragmentShader.AddSpecializationConstant(0, 2.0f);
+    fragmentShader.AddSpecializationConstant(kWeightedBlendedOITConstantID, static_cast<VkBool32>(useWeightedBlendedOIT));
 
     m_transparentPipeline = std::make_unique<Pipeline>(
             m_device,
@@ -316,10 +289,7 @@ void PhongTransparentRenderSystem::CreatePipeline(VkRenderPass _renderPass)
 
 void PhongTransparentRenderSystem::Cleanup()
 {
-    for (int32 i = 0; i < m_bindlessBindingMaterialIndexUbos.size(); ++i)
-    {
-        m_buffer->Destroy(m_bindlessBindingMaterialIndexUbos[i]);
-    }
+    m_materialDescriptorSets.clear();
 }
 
 VESPERENGINE_NAMESPACE_END
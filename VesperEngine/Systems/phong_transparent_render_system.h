@@ -6,11 +6,13 @@
 
 #include "Core/core_defines.h"
 #include "Systems/base_render_system.h"
+#include "Utility/draw_sorter.h"
 
 #include "vulkan/vulkan.h"
 
 #include <memory>
 #include <vector>
+#include <unordered_map>
 
 VESPERENGINE_NAMESPACE_BEGIN
 
@@ -19,10 +21,9 @@ class Device;
 class Renderer;
 class Pipeline;
 class DescriptorSetLayout;
-class Buffer;
 
 struct FrameInfo;
-struct BufferComponent;
+struct PhongMaterialComponent;
 
 class VESPERENGINE_API PhongTransparentRenderSystem : public BaseRenderSystem
 {
@@ -34,7 +35,9 @@ public:
     static constexpr uint32 kPhongAlphaTextureBindingIndex = 4u;
     static constexpr uint32 kPhongUniformBufferBindingIndex = 5u;
 
-    static constexpr uint32 kPhongUniformBufferOnlyBindingIndex = 0u;
+
+    // constant_id 0 is the brightness factor of phong_shader.frag
+    static constexpr uint32 kWeightedBlendedOITConstantID = 1u;
 
 public:
     PhongTransparentRenderSystem(VesperApp& _app, Device& _device, Renderer& _renderer,
@@ -53,15 +56,21 @@ public:
     virtual void Render(const FrameInfo& _frameInfo);
     void Cleanup();
 
+protected:
+    // the material set of _materialComponent with its resources, only without bindless
+    VkDescriptorSet BuildMaterialDescriptorSet(PhongMaterialComponent& _materialComponent);
+    // with bindless push the index of the material in the bindless arrays, otherwise bind its set
+    void BindMaterial(const FrameInfo& _frameInfo, int32 _materialIndex, VkDescriptorSet _materialSet);
+
 protected:
     VesperApp& m_app;
     Renderer& m_renderer;
     std::unique_ptr<Pipeline> m_transparentPipeline;
     std::unique_ptr<DescriptorSetLayout> m_materialSetLayout;
 
-    std::unique_ptr<Buffer> m_buffer;
+    std::unordered_map<int32, VkDescriptorSet> m_materialDescriptorSets; // by material index, shared by its entities
 
-    std::vector<BufferComponent> m_bindlessBindingMaterialIndexUbos;
+    DrawSorter m_drawSorter;
 
     uint32 m_entitySetIndex = 1;
     uint32 m_materialSetIndex = 2;
@@ -0,0 +1,157 @@
+// Copyright (c) 2025-2025 Michele Condo'
+// File: C:\Projects\Vesper\VesperEngine\Systems\render_extraction_system.cpp
+// Licensed under the MIT License. See LICENSE file in the project root for full license information.
+
+#include "Systems/render_extraction_system.h"
+
+#include "Backend/swap_chain.h"
+
+#include "Components/graphics_components.h"
+#include "Components/object_components.h"
+#include "Components/pipeline_components.h"
+#include "Components/camera_components.h"
+
+#include "Utility/draw_sorter.h"
+
+#include "App/vesper_app.h"
+#include "App/config.h"
+
+#include "ECS/ECS/ecs.h"
+
+#include <type_traits>
+
+
+VESPERENGINE_NAMESPACE_BEGIN
+
+RenderExtractionSystem::RenderExtractionSystem(VesperApp& _app)
+	: m_app(_app)
+{
+	m_packetLists.resize(SwapChain::kMaxFramesInFlight);
+	for (RenderPacketList& packetList : m_packetLists)
+	{
+		packetList.Reserve(m_app.GetConfig().MaxEntities);
+	}
+}
+
+void RenderExtractionSystem::Extract(int32 _frameIndex, const CameraComponent& _cameraComponent)
+{
+	RenderPacketList& packetList = m_packetLists[_frameIndex];
+	packetList.Clear();
+
+	const glm::mat4& viewMatrix = _cameraComponent.ViewMatrix;
+	const bool useFarthestBound = m_app.GetConfig().SortTransparentByFarthestBound;
+
+	ExtractPipeline<PhongMaterialComponent, PipelineOpaqueComponent>(_frameIndex, viewMatrix, RenderPacketPipeline::PhongOpaque, false, packetList);
+	ExtractPipeline<PhongMaterialComponent, PipelineTransparentComponent>(_frameIndex, viewMatrix, RenderPacketPipeline::PhongTransparent, useFarthestBound, packetList);
+	ExtractPipeline<PBRMaterialComponent, PipelineOpaqueComponent>(_frameIndex, viewMatrix, RenderPacketPipeline::PBROpaque, false, packetList);
+	ExtractPipeline<PBRMaterialComponent, PipelineTransparentComponent>(_frameIndex, viewMatrix, RenderPacketPipeline::PBRTransparent, useFarthestBound, packetList);
+	ExtractSkybox(_frameIndex, _cameraComponent, packetList);
+}
+
+template<typename TMaterialComponent, typename TPipelineComponent>
+void RenderExtractionSystem::ExtractPipeline(int32 _frameIndex, const glm::mat4& _viewMatrix, RenderPacketPipeline _pipeline, bool _useFarthestBound, RenderPacketList& _packetList)
+{
+	ecs::EntityManager& entityManager = m_app.GetEntityManager();
+	ecs::ComponentManager& componentManager = m_app.GetComponentManager();
+
+	const uint32 first = _packetList.GetCount();
+
+	for (auto gameEntity : ecs::IterateEntitiesWithAll<TMaterialComponent, TPipelineComponent, DynamicOffsetComponent, VertexBufferComponent, VisibilityComponent, UpdateComponent>(entityManager, componentManager))
+	{
+		const TMaterialComponent& materialComponent = componentManager.GetComponent<TMaterialComponent>(gameEntity);
+		const DynamicOffsetComponent& dynamicOffsetComponent = componentManager.GetComponent<DynamicOffsetComponent>(gameEntity);
+		const VertexBufferComponent& vertexBufferComponent = componentManager.GetComponent<VertexBufferComponent>(gameEntity);
+		const UpdateComponent& updateComponent = componentManager.GetComponent<UpdateComponent>(gameEntity);
+
+		RenderPacket& packet = _packetList.Add();
+		packet.ModelMatrix = updateComponent.ModelMatrix;
+
+		packet.VertexBuffer = vertexBufferComponent.Buffer;
+		packet.Count = vertexBufferComponent.Count;
+		packet.First = vertexBufferComponent.FirstVertex;
+
+		if (componentManager.HasComponents<IndexBufferComponent>(gameEntity))
+		{
+			const IndexBufferComponent& indexBufferComponent = componentManager.GetComponent<IndexBufferComponent>(gameEntity);
+
+			packet.IndexBuffer = indexBufferComponent.Buffer;
+			packet.Count = indexBufferComponent.Count;
+			packet.First = indexBufferComponent.FirstIndex;
+			packet.VertexOffset = indexBufferComponent.VertexOffset;
+			packet.SortFlags |= DrawSorter::kFlagHasIndexBuffer;
+		}
+
+		packet.MaterialDescriptorSet = materialComponent.BoundDescriptorSet[_frameIndex];
+		packet.MaterialIndex = materialComponent.Index;
+
+		packet.DynamicOffsetIndex = dynamicOffsetComponent.DynamicOffsetIndex;
+		packet.DynamicOffset = dynamicOffsetComponent.DynamicOffset;
+		packet.EntityIndex = gameEntity.GetIndex();
+
+		if (materialComponent.IsAlphaTested)
+		{
+			packet.SortFlags |= DrawSorter::kFlagAlphaTested;
+		}
+
+		if constexpr (std::is_same_v<TMaterialComponent, PBRMaterialComponent>)
+		{
+			packet.SortFlags |= materialComponent.FeatureMask << DrawSorter::kFlagPermutationShift;
+		}
+
+		packet.Pipeline = _pipeline;
+		packet.IsDoubleSided = materialComponent.IsDoubleSided;
+		packet.IsMirrored = updateComponent.IsMirrored;
+
+		const glm::mat4 viewModel = _viewMatrix * updateComponent.ModelMatrix;
+
+		if (componentManager.HasComponents<BoundsComponent>(gameEntity))
+		{
+			const BoundsComponent& boundsComponent = componentManager.GetComponent<BoundsComponent>(gameEntity);
+			packet.ViewDepth = DrawSorter::ComputeViewDepth(viewModel, boundsComponent.Min, boundsComponent.Max, _useFarthestBound);
+		}
+		else
+		{
+			packet.ViewDepth = viewModel[3].z;
+		}
+	}
+
+	_packetList.CloseRange(_pipeline, first);
+}
+
+void RenderExtractionSystem::ExtractSkybox(int32 _frameIndex, const CameraComponent& _cameraComponent, RenderPacketList& _packetList)
+{
+	ecs::EntityManager& entityManager = m_app.GetEntityManager();
+	ecs::ComponentManager& componentManager = m_app.GetComponentManager();
+
+	const uint32 first = _packetList.GetCount();
+
+	// the skybox follows the camera, only its rotation is kept
+	const glm::mat4 viewProjectionMatrix = _cameraComponent.ProjectionMatrix * glm::mat4(glm::mat3(_cameraComponent.ViewMatrix));
+
+	for (auto gameEntity : ecs::IterateEntitiesWithAll<PipelineSkyboxComponent, VertexBufferComponent, IndexBufferComponent, SkyboxMaterialComponent, VisibilityComponent>(entityManager, componentManager))
+	{
+		const VertexBufferComponent& vertexBufferComponent = componentManager.GetComponent<VertexBufferComponent>(gameEntity);
+		const IndexBufferComponent& indexBufferComponent = componentManager.GetComponent<IndexBufferComponent>(gameEntity);
+		const SkyboxMaterialComponent& materialComponent = componentManager.GetComponent<SkyboxMaterialComponent>(gameEntity);
+
+		RenderPacket& packet = _packetList.Add();
+		packet.ModelMatrix = viewProjectionMatrix;
+
+		packet.VertexBuffer = vertexBufferComponent.Buffer;
+		packet.IndexBuffer = indexBufferComponent.Buffer;
+		packet.Count = indexBufferComponent.Count;
+		packet.First = indexBufferComponent.FirstIndex;
+		packet.VertexOffset = indexBufferComponent.VertexOffset;
+
+		packet.MaterialDescriptorSet = materialComponent.BoundDescriptorSet[_frameIndex];
+		packet.MaterialIndex = materialComponent.Index;
+		packet.EntityIndex = gameEntity.GetIndex();
+
+		packet.Pipeline = RenderPacketPipeline::Skybox;
+		packet.IsDoubleSided = true;
+	}
+
+	_packetList.CloseRange(RenderPacketPipeline::Skybox, first);
+}
+
+VESPERENGINE_NAMESPACE_END
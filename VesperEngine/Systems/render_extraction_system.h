@@ -0,0 +1,52 @@
+// Copyright (c) 2025-2025 Michele Condo'
+// File: C:\Projects\Vesper\VesperEngine\Systems\render_extraction_system.h
+// Licensed under the MIT License. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include "Core/core_defines.h"
+#include "Core/glm_config.h"
+
+#include "Backend/render_packet.h"
+
+#include <vector>
+
+
+VESPERENGINE_NAMESPACE_BEGIN
+
+class VesperApp;
+
+struct CameraComponent;
+
+/**
+ * Walks the visible renderable entities once per frame and copies what their draws need in the RenderPacketList of the frame.
+ * The render systems then record from the packets only: one pass of component lookups per frame instead of one per system,
+ * and, one list per frame in flight, the components can change for the next frame while the packets of this one are still read.
+ * The entity data and the lights are not extracted: their uploads cover every entity, visible or not, and copy only the changed ones.
+ */
+class VESPERENGINE_API RenderExtractionSystem final
+{
+public:
+	RenderExtractionSystem(VesperApp& _app);
+	~RenderExtractionSystem() = default;
+
+	RenderExtractionSystem(const RenderExtractionSystem&) = delete;
+	RenderExtractionSystem& operator=(const RenderExtractionSystem&) = delete;
+
+public:
+	VESPERENGINE_INLINE const RenderPacketList& GetPackets(int32 _frameIndex) const { return m_packetLists[_frameIndex]; }
+
+	// Call every frame after the model matrices and the entity data are updated, before any render system records
+	void Extract(int32 _frameIndex, const CameraComponent& _cameraComponent);
+
+private:
+	template<typename TMaterialComponent, typename TPipelineComponent>
+	void ExtractPipeline(int32 _frameIndex, const glm::mat4& _viewMatrix, RenderPacketPipeline _pipeline, bool _useFarthestBound, RenderPacketList& _packetList);
+	void ExtractSkybox(int32 _frameIndex, const CameraComponent& _cameraComponent, RenderPacketList& _packetList);
+
+private:
+	VesperApp& m_app;
+	std::vector<RenderPacketList> m_packetLists;	// per frame in flight
+};
+
+VESPERENGINE_NAMESPACE_END
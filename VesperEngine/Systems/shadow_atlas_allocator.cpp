@@ -0,0 +1,133 @@
+// Copyright (c) 2025-2025 Michele Condo'
+// File: C:\Projects\Vesper\VesperEngine\Systems\shadow_atlas_allocator.cpp
+// Licensed under the MIT License. See LICENSE file in the project root for full license information.
+
+#include "Systems/shadow_atlas_allocator.h"
+
+#include <algorithm>
+
+
+VESPERENGINE_NAMESPACE_BEGIN
+
+void ShadowAtlasAllocator::Initialize(uint32 _atlasSize, uint32 _minTileSize)
+{
+	assertMsgReturnVoid(_minTileSize > 0 && _minTileSize <= _atlasSize, "The smallest tile has to fit the atlas");
+
+	m_atlasSize = _atlasSize;
+	m_levelCount = 1;
+	for (uint32 size = _atlasSize; size > _minTileSize; size /= 2)
+	{
+		++m_levelCount;
+	}
+
+	m_freeTiles.clear();
+	m_freeTiles.resize(m_levelCount);
+	m_freeTiles[0].push_back({ 0, 0, _atlasSize });
+}
+
+bool ShadowAtlasAllocator::Allocate(uint32 _size, Tile& _outTile)
+{
+	if (_size == 0 || _size > m_atlasSize)
+	{
+		return false;
+	}
+
+	return AllocateAtLevel(GetLevel(_size), _outTile);
+}
+
+void ShadowAtlasAllocator::Free(const Tile& _tile)
+{
+	if (_tile.Size == 0)
+	{
+		return;
+	}
+
+	const uint32 level = GetLevel(_tile.Size);
+	std::vector<Tile>& freeTiles = m_freeTiles[level];
+
+	if (level == 0)
+	{
+		freeTiles.push_back(_tile);
+		return;
+	}
+
+	// the parent is aligned to its own size, the tile is one of its four quadrants
+	const uint32 parentSize = _tile.Size * 2;
+	const uint32 parentX = _tile.X - _tile.X % parentSize;
+	const uint32 parentY = _tile.Y - _tile.Y % parentSize;
+
+	std::size_t siblings[3];
+	uint32 siblingCount = 0;
+	for (uint32 i = 0; i < 4; ++i)
+	{
+		const uint32 x = parentX + (i & 1) * _tile.Size;
+		const uint32 y = parentY + (i >> 1) * _tile.Size;
+		if (x == _tile.X && y == _tile.Y)
+		{
+			continue;
+		}
+
+		auto it = std::find_if(freeTiles.begin(), freeTiles.end(), [x, y](const Tile& _free) { return _free.X == x && _free.Y == y; });
+		if (it == freeTiles.end())
+		{
+			break;
+		}
+
+		siblings[siblingCount++] = static_cast<std::size_t>(it - freeTiles.begin());
+	}
+
+	if (siblingCount < 3)
+	{
+		freeTiles.push_back(_tile);
+		return;
+	}
+
+	// all the four quadrants are free: merged back in the parent, erased from the last so the indices stay valid
+	std::sort(siblings, siblings + 3);
+	for (int32 i = 2; i >= 0; --i)
+	{
+		freeTiles.erase(freeTiles.begin() + siblings[i]);
+	}
+
+	Free({ parentX, parentY, parentSize });
+}
+
+bool ShadowAtlasAllocator::AllocateAtLevel(uint32 _level, Tile& _outTile)
+{
+	std::vector<Tile>& freeTiles = m_freeTiles[_level];
+	if (!freeTiles.empty())
+	{
+		_outTile = freeTiles.back();
+		freeTiles.pop_back();
+		return true;
+	}
+
+	Tile parent;
+	if (_level == 0 || !AllocateAtLevel(_level - 1, parent))
+	{
+		return false;
+	}
+
+	// split the parent: the first quadrant is returned, the other three are free
+	const uint32 size = parent.Size / 2;
+	freeTiles.push_back({ parent.X + size, parent.Y + size, size });
+	freeTiles.push_back({ parent.X, parent.Y + size, size });
+	freeTiles.push_back({ parent.X + size, parent.Y, size });
+
+	_outTile = { parent.X, parent.Y, size };
+	return true;
+}
+
+uint32 ShadowAtlasAllocator::GetLevel(uint32 _size) const
+{
+	uint32 level = 0;
+	uint32 levelSize = m_atlasSize;
+	while (level + 1 < m_levelCount && levelSize / 2 >= _size)
+	{
+		levelSize /= 2;
+		++level;
+	}
+	return level;
+}
+
+VESPERENGINE_NAMESPACE_END
@@ -0,0 +1,57 @@
+// Copyright (c) 2025-2025 Michele Condo'
+// File: C:\Projects\Vesper\VesperEngine\Systems\shadow_atlas_allocator.h
+// Licensed under the MIT License. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include "Core/core_defines.h"
+
+#include <vector>
+
+
+VESPERENGINE_NAMESPACE_BEGIN
+
+/**
+ * Quadtree buddy allocator of the square tiles of the shadow atlas: every level halves the side of the tiles of the previous one,
+ * a free tile is split in four when a smaller one is needed and merged back as soon as its four children are free again.
+ * The sizes are rounded up to the side of a level, so from the whole atlas down to the smallest tile.
+ */
+class VESPERENGINE_API ShadowAtlasAllocator final
+{
+public:
+	// texels, a Size of 0 is no tile
+	struct Tile
+	{
+		uint32 X{ 0 };
+		uint32 Y{ 0 };
+		uint32 Size{ 0 };
+	};
+
+public:
+	ShadowAtlasAllocator() = default;
+	~ShadowAtlasAllocator() = default;
+
+	ShadowAtlasAllocator(const ShadowAtlasAllocator&) = delete;
+	ShadowAtlasAllocator& operator=(const ShadowAtlasAllocator&) = delete;
+
+public:
+	VESPERENGINE_INLINE uint32 GetAtlasSize() const { return m_atlasSize; }
+
+public:
+	// both power of two, _minTileSize not bigger than _atlasSize. The whole atlas is free after it
+	void Initialize(uint32 _atlasSize, uint32 _minTileSize);
+	// false if no tile of that size is free
+	bool Allocate(uint32 _size, Tile& _outTile);
+	void Free(const Tile& _tile);
+
+private:
+	bool AllocateAtLevel(uint32 _level, Tile& _outTile);
+	uint32 GetLevel(uint32 _size) const;
+
+private:
+	std::vector<std::vector<Tile>> m_freeTiles;		// per level, level 0 is the whole atlas
+	uint32 m_atlasSize{ 0 };
+	uint32 m_levelCount{ 0 };
+};
+
+VESPERENGINE_NAMESPACE_END
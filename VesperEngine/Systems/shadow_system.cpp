@@ -0,0 +1,868 @@
+// Copyright (c) 2025-2025 Michele Condo'
+// File: C:\Projects\Vesper\VesperEngine\Systems\shadow_system.cpp
+// Licensed under the MIT License. See LICENSE file in the project root for full license information.
+
+#include "Systems/shadow_system.h"
+#include "Systems/light_system.h"
+#include "Systems/light_cluster_system.h"
+
+#include "Backend/buffer.h"
+#include "Backend/device.h"
+#include "Backend/frame_info.h"
+#include "Backend/pipeline.h"
+#include "Backend/swap_chain.h"
+
+#include "Components/camera_components.h"
+#include "Components/object_components.h"
+#include "Components/pipeline_components.h"
+
+#include "App/vesper_app.h"
+#include "App/config.h"
+
+#include "Core/memory_copy.h"
+
+#include "Utility/hash.h"
+
+#include "ECS/ECS/ecs.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <stdexcept>
+
+
+VESPERENGINE_NAMESPACE_BEGIN
+
+ShadowSystem::ShadowSystem(VesperApp& _app, Device& _device, LightSystem& _lightSystem)
+	: BaseRenderSystem{ _device }
+	, m_app(_app)
+	, m_lightSystem(_lightSystem)
+{
+	m_buffer = std::make_unique<Buffer>(m_device);
+
+	// copied between the layers and sampled with comparison, 16 bits are enough when 32 are not supported
+	m_depthFormat = m_device.FindSupportedFormat(
+		{ VK_FORMAT_D32_SFLOAT, VK_FORMAT_D16_UNORM },
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_TRANSFER_SRC_BIT | VK_FORMAT_FEATURE_TRANSFER_DST_BIT);
+
+	CreateRenderPasses();
+
+	// the casters need only their matrices, no descriptor set
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(ShadowPushConstants);
+	m_pushConstants.push_back(pushConstantRange);
+
+	CreatePipelineLayout({});
+}
+
+void ShadowSystem::Initialize()
+{
+	const uint32 atlasSize = m_app.GetConfig().ShadowAtlasSize;
+	assertMsgReturnVoid(atlasSize >= kPointFaceTileDivider && (atlasSize & (atlasSize - 1)) == 0, "The shadow atlas size has to be a power of two");
+
+	m_allocator.Initialize(atlasSize, atlasSize / kPointFaceTileDivider);
+
+	CreateAtlas();
+	CreateFramebuffers();
+	CreateSampler();
+
+	m_atlasImageInfo.sampler = m_sampler;
+	m_atlasImageInfo.imageView = m_layerViews[kCompositeLayer];
+	m_atlasImageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	m_shadowBuffers.resize(SwapChain::kMaxFramesInFlight);
+	m_shadowMappedMemory.resize(SwapChain::kMaxFramesInFlight, nullptr);
+
+	// fixed size, the ShadowData are at most kMaxShadowViews and small
+	for (int32 i = 0; i < SwapChain::kMaxFramesInFlight; ++i)
+	{
+		m_shadowBuffers[i] = m_buffer->Create<BufferComponent>(
+			sizeof(ShadowData),
+			kMaxShadowViews,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
+			VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
+			/*minUboAlignment*/1,
+			true
+		);
+
+		m_shadowMappedMemory[i] = static_cast<uint8*>(m_buffer->GetMappedMemory(m_shadowBuffers[i]));
+	}
+}
+
+void ShadowSystem::CreatePipeline()
+{
+	assertMsgReturnVoid(m_pipelineLayout != nullptr, "Cannot create pipeline before pipeline layout");
+
+	PipelineConfigInfo pipelineConfig{};
+
+	Pipeline::ShadowPipelineConfig(pipelineConfig);
+
+	// the load render pass is compatible, same single depth attachment
+	pipelineConfig.RenderPass = m_clearRenderPass;
+	pipelineConfig.PipelineLayout = m_pipelineLayout;
+
+	ShaderInfo vertexShader(
+		m_app.GetConfig().ShadersPath + "shadow_depth.vert.spv",
+		ShaderType::Vertex
+	);
+
+	m_pipeline = std::make_unique<Pipeline>(
+		m_device,
+		std::vector{
+				vertexShader
+		},
+		pipelineConfig
+		);
+}
+
+void ShadowSystem::Update(const FrameInfo& _frameInfo, const CameraComponent& _cameraComponent)
+{
+	++m_frameCounter;
+	m_updatedViews.clear();
+
+	const Config& config = m_app.GetConfig();
+
+	// the lights point to their ShadowData even if the shadows are disabled, they are all written as not valid then
+	const uint32 shadowDataCount = m_lightSystem.GetShadowViewCount();
+	const uint32 viewCount = config.EnableShadows ? shadowDataCount : 0u;
+
+	for (uint32 i = viewCount; i < static_cast<uint32>(m_views.size()); ++i)
+	{
+		m_allocator.Free(m_views[i].Tile);
+	}
+	m_views.resize(viewCount);
+
+	if (viewCount > 0)
+	{
+		for (const DirectionalLight& light : m_lightSystem.GetDirectionalLights())
+		{
+			if (light.Direction.w >= 0.0f)
+			{
+				PlaceDirectionalViews(light, _cameraComponent);
+			}
+		}
+
+		for (const PointLight& light : m_lightSystem.GetPointLights())
+		{
+			if (light.Position.w >= 0.0f)
+			{
+				PlacePointViews(light);
+			}
+		}
+
+		for (const SpotLight& light : m_lightSystem.GetSpotLights())
+		{
+			if (light.Position.w >= 0.0f)
+			{
+				PlaceSpotView(light);
+			}
+		}
+
+		GatherCasters();
+		SelectUpdatedViews();
+	}
+
+	// what the atlas holds, the views not redrawn this frame keep the data they have been drawn with
+	m_shadowData.assign(shadowDataCount, ShadowData{});
+	for (uint32 i = 0; i < viewCount; ++i)
+	{
+		if (m_views[i].IsRendered)
+		{
+			m_shadowData[i] = m_views[i].Rendered;
+		}
+	}
+
+	if (shadowDataCount > 0)
+	{
+		MemCpy(m_shadowMappedMemory[_frameInfo.FrameIndex], m_shadowData.data(), sizeof(ShadowData) * shadowDataCount);
+	}
+}
+
+void ShadowSystem::Render(const FrameInfo& _frameInfo)
+{
+	if (m_updatedViews.empty() || !m_pipeline)
+	{
+		return;
+	}
+
+	const VkCommandBuffer commandBuffer = _frameInfo.CommandBuffer;
+	const VkPipelineStageFlags depthStages = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	const VkAccessFlags depthAccess = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+	m_commandRecorder.Reset(commandBuffer);
+
+	// 1. the static casters of the views whose cache is stale, each tile cleared by its own render pass
+	const bool isAnyStaticStale = std::any_of(m_updatedViews.begin(), m_updatedViews.end(), [this](uint32 _viewIndex) { return m_views[_viewIndex].IsStaticStale; });
+	if (isAnyStaticStale)
+	{
+		RecordLayerBarrier(commandBuffer, kStaticLayer, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, depthStages, depthAccess);
+
+		for (uint32 viewIndex : m_updatedViews)
+		{
+			const ShadowView& view = m_views[viewIndex];
+			if (!view.IsStaticStale)
+			{
+				continue;
+			}
+
+			BeginTilePass(commandBuffer, m_clearRenderPass, kStaticLayer, view.Tile);
+			DrawCasters(_frameInfo, view, true);
+			vkCmdEndRenderPass(commandBuffer);
+		}
+
+		RecordLayerBarrier(commandBuffer, kStaticLayer, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			depthStages, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+	}
+
+	// 2. the cached static tiles restart the composite tiles, in one copy
+	RecordLayerBarrier(commandBuffer, kCompositeLayer, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+
+	std::vector<VkImageCopy> regions;
+	regions.reserve(m_updatedViews.size());
+	for (uint32 viewIndex : m_updatedViews)
+	{
+		const ShadowAtlasAllocator::Tile& tile = m_views[viewIndex].Tile;
+
+		VkImageCopy region{};
+		region.srcSubresource = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, kStaticLayer, 1 };
+		region.srcOffset = { static_cast<int32>(tile.X), static_cast<int32>(tile.Y), 0 };
+		region.dstSubresource = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, kCompositeLayer, 1 };
+		region.dstOffset = region.srcOffset;
+		region.extent = { tile.Size, tile.Size, 1 };
+		regions.push_back(region);
+	}
+
+	vkCmdCopyImage(commandBuffer,
+		m_atlasImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		m_atlasImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		static_cast<uint32>(regions.size()), regions.data());
+
+	RecordLayerBarrier(commandBuffer, kCompositeLayer, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, depthStages, depthAccess);
+
+	// 3. the dynamic casters on top
+	for (uint32 viewIndex : m_updatedViews)
+	{
+		const ShadowView& view = m_views[viewIndex];
+
+		BeginTilePass(commandBuffer, m_loadRenderPass, kCompositeLayer, view.Tile);
+		DrawCasters(_frameInfo, view, false);
+		vkCmdEndRenderPass(commandBuffer);
+	}
+
+	RecordLayerBarrier(commandBuffer, kCompositeLayer, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		depthStages, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+}
+
+void ShadowSystem::Cleanup()
+{
+	for (int32 i = 0; i < static_cast<int32>(m_shadowBuffers.size()); ++i)
+	{
+		m_buffer->Destroy(m_shadowBuffers[i]);
+	}
+	m_shadowBuffers.clear();
+	m_shadowMappedMemory.clear();
+
+	for (uint32 i = 0; i < kLayerCount; ++i)
+	{
+		if (m_framebuffers[i] != VK_NULL_HANDLE)
+		{
+			vkDestroyFramebuffer(m_device.GetDevice(), m_framebuffers[i], nullptr);
+			m_framebuffers[i] = VK_NULL_HANDLE;
+		}
+
+		if (m_layerViews[i] != VK_NULL_HANDLE)
+		{
+			vkDestroyImageView(m_device.GetDevice(), m_layerViews[i], nullptr);
+			m_layerViews[i] = VK_NULL_HANDLE;
+		}
+	}
+
+	if (m_sampler != VK_NULL_HANDLE)
+	{
+		vkDestroySampler(m_device.GetDevice(), m_sampler, nullptr);
+		m_sampler = VK_NULL_HANDLE;
+	}
+
+	if (m_atlasImage != VK_NULL_HANDLE)
+	{
+		vmaDestroyImage(m_device.GetAllocator(), m_atlasImage, m_atlasImageMemory);
+		m_atlasImage = VK_NULL_HANDLE;
+		m_atlasImageMemory = VK_NULL_HANDLE;
+	}
+
+	vkDestroyRenderPass(m_device.GetDevice(), m_clearRenderPass, nullptr);
+	vkDestroyRenderPass(m_device.GetDevice(), m_loadRenderPass, nullptr);
+	m_clearRenderPass = VK_NULL_HANDLE;
+	m_loadRenderPass = VK_NULL_HANDLE;
+
+	m_views.clear();
+	m_shadowData.clear();
+	m_casters.clear();
+	m_updatedViews.clear();
+}
+
+void ShadowSystem::CreateAtlas()
+{
+	const uint32 atlasSize = m_allocator.GetAtlasSize();
+
+	VkImageCreateInfo imageInfo{};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.extent = { atlasSize, atlasSize, 1 };
+	imageInfo.mipLevels = 1;
+	imageInfo.arrayLayers = kLayerCount;
+	imageInfo.format = m_depthFormat;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	m_device.CreateImageWithInfo(imageInfo, m_atlasImage, m_atlasImageMemory, VMA_MEMORY_USAGE_GPU_ONLY);
+
+	// one view per layer: the static layer is only a render target, the composite layer is also the sampled one
+	for (uint32 i = 0; i < kLayerCount; ++i)
+	{
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = m_atlasImage;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = m_depthFormat;
+		viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+		viewInfo.subresourceRange.baseMipLevel = 0;
+		viewInfo.subresourceRange.levelCount = 1;
+		viewInfo.subresourceRange.baseArrayLayer = i;
+		viewInfo.subresourceRange.layerCount = 1;
+
+		if (vkCreateImageView(m_device.GetDevice(), &viewInfo, nullptr, &m_layerViews[i]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create shadow atlas image view!");
+		}
+	}
+
+	// the layouts the layers rest in between the frames
+	VkCommandBuffer commandBuffer = m_device.BeginSingleTimeCommands();
+
+	RecordLayerBarrier(commandBuffer, kStaticLayer, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+	RecordLayerBarrier(commandBuffer, kCompositeLayer, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+	m_device.EndSingleTimeCommands(commandBuffer);
+}
+
+void ShadowSystem::CreateRenderPasses()
+{
+	VkAttachmentDescription depthAttachment{};
+	depthAttachment.format = m_depthFormat;
+	depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	// the layouts are changed by the barriers of Render, around all the tiles of a layer
+	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	VkAttachmentReference depthAttachmentRef{};
+	depthAttachmentRef.attachment = 0;
+	depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	VkSubpassDescription subpass{};
+	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpass.colorAttachmentCount = 0;
+	subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+	// the tiles drawn one after the other in the same layer
+	VkSubpassDependency dependency{};
+	dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependency.dstSubpass = 0;
+	dependency.srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependency.dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependency.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependency.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+	VkRenderPassCreateInfo renderPassInfo{};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	renderPassInfo.attachmentCount = 1;
+	renderPassInfo.pAttachments = &depthAttachment;
+	renderPassInfo.subpassCount = 1;
+	renderPassInfo.pSubpasses = &subpass;
+	renderPassInfo.dependencyCount = 1;
+	renderPassInfo.pDependencies = &dependency;
+
+	// static layer: only the render area, the tile, is cleared
+	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	if (vkCreateRenderPass(m_device.GetDevice(), &renderPassInfo, nullptr, &m_clearRenderPass) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create shadow clear render pass!");
+	}
+
+	// composite layer: the tile already holds the static casters
+	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	if (vkCreateRenderPass(m_device.GetDevice(), &renderPassInfo, nullptr, &m_loadRenderPass) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create shadow load render pass!");
+	}
+}
+
+void ShadowSystem::CreateFramebuffers()
+{
+	const uint32 atlasSize = m_allocator.GetAtlasSize();
+
+	for (uint32 i = 0; i < kLayerCount; ++i)
+	{
+		VkFramebufferCreateInfo framebufferInfo = {};
+		framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		framebufferInfo.renderPass = i == kStaticLayer ? m_clearRenderPass : m_loadRenderPass;
+		framebufferInfo.attachmentCount = 1;
+		framebufferInfo.pAttachments = &m_layerViews[i];
+		framebufferInfo.width = atlasSize;
+		framebufferInfo.height = atlasSize;
+		framebufferInfo.layers = 1;
+
+		if (vkCreateFramebuffer(
+			m_device.GetDevice(),
+			&framebufferInfo,
+			nullptr,
+			&m_framebuffers[i]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create shadow framebuffer!");
+		}
+	}
+}
+
+void ShadowSystem::CreateSampler()
+{
+	// hardware comparison, the linear filter blends the results of the 4 texels: with the PCF of the shader it is a smooth edge
+	VkSamplerCreateInfo samplerInfo{};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_LINEAR;
+	samplerInfo.minFilter = VK_FILTER_LINEAR;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.anisotropyEnable = VK_FALSE;
+	samplerInfo.maxAnisotropy = 1.0f;
+	samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+	samplerInfo.unnormalizedCoordinates = VK_FALSE;
+	samplerInfo.compareEnable = VK_TRUE;
+	samplerInfo.compareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+	samplerInfo.minLod = 0.0f;
+	samplerInfo.maxLod = 0.0f;
+	samplerInfo.mipLodBias = 0.0f;
+
+	if (vkCreateSampler(m_device.GetDevice(), &samplerInfo, nullptr, &m_sampler) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create shadow sampler!");
+	}
+}
+
+void ShadowSystem::PlaceDirectionalViews(const DirectionalLight& _light, const CameraComponent& _cameraComponent)
+{
+	const uint32 firstView = static_cast<uint32>(_light.Direction.w);
+	const glm::vec3 lightDirection(_light.Direction);
+	if (glm::dot(lightDirection, lightDirection) <= 0.0f)
+	{
+		for (uint32 i = 0; i < kShadowCascadeCount; ++i)
+		{
+			InvalidateView(firstView + i);
+		}
+		return;
+	}
+
+	// near and far back from the projection, left handed with depth from 0 to 1 (see glm_config.h)
+	const glm::mat4& projection = _cameraComponent.ProjectionMatrix;
+	const bool isOrthographic = projection[2][3] == 0.0f;
+	float cameraNear = -projection[3][2] / projection[2][2];
+	float cameraFar = isOrthographic ? (1.0f - projection[3][2]) / projection[2][2] : projection[3][2] / (1.0f - projection[2][2]);
+	cameraNear = std::max(cameraNear, LightClusterSystem::kMinNearPlane);
+	cameraFar = std::max(std::min(cameraFar, m_app.GetConfig().ShadowDistance), cameraNear * 2.0f);
+
+	// view space half size of the frustum, at depth 1 if perspective
+	const glm::vec2 halfExtent(1.0f / std::abs(projection[0][0]), 1.0f / std::abs(projection[1][1]));
+	const glm::mat4 inverseView = glm::inverse(_cameraComponent.ViewMatrix);
+
+	const glm::vec3 direction = glm::normalize(lightDirection);
+	const glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+	const glm::mat4 lightRotation = glm::lookAtLH(glm::vec3(0.0f), direction, up);
+	const glm::mat4 inverseLightRotation = glm::inverse(lightRotation);
+
+	const uint32 tileSize = m_allocator.GetAtlasSize() / kCascadeTileDivider;
+
+	float sliceNear = cameraNear;
+	for (uint32 i = 0; i < kShadowCascadeCount; ++i)
+	{
+		// practical split scheme, between the logarithmic and the uniform ones
+		const float t = static_cast<float>(i + 1) / static_cast<float>(kShadowCascadeCount);
+		const float logarithmicSplit = cameraNear * std::pow(cameraFar / cameraNear, t);
+		const float uniformSplit = cameraNear + (cameraFar - cameraNear) * t;
+		const float sliceFar = kCascadeSplitLambda * logarithmicSplit + (1.0f - kCascadeSplitLambda) * uniformSplit;
+
+		// the sphere around the slice does not change rotating the camera, so neither does the size of the texels
+		std::array<glm::vec3, 8> corners;
+		glm::vec3 center(0.0f);
+		for (int32 c = 0; c < 8; ++c)
+		{
+			const float depth = (c & 4) ? sliceFar : sliceNear;
+			const glm::vec2 halfSize = isOrthographic ? halfExtent : halfExtent * depth;
+			const glm::vec4 viewCorner((c & 1) ? halfSize.x : -halfSize.x, (c & 2) ? halfSize.y : -halfSize.y, depth, 1.0f);
+			corners[c] = glm::vec3(inverseView * viewCorner);
+			center += corners[c];
+		}
+		center /= 8.0f;
+
+		float radius = 0.0f;
+		for (const glm::vec3& corner : corners)
+		{
+			radius = std::max(radius, glm::length(corner - center));
+		}
+		radius = std::ceil(radius * 16.0f) / 16.0f;
+
+		// moved by whole texels in light space, so the shadow edges do not shimmer when the camera moves
+		const float texelWorldSize = 2.0f * radius / static_cast<float>(tileSize);
+		glm::vec3 lightCenter = glm::vec3(lightRotation * glm::vec4(center, 1.0f));
+		lightCenter.x = std::floor(lightCenter.x / texelWorldSize) * texelWorldSize;
+		lightCenter.y = std::floor(lightCenter.y / texelWorldSize) * texelWorldSize;
+		center = glm::vec3(inverseLightRotation * glm::vec4(lightCenter, 1.0f));
+
+		const glm::vec3 eye = center - direction * (radius + kCascadeBackOff);
+		const glm::mat4 view = glm::lookAtLH(eye, center, up);
+		const glm::mat4 projectionMatrix = glm::orthoLH_ZO(-radius, radius, -radius, radius, 0.0f, 2.0f * radius + kCascadeBackOff);
+
+		SetView(firstView + i, tileSize, view, projectionMatrix, texelWorldSize, sliceFar, false);
+
+		sliceNear = sliceFar;
+	}
+}
+
+void ShadowSystem::PlacePointViews(const PointLight& _light)
+{
+	static const glm::vec3 kFaceDirections[kPointShadowFaceCount] =
+	{
+		{ 1.0f, 0.0f, 0.0f }, { -1.0f, 0.0f, 0.0f },
+		{ 0.0f, 1.0f, 0.0f }, { 0.0f, -1.0f, 0.0f },
+		{ 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, -1.0f }
+	};
+	static const glm::vec3 kFaceUps[kPointShadowFaceCount] =
+	{
+		{ 0.0f, 1.0f, 0.0f }, { 0.0f, 1.0f, 0.0f },
+		{ 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, 1.0f },
+		{ 0.0f, 1.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }
+	};
+
+	const uint32 firstView = static_cast<uint32>(_light.Position.w);
+
+	// the lights never attenuated reach as far as the shadows go
+	const float range = std::min(LightClusterSystem::ComputePointLightRadius(_light), m_app.GetConfig().ShadowDistance);
+	if (range <= kPerspectiveNearPlane)
+	{
+		for (uint32 i = 0; i < kPointShadowFaceCount; ++i)
+		{
+			InvalidateView(firstView + i);
+		}
+		return;
+	}
+
+	const uint32 tileSize = m_allocator.GetAtlasSize() / kPointFaceTileDivider;
+	const glm::vec3 position(_light.Position);
+	const glm::mat4 projection = glm::perspectiveLH_ZO(glm::radians(90.0f), 1.0f, kPerspectiveNearPlane, range);
+	const float texelWorldSize = 2.0f / static_cast<float>(tileSize);
+
+	for (uint32 i = 0; i < kPointShadowFaceCount; ++i)
+	{
+		const glm::mat4 view = glm::lookAtLH(position, position + kFaceDirections[i], kFaceUps[i]);
+		SetView(firstView + i, tileSize, view, projection, texelWorldSize, range, true);
+	}
+}
+
+void ShadowSystem::PlaceSpotView(const SpotLight& _light)
+{
+	const uint32 viewIndex = static_cast<uint32>(_light.Position.w);
+	const glm::vec3 lightDirection(_light.Direction);
+
+	const float range = std::min(LightClusterSystem::ComputeSpotLightRadius(_light), m_app.GetConfig().ShadowDistance);
+	if (range <= kPerspectiveNearPlane || glm::dot(lightDirection, lightDirection) <= 0.0f)
+	{
+		InvalidateView(viewIndex);
+		return;
+	}
+
+	// the cutoffs are cosines, the wider cone is the smaller one. Not wider than 170 degrees, a perspective cannot reach 180
+	const float cosHalfAngle = std::clamp(std::min(_light.Params.x, _light.Params.y), std::cos(glm::radians(85.0f)), 1.0f);
+	const float halfAngle = std::max(std::acos(cosHalfAngle), glm::radians(1.0f));
+
+	const uint32 tileSize = m_allocator.GetAtlasSize() / kSpotTileDivider;
+	const glm::vec3 position(_light.Position);
+	const glm::vec3 direction = glm::normalize(lightDirection);
+	const glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+
+	const glm::mat4 view = glm::lookAtLH(position, position + direction, up);
+	const glm::mat4 projection = glm::perspectiveLH_ZO(2.0f * halfAngle, 1.0f, kPerspectiveNearPlane, range);
+	const float texelWorldSize = 2.0f * std::tan(halfAngle) / static_cast<float>(tileSize);
+
+	SetView(viewIndex, tileSize, view, projection, texelWorldSize, range, true);
+}
+
+void ShadowSystem::InvalidateView(uint32 _viewIndex)
+{
+	ShadowView& view = m_views[_viewIndex];
+	m_allocator.Free(view.Tile);
+	view.Tile = {};
+	view.IsValid = false;
+	view.IsRendered = false;
+}
+
+void ShadowSystem::SetView(uint32 _viewIndex, uint32 _tileSize, const glm::mat4& _view, const glm::mat4& _projection, float _texelWorldSize, float _cascadeFar, bool _isPerspective)
+{
+	ShadowView& view = m_views[_viewIndex];
+
+	// a new tile holds nothing of this view
+	if (view.Tile.Size != _tileSize)
+	{
+		InvalidateView(_viewIndex);
+		if (!m_allocator.Allocate(_tileSize, view.Tile))
+		{
+			// the atlas is full, tried again the next frame
+			view.Tile = {};
+			return;
+		}
+	}
+
+	view.ViewProjection = _projection * _view;
+	view.TexelWorldSize = _texelWorldSize;
+	view.CascadeFar = _cascadeFar;
+	view.IsPerspective = _isPerspective;
+	view.IsValid = true;
+
+	// Gribb-Hartmann, with depth from 0 to 1 the near plane is the third row alone
+	const glm::mat4& m = view.ViewProjection;
+	const glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+	const glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+	const glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+	const glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+	view.Planes[0] = row3 + row0;
+	view.Planes[1] = row3 - row0;
+	view.Planes[2] = row3 + row1;
+	view.Planes[3] = row3 - row1;
+	view.Planes[4] = row2;
+	view.Planes[5] = row3 - row2;
+
+	for (glm::vec4& plane : view.Planes)
+	{
+		plane /= glm::length(glm::vec3(plane));
+	}
+}
+
+void ShadowSystem::GatherCasters()
+{
+	ecs::EntityManager& entityManager = m_app.GetEntityManager();
+	ecs::ComponentManager& componentManager = m_app.GetComponentManager();
+
+	m_casters.clear();
+	m_staticHash = 0;
+
+	for (auto gameEntity : ecs::IterateEntitiesWithAll<PipelineOpaqueComponent, VertexBufferComponent, UpdateComponent, BoundsComponent, VisibilityComponent>(entityManager, componentManager))
+	{
+		const UpdateComponent& updateComponent = componentManager.GetComponent<UpdateComponent>(gameEntity);
+		const BoundsComponent& boundsComponent = componentManager.GetComponent<BoundsComponent>(gameEntity);
+
+		// the sphere around the local bounds, scaled by the largest axis of the model matrix
+		const glm::mat4& modelMatrix = updateComponent.ModelMatrix;
+		const float scale = std::max(std::max(glm::length(glm::vec3(modelMatrix[0])), glm::length(glm::vec3(modelMatrix[1]))), glm::length(glm::vec3(modelMatrix[2])));
+
+		ShadowCaster caster;
+		caster.EntityIndex = gameEntity.GetIndex();
+		caster.Center = glm::vec3(modelMatrix * glm::vec4((boundsComponent.Min + boundsComponent.Max) * 0.5f, 1.0f));
+		caster.Radius = glm::length(boundsComponent.Max - boundsComponent.Min) * 0.5f * scale;
+		caster.IsStatic = componentManager.HasComponents<StaticComponent>(gameEntity);
+		HashCombine(caster.Hash, caster.EntityIndex, modelMatrix);
+
+		// every static caster is in the cache of every view, any of them changing or disappearing invalidates all of it
+		if (caster.IsStatic)
+		{
+			HashCombine(m_staticHash, caster.Hash);
+		}
+
+		m_casters.push_back(caster);
+	}
+}
+
+void ShadowSystem::SelectUpdatedViews()
+{
+	m_candidateViews.clear();
+
+	for (uint32 i = 0; i < static_cast<uint32>(m_views.size()); ++i)
+	{
+		ShadowView& view = m_views[i];
+		if (!view.IsValid)
+		{
+			continue;
+		}
+
+		view.CurrentDynamicHash = 0;
+		for (const ShadowCaster& caster : m_casters)
+		{
+			if (!caster.IsStatic && IsSphereInFrustum(view.Planes, caster.Center, caster.Radius))
+			{
+				HashCombine(view.CurrentDynamicHash, caster.Hash);
+			}
+		}
+
+		view.IsStaticStale = !view.IsRendered || view.StaticHash != m_staticHash || view.Rendered.ViewProjection != view.ViewProjection;
+		if (view.IsStaticStale || view.DynamicHash != view.CurrentDynamicHash)
+		{
+			m_candidateViews.push_back(i);
+		}
+	}
+
+	// the ones waiting longer first, the never rendered ones before all
+	std::stable_sort(m_candidateViews.begin(), m_candidateViews.end(),
+		[this](uint32 _a, uint32 _b) { return m_views[_a].LastUpdateFrame < m_views[_b].LastUpdateFrame; });
+
+	const uint32 budget = m_app.GetConfig().ShadowUpdateBudget;
+	if (budget > 0 && m_candidateViews.size() > budget)
+	{
+		m_candidateViews.resize(budget);
+	}
+
+	const float atlasSize = static_cast<float>(m_allocator.GetAtlasSize());
+	for (uint32 viewIndex : m_candidateViews)
+	{
+		ShadowView& view = m_views[viewIndex];
+
+		view.Rendered.ViewProjection = view.ViewProjection;
+		view.Rendered.AtlasRect = glm::vec4(
+			static_cast<float>(view.Tile.X), static_cast<float>(view.Tile.Y),
+			static_cast<float>(view.Tile.Size), static_cast<float>(view.Tile.Size)) / atlasSize;
+		view.Rendered.Params = glm::vec4(1.0f, view.TexelWorldSize, view.CascadeFar, view.IsPerspective ? 1.0f : 0.0f);
+
+		view.StaticHash = m_staticHash;
+		view.DynamicHash = view.CurrentDynamicHash;
+		view.LastUpdateFrame = m_frameCounter;
+		view.IsRendered = true;
+
+		m_updatedViews.push_back(viewIndex);
+	}
+}
+
+void ShadowSystem::BeginTilePass(VkCommandBuffer _commandBuffer, VkRenderPass _renderPass, uint32 _layer, const ShadowAtlasAllocator::Tile& _tile) const
+{
+	VkClearValue clearValue{};
+	clearValue.depthStencil = { 1.0f, 0 };
+
+	VkRenderPassBeginInfo renderPassInfo{};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.renderPass = _renderPass;
+	renderPassInfo.framebuffer = m_framebuffers[_layer];
+	renderPassInfo.renderArea.offset = { static_cast<int32>(_tile.X), static_cast<int32>(_tile.Y) };
+	renderPassInfo.renderArea.extent = { _tile.Size, _tile.Size };
+	renderPassInfo.clearValueCount = 1;
+	renderPassInfo.pClearValues = &clearValue;
+
+	vkCmdBeginRenderPass(_commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+	VkViewport viewport{};
+	viewport.x = static_cast<float>(_tile.X);
+	viewport.y = static_cast<float>(_tile.Y);
+	viewport.width = static_cast<float>(_tile.Size);
+	viewport.height = static_cast<float>(_tile.Size);
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(_commandBuffer, 0, 1, &viewport);
+	vkCmdSetScissor(_commandBuffer, 0, 1, &renderPassInfo.renderArea);
+}
+
+void ShadowSystem::DrawCasters(const FrameInfo& _frameInfo, const ShadowView& _view, bool _isStatic)
+{
+	ecs::EntityManager& entityManager = m_app.GetEntityManager();
+	ecs::ComponentManager& componentManager = m_app.GetComponentManager();
+
+	m_commandRecorder.BindPipeline(_frameInfo.CommandBuffer, *m_pipeline);
+
+	ShadowPushConstants pushConstants;
+	pushConstants.ViewProjection = _view.ViewProjection;
+
+	for (const ShadowCaster& caster : m_casters)
+	{
+		if (caster.IsStatic != _isStatic || !IsSphereInFrustum(_view.Planes, caster.Center, caster.Radius))
+		{
+			continue;
+		}
+
+		const ecs::Entity entity = entityManager.GetEntity(caster.EntityIndex);
+		const VertexBufferComponent& vertexBufferComponent = componentManager.GetComponent<VertexBufferComponent>(entity);
+		const UpdateComponent& updateComponent = componentManager.GetComponent<UpdateComponent>(entity);
+
+		pushConstants.ModelMatrix = updateComponent.ModelMatrix;
+
+		// both faces cast, see Pipeline::ShadowPipelineConfig, the winding is set only because it is a dynamic state
+		m_commandRecorder.SetCullMode(_frameInfo.CommandBuffer, VK_CULL_MODE_NONE);
+		m_commandRecorder.SetFrontFace(_frameInfo.CommandBuffer, updateComponent.IsMirrored ? VK_FRONT_FACE_CLOCKWISE : VK_FRONT_FACE_COUNTER_CLOCKWISE);
+
+		PushConstants(_frameInfo.CommandBuffer, 0, &pushConstants);
+
+		if (componentManager.HasComponents<IndexBufferComponent>(entity))
+		{
+			const IndexBufferComponent& indexBufferComponent = componentManager.GetComponent<IndexBufferComponent>(entity);
+			Bind(vertexBufferComponent, indexBufferComponent, _frameInfo.CommandBuffer);
+			Draw(indexBufferComponent, _frameInfo.CommandBuffer);
+		}
+		else
+		{
+			Bind(vertexBufferComponent, _frameInfo.CommandBuffer);
+			Draw(vertexBufferComponent, _frameInfo.CommandBuffer);
+		}
+	}
+}
+
+void ShadowSystem::RecordLayerBarrier(VkCommandBuffer _commandBuffer, uint32 _layer, VkImageLayout _oldLayout, VkImageLayout _newLayout,
+	VkPipelineStageFlags _srcStage, VkAccessFlags _srcAccess, VkPipelineStageFlags _dstStage, VkAccessFlags _dstAccess) const
+{
+	VkImageMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.oldLayout = _oldLayout;
+	barrier.newLayout = _newLayout;
+	barrier.srcAccessMask = _srcAccess;
+	barrier.dstAccessMask = _dstAccess;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = m_atlasImage;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = 1;
+	barrier.subresourceRange.baseArrayLayer = _layer;
+	barrier.subresourceRange.layerCount = 1;
+
+	vkCmdPipelineBarrier(
+		_commandBuffer,
+		_srcStage,
+		_dstStage,
+		0,
+		0, nullptr,
+		0, nullptr,
+		1, &barrier);
+}
+
+bool ShadowSystem::IsSphereInFrustum(const glm::vec4 (&_planes)[6], const glm::vec3& _center, float _radius)
+{
+	for (const glm::vec4& plane : _planes)
+	{
+		if (glm::dot(glm::vec3(plane), _center) + plane.w < -_radius)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+VESPERENGINE_NAMESPACE_END
@@ -0,0 +1,166 @@
+// Copyright (c) 2025-2025 Michele Condo'
+// File: C:\Projects\Vesper\VesperEngine\Systems\shadow_system.h
+// Licensed under the MIT License. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include "Core/core_defines.h"
+#include "Core/glm_config.h"
+
+#include "Systems/base_render_system.h"
+#include "Systems/shadow_atlas_allocator.h"
+#include "Systems/uniform_buffer.h"
+
+#include "Components/graphics_components.h"
+
+#include "vulkan/vulkan.h"
+
+#include <memory>
+#include <vector>
+
+
+VESPERENGINE_NAMESPACE_BEGIN
+
+class VesperApp;
+class Device;
+class Pipeline;
+class Buffer;
+class LightSystem;
+
+struct FrameInfo;
+struct CameraComponent;
+
+/**
+ * Shadow maps of the lights, every view a square tile of one depth atlas: kShadowCascadeCount cascades per directional light,
+ * kPointShadowFaceCount faces per point light and one view per spot light, in the ShadowData range the LightSystem gave to the light.
+ * The atlas has two layers. The static layer caches the depth of the casters with a StaticComponent and is redrawn only when
+ * the view, its tile or any static caster changes. The composite layer, the one sampled, is the static tile copied over
+ * with the dynamic casters drawn on top, redone only when the static tile changed or the dynamic casters in the view did.
+ * At most ShadowUpdateBudget views are redrawn per frame, the ones waiting longer first: the others keep the depth and the ShadowData
+ * they have been drawn with, so what is sampled is always coherent, at worst a few frames late.
+ */
+class VESPERENGINE_API ShadowSystem : public BaseRenderSystem
+{
+public:
+	static constexpr uint32 kStaticLayer = 0u;
+	static constexpr uint32 kCompositeLayer = 1u;
+	static constexpr uint32 kLayerCount = 2u;
+
+	// tile side as a fraction of the atlas side
+	static constexpr uint32 kCascadeTileDivider = 4u;
+	static constexpr uint32 kSpotTileDivider = 8u;
+	static constexpr uint32 kPointFaceTileDivider = 16u;
+
+	static constexpr float kCascadeSplitLambda = 0.75f;		// 0 uniform splits, 1 logarithmic splits
+	static constexpr float kCascadeBackOff = 20.0f;			// world units the cascade extends toward the light, for the casters out of the camera slice
+	static constexpr float kPerspectiveNearPlane = 0.05f;
+
+public:
+	ShadowSystem(VesperApp& _app, Device& _device, LightSystem& _lightSystem);
+	virtual ~ShadowSystem() = default;
+
+	ShadowSystem(const ShadowSystem&) = delete;
+	ShadowSystem& operator=(const ShadowSystem&) = delete;
+
+public:
+	// the composite layer, with the comparison sampler
+	VESPERENGINE_INLINE const VkDescriptorImageInfo& GetAtlasImageInfo() const { return m_atlasImageInfo; }
+	VESPERENGINE_INLINE VkImage GetAtlasImage() const { return m_atlasImage; }
+	VESPERENGINE_INLINE VkBuffer GetShadowBuffer(const int32 _frameIndex) const { return m_shadowBuffers[_frameIndex].Buffer; }
+	// views redrawn by the last Update, to monitor the budget
+	VESPERENGINE_INLINE uint32 GetUpdatedViewCount() const { return static_cast<uint32>(m_updatedViews.size()); }
+
+public:
+	// Create the atlas and the per frame ShadowData buffers, before the MasterRenderSystem::Initialize which binds them
+	void Initialize();
+	void CreatePipeline();
+	// Call after MasterRenderSystem::UpdateScene, which gathers the lights: place the views, find the ones to redraw and write the ShadowData of the frame
+	void Update(const FrameInfo& _frameInfo, const CameraComponent& _cameraComponent);
+	// Call outside of any render pass, before the draws sampling the atlas
+	void Render(const FrameInfo& _frameInfo);
+	// Call at the end or at destruction time, anyway after the game loop is done.
+	void Cleanup();
+
+private:
+	struct ShadowView
+	{
+		glm::mat4 ViewProjection{ 1.0f };
+		glm::vec4 Planes[6]{};					// of the frustum of ViewProjection, xyz inward normal, w distance
+		ShadowAtlasAllocator::Tile Tile{};
+		float TexelWorldSize{ 0.0f };
+		float CascadeFar{ 0.0f };
+		std::size_t CurrentDynamicHash{ 0 };	// of the dynamic casters in the frustum this frame
+		bool IsPerspective{ false };
+		bool IsValid{ false };					// false if the light does not reach anything or there is no tile for it
+
+		// what the atlas holds for this view, its tile is Tile: when the tile changes the view is not rendered anymore
+		ShadowData Rendered{};
+		std::size_t StaticHash{ 0 };
+		std::size_t DynamicHash{ 0 };
+		uint64 LastUpdateFrame{ 0 };
+		bool IsRendered{ false };
+		bool IsStaticStale{ false };			// set for the views redrawn this frame, if the static layer has to be redrawn too
+	};
+
+	struct ShadowCaster
+	{
+		std::size_t Hash{ 0 };					// of the entity and its model matrix
+		glm::vec3 Center{ 0.0f };				// world space bounding sphere
+		float Radius{ 0.0f };
+		uint16 EntityIndex{ 0 };
+		bool IsStatic{ false };
+	};
+
+	void CreateAtlas();
+	void CreateRenderPasses();
+	void CreateFramebuffers();
+	void CreateSampler();
+
+	void PlaceDirectionalViews(const DirectionalLight& _light, const CameraComponent& _cameraComponent);
+	void PlacePointViews(const PointLight& _light);
+	void PlaceSpotView(const SpotLight& _light);
+	void InvalidateView(uint32 _viewIndex);
+	void SetView(uint32 _viewIndex, uint32 _tileSize, const glm::mat4& _view, const glm::mat4& _projection, float _texelWorldSize, float _cascadeFar, bool _isPerspective);
+	void GatherCasters();
+	void SelectUpdatedViews();
+
+	void BeginTilePass(VkCommandBuffer _commandBuffer, VkRenderPass _renderPass, uint32 _layer, const ShadowAtlasAllocator::Tile& _tile) const;
+	void DrawCasters(const FrameInfo& _frameInfo, const ShadowView& _view, bool _isStatic);
+	void RecordLayerBarrier(VkCommandBuffer _commandBuffer, uint32 _layer, VkImageLayout _oldLayout, VkImageLayout _newLayout,
+		VkPipelineStageFlags _srcStage, VkAccessFlags _srcAccess, VkPipelineStageFlags _dstStage, VkAccessFlags _dstAccess) const;
+
+	static bool IsSphereInFrustum(const glm::vec4 (&_planes)[6], const glm::vec3& _center, float _radius);
+
+private:
+	VesperApp& m_app;
+	LightSystem& m_lightSystem;
+
+	std::unique_ptr<Pipeline> m_pipeline;
+	std::unique_ptr<Buffer> m_buffer;
+
+	ShadowAtlasAllocator m_allocator;
+
+	VkFormat m_depthFormat{ VK_FORMAT_UNDEFINED };
+	VkImage m_atlasImage{ VK_NULL_HANDLE };
+	VmaAllocation m_atlasImageMemory{ VK_NULL_HANDLE };
+	VkImageView m_layerViews[kLayerCount]{ VK_NULL_HANDLE, VK_NULL_HANDLE };
+	VkFramebuffer m_framebuffers[kLayerCount]{ VK_NULL_HANDLE, VK_NULL_HANDLE };
+	VkRenderPass m_clearRenderPass{ VK_NULL_HANDLE };		// static layer, the tile is cleared
+	VkRenderPass m_loadRenderPass{ VK_NULL_HANDLE };		// composite layer, drawn over the copied static tile
+	VkSampler m_sampler{ VK_NULL_HANDLE };
+	VkDescriptorImageInfo m_atlasImageInfo{};
+
+	std::vector<BufferComponent> m_shadowBuffers;
+	std::vector<uint8*> m_shadowMappedMemory;		// per frame, persistent mapping cached at creation
+
+	std::vector<ShadowView> m_views;				// indexed like the ShadowData
+	std::vector<ShadowData> m_shadowData;
+	std::vector<ShadowCaster> m_casters;
+	std::vector<uint32> m_updatedViews;				// views redrawn this frame
+	std::vector<uint32> m_candidateViews;			// per frame scratch
+
+	std::size_t m_staticHash{ 0 };
+	uint64 m_frameCounter{ 0 };
+};
+
+VESPERENGINE_NAMESPACE_END
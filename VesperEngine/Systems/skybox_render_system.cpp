@@ -9,10 +9,10 @@
 #include "Backend/frame_info.h"
 #include "Backend/descriptors.h"
 #include "Backend/device.h"
+#include "Backend/render_packet.h"
 
 #include "Components/graphics_components.h"
 #include "Components/object_components.h"
-#include "Components/camera_components.h"
 #include "Components/pipeline_components.h"
 
 #include "App/vesper_app.h"
@@ -99,40 +99,32 @@ void SkyboxRenderSystem::Update(const FrameInfo& _frameInfo)
 
 void SkyboxRenderSystem::Render(const FrameInfo& _frameInfo)
 {
-    m_pipeline->Bind(_frameInfo.CommandBuffer);
-
-    ecs::EntityManager& entityManager = m_app.GetEntityManager();
-    ecs::ComponentManager& componentManager = m_app.GetComponentManager();
-
-    // Get active camera data
-    std::vector<ecs::Entity> cameras = ecs::EntityCollector::CollectEntitiesWithAll<CameraActive, CameraComponent, CameraTransformComponent>(entityManager, componentManager);
-    if (cameras.empty())
+    assertMsgReturnVoid(_frameInfo.RenderPackets != nullptr, "The render packets must be extracted before recording");
+    const RenderPacketRange packets = _frameInfo.RenderPackets->GetRange(RenderPacketPipeline::Skybox);
+    if (packets.Count == 0)
     {
         return;
     }
 
-    CameraComponent camera = componentManager.GetComponent<CameraComponent>(cameras[0]);
+    m_commandRecorder.Reset(_frameInfo.CommandBuffer);
 
-    glm::mat4 view = glm::mat4(glm::mat3(camera.ViewMatrix));
-    SkyboxPushConstant push{};
-    push.ViewProjection = camera.ProjectionMatrix * view;
+    m_pipeline->Bind(_frameInfo.CommandBuffer);
 
-    for (auto entity : ecs::IterateEntitiesWithAll<PipelineSkyboxComponent, VertexBufferComponent, SkyboxMaterialComponent, VisibilityComponent>(entityManager, componentManager))
+    for (const RenderPacket& packet : packets)
     {
-        const VertexBufferComponent& vertex = componentManager.GetComponent<VertexBufferComponent>(entity);
-        const IndexBufferComponent& index = componentManager.GetComponent<IndexBufferComponent>(entity);
-        SkyboxMaterialComponent& sb = componentManager.GetComponent<SkyboxMaterialComponent>(entity);
-
         vkCmdBindDescriptorSets(
             _frameInfo.CommandBuffer,
             VK_PIPELINE_BIND_POINT_GRAPHICS,
             m_pipelineLayout,
             m_skyboxSetIndex,
             1,
-            &sb.BoundDescriptorSet[_frameInfo.FrameIndex],
+            &packet.MaterialDescriptorSet,
             0,
             nullptr);
 
+        // the view projection of the skybox, extracted with the packet
+        SkyboxPushConstant push{};
+        push.ViewProjection = packet.ModelMatrix;
         PushConstants(_frameInfo.CommandBuffer, 0, 0, sizeof(SkyboxPushConstant), &push);
 
         //if (vkCmdSetCullModeEXT && vkCmdSetFrontFaceEXT)  // no need, we do throw and exception if not supported
@@ -141,8 +133,8 @@ void SkyboxRenderSystem::Render(const FrameInfo& _frameInfo)
             vkCmdSetFrontFaceEXT(_frameInfo.CommandBuffer, VK_FRONT_FACE_COUNTER_CLOCKWISE);
         }
 
-        Bind(vertex, index, _frameInfo.CommandBuffer);
-        Draw(index, _frameInfo.CommandBuffer);
+        Bind(packet, _frameInfo.CommandBuffer);
+        Draw(packet, _frameInfo.CommandBuffer);
     }
 }
 
@@ -0,0 +1,453 @@
+// Copyright (c) 2025-2025 Michele Condo'
+// File: C:\Projects\Vesper\VesperEngine\Systems\static_batch_system.cpp
+// Licensed under the MIT License. See LICENSE file in the project root for full license information.
+
+#include "Systems/static_batch_system.h"
+#include "Systems/model_system.h"
+#include "Systems/game_entity_system.h"
+#include "Systems/entity_handler_system.h"
+
+#include "Backend/device.h"
+#include "Backend/buffer.h"
+#include "Backend/model_data.h"
+
+#include "Components/object_components.h"
+#include "Components/pipeline_components.h"
+
+#include "App/vesper_app.h"
+#include "App/config.h"
+
+#include "ECS/ECS/ecs.h"
+
+#include <algorithm>
+#include <limits>
+
+
+VESPERENGINE_NAMESPACE_BEGIN
+
+namespace
+{
+	// spread the lower 10 bits of _value to every third bit
+	uint32 SpreadBits(uint32 _value)
+	{
+		_value &= 0x000003ffu;
+		_value = (_value | (_value << 16)) & 0x030000ffu;
+		_value = (_value | (_value << 8)) & 0x0300f00fu;
+		_value = (_value | (_value << 4)) & 0x030c30c3u;
+		_value = (_value | (_value << 2)) & 0x09249249u;
+		return _value;
+	}
+
+	// 30 bits Morton code of _point normalized inside _min, _max
+	uint32 ComputeMortonCode(const glm::vec3& _point, const glm::vec3& _min, const glm::vec3& _max)
+	{
+		const glm::vec3 extent = glm::max(_max - _min, glm::vec3(1e-6f));
+		const glm::vec3 normalized = glm::clamp((_point - _min) / extent, glm::vec3(0.0f), glm::vec3(1.0f));
+		const glm::uvec3 quantized = glm::uvec3(normalized * 1023.0f);
+
+		return (SpreadBits(quantized.x) << 2) | (SpreadBits(quantized.y) << 1) | SpreadBits(quantized.z);
+	}
+}
+
+StaticBatchSystem::StaticBatchSystem(VesperApp& _app, Device& _device, ModelSystem& _modelSystem, GameEntitySystem& _gameEntitySystem, EntityHandlerSystem& _entityHandlerSystem)
+	: m_app(_app)
+	, m_device(_device)
+	, m_modelSystem(_modelSystem)
+	, m_gameEntitySystem(_gameEntitySystem)
+	, m_entityHandlerSystem(_entityHandlerSystem)
+{
+	m_buffer = std::make_unique<Buffer>(m_device);
+}
+
+void StaticBatchSystem::BuildBatches()
+{
+	assertMsgReturnVoid(m_app.GetConfig().EnableStaticBatching, "Static batching requires Config::EnableStaticBatching set before loading the models");
+	assertMsgReturnVoid(m_clusterEntities.empty(), "Static batches already built, clear them first");
+
+	CollectCandidates();
+	SplitClusters();
+
+	std::vector<Vertex> vertices;
+	std::vector<uint32> indices;
+
+	// a cluster of a single entity would be the same draw of the entity, it is left as it is
+	for (Cluster& cluster : m_clusters)
+	{
+		if (cluster.CandidateCount < 2)
+		{
+			continue;
+		}
+
+		cluster.FirstVertex = static_cast<uint32>(vertices.size());
+		cluster.FirstIndex = static_cast<uint32>(indices.size());
+
+		for (uint32 i = cluster.FirstCandidate; i < cluster.FirstCandidate + cluster.CandidateCount; ++i)
+		{
+			AppendCandidate(m_candidates[i], cluster, vertices, indices);
+		}
+	}
+
+	if (!vertices.empty())
+	{
+		CreateBuffers(vertices, indices);
+
+		for (const Cluster& cluster : m_clusters)
+		{
+			if (cluster.CandidateCount >= 2)
+			{
+				CreateClusterEntity(cluster);
+			}
+		}
+	}
+
+	// the CPU copies are not needed anymore, the merged vertices are on the GPU now
+	m_modelSystem.ReleaseRetainedGeometryData();
+
+	m_candidates.clear();
+	m_clusters.clear();
+}
+
+void StaticBatchSystem::ClearBatches()
+{
+	ecs::EntityManager& entityManager = m_app.GetEntityManager();
+	ecs::ComponentManager& componentManager = m_app.GetComponentManager();
+
+	for (const uint32 entityIndex : m_clusterEntities)
+	{
+		const ecs::Entity entity = entityManager.GetEntity(static_cast<uint16>(entityIndex));
+
+		componentManager.RemoveComponent<VertexBufferComponent>(entity);
+		componentManager.RemoveComponent<IndexBufferComponent>(entity);
+		componentManager.RemoveComponent<BoundsComponent>(entity);
+		componentManager.RemoveComponent<StaticComponent>(entity);
+		componentManager.RemoveComponent<PipelineOpaqueComponent>(entity);
+
+		if (componentManager.HasComponents<PhongMaterialComponent>(entity))
+		{
+			componentManager.RemoveComponent<PhongMaterialComponent>(entity);
+		}
+
+		if (componentManager.HasComponents<PBRMaterialComponent>(entity))
+		{
+			componentManager.RemoveComponent<PBRMaterialComponent>(entity);
+		}
+
+		m_gameEntitySystem.DestroyGameEntity(entity);
+	}
+	m_clusterEntities.clear();
+
+	for (const uint32 entityIndex : m_mergedEntities)
+	{
+		const ecs::Entity entity = entityManager.GetEntity(static_cast<uint16>(entityIndex));
+		componentManager.AddComponent<VisibilityComponent>(entity);
+	}
+	m_mergedEntities.clear();
+
+	if (m_vertexBuffer.Buffer != VK_NULL_HANDLE)
+	{
+		m_buffer->Destroy(m_vertexBuffer);
+		m_vertexBuffer = VertexBufferComponent{};
+	}
+
+	if (m_indexBuffer.Buffer != VK_NULL_HANDLE)
+	{
+		m_buffer->Destroy(m_indexBuffer);
+		m_indexBuffer = IndexBufferComponent{};
+	}
+}
+
+void StaticBatchSystem::CollectCandidates()
+{
+	ecs::EntityManager& entityManager = m_app.GetEntityManager();
+	ecs::ComponentManager& componentManager = m_app.GetComponentManager();
+
+	m_candidates.clear();
+
+	glm::vec3 sceneMin{ std::numeric_limits<float>::max() };
+	glm::vec3 sceneMax{ std::numeric_limits<float>::lowest() };
+
+	for (auto gameEntity : ecs::IterateEntitiesWithAll<StaticComponent, PipelineOpaqueComponent, GeometryComponent, VertexBufferComponent, BoundsComponent, TransformComponent, UpdateComponent, VisibilityComponent>(entityManager, componentManager))
+	{
+		// the morph targets are blended in the vertex shader, on the local vertices
+		if (componentManager.HasComponents<MorphWeightsComponent>(gameEntity))
+		{
+			continue;
+		}
+
+		uint64 materialKey;
+		if (componentManager.HasComponents<PBRMaterialComponent>(gameEntity))
+		{
+			materialKey = (1ull << 32) | static_cast<uint32>(componentManager.GetComponent<PBRMaterialComponent>(gameEntity).Index);
+		}
+		else if (componentManager.HasComponents<PhongMaterialComponent>(gameEntity))
+		{
+			materialKey = static_cast<uint32>(componentManager.GetComponent<PhongMaterialComponent>(gameEntity).Index);
+		}
+		else
+		{
+			continue;
+		}
+
+		const GeometryComponent& geometryComponent = componentManager.GetComponent<GeometryComponent>(gameEntity);
+		const ModelData* data = m_modelSystem.GetRetainedGeometryData(geometryComponent.Handle);
+		if (data == nullptr || data->Vertices.empty())
+		{
+			continue;
+		}
+
+		const TransformComponent& transformComponent = componentManager.GetComponent<TransformComponent>(gameEntity);
+		const UpdateComponent& updateComponent = componentManager.GetComponent<UpdateComponent>(gameEntity);
+		const BoundsComponent& boundsComponent = componentManager.GetComponent<BoundsComponent>(gameEntity);
+
+		Candidate& candidate = m_candidates.emplace_back();
+
+		// the winding is kept per cluster, the mirrored entities keep their front face
+		candidate.GroupKey = (materialKey << 1) | (updateComponent.IsMirrored ? 1ull : 0ull);
+		candidate.EntityIndex = gameEntity.GetIndex();
+		candidate.Data = data;
+
+		// same composition of the render systems, the model matrix is not computed yet at load time
+		candidate.ModelMatrix = glm::translate(glm::mat4{ 1.0f }, transformComponent.Position);
+		candidate.ModelMatrix = candidate.ModelMatrix * glm::toMat4(transformComponent.Rotation);
+		candidate.ModelMatrix = glm::scale(candidate.ModelMatrix, transformComponent.Scale);
+
+		// world bounds of the 8 transformed corners
+		candidate.BoundsMin = glm::vec3{ std::numeric_limits<float>::max() };
+		candidate.BoundsMax = glm::vec3{ std::numeric_limits<float>::lowest() };
+		for (uint32 corner = 0; corner < 8; ++corner)
+		{
+			const glm::vec3 local{
+				(corner & 1u) ? boundsComponent.Max.x : boundsComponent.Min.x,
+				(corner & 2u) ? boundsComponent.Max.y : boundsComponent.Min.y,
+				(corner & 4u) ? boundsComponent.Max.z : boundsComponent.Min.z };
+			const glm::vec3 world = glm::vec3(candidate.ModelMatrix * glm::vec4(local, 1.0f));
+
+			candidate.BoundsMin = glm::min(candidate.BoundsMin, world);
+			candidate.BoundsMax = glm::max(candidate.BoundsMax, world);
+		}
+
+		sceneMin = glm::min(sceneMin, candidate.BoundsMin);
+		sceneMax = glm::max(sceneMax, candidate.BoundsMax);
+	}
+
+	for (Candidate& candidate : m_candidates)
+	{
+		candidate.MortonCode = ComputeMortonCode(0.5f * (candidate.BoundsMin + candidate.BoundsMax), sceneMin, sceneMax);
+	}
+
+	// grouped by material and winding, spatially coherent inside every group
+	std::sort(m_candidates.begin(), m_candidates.end(), [](const Candidate& _a, const Candidate& _b)
+		{
+			return _a.GroupKey != _b.GroupKey ? _a.GroupKey < _b.GroupKey : _a.MortonCode < _b.MortonCode;
+		});
+}
+
+void StaticBatchSystem::SplitClusters()
+{
+	const float clusterSize = m_app.GetConfig().StaticBatchClusterSize;
+	const uint32 maxVertexCount = m_app.GetConfig().StaticBatchMaxClusterVertexCount;
+
+	m_clusters.clear();
+
+	for (uint32 i = 0; i < static_cast<uint32>(m_candidates.size()); ++i)
+	{
+		const Candidate& candidate = m_candidates[i];
+		const uint32 vertexCount = static_cast<uint32>(candidate.Data->Vertices.size());
+
+		if (!m_clusters.empty())
+		{
+			Cluster& cluster = m_clusters.back();
+			const Candidate& first = m_candidates[cluster.FirstCandidate];
+
+			const glm::vec3 mergedMin = glm::min(cluster.BoundsMin, candidate.BoundsMin);
+			const glm::vec3 mergedMax = glm::max(cluster.BoundsMax, candidate.BoundsMax);
+			const glm::vec3 mergedExtent = mergedMax - mergedMin;
+
+			// along the Morton curve the next candidate is close to the last ones, it joins them while the cluster stays small enough
+			if (first.GroupKey == candidate.GroupKey
+				&& cluster.VertexCount + vertexCount <= maxVertexCount
+				&& std::max(mergedExtent.x, std::max(mergedExtent.y, mergedExtent.z)) <= clusterSize)
+			{
+				cluster.CandidateCount += 1;
+				cluster.VertexCount += vertexCount;
+				cluster.BoundsMin = mergedMin;
+				cluster.BoundsMax = mergedMax;
+				continue;
+			}
+		}
+
+		Cluster& cluster = m_clusters.emplace_back();
+		cluster.FirstCandidate = i;
+		cluster.CandidateCount = 1;
+		cluster.VertexCount = vertexCount;
+		cluster.BoundsMin = candidate.BoundsMin;
+		cluster.BoundsMax = candidate.BoundsMax;
+	}
+}
+
+void StaticBatchSystem::AppendCandidate(const Candidate& _candidate, Cluster& _cluster, std::vector<Vertex>& _vertices, std::vector<uint32>& _indices) const
+{
+	const glm::mat3 tangentMatrix = glm::mat3(_candidate.ModelMatrix);
+	const glm::mat3 normalMatrix = glm::transpose(glm::inverse(tangentMatrix));
+
+	// indices are local to the cluster, the IndexBufferComponent::VertexOffset of the cluster points to its first vertex
+	const uint32 baseVertex = static_cast<uint32>(_vertices.size()) - _cluster.FirstVertex;
+
+	for (const Vertex& source : _candidate.Data->Vertices)
+	{
+		Vertex& vertex = _vertices.emplace_back(source);
+		vertex.Position = glm::vec3(_candidate.ModelMatrix * glm::vec4(source.Position, 1.0f));
+		vertex.Normal = glm::normalize(normalMatrix * source.Normal);
+
+		// the bitangent sign is kept, the shader rebuilds it from the world space normal and tangent as for the not merged entities
+		if (glm::dot(glm::vec3(source.Tangent), glm::vec3(source.Tangent)) > 0.0f)
+		{
+			vertex.Tangent = glm::vec4(glm::normalize(tangentMatrix * glm::vec3(source.Tangent)), source.Tangent.w);
+		}
+	}
+
+	const std::vector<uint32>& sourceIndices = _candidate.Data->Indices;
+	const uint32 vertexCount = static_cast<uint32>(_candidate.Data->Vertices.size());
+
+	// not indexed geometry gets the sequential indices, the cluster is always drawn indexed
+	if (sourceIndices.empty())
+	{
+		for (uint32 i = 0; i < vertexCount; ++i)
+		{
+			_indices.push_back(baseVertex + i);
+		}
+	}
+	else
+	{
+		for (const uint32 index : sourceIndices)
+		{
+			_indices.push_back(baseVertex + index);
+		}
+	}
+
+	_cluster.IndexCount = static_cast<uint32>(_indices.size()) - _cluster.FirstIndex;
+}
+
+void StaticBatchSystem::CreateClusterEntity(const Cluster& _cluster)
+{
+	ecs::EntityManager& entityManager = m_app.GetEntityManager();
+	ecs::ComponentManager& componentManager = m_app.GetComponentManager();
+
+	const Candidate& first = m_candidates[_cluster.FirstCandidate];
+	const ecs::Entity firstEntity = entityManager.GetEntity(static_cast<uint16>(first.EntityIndex));
+
+	// identity transform, the vertices are already in world space
+	const ecs::Entity entity = m_gameEntitySystem.CreateGameEntity(EntityType::Renderable);
+
+	componentManager.GetComponent<UpdateComponent>(entity).IsMirrored = componentManager.GetComponent<UpdateComponent>(firstEntity).IsMirrored;
+
+	if (componentManager.HasComponents<PBRMaterialComponent>(firstEntity))
+	{
+		CopyMaterial<PBRMaterialComponent>(firstEntity, entity);
+	}
+	else
+	{
+		CopyMaterial<PhongMaterialComponent>(firstEntity, entity);
+	}
+
+	componentManager.AddComponent<PipelineOpaqueComponent>(entity);
+	componentManager.AddComponent<StaticComponent>(entity);
+
+	// no GeometryComponent: the cluster is unique, it is never instanced, and its buffers are not owned by the ModelSystem
+	componentManager.AddComponent<VertexBufferComponent>(entity);
+	VertexBufferComponent& vertexBufferComponent = componentManager.GetComponent<VertexBufferComponent>(entity);
+	vertexBufferComponent = m_vertexBuffer;
+	vertexBufferComponent.Count = _cluster.VertexCount;
+	vertexBufferComponent.FirstVertex = _cluster.FirstVertex;
+
+	componentManager.AddComponent<IndexBufferComponent>(entity);
+	IndexBufferComponent& indexBufferComponent = componentManager.GetComponent<IndexBufferComponent>(entity);
+	indexBufferComponent = m_indexBuffer;
+	indexBufferComponent.Count = _cluster.IndexCount;
+	indexBufferComponent.FirstIndex = _cluster.FirstIndex;
+	indexBufferComponent.VertexOffset = static_cast<int32>(_cluster.FirstVertex);
+
+	componentManager.AddComponent<BoundsComponent>(entity);
+	BoundsComponent& boundsComponent = componentManager.GetComponent<BoundsComponent>(entity);
+	boundsComponent.Min = _cluster.BoundsMin;
+	boundsComponent.Max = _cluster.BoundsMax;
+
+	m_entityHandlerSystem.RegisterRenderableEntity(entity);
+	m_clusterEntities.push_back(entity.GetIndex());
+
+	// the merged entities are not drawn anymore, nor cast shadows: the cluster does it for them
+	for (uint32 i = _cluster.FirstCandidate; i < _cluster.FirstCandidate + _cluster.CandidateCount; ++i)
+	{
+		const ecs::Entity mergedEntity = entityManager.GetEntity(static_cast<uint16>(m_candidates[i].EntityIndex));
+		componentManager.RemoveComponent<VisibilityComponent>(mergedEntity);
+		m_mergedEntities.push_back(m_candidates[i].EntityIndex);
+	}
+}
+
+template<typename TMaterialComponent>
+void StaticBatchSystem::CopyMaterial(ecs::Entity _from, ecs::Entity _to) const
+{
+	ecs::ComponentManager& componentManager = m_app.GetComponentManager();
+
+	componentManager.AddComponent<TMaterialComponent>(_to);
+	componentManager.GetComponent<TMaterialComponent>(_to) = componentManager.GetComponent<TMaterialComponent>(_from);
+}
+
+void StaticBatchSystem::CreateBuffers(const std::vector<Vertex>& _vertices, const std::vector<uint32>& _indices)
+{
+	const uint32 vertexCount = static_cast<uint32>(_vertices.size());
+	const uint32 vertexSize = sizeof(_vertices[0]);
+	const VkDeviceSize vertexBufferSize = static_cast<VkDeviceSize>(vertexSize) * vertexCount;
+
+	BufferComponent vertexStagingBuffer = m_buffer->Create<BufferComponent>(
+		vertexSize,
+		vertexCount,
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
+		VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT
+	);
+
+	m_buffer->Map(vertexStagingBuffer);
+	m_buffer->WriteToBuffer(vertexStagingBuffer.MappedMemory, (void*)_vertices.data(), static_cast<std::size_t>(vertexBufferSize));
+	m_buffer->Unmap(vertexStagingBuffer);
+
+	m_vertexBuffer = m_buffer->Create<VertexBufferComponent>(
+		vertexSize,
+		vertexCount,
+		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+		VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT
+	);
+
+	m_buffer->Copy(vertexStagingBuffer, m_vertexBuffer, vertexBufferSize);
+	m_buffer->Destroy(vertexStagingBuffer);
+
+	const uint32 indexCount = static_cast<uint32>(_indices.size());
+	const uint32 indexSize = sizeof(_indices[0]);
+	const VkDeviceSize indexBufferSize = static_cast<VkDeviceSize>(indexSize) * indexCount;
+
+	BufferComponent indexStagingBuffer = m_buffer->Create<BufferComponent>(
+		indexSize,
+		indexCount,
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
+		VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT
+	);
+
+	m_buffer->Map(indexStagingBuffer);
+	m_buffer->WriteToBuffer(indexStagingBuffer.MappedMemory, (void*)_indices.data(), static_cast<std::size_t>(indexBufferSize));
+	m_buffer->Unmap(indexStagingBuffer);
+
+	m_indexBuffer = m_buffer->Create<IndexBufferComponent>(
+		indexSize,
+		indexCount,
+		VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
+		VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT
+	);
+
+	m_buffer->Copy(indexStagingBuffer, m_indexBuffer, indexBufferSize);
+	m_buffer->Destroy(indexStagingBuffer);
+}
+
+VESPERENGINE_NAMESPACE_END
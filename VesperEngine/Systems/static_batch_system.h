@@ -0,0 +1,110 @@
+// Copyright (c) 2025-2025 Michele Condo'
+// File: C:\Projects\Vesper\VesperEngine\Systems\static_batch_system.h
+// Licensed under the MIT License. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include "Core/core_defines.h"
+#include "Core/glm_config.h"
+
+#include "Components/graphics_components.h"
+
+#include "ECS/ECS/entity.h"
+
+#include <vector>
+#include <memory>
+
+
+VESPERENGINE_NAMESPACE_BEGIN
+
+class VesperApp;
+class Device;
+class Buffer;
+class ModelSystem;
+class GameEntitySystem;
+class EntityHandlerSystem;
+
+struct ModelData;
+struct Vertex;
+
+/**
+ * Load time merge of the static opaque geometry.
+ * The entities with StaticComponent sharing material and winding are ordered along a Morton curve of their world bounds centers,
+ * then split in clusters bounded by Config::StaticBatchClusterSize and Config::StaticBatchMaxClusterVertexCount.
+ * The vertices of every cluster are transformed in world space and appended to one vertex and one index buffer shared by all the clusters.
+ * Every cluster is a renderable entity with identity transform, the material of its entities and their world bounds: one draw, still culled.
+ * The merged entities are kept for the game side, only their VisibilityComponent is removed, and they must not move anymore.
+ */
+class VESPERENGINE_API StaticBatchSystem final
+{
+public:
+	StaticBatchSystem(VesperApp& _app, Device& _device, ModelSystem& _modelSystem, GameEntitySystem& _gameEntitySystem, EntityHandlerSystem& _entityHandlerSystem);
+	~StaticBatchSystem() = default;
+
+	StaticBatchSystem(const StaticBatchSystem&) = delete;
+	StaticBatchSystem& operator=(const StaticBatchSystem&) = delete;
+
+public:
+	VESPERENGINE_INLINE uint32 GetClusterCount() const { return static_cast<uint32>(m_clusterEntities.size()); }
+	VESPERENGINE_INLINE uint32 GetMergedEntityCount() const { return static_cast<uint32>(m_mergedEntities.size()); }
+
+	// Merge the static entities loaded so far, requires Config::EnableStaticBatching set before the loading.
+	// Call before the MaterialBinding of the render systems, the cluster entities need their material sets as well
+	void BuildBatches();
+	// Destroy the cluster entities and the shared buffers, the merged entities are visible again.
+	// Call before the models are unloaded, the ModelSystem would destroy the shared buffers once per cluster otherwise
+	void ClearBatches();
+
+private:
+	struct Candidate
+	{
+		uint64 GroupKey{ 0 };			// material type | material index | winding
+		uint32 MortonCode{ 0 };			// of the world bounds center, inside the bounds of all the candidates
+		uint32 EntityIndex{ 0 };
+		const ModelData* Data{ nullptr };
+		glm::mat4 ModelMatrix{ 1.0f };
+		glm::vec3 BoundsMin{ 0.0f };	// world space
+		glm::vec3 BoundsMax{ 0.0f };
+	};
+
+	struct Cluster
+	{
+		uint32 FirstCandidate{ 0 };
+		uint32 CandidateCount{ 0 };
+		uint32 FirstIndex{ 0 };
+		uint32 IndexCount{ 0 };
+		uint32 FirstVertex{ 0 };
+		uint32 VertexCount{ 0 };
+		glm::vec3 BoundsMin{ 0.0f };
+		glm::vec3 BoundsMax{ 0.0f };
+	};
+
+	void CollectCandidates();
+	void SplitClusters();
+	// transform the vertices of the candidate in world space and append them to the cluster
+	void AppendCandidate(const Candidate& _candidate, Cluster& _cluster, std::vector<Vertex>& _vertices, std::vector<uint32>& _indices) const;
+	void CreateClusterEntity(const Cluster& _cluster);
+
+	template<typename TMaterialComponent>
+	void CopyMaterial(ecs::Entity _from, ecs::Entity _to) const;
+
+	void CreateBuffers(const std::vector<Vertex>& _vertices, const std::vector<uint32>& _indices);
+
+private:
+	VesperApp& m_app;
+	Device& m_device;
+	ModelSystem& m_modelSystem;
+	GameEntitySystem& m_gameEntitySystem;
+	EntityHandlerSystem& m_entityHandlerSystem;
+	std::unique_ptr<Buffer> m_buffer;
+
+	VertexBufferComponent m_vertexBuffer{};	// shared by all the clusters
+	IndexBufferComponent m_indexBuffer{};
+
+	std::vector<Candidate> m_candidates;
+	std::vector<Cluster> m_clusters;
+	std::vector<uint32> m_clusterEntities;
+	std::vector<uint32> m_mergedEntities;
+};
+
+VESPERENGINE_NAMESPACE_END
@@ -22,14 +22,14 @@ struct VESPERENGINE_ALIGN16 SceneUBO
 // Directional Light
 struct VESPERENGINE_ALIGN16 DirectionalLight
 {
-	glm::vec4 Direction{ 0.0f, -1.0f, 0.0f, 0.0f };
+	glm::vec4 Direction{ 0.0f, -1.0f, 0.0f, -1.0f };	// w first of its kShadowCascadeCount ShadowData, -1 if it casts no shadows
 	glm::vec4 Color{ 1.0f, 1.0f, 1.0f, 1.0f }; // w intensity
 };
 
 // Point Light
 struct VESPERENGINE_ALIGN16 PointLight
 {
-	glm::vec4 Position{ 0.0f, 0.0f, 0.0f, 0.0f };
+	glm::vec4 Position{ 0.0f, 0.0f, 0.0f, -1.0f };	// w first of its kPointShadowFaceCount ShadowData, -1 if it casts no shadows
 	glm::vec4 Color{ 1.0f, 1.0f, 1.0f, 1.0f }; // w intensity
 	glm::vec4 Attenuation{ 1.0f, 0.0f, 0.0f, 0.0f }; // constant, linear, quadratic
 };
@@ -37,26 +37,59 @@ struct VESPERENGINE_ALIGN16 PointLight
 // Spot Light
 struct VESPERENGINE_ALIGN16 SpotLight
 {
-	glm::vec4 Position{ 0.0f, 0.0f, 0.0f, 0.0f };
+	glm::vec4 Position{ 0.0f, 0.0f, 0.0f, -1.0f };	// w its ShadowData, -1 if it casts no shadows
 	glm::vec4 Direction{ 0.0f, -1.0f, 0.0f, 0.0f };
 	glm::vec4 Color{ 1.0f, 1.0f, 1.0f, 1.0f }; // w intensity
 	glm::vec4 Params{ 0.8f, 0.9f, 0.0f, 0.0f }; // x innerCutoff, y outerCutoff
 };
 
-static constexpr uint32 kMaxDirectionalLights = 16;
-static constexpr uint32 kMaxPointLights = 256;
-static constexpr uint32 kMaxSpotLights = 256;
 static constexpr uint32 kMaxMorphTargets = 8;
 
+// Only the counts, the lights are in one std430 storage buffer per type, sized on the actual count
 struct VESPERENGINE_ALIGN16 LightsUBO
 {
 	int32 DirectionalCount{ 0 };
 	int32 PointCount{ 0 };
 	int32 SpotCount{ 0 };
-	int32 _padding;
-	DirectionalLight DirectionalLights[kMaxDirectionalLights];
-	PointLight PointLights[kMaxPointLights];
-	SpotLight SpotLights[kMaxSpotLights];
+	int32 _padding{ 0 };
+	glm::uvec4 ClusterCount{ 0u };		// clusters along x, y and z, see LightClusterSystem
+	glm::vec4 ClusterParams{ 0.0f };	// x, y cluster size in pixels, z, w scale and bias of the depth slice from log(view depth)
+};
+
+// Clustered lighting, std430 storage buffer entry per cluster: ranges in the light index list, point lights followed by spot lights
+struct VESPERENGINE_ALIGN16 LightClusterData
+{
+	uint32 PointOffset{ 0 };
+	uint32 PointCount{ 0 };
+	uint32 SpotOffset{ 0 };
+	uint32 SpotCount{ 0 };
+};
+
+// Shadows: a view is a cascade of a directional light, a face of a point light or a spot light, see ShadowSystem
+static constexpr uint32 kShadowCascadeCount = 4;
+static constexpr uint32 kPointShadowFaceCount = 6;
+static constexpr uint32 kMaxShadowViews = 256;
+
+// Shadows, std430 storage buffer entry per shadow view, the lights point to their first one
+struct VESPERENGINE_ALIGN16 ShadowData
+{
+	glm::mat4 ViewProjection{ 1.0f };
+	glm::vec4 AtlasRect{ 0.0f };	// xy offset, zw size of the tile in the atlas, in uv
+	glm::vec4 Params{ 0.0f };		// x 1 if the tile holds the view, y texel size in world units (at distance 1 if w is 1), z far view depth of the cascade, w 1 if perspective
+};
+
+struct VESPERENGINE_ALIGN16 ShadowPushConstants
+{
+	glm::mat4 ViewProjection{ 1.0f };
+	glm::mat4 ModelMatrix{ 1.0f };
+};
+
+// Dynamic resolution, see UpscaleRenderSystem
+struct VESPERENGINE_ALIGN16 UpscalePushConstants
+{
+	glm::vec2 UVScale{ 1.0f };		// render extent over the scene target extent
+	glm::vec2 TexelSize{ 0.0f };	// of the scene target, in uv
+	float Sharpness{ 0.0f };
 };
 
 // Entity
@@ -68,6 +101,80 @@ struct VESPERENGINE_ALIGN16 EntityUBO
 	int32 MorphTargetCount{ 0 };
 };
 
+// Entity, std430 storage buffer entry used instead of EntityUBO when Config::UseEntityStorageBuffer is set:
+// all the entities in one buffer, indexed by the firstInstance of their draw.
+// The matrices are not here, they are resident on the GPU in the EntityTransform buffer at the same index
+struct VESPERENGINE_ALIGN16 EntityData
+{
+	glm::vec4 MorphWeights0{ 0.0f };
+	glm::vec4 MorphWeights1{ 0.0f };
+	int32 MorphTargetCount{ 0 };
+	int32 MaterialIndex{ -1 };		// index of the material of the entity, -1 if it has none
+};
+
+// Entity, std430 storage buffer entry written only by the transform scatter pass, see GPUTransformSystem
+struct VESPERENGINE_ALIGN16 EntityTransform
+{
+	glm::mat4 ModelMatrix{ 1.0f };
+	glm::mat4 NormalMatrix{ 1.0f };	// transpose(inverse(ModelMatrix)), composed on GPU instead of per vertex
+};
+
+// GPU transforms, std430 storage buffer entry per changed entity: the scatter pass composes it in the EntityTransform at EntityIndex
+struct VESPERENGINE_ALIGN16 GPUTransformUpdate
+{
+	glm::vec4 Rotation{ 0.0f, 0.0f, 0.0f, 1.0f };	// quaternion as x, y, z, w
+	glm::vec4 Position{ 0.0f };						// w unused
+	glm::vec4 Scale{ 1.0f };						// w unused
+	uint32 EntityIndex{ 0 };
+	uint32 _padding0{ 0 };
+	uint32 _padding1{ 0 };
+	uint32 _padding2{ 0 };
+};
+
+struct VESPERENGINE_ALIGN16 GPUTransformPushConstants
+{
+	uint32 UpdateCount{ 0 };
+};
+
+// Instance, std430 storage buffer entry: same content of EntityUBO, but packed one after the other and indexed by gl_InstanceIndex
+struct VESPERENGINE_ALIGN16 InstanceData
+{
+	glm::mat4 ModelMatrix{ 1.0f };
+	glm::vec4 MorphWeights0{ 0.0f };
+	glm::vec4 MorphWeights1{ 0.0f };
+	int32 MorphTargetCount{ 0 };
+};
+
+// GPU culling, std430 storage buffer entry per object: the object index is also its index in the InstanceData buffer
+struct VESPERENGINE_ALIGN16 GPUObjectData
+{
+	glm::vec4 BoundsMin{ 0.0f };	// local space
+	glm::vec4 BoundsMax{ 0.0f };	// local space
+	uint32 BatchIndex{ 0 };
+	uint32 Flags{ 0 };
+	uint32 _padding0{ 0 };
+	uint32 _padding1{ 0 };
+};
+
+// GPU culling, std430 storage buffer entry per batch: objects of a batch share the geometry, so the same indexed draw
+struct VESPERENGINE_ALIGN16 GPUBatchData
+{
+	uint32 IndexCount{ 0 };
+	uint32 FirstCommand{ 0 };		// first slot of the batch in the indirect commands buffer
+	uint32 Capacity{ 0 };			// objects in the batch, so the max count of draws it can emit
+	uint32 FirstIndex{ 0 };			// range of the geometry in the bound buffers, not 0 when they are shared (i.e. GeometryArena)
+	int32 VertexOffset{ 0 };
+	uint32 _padding0{ 0 };
+	uint32 _padding1{ 0 };
+	uint32 _padding2{ 0 };
+};
+
+struct VESPERENGINE_ALIGN16 GPUCullingPushConstants
+{
+	glm::mat4 ViewProjectionMatrix{ 1.0f };
+	uint32 ObjectCount{ 0 };
+};
+
 
 struct VESPERENGINE_ALIGN16 PhongMaterialUBO
 {
@@ -102,10 +209,4 @@ struct VESPERENGINE_ALIGN16 PBRMaterialUBO
 	alignInt32 UVIndices[7] = { 0, 0, 0, 0, 0, 0, 0 };
 };
 
-
-struct VESPERENGINE_ALIGN16 PhongBindlessMaterialIndexUBO
-{
-	alignInt32 MaterialIndex{ 0 };
-};
-
 VESPERENGINE_NAMESPACE_END
\ No newline at end of file
@@ -0,0 +1,201 @@
+// Copyright (c) 2025-2025 Michele Condo'
+// File: C:\Projects\Vesper\VesperEngine\Systems\upscale_render_system.cpp
+// Licensed under the MIT License. See LICENSE file in the project root for full license information.
+
+#include "Systems/upscale_render_system.h"
+#include "Systems/uniform_buffer.h"
+
+#include "Backend/device.h"
+#include "Backend/buffer.h"
+#include "Backend/model_data.h"
+#include "Backend/pipeline.h"
+#include "Backend/frame_info.h"
+#include "Backend/descriptors.h"
+#include "Backend/renderer.h"
+#include "Backend/swap_chain.h"
+
+#include "App/vesper_app.h"
+#include "App/config.h"
+
+#include <stdexcept>
+
+
+VESPERENGINE_NAMESPACE_BEGIN
+
+UpscaleRenderSystem::UpscaleRenderSystem(VesperApp& _app, Device& _device, Renderer& _renderer)
+    : BaseRenderSystem{ _device }
+    , m_app(_app)
+    , m_renderer(_renderer)
+{
+    assertMsgReturnVoid(m_renderer.IsDynamicResolutionEnabled(), "UpscaleRenderSystem requires a renderer created with dynamic resolution enabled");
+
+    m_buffer = std::make_unique<Buffer>(m_device);
+
+    // the full screen triangle is generated from gl_VertexIndex, but fullscreen.vert still declares the vertex inputs
+    const uint32 vertexCount = 3;
+    const uint32 vertexSize = sizeof(Vertex);
+
+    m_fullscreenVertexBufferComponent = m_buffer->Create<VertexBufferComponent>(
+        vertexSize,
+        vertexCount,
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+        VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
+        VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT
+    );
+
+    m_sceneColorSetLayout = DescriptorSetLayout::Builder(_device)
+        .AddBinding(kSceneColorBindingIndex, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT)
+        .Build();
+
+    // own pool, one set per swap chain image, the image count is 2 or 3 so kMaxFramesInFlight is always enough
+    m_sceneColorPool = DescriptorPool::Builder(_device)
+        .SetMaxSets(SwapChain::kMaxFramesInFlight)
+        .AddPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, SwapChain::kMaxFramesInFlight)
+        .Build();
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(UpscalePushConstants);
+    m_pushConstants.push_back(pushConstantRange);
+
+    CreatePipelineLayout(std::vector<VkDescriptorSetLayout>{ m_sceneColorSetLayout->GetDescriptorSetLayout() });
+
+    CreateSampler();
+    UpdateSceneColorDescriptors();
+}
+
+UpscaleRenderSystem::~UpscaleRenderSystem()
+{
+}
+
+void UpscaleRenderSystem::CreateSampler()
+{
+    // bilinear, clamped: the shader keeps the uv inside the rendered area anyway
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.anisotropyEnable = VK_FALSE;
+    samplerInfo.maxAnisotropy = 1.0f;
+    samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK;
+    samplerInfo.unnormalizedCoordinates = VK_FALSE;
+    samplerInfo.compareEnable = VK_FALSE;
+    samplerInfo.minLod = 0.0f;
+    samplerInfo.maxLod = 0.0f;
+    samplerInfo.mipLodBias = 0.0f;
+
+    if (vkCreateSampler(m_device.GetDevice(), &samplerInfo, nullptr, &m_sampler) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create upscale sampler!");
+    }
+}
+
+void UpscaleRenderSystem::UpdateSceneColorDescriptors()
+{
+    if (!m_sceneColorDescriptorSets.empty() && m_swapChainGeneration == m_renderer.GetSwapChainGeneration())
+    {
+        return;
+    }
+
+    // the swap chain recreation waits for the device to be idle, so none of the old sets is in use anymore
+    m_sceneColorPool->ResetPool();
+
+    const std::size_t imageCount = m_renderer.GetSwapChainImageCount();
+    m_sceneColorDescriptorSets.resize(imageCount);
+
+    for (int32 i = 0; i < imageCount; ++i)
+    {
+        VkDescriptorImageInfo sceneColorInfo{};
+        sceneColorInfo.sampler = m_sampler;
+        sceneColorInfo.imageView = m_renderer.GetSceneColorImageView(i);
+        sceneColorInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        DescriptorWriter(*m_sceneColorSetLayout, *m_sceneColorPool)
+            .WriteImage(kSceneColorBindingIndex, &sceneColorInfo)
+            .Build(m_sceneColorDescriptorSets[i]);
+    }
+
+    m_swapChainGeneration = m_renderer.GetSwapChainGeneration();
+}
+
+void UpscaleRenderSystem::Render(const FrameInfo& _frameInfo)
+{
+    UpdateSceneColorDescriptors();
+
+    m_commandRecorder.Reset(_frameInfo.CommandBuffer);
+
+    m_pipeline->Bind(_frameInfo.CommandBuffer);
+
+    vkCmdBindDescriptorSets(
+        _frameInfo.CommandBuffer,
+        VK_PIPELINE_BIND_POINT_GRAPHICS,
+        m_pipelineLayout,
+        0,
+        1,
+        &m_sceneColorDescriptorSets[m_renderer.GetCurrentImageIndex()],
+        0,
+        nullptr
+    );
+
+    //if (vkCmdSetCullModeEXT && vkCmdSetFrontFaceEXT)  // no need, we do throw and exception if not supported
+    {
+        vkCmdSetCullModeEXT(_frameInfo.CommandBuffer, VK_CULL_MODE_NONE);
+        vkCmdSetFrontFaceEXT(_frameInfo.CommandBuffer, VK_FRONT_FACE_COUNTER_CLOCKWISE);
+    }
+
+    // the scene target has the swap chain extent, the scene covers only the render extent of this frame
+    const VkExtent2D extent = m_renderer.GetSwapChainExtent();
+    const VkExtent2D renderExtent = m_renderer.GetRenderExtent();
+
+    UpscalePushConstants push{};
+    push.UVScale = glm::vec2(static_cast<float>(renderExtent.width) / static_cast<float>(extent.width), static_cast<float>(renderExtent.height) / static_cast<float>(extent.height));
+    push.TexelSize = glm::vec2(1.0f / static_cast<float>(extent.width), 1.0f / static_cast<float>(extent.height));
+    push.Sharpness = m_app.GetConfig().DynamicResolutionSharpness;
+
+    PushConstants(_frameInfo.CommandBuffer, 0, &push);
+
+    Bind(m_fullscreenVertexBufferComponent, _frameInfo.CommandBuffer);
+    Draw(m_fullscreenVertexBufferComponent, _frameInfo.CommandBuffer);
+}
+
+void UpscaleRenderSystem::CreatePipeline(VkRenderPass _renderPass)
+{
+    assertMsgReturnVoid(m_pipelineLayout != nullptr, "Cannot create pipeline before pipeline layout");
+
+    PipelineConfigInfo pipelineConfig{};
+
+    Pipeline::DefaultPipelineConfiguration(pipelineConfig);
+
+    pipelineConfig.RenderPass = _renderPass;
+    pipelineConfig.PipelineLayout = m_pipelineLayout;
+
+    pipelineConfig.DepthStencilInfo.depthTestEnable = VK_FALSE;
+    pipelineConfig.DepthStencilInfo.depthWriteEnable = VK_FALSE;
+    pipelineConfig.DepthStencilInfo.stencilTestEnable = VK_FALSE;
+
+    pipelineConfig.RasterizationInfo.cullMode = VK_CULL_MODE_NONE;
+
+    m_pipeline = std::make_unique<Pipeline>(
+        m_device,
+        std::vector{ ShaderInfo{m_app.GetConfig().ShadersPath + "fullscreen.vert.spv", ShaderType::Vertex}, ShaderInfo{m_app.GetConfig().ShadersPath + "upscale.frag.spv", ShaderType::Fragment}, },
+        pipelineConfig
+    );
+}
+
+void UpscaleRenderSystem::Cleanup()
+{
+    m_buffer->Destroy(m_fullscreenVertexBufferComponent);
+
+    if (m_sampler != VK_NULL_HANDLE)
+    {
+        vkDestroySampler(m_device.GetDevice(), m_sampler, nullptr);
+        m_sampler = VK_NULL_HANDLE;
+    }
+}
+
+VESPERENGINE_NAMESPACE_END
@@ -0,0 +1,70 @@
+// Copyright (c) 2025-2025 Michele Condo'
+// File: C:\Projects\Vesper\VesperEngine\Systems\upscale_render_system.h
+// Licensed under the MIT License. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include "Core/core_defines.h"
+
+#include "Systems/base_render_system.h"
+
+#include "Components/graphics_components.h"
+
+#include "vulkan/vulkan.h"
+
+#include <memory>
+#include <vector>
+
+
+VESPERENGINE_NAMESPACE_BEGIN
+
+class VesperApp;
+class Device;
+class Renderer;
+class Pipeline;
+class Buffer;
+class DescriptorSetLayout;
+class DescriptorPool;
+
+struct FrameInfo;
+
+/**
+ * Dynamic resolution upscale, in the upscale render pass of the renderer: the scene color, rendered in the scaled render area,
+ * is filtered bilinearly to the whole swap chain image and sharpened by Config::DynamicResolutionSharpness.
+ */
+class VESPERENGINE_API UpscaleRenderSystem : public BaseRenderSystem
+{
+public:
+    static constexpr uint32 kSceneColorBindingIndex = 0u;
+
+public:
+    UpscaleRenderSystem(VesperApp& _app, Device& _device, Renderer& _renderer);
+    virtual ~UpscaleRenderSystem();
+
+    UpscaleRenderSystem(const UpscaleRenderSystem&) = delete;
+    UpscaleRenderSystem& operator=(const UpscaleRenderSystem&) = delete;
+
+public:
+    void CreatePipeline(VkRenderPass _renderPass);
+    void Render(const FrameInfo& _frameInfo);
+    void Cleanup();
+
+private:
+    void CreateSampler();
+    // the scene color targets belong to the swap chain, so the sets have to follow the swap chain when it is recreated
+    void UpdateSceneColorDescriptors();
+
+private:
+    VesperApp& m_app;
+    Renderer& m_renderer;
+    std::unique_ptr<Pipeline> m_pipeline;
+    std::unique_ptr<DescriptorSetLayout> m_sceneColorSetLayout;
+    std::unique_ptr<DescriptorPool> m_sceneColorPool;
+    std::vector<VkDescriptorSet> m_sceneColorDescriptorSets;
+    std::unique_ptr<Buffer> m_buffer;
+    VertexBufferComponent m_fullscreenVertexBufferComponent;
+    VkSampler m_sampler{ VK_NULL_HANDLE };
+    uint32 m_swapChainGeneration = 0;
+};
+
+VESPERENGINE_NAMESPACE_END
@@ -0,0 +1,140 @@
+// Copyright (c) 2025-2025 Michele Condo'
+// File: C:\Projects\Vesper\VesperEngine\Utility\draw_sorter.cpp
+// Licensed under the MIT License. See LICENSE file in the project root for full license information.
+
+#include "Utility/draw_sorter.h"
+
+#include <algorithm>
+#include <limits>
+
+
+VESPERENGINE_NAMESPACE_BEGIN
+
+void DrawSorter::Reserve(uint32 _count)
+{
+	m_entries.reserve(_count);
+	m_scratch.reserve(_count);
+}
+
+void DrawSorter::SortBackToFront()
+{
+	RadixSort(true);
+}
+
+void DrawSorter::SortFrontToBack()
+{
+	RadixSort(false);
+}
+
+void DrawSorter::SortByMaterial()
+{
+	for (DrawSortEntry& entry : m_entries)
+	{
+		// -1, no material, is the first group. Alpha tested in the top bit, the permutation in the next 8, the material in the low 23
+		const uint32 alphaTestedBit = (entry.Flags & kFlagAlphaTested) ? 0x80000000u : 0u;
+		const uint32 permutationBits = ((entry.Flags >> kFlagPermutationShift) & 0xFFu) << 23;
+		entry.Key = alphaTestedBit | permutationBits | (static_cast<uint32>(entry.MaterialIndex + 1) & 0x7FFFFFu);
+	}
+
+	RadixSort(false);
+}
+
+float DrawSorter::ComputeViewDepth(const glm::mat4& _viewModel, const glm::vec3& _boundsMin, const glm::vec3& _boundsMax, bool _useFarthestPoint)
+{
+	if (!_useFarthestPoint)
+	{
+		const glm::vec3 center = (_boundsMin + _boundsMax) * 0.5f;
+		return (_viewModel * glm::vec4(center, 1.0f)).z;
+	}
+
+	float farthest = -std::numeric_limits<float>::max();
+	for (uint32 i = 0; i < 8; ++i)
+	{
+		const glm::vec3 corner(
+			(i & 1u) ? _boundsMax.x : _boundsMin.x,
+			(i & 2u) ? _boundsMax.y : _boundsMin.y,
+			(i & 4u) ? _boundsMax.z : _boundsMin.z);
+
+		farthest = std::max(farthest, (_viewModel * glm::vec4(corner, 1.0f)).z);
+	}
+	return farthest;
+}
+
+void DrawSorter::RadixSort(bool _invertKeys)
+{
+	const std::size_t count = m_entries.size();
+	if (count < 2)
+	{
+		return;
+	}
+
+	// descending order is an ascending order on the complemented key, and stays stable
+	if (_invertKeys)
+	{
+		for (DrawSortEntry& entry : m_entries)
+		{
+			entry.Key = ~entry.Key;
+		}
+	}
+
+	// grows only, never shrinks, so steady state frames do not allocate
+	if (m_scratch.size() < count)
+	{
+		m_scratch.resize(count);
+	}
+
+	uint32 histograms[4][256] = {};
+	for (const DrawSortEntry& entry : m_entries)
+	{
+		++histograms[0][(entry.Key >> 0) & 0xFF];
+		++histograms[1][(entry.Key >> 8) & 0xFF];
+		++histograms[2][(entry.Key >> 16) & 0xFF];
+		++histograms[3][(entry.Key >> 24) & 0xFF];
+	}
+
+	DrawSortEntry* source = m_entries.data();
+	DrawSortEntry* destination = m_scratch.data();
+
+	for (uint32 pass = 0; pass < 4; ++pass)
+	{
+		uint32* histogram = histograms[pass];
+		const uint32 shift = pass * 8;
+
+		// all the keys share this digit, the pass would be an identity copy
+		if (histogram[(source[0].Key >> shift) & 0xFF] == count)
+		{
+			continue;
+		}
+
+		uint32 offset = 0;
+		for (uint32 bucket = 0; bucket < 256; ++bucket)
+		{
+			const uint32 bucketCount = histogram[bucket];
+			histogram[bucket] = offset;
+			offset += bucketCount;
+		}
+
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			const uint32 digit = (source[i].Key >> shift) & 0xFF;
+			destination[histogram[digit]++] = source[i];
+		}
+
+		std::swap(source, destination);
+	}
+
+	if (source != m_entries.data())
+	{
+		std::copy(source, source + count, m_entries.data());
+	}
+
+	if (_invertKeys)
+	{
+		for (DrawSortEntry& entry : m_entries)
+		{
+			entry.Key = ~entry.Key;
+		}
+	}
+}
+
+VESPERENGINE_NAMESPACE_END
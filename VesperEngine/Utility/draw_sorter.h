@@ -0,0 +1,91 @@
+// Copyright (c) 2025-2025 Michele Condo'
+// File: C:\Projects\Vesper\VesperEngine\Utility\draw_sorter.h
+// Licensed under the MIT License. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include "Core/core_defines.h"
+#include "Core/glm_config.h"
+
+#include <vector>
+#include <cstring>
+
+
+VESPERENGINE_NAMESPACE_BEGIN
+
+struct DrawSortEntry
+{
+	uint32 Key{ 0 };
+	uint32 PacketIndex{ 0 };		// of the draw in the render packets of the system
+	int32 MaterialIndex{ -1 };
+	uint32 Flags{ 0 };
+};
+
+/**
+ * Collects the draws of a render system and orders them by view depth.
+ * The sort is a stable LSD radix sort (8 bits per pass) on the depth converted to an order preserving uint32,
+ * so entries at the same depth keep the order they were added in and the result does not flicker frame to frame.
+ * Entries and scratch are kept alive between frames: after the first frames no allocation happens anymore.
+ */
+class VESPERENGINE_API DrawSorter final
+{
+public:
+	static constexpr uint32 kFlagHasIndexBuffer = 1u << 0;
+	static constexpr uint32 kFlagAlphaTested = 1u << 1;
+	// the flags from this bit up hold the pipeline permutation of the draw, 8 bits
+	static constexpr uint32 kFlagPermutationShift = 8u;
+
+public:
+	DrawSorter() = default;
+	~DrawSorter() = default;
+
+	DrawSorter(const DrawSorter&) = delete;
+	DrawSorter& operator=(const DrawSorter&) = delete;
+
+public:
+	VESPERENGINE_INLINE const std::vector<DrawSortEntry>& GetEntries() const { return m_entries; }
+	VESPERENGINE_INLINE bool IsEmpty() const { return m_entries.empty(); }
+
+	VESPERENGINE_INLINE void Clear() { m_entries.clear(); }
+
+	VESPERENGINE_INLINE void Add(float _viewDepth, uint32 _packetIndex, int32 _materialIndex, uint32 _flags)
+	{
+		DrawSortEntry& entry = m_entries.emplace_back();
+		entry.Key = DepthToKey(_viewDepth);
+		entry.PacketIndex = _packetIndex;
+		entry.MaterialIndex = _materialIndex;
+		entry.Flags = _flags;
+	}
+
+	void Reserve(uint32 _count);
+
+	// farthest first, as required to blend transparent surfaces
+	void SortBackToFront();
+	// nearest first, to maximize early depth rejection on opaque surfaces
+	void SortFrontToBack();
+	// grouped by pipeline permutation then by material, the alpha tested ones last. Stable, so after a sort by depth every group keeps that order inside.
+	// The keys are the groups afterwards, not the depths anymore
+	void SortByMaterial();
+
+	// view space depth of the local bounds, where the view is left handed (+Z forward).
+	// _useFarthestPoint is meant for large objects crossing other transparent ones: they are ordered by the corner farthest from the camera instead of their center
+	static float ComputeViewDepth(const glm::mat4& _viewModel, const glm::vec3& _boundsMin, const glm::vec3& _boundsMax, bool _useFarthestPoint);
+
+	// maps the float bits to an unsigned value keeping the same ordering, negative depths (behind the camera) included
+	static VESPERENGINE_INLINE uint32 DepthToKey(float _depth)
+	{
+		uint32 bits;
+		std::memcpy(&bits, &_depth, sizeof(uint32));
+		const uint32 mask = (bits & 0x80000000u) ? 0xFFFFFFFFu : 0x80000000u;
+		return bits ^ mask;
+	}
+
+private:
+	void RadixSort(bool _invertKeys);
+
+private:
+	std::vector<DrawSortEntry> m_entries;
+	std::vector<DrawSortEntry> m_scratch;
+};
+
+VESPERENGINE_NAMESPACE_END
@@ -33,4 +33,16 @@ VESPERENGINE_INLINE uint32 HashString(const std::string& _value)
 	return hash;
 }
 
+// FNV-1a as ecs::Hash, iterative: for file contents, too large for the constexpr recursion
+VESPERENGINE_INLINE uint32 HashBytes(const void* _data, std::size_t _size)
+{
+	const uint8* bytes = static_cast<const uint8*>(_data);
+	uint32 hash = 2166136261u;
+	for (std::size_t i = 0; i < _size; ++i)
+	{
+		hash = (hash ^ bytes[i]) * 16777619u;
+	}
+	return hash;
+}
+
 VESPERENGINE_NAMESPACE_END
@@ -31,6 +31,12 @@ echo Compiling fragment shader files:
 for %%f in ("%~1Assets\Shaders\*.frag") do (
     call :COMPILE_SHADER "%%f" "fragment"
 )
+echo:
+
+echo Compiling compute shader files:
+for %%f in ("%~1Assets\Shaders\*.comp") do (
+    call :COMPILE_SHADER "%%f" "compute"
+)
 
 :: Create the timestamp file here if everything is successful
 echo. > "%~2compile_shaders_build.timestamp"
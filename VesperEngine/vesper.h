@@ -18,6 +18,16 @@
 #include "Backend/renderer.h"
 #include "Backend/offscreen_renderer.h"
 #include "Backend/frame_info.h"
+#include "Backend/instance_buffer.h"
+#include "Backend/parallel_command_recorder.h"
+#include "Backend/pipeline_compiler.h"
+#include "Backend/shader_module_cache.h"
+#include "Backend/bindless_registry.h"
+#include "Backend/command_recorder.h"
+#include "Backend/geometry_arena.h"
+#include "Backend/dynamic_resolution.h"
+#include "Backend/render_packet.h"
+#include "Backend/render_graph.h"
 
 #include "Components/graphics_components.h"
 #include "Components/object_components.h"
@@ -36,19 +46,29 @@
 #include "Systems/phong_transparent_render_system.h"
 #include "Systems/pbr_opaque_render_system.h"
 #include "Systems/pbr_transparent_render_system.h"
+#include "Systems/oit_composite_render_system.h"
+#include "Systems/upscale_render_system.h"
+#include "Systems/gpu_culling_system.h"
+#include "Systems/gpu_transform_system.h"
 #include "Systems/skybox_render_system.h"
 #include "Systems/camera_system.h"
 #include "Systems/brdf_lut_generation_system.h"
 #include "Systems/irradiance_convolution_generation_system.h"
 #include "Systems/pre_filtered_environment_generation_system.h"
 #include "Systems/light_system.h"
+#include "Systems/light_cluster_system.h"
+#include "Systems/shadow_atlas_allocator.h"
+#include "Systems/shadow_system.h"
 #include "Systems/blend_shape_animation_system.h"
+#include "Systems/render_extraction_system.h"
+#include "Systems/static_batch_system.h"
 
 #include "Utility/hash.h"
 #include "Utility/logger.h"
 #include "Utility/primitive_factory.h"
 #include "Utility/obj_loader.h"
 #include "Utility/gltf_loader.h"
+#include "Utility/draw_sorter.h"
 
 #include "App/config.h"
 #include "App/file_system.h"
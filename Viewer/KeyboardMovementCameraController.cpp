@@ -35,6 +35,11 @@ void KeyboardMovementCameraController::Update(GLFWwindow* _window, float _dt)
 		m_blendShapeAnimationSystem.SetNextAnimationForAllEntities();
 	}
 
+	if (IsKeyJustPressed(m_keys.ReloadShaders, _window))
+	{
+		m_isShaderReloadRequested = true;
+	}
+
 	if (IsKeyJustPressed(m_keys.ToggleLights, _window))
     {
         m_showLights = !m_showLights;
@@ -104,3 +109,10 @@ void KeyboardMovementCameraController::Update(GLFWwindow* _window, float _dt)
 		}
 	}
 }
+
+bool KeyboardMovementCameraController::ConsumeShaderReloadRequest()
+{
+	const bool isRequested = m_isShaderReloadRequested;
+	m_isShaderReloadRequested = false;
+	return isRequested;
+}
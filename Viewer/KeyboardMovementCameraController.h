@@ -36,9 +36,12 @@ public:
 		int32 LookRollLeft = GLFW_KEY_PAGE_DOWN;
 		int32 ToggleLights = GLFW_KEY_L;
 		int32 NextAnimation = GLFW_KEY_N;
+		int32 ReloadShaders = GLFW_KEY_F5;
 	};
 
 	void Update(GLFWwindow* _window, float _dt);
+	// true once per press of the reload key, the app then reloads the shaders between two frames
+	bool ConsumeShaderReloadRequest();
 
 private:
 	bool IsKeyJustPressed(int32 _key, GLFWwindow* _window);
@@ -56,5 +59,6 @@ private:
 
 	bool m_limitLook{true};
 	bool m_showLights{ false };
+	bool m_isShaderReloadRequested{ false };
 };
 
@@ -17,6 +17,9 @@ PhongCustomOpaqueRenderSystem::PhongCustomOpaqueRenderSystem(VesperApp& app, Dev
     : PhongOpaqueRenderSystem(app, device, renderer, globalDescriptorSetLayout,
         entityDescriptorSetLayout, bindlessBindingDescriptorSetLayout)
 {
+    // the color tint is pushed per entity, so every entity needs its own draw
+    m_allowInstancing = false;
+
     ecs::ComponentManager& componentManager = m_app.GetComponentManager();
     if (!componentManager.IsComponentRegistered<ColorTintPushConstantData>())
     {
@@ -70,9 +73,10 @@ void PhongCustomOpaqueRenderSystem::CreatePipeline(VkRenderPass renderPass)
     pipelineConfig.RenderPass = renderPass;
     pipelineConfig.PipelineLayout = m_pipelineLayout;
 
+    const std::string vertexShaderName = m_app.GetConfig().UseEntityStorageBuffer ? "entity_storage_shader" : "tint_phong_shader";
     const std::string vertexShaderFilepath = m_device.IsBindlessResourcesSupported()
-        ? m_app.GetConfig().ShadersPath + "tint_phong_shader_bindless1.vert.spv"
-        : m_app.GetConfig().ShadersPath + "tint_phong_shader_bindless0.vert.spv";
+        ? m_app.GetConfig().ShadersPath + vertexShaderName + "_bindless1.vert.spv"
+        : m_app.GetConfig().ShadersPath + vertexShaderName + "_bindless0.vert.spv";
 
     ShaderInfo vertexShader(vertexShaderFilepath, ShaderType::Vertex);
 
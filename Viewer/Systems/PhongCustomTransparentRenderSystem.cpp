@@ -69,9 +69,10 @@ void PhongCustomTransparentRenderSystem::CreatePipeline(VkRenderPass renderPass)
     pipelineConfig.RenderPass = renderPass;
     pipelineConfig.PipelineLayout = m_pipelineLayout;
 
+    const std::string vertexShaderName = m_app.GetConfig().UseEntityStorageBuffer ? "entity_storage_shader" : "tint_phong_shader";
     const std::string vertexShaderFilepath = m_device.IsBindlessResourcesSupported()
-        ? m_app.GetConfig().ShadersPath + "tint_phong_shader_bindless1.vert.spv"
-        : m_app.GetConfig().ShadersPath + "tint_phong_shader_bindless0.vert.spv";
+        ? m_app.GetConfig().ShadersPath + vertexShaderName + "_bindless1.vert.spv"
+        : m_app.GetConfig().ShadersPath + vertexShaderName + "_bindless0.vert.spv";
 
     ShaderInfo vertexShader(vertexShaderFilepath, ShaderType::Vertex);
 
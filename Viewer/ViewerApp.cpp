@@ -35,7 +35,9 @@ ViewerApp::ViewerApp(Config& _config) :
 	m_window = std::make_unique<ViewerWindow>(_config.WindowWidth, _config.WindowHeight, _config.WindowName);
 
 	m_device = std::make_unique<Device>(*m_window);
-	m_renderer = std::make_unique<Renderer>(*m_window, *m_device);
+	m_device->LoadPipelineCache(_config.PipelineCacheFilePath);
+	m_renderer = std::make_unique<Renderer>(*m_window, *m_device, _config.UseWeightedBlendedOIT, _config.RecordingThreadCount,
+		_config.EnableDynamicResolution, _config.DynamicResolutionMinScale, _config.DynamicResolutionTargetFrameTime);
 
 	m_renderer->SetupGlobalDescriptors(
 		{ { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, DESCRIPTOR_MAX_COUNT_PER_POOL_TYPE }
@@ -52,8 +54,17 @@ ViewerApp::ViewerApp(Config& _config) :
 	m_modelSystem = std::make_unique<ModelSystem>(*this, *m_device, *m_materialSystem);
 	m_lightSystem = std::make_unique<LightSystem>(*this, *m_gameEntitySystem);
 	m_blendShapeAnimationSystem = std::make_unique<BlendShapeAnimationSystem>(*this);
+	m_renderExtractionSystem = std::make_unique<RenderExtractionSystem>(*this);
+	m_staticBatchSystem = std::make_unique<StaticBatchSystem>(*this, *m_device, *m_modelSystem, *m_gameEntitySystem, *m_entityHandlerSystem);
 
-    m_masterRenderSystem = std::make_unique<MasterRenderSystem>(*m_device, *m_renderer, *m_lightSystem);
+    m_masterRenderSystem = std::make_unique<MasterRenderSystem>(*m_device, *m_renderer, *m_lightSystem,
+		_config.BindlessTextureCapacity, _config.BindlessBufferCapacity);
+
+	// the layouts of every system are described here, their pipelines are compiled on the workers while the assets are loaded
+	PipelineCompiler pipelineCompiler(_config.PipelineCompileThreadCount);
+
+	m_shadowSystem = std::make_unique<ShadowSystem>(*this, *m_device, *m_lightSystem);
+	pipelineCompiler.Enqueue([this]() { m_shadowSystem->CreatePipeline(); });
 	
 	// IN-ENGINE SYSTEMS
 	// PHONG
@@ -62,14 +73,14 @@ ViewerApp::ViewerApp(Config& _config) :
             m_entityHandlerSystem->GetEntityDescriptorSetLayout(),
             m_masterRenderSystem->GetBindlessBindingDescriptorSetLayout());
 
-	m_phongOpaqueRenderSystem->CreatePipeline(m_renderer->GetSwapChainRenderPass());
+	pipelineCompiler.Enqueue([this]() { m_phongOpaqueRenderSystem->CreatePipeline(m_renderer->GetSwapChainRenderPass()); });
 
     m_phongTransparentRenderSystem = std::make_unique<PhongTransparentRenderSystem>(*this, *m_device, *m_renderer,
             m_masterRenderSystem->GetGlobalDescriptorSetLayout(),
             m_entityHandlerSystem->GetEntityDescriptorSetLayout(),
             m_masterRenderSystem->GetBindlessBindingDescriptorSetLayout());
 
-	m_phongTransparentRenderSystem->CreatePipeline(m_renderer->GetSwapChainRenderPass());
+	pipelineCompiler.Enqueue([this]() { m_phongTransparentRenderSystem->CreatePipeline(m_renderer->GetSwapChainRenderPass()); });
 
 	// PBR
 	m_pbrOpaqueRenderSystem = std::make_unique<PBROpaqueRenderSystem>(*this, *m_device, *m_renderer,
@@ -77,14 +88,28 @@ ViewerApp::ViewerApp(Config& _config) :
 		m_entityHandlerSystem->GetEntityDescriptorSetLayout(),
 		m_masterRenderSystem->GetBindlessBindingDescriptorSetLayout());
 
-	m_pbrOpaqueRenderSystem->CreatePipeline(m_renderer->GetSwapChainRenderPass());
+	pipelineCompiler.Enqueue([this]() { m_pbrOpaqueRenderSystem->CreatePipeline(m_renderer->GetSwapChainRenderPass()); });
 
 	m_pbrTransparentRenderSystem = std::make_unique<PBRTransparentRenderSystem>(*this, *m_device, *m_renderer,
 		m_masterRenderSystem->GetGlobalDescriptorSetLayout(),
 		m_entityHandlerSystem->GetEntityDescriptorSetLayout(),
 		m_masterRenderSystem->GetBindlessBindingDescriptorSetLayout());
 
-	m_pbrTransparentRenderSystem->CreatePipeline(m_renderer->GetSwapChainRenderPass());
+	pipelineCompiler.Enqueue([this]() { m_pbrTransparentRenderSystem->CreatePipeline(m_renderer->GetSwapChainRenderPass()); });
+
+	// OIT
+	if (m_renderer->IsWeightedBlendedOITEnabled())
+	{
+		m_oitCompositeRenderSystem = std::make_unique<OITCompositeRenderSystem>(*this, *m_device, *m_renderer);
+		pipelineCompiler.Enqueue([this]() { m_oitCompositeRenderSystem->CreatePipeline(m_renderer->GetSwapChainRenderPass()); });
+	}
+
+	// DYNAMIC RESOLUTION
+	if (m_renderer->IsDynamicResolutionEnabled())
+	{
+		m_upscaleRenderSystem = std::make_unique<UpscaleRenderSystem>(*this, *m_device, *m_renderer);
+		pipelineCompiler.Enqueue([this]() { m_upscaleRenderSystem->CreatePipeline(m_renderer->GetUpscaleRenderPass()); });
+	}
 
 	// CUSTOM IN-APP SYSTEMS
 	/*
@@ -107,7 +132,7 @@ ViewerApp::ViewerApp(Config& _config) :
             m_masterRenderSystem->GetGlobalDescriptorSetLayout(),
             m_masterRenderSystem->GetBindlessBindingDescriptorSetLayout());
 
-    m_skyboxRenderSystem->CreatePipeline(m_renderer->GetSwapChainRenderPass());
+	pipelineCompiler.Enqueue([this]() { m_skyboxRenderSystem->CreatePipeline(m_renderer->GetSwapChainRenderPass()); });
 
 	m_cameraSystem = std::make_unique<CameraSystem>(*this);
 	m_objLoader = std::make_unique<ObjLoader>(*this , *m_device, *m_materialSystem);
@@ -141,6 +166,15 @@ ViewerApp::ViewerApp(Config& _config) :
     m_gameManager->LoadGameEntities();
 	m_gameManager->LoadLights();
 
+	// before the material binding, the cluster entities get their material sets as any other entity
+	if (_config.EnableStaticBatching)
+	{
+		m_staticBatchSystem->BuildBatches();
+	}
+
+	// every pipeline is compiled before the systems are used
+	pipelineCompiler.Wait();
+
     m_phongOpaqueRenderSystem->MaterialBinding();
     m_phongTransparentRenderSystem->MaterialBinding();
 	m_pbrOpaqueRenderSystem->MaterialBinding();
@@ -150,6 +184,7 @@ ViewerApp::ViewerApp(Config& _config) :
 
 ViewerApp::~ViewerApp()
 {
+	m_staticBatchSystem->ClearBatches();
 	m_gameManager->UnloadGameEntities();
 	m_textureSystem->Cleanup();
     m_materialSystem->Cleanup();
@@ -157,7 +192,16 @@ ViewerApp::~ViewerApp()
     m_phongTransparentRenderSystem->Cleanup();
 	m_pbrOpaqueRenderSystem->Cleanup();
 	m_pbrTransparentRenderSystem->Cleanup();
+	if (m_oitCompositeRenderSystem)
+	{
+		m_oitCompositeRenderSystem->Cleanup();
+	}
+	if (m_upscaleRenderSystem)
+	{
+		m_upscaleRenderSystem->Cleanup();
+	}
     m_skyboxRenderSystem->Cleanup();
+	m_shadowSystem->Cleanup();
     m_masterRenderSystem->Cleanup();
 }
 
@@ -169,11 +213,72 @@ void ViewerApp::Run()
 	CameraTransformComponent activeCameraTransformComponent;
 
 	m_entityHandlerSystem->Initialize();
-	m_masterRenderSystem->Initialize(*m_textureSystem, *m_materialSystem,
+	m_shadowSystem->Initialize();
+	m_masterRenderSystem->Initialize(*m_textureSystem, *m_materialSystem, *m_shadowSystem,
 		m_gameManager->GetIrradianceMap(),
 		m_gameManager->GetPrefilteredEnvMap(),
 		m_gameManager->GetBrdfLut());
 
+	// the frame passes, in execution order: the graph records the barriers between them
+	RenderGraph renderGraph(*m_device);
+
+	const bool isStorageBuffer = m_entityHandlerSystem->IsStorageBuffer();
+	const bool isGPUDriven = m_pbrOpaqueRenderSystem->IsGPUDriven();
+
+	// the buffers are one per frame in flight or resident, their handles are not needed: the graph synchronizes them with a global memory barrier
+	const RenderGraphResource transforms = isStorageBuffer ? renderGraph.ImportBuffer("EntityTransforms", RenderGraphAccess::VertexShaderRead) : kInvalidRenderGraphResource;
+	const RenderGraphResource drawCommands = isGPUDriven ? renderGraph.ImportBuffer("OpaqueDrawCommands") : kInvalidRenderGraphResource;
+	const RenderGraphResource shadowAtlas = renderGraph.ImportImage("ShadowAtlas", m_shadowSystem->GetAtlasImage(), VK_IMAGE_ASPECT_DEPTH_BIT, RenderGraphAccess::FragmentShaderRead);
+
+	if (isStorageBuffer)
+	{
+		renderGraph.AddPass("EntityTransforms", [this](const FrameInfo& _frameInfo) { m_entityHandlerSystem->DispatchTransforms(_frameInfo); })
+			.Write(transforms, RenderGraphAccess::ComputeShaderWrite);
+	}
+
+	// view the opaque draws are sorted by and, GPU driven, the compute culling
+	RenderGraph::PassBuilder prepareDrawsPass = renderGraph.AddPass("OpaqueDrawPreparation",
+		[this, &activeCameraComponent](const FrameInfo& _frameInfo) { m_pbrOpaqueRenderSystem->PrepareDraws(_frameInfo, activeCameraComponent); });
+	prepareDrawsPass.SetSideEffects();
+	if (isGPUDriven)
+	{
+		prepareDrawsPass.Write(drawCommands, RenderGraphAccess::ComputeShaderWrite);
+	}
+
+	// off screen shadow passes, their render pass leaves the atlas ready to be sampled
+	renderGraph.AddPass("Shadows", [this, &activeCameraComponent](const FrameInfo& _frameInfo)
+		{
+			m_shadowSystem->Update(_frameInfo, activeCameraComponent);
+			m_shadowSystem->Render(_frameInfo);
+		})
+		.WriteSynchronized(shadowAtlas, RenderGraphAccess::FragmentShaderRead)
+		.SetSideEffects();
+
+	RenderGraph::PassBuilder scenePass = renderGraph.AddPass("Scene", [this](const FrameInfo& _frameInfo) { RenderScene(_frameInfo); });
+	scenePass.Read(shadowAtlas, RenderGraphAccess::FragmentShaderRead).SetSideEffects();
+	if (isStorageBuffer)
+	{
+		scenePass.Read(transforms, RenderGraphAccess::VertexShaderRead);
+	}
+	if (isGPUDriven)
+	{
+		scenePass.Read(drawCommands, RenderGraphAccess::IndirectRead);
+	}
+
+	// the scene has been drawn in a scaled target, filtered to the swap chain image
+	if (m_upscaleRenderSystem)
+	{
+		renderGraph.AddPass("Upscale", [this](const FrameInfo& _frameInfo)
+			{
+				m_renderer->BeginUpscaleRenderPass(_frameInfo.CommandBuffer);
+				m_upscaleRenderSystem->Render(_frameInfo);
+				m_renderer->EndUpscaleRenderPass(_frameInfo.CommandBuffer);
+			})
+			.SetSideEffects();
+	}
+
+	renderGraph.Compile();
+
 	while (!m_window->ShouldClose())
 	{
 		glfwPollEvents();
@@ -187,6 +292,11 @@ void ViewerApp::Run()
 		m_keyboardController->Update(m_window->GetWindow(), frameTime);
 		m_mouseController->Update(frameTime);
 
+		if (m_keyboardController->ConsumeShaderReloadRequest())
+		{
+			ReloadShaders();
+		}
+
 		auto commandBuffer = m_renderer->BeginFrame();
 		if (commandBuffer != VK_NULL_HANDLE)
 		{
@@ -195,7 +305,8 @@ void ViewerApp::Run()
             FrameInfo frameInfo { frameIndex, frameTime, commandBuffer,
                     m_masterRenderSystem->GetGlobalDescriptorSet(frameIndex),
                     m_entityHandlerSystem->GetEntityDescriptorSet(frameIndex),
-					m_masterRenderSystem->GetBindlessBindingDescriptorSet(frameIndex) };
+					m_masterRenderSystem->GetBindlessBindingDescriptorSet(frameIndex),
+					m_entityHandlerSystem->IsStorageBuffer() };
 			
 			m_gameManager->Update(frameInfo);
 
@@ -216,27 +327,86 @@ void ViewerApp::Run()
 			m_masterRenderSystem->UpdateScene(frameInfo, activeCameraComponent, activeCameraTransformComponent);
 			m_entityHandlerSystem->UpdateEntities(frameInfo);
 
-			// For instance, add here before the swap chain:
-			// begin off screen shadow pass
-			//	render shadow casting objects
-			// end off screen shadow pass
-			
-			m_masterRenderSystem->BindGlobalDescriptor(frameInfo);
+			// a single walk of the components for all the render systems, they record the draws from the packets
+			m_renderExtractionSystem->Extract(frameIndex, activeCameraComponent);
+			frameInfo.RenderPackets = &m_renderExtractionSystem->GetPackets(frameIndex);
 
-            m_renderer->BeginSwapChainRenderPass(commandBuffer);
+			// transforms, draw preparation, shadows, scene and upscale, with the batched barriers between them
+			renderGraph.Execute(frameInfo);
 
-            m_skyboxRenderSystem->Render(frameInfo);
+			m_renderer->EndFrame();
+			m_masterRenderSystem->EndFrame();
+		}
+	}
 
-			m_pbrOpaqueRenderSystem->Render(frameInfo);
-            m_phongOpaqueRenderSystem->Render(frameInfo);
+	vkDeviceWaitIdle(m_device->GetDevice());
+}
 
-			m_pbrTransparentRenderSystem->Render(frameInfo);
-			m_phongTransparentRenderSystem->Render(frameInfo);
+void ViewerApp::RenderScene(const FrameInfo& _frameInfo)
+{
+	m_masterRenderSystem->BindGlobalDescriptor(_frameInfo);
 
-			m_renderer->EndSwapChainRenderPass(commandBuffer);
-			m_renderer->EndFrame();
-		}
+	m_renderer->BeginSwapChainRenderPass(_frameInfo.CommandBuffer);
+
+	// with parallel recording every system records its own secondary command buffer, which does not inherit the bound global descriptor sets
+	const Renderer::RenderFunction bindGlobalDescriptor = [this](const FrameInfo& _recordFrameInfo) { m_masterRenderSystem->BindGlobalDescriptor(_recordFrameInfo); };
+
+	m_renderer->RecordSubpass(_frameInfo, {
+		[this](const FrameInfo& _recordFrameInfo) { m_skyboxRenderSystem->Render(_recordFrameInfo); },
+		[this](const FrameInfo& _recordFrameInfo) { m_pbrOpaqueRenderSystem->Render(_recordFrameInfo); },
+		[this](const FrameInfo& _recordFrameInfo) { m_phongOpaqueRenderSystem->Render(_recordFrameInfo); }
+		}, bindGlobalDescriptor);
+
+	// with OIT the transparent objects go in their own subpass, then composited over the opaque ones
+	if (m_oitCompositeRenderSystem)
+	{
+		m_renderer->NextSubpass(_frameInfo.CommandBuffer);
+	}
+
+	m_renderer->RecordSubpass(_frameInfo, {
+		[this](const FrameInfo& _recordFrameInfo) { m_pbrTransparentRenderSystem->Render(_recordFrameInfo); },
+		[this](const FrameInfo& _recordFrameInfo) { m_phongTransparentRenderSystem->Render(_recordFrameInfo); }
+		}, bindGlobalDescriptor);
+
+	if (m_oitCompositeRenderSystem)
+	{
+		m_renderer->NextSubpass(_frameInfo.CommandBuffer);
+		m_renderer->RecordSubpass(_frameInfo, {
+			[this](const FrameInfo& _recordFrameInfo) { m_oitCompositeRenderSystem->Render(_recordFrameInfo); }
+			});
+	}
+
+	m_renderer->EndSwapChainRenderPass(_frameInfo.CommandBuffer);
+}
+
+void ViewerApp::ReloadShaders()
+{
+	const uint32 reloadedCount = m_device->GetShaderModuleCache().Reload();
+	LOG(Logger::INFO, "Shaders reloaded: ", reloadedCount);
+
+	if (reloadedCount == 0)
+	{
+		return;
 	}
 
+	// the pipelines created again replace the ones the frames in flight could still be using
 	vkDeviceWaitIdle(m_device->GetDevice());
+
+	m_entityHandlerSystem->CreatePipeline();
+	m_shadowSystem->CreatePipeline();
+	m_phongOpaqueRenderSystem->CreatePipeline(m_renderer->GetSwapChainRenderPass());
+	m_phongTransparentRenderSystem->CreatePipeline(m_renderer->GetSwapChainRenderPass());
+	m_pbrOpaqueRenderSystem->CreatePipeline(m_renderer->GetSwapChainRenderPass());
+	m_pbrTransparentRenderSystem->CreatePipeline(m_renderer->GetSwapChainRenderPass());
+	m_skyboxRenderSystem->CreatePipeline(m_renderer->GetSwapChainRenderPass());
+
+	if (m_oitCompositeRenderSystem)
+	{
+		m_oitCompositeRenderSystem->CreatePipeline(m_renderer->GetSwapChainRenderPass());
+	}
+
+	if (m_upscaleRenderSystem)
+	{
+		m_upscaleRenderSystem->CreatePipeline(m_renderer->GetUpscaleRenderPass());
+	}
 }
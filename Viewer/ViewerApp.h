@@ -31,6 +31,12 @@ public:
 public:
 	void Run();
 
+private:
+	// the swap chain render pass: opaque, transparent and, with OIT, composite subpasses
+	void RenderScene(const FrameInfo& _frameInfo);
+	// read again the changed SPIR-V files and create again the pipelines, so they use the new modules
+	void ReloadShaders();
+
 private:
 	// from engine side
 	std::unique_ptr<ViewerWindow> m_window;
@@ -44,13 +50,18 @@ private:
 	std::unique_ptr<MaterialSystem> m_materialSystem;
     std::unique_ptr<MasterRenderSystem> m_masterRenderSystem;
 	std::unique_ptr<LightSystem> m_lightSystem;
+	std::unique_ptr<ShadowSystem> m_shadowSystem;
 	std::unique_ptr<BlendShapeAnimationSystem> m_blendShapeAnimationSystem;
+	std::unique_ptr<RenderExtractionSystem> m_renderExtractionSystem;
+	std::unique_ptr<StaticBatchSystem> m_staticBatchSystem;
     
 	// IN-ENGINE SYSTEMS
 	std::unique_ptr<PhongOpaqueRenderSystem> m_phongOpaqueRenderSystem;
     std::unique_ptr<PhongTransparentRenderSystem> m_phongTransparentRenderSystem;
 	std::unique_ptr<PBROpaqueRenderSystem> m_pbrOpaqueRenderSystem;
 	std::unique_ptr<PBRTransparentRenderSystem> m_pbrTransparentRenderSystem;
+	std::unique_ptr<OITCompositeRenderSystem> m_oitCompositeRenderSystem;
+	std::unique_ptr<UpscaleRenderSystem> m_upscaleRenderSystem;
 	
 	// CUSTOM IN-APP SYSTEMS
 	//std::unique_ptr<PhongCustomOpaqueRenderSystem> m_phongOpaqueRenderSystem;